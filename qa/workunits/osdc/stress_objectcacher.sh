@@ -1,5 +1,7 @@
 #!/bin/sh -ex
 
+ceph_test_objectcacher_stress --scan-test
+
 for i in $(seq 1 10)
 do
     for DELAY in 0 1000
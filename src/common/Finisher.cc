@@ -2,6 +2,7 @@
 // vim: ts=8 sw=2 smarttab
 
 #include "common/config.h"
+#include "common/Clock.h"
 #include "Finisher.h"
 
 #include "common/debug.h"
@@ -88,3 +89,215 @@ void *Finisher::finisher_thread_entry()
   return 0;
 }
 
+
+
+#undef dout_prefix
+#define dout_prefix *_dout << "sharded_finisher(" << this << ") "
+
+ShardedFinisher::ShardedFinisher(CephContext *cct_, string name,
+				 int num_threads, int num_shards)
+  : cct(cct_), logger(NULL),
+    sleep_lock("ShardedFinisher::sleep_lock"),
+    stopping(false)
+{
+  if (num_threads < 1)
+    num_threads = 1;
+  if (num_shards < 1)
+    num_shards = num_threads == 1 ? 1 : num_threads * 4;
+  for (int i = 0; i < num_threads; ++i)
+    workers.push_back(new Worker(this, i));
+  for (int i = 0; i < num_shards; ++i)
+    shards.push_back(new Shard(i % num_threads));
+
+  PerfCountersBuilder b(cct, string("finisher-") + name,
+			l_sharded_finisher_first, l_sharded_finisher_last);
+  b.add_u64(l_sharded_finisher_queue_len, "queue_len");
+  b.add_time_avg(l_sharded_finisher_complete_lat, "complete_latency");
+  b.add_u64_counter(l_sharded_finisher_steals, "steals");
+  logger = b.create_perf_counters();
+  cct->get_perfcounters_collection()->add(logger);
+}
+
+ShardedFinisher::~ShardedFinisher()
+{
+  for (vector<Worker*>::iterator p = workers.begin(); p != workers.end(); ++p)
+    delete *p;
+  for (vector<Shard*>::iterator p = shards.begin(); p != shards.end(); ++p) {
+    assert((*p)->q.empty());
+    delete *p;
+  }
+  cct->get_perfcounters_collection()->remove(logger);
+  delete logger;
+}
+
+void ShardedFinisher::queue(uint64_t key, Context *c, int r)
+{
+  Shard *s = get_shard(key);
+  pending.inc();
+  logger->inc(l_sharded_finisher_queue_len);
+  s->lock.Lock();
+  s->q.push_back(Item(c, r, ceph_clock_now(cct)));
+  bool sched = !s->scheduled;
+  s->scheduled = true;
+  s->lock.Unlock();
+  if (sched)
+    _schedule(s);
+}
+
+void ShardedFinisher::queue(uint64_t key, list<Context*>& ls)
+{
+  if (ls.empty())
+    return;
+  Shard *s = get_shard(key);
+  pending.add(ls.size());
+  logger->inc(l_sharded_finisher_queue_len, ls.size());
+  utime_t now = ceph_clock_now(cct);
+  s->lock.Lock();
+  for (list<Context*>::iterator p = ls.begin(); p != ls.end(); ++p)
+    s->q.push_back(Item(*p, 0, now));
+  bool sched = !s->scheduled;
+  s->scheduled = true;
+  s->lock.Unlock();
+  ls.clear();
+  if (sched)
+    _schedule(s);
+}
+
+/*
+ * Put a shard on its home worker's ready queue and make sure someone
+ * will look at it.  The ready count is published before we look for
+ * idle workers, and a worker counts itself idle before its last look
+ * at the ready count, so one of us sees the other.
+ */
+void ShardedFinisher::_schedule(Shard *s)
+{
+  Worker *w = workers[s->home];
+  w->lock.Lock();
+  w->ready.push_back(s);
+  w->lock.Unlock();
+  ready.inc();
+  __sync_synchronize();
+  if (idle.read()) {
+    sleep_lock.Lock();
+    sleep_cond.Signal();
+    sleep_lock.Unlock();
+  }
+}
+
+ShardedFinisher::Shard *ShardedFinisher::_next_shard(Worker *w)
+{
+  Shard *s = NULL;
+  w->lock.Lock();
+  if (!w->ready.empty()) {
+    s = w->ready.front();
+    w->ready.pop_front();
+  }
+  w->lock.Unlock();
+
+  // steal from the back of the others' queues
+  for (unsigned i = 1; !s && i < workers.size(); ++i) {
+    Worker *o = workers[(w->id + i) % workers.size()];
+    o->lock.Lock();
+    if (!o->ready.empty()) {
+      s = o->ready.back();
+      o->ready.pop_back();
+      logger->inc(l_sharded_finisher_steals);
+    }
+    o->lock.Unlock();
+  }
+  if (s)
+    ready.dec();
+  return s;
+}
+
+void ShardedFinisher::_run_shard(Worker *w, Shard *s)
+{
+  vector<Item> ls;
+  s->lock.Lock();
+  ls.swap(s->q);
+  s->lock.Unlock();
+
+  ldout(cct, 20) << "worker " << w->id << " running " << ls.size() << dendl;
+  for (vector<Item>::iterator p = ls.begin(); p != ls.end(); ++p) {
+    utime_t lat = ceph_clock_now(cct);
+    lat -= p->stamp;
+    p->c->complete(p->r);
+    logger->tinc(l_sharded_finisher_complete_lat, lat);
+    logger->dec(l_sharded_finisher_queue_len);
+  }
+
+  // more arrived while we ran: back in line, where others can steal it
+  s->lock.Lock();
+  bool more = !s->q.empty();
+  if (!more)
+    s->scheduled = false;
+  s->lock.Unlock();
+  if (more)
+    _schedule(s);
+
+  pending.sub(ls.size());
+  if (pending.read() == 0) {
+    sleep_lock.Lock();
+    empty_cond.SignalAll();
+    if (stopping)
+      sleep_cond.SignalAll();  // the others can exit now
+    sleep_lock.Unlock();
+  }
+}
+
+void ShardedFinisher::worker_entry(Worker *w)
+{
+  ldout(cct, 10) << "worker " << w->id << " start" << dendl;
+  while (true) {
+    Shard *s = _next_shard(w);
+    if (s) {
+      _run_shard(w, s);
+      continue;
+    }
+
+    sleep_lock.Lock();
+    if (stopping && !pending.read()) {
+      sleep_lock.Unlock();
+      break;
+    }
+    idle.inc();
+    __sync_synchronize();
+    if (!ready.read())
+      sleep_cond.Wait(sleep_lock);
+    idle.dec();
+    sleep_lock.Unlock();
+  }
+  ldout(cct, 10) << "worker " << w->id << " stop" << dendl;
+}
+
+void ShardedFinisher::start()
+{
+  ldout(cct, 10) << __func__ << " " << workers.size() << " threads, "
+		 << shards.size() << " shards" << dendl;
+  for (vector<Worker*>::iterator p = workers.begin(); p != workers.end(); ++p)
+    (*p)->create();
+}
+
+void ShardedFinisher::stop()
+{
+  ldout(cct, 10) << __func__ << dendl;
+  sleep_lock.Lock();
+  stopping = true;
+  sleep_cond.SignalAll();
+  sleep_lock.Unlock();
+  for (vector<Worker*>::iterator p = workers.begin(); p != workers.end(); ++p)
+    (*p)->join();
+  stopping = false;
+  ldout(cct, 10) << __func__ << " finish" << dendl;
+}
+
+void ShardedFinisher::wait_for_empty()
+{
+  sleep_lock.Lock();
+  while (pending.read()) {
+    ldout(cct, 10) << "wait_for_empty waiting" << dendl;
+    empty_cond.Wait(sleep_lock);
+  }
+  ldout(cct, 10) << "wait_for_empty empty" << dendl;
+  sleep_lock.Unlock();
+}
@@ -15,6 +15,8 @@
 #ifndef CEPH_FINISHER_H
 #define CEPH_FINISHER_H
 
+#include <deque>
+
 #include "include/atomic.h"
 #include "common/Mutex.h"
 #include "common/Cond.h"
@@ -118,6 +120,90 @@ class Finisher {
   }
 };
 
+enum {
+  l_sharded_finisher_first = 997182,
+  l_sharded_finisher_queue_len,
+  l_sharded_finisher_complete_lat,
+  l_sharded_finisher_steals,
+  l_sharded_finisher_last
+};
+
+/*
+ * ShardedFinisher runs completions on several threads while keeping
+ * the order of those queued under the same key (e.g. a sequencer).
+ *
+ * Keys hash to shards, and a shard is drained by one thread at a time,
+ * in queue order.  A shard with work sits in the ready queue of its
+ * home thread; a thread with nothing of its own steals ready shards
+ * from the other threads.  There are a few shards per thread so that
+ * stealing has something to take.  With one thread there is one shard,
+ * and everything runs in queue order as with Finisher.
+ */
+class ShardedFinisher {
+  struct Item {
+    Context *c;
+    int r;
+    utime_t stamp;
+    Item(Context *c, int r, utime_t s) : c(c), r(r), stamp(s) {}
+  };
+  struct Shard {
+    Mutex lock;
+    vector<Item> q;
+    bool scheduled;  ///< in a ready queue or being drained
+    unsigned home;
+    Shard(unsigned h) : lock("ShardedFinisher::Shard::lock"),
+			scheduled(false), home(h) {}
+  };
+  struct Worker : public Thread {
+    ShardedFinisher *fin;
+    unsigned id;
+    Mutex lock;
+    deque<Shard*> ready;
+    Worker(ShardedFinisher *f, unsigned i)
+      : fin(f), id(i), lock("ShardedFinisher::Worker::lock") {}
+    void *entry() {
+      fin->worker_entry(this);
+      return NULL;
+    }
+  };
+
+  CephContext *cct;
+  vector<Shard*> shards;
+  vector<Worker*> workers;
+  PerfCounters *logger;
+
+  Mutex sleep_lock;
+  Cond sleep_cond, empty_cond;
+  bool stopping;
+  atomic_t idle;      ///< workers asleep on sleep_cond
+  atomic_t ready;     ///< shards sitting in ready queues
+  atomic_t pending;   ///< queued or running items
+
+  Shard *get_shard(uint64_t key) {
+    uint64_t h = key * 0x9e3779b97f4a7c15ull;
+    return shards[(h >> 32) % shards.size()];
+  }
+  void _schedule(Shard *s);
+  Shard *_next_shard(Worker *w);
+  void _run_shard(Worker *w, Shard *s);
+  void worker_entry(Worker *w);
+
+ public:
+  /// num_shards = 0 picks a few per thread
+  ShardedFinisher(CephContext *cct_, string name, int num_threads,
+		  int num_shards = 0);
+  ~ShardedFinisher();
+
+  void queue(uint64_t key, Context *c, int r = 0);
+  void queue(uint64_t key, list<Context*>& ls);
+
+  void start();
+  void stop();
+
+  /// wait until everything queued so far has run
+  void wait_for_empty();
+};
+
 class C_OnFinisher : public Context {
   Context *con;
   Finisher *fin;
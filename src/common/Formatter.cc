@@ -55,6 +55,7 @@ FormatterAttrs::FormatterAttrs(const char *attr, ...)
 }
 
 Formatter::Formatter()
+  : m_sink(NULL), m_sink_threshold(0)
 {
 }
 
@@ -81,6 +82,14 @@ new_formatter(const std::string &type)
       return (Formatter *)NULL;
 }
 
+void Formatter::flush_to_sink()
+{
+  bufferlist bl;
+  flush(bl);
+  if (bl.length())
+    m_sink->write(bl);
+}
+
 void Formatter::dump_format(const char *name, const char *fmt, ...)
 {
   va_list ap;
@@ -227,6 +236,7 @@ void JSONFormatter::close_section()
   struct json_formatter_stack_entry_d& entry = m_stack.back();
   m_ss << (entry.is_array ? ']' : '}');
   m_stack.pop_back();
+  item_done();
 }
 
 void JSONFormatter::finish_pending_string()
@@ -242,12 +252,14 @@ void JSONFormatter::dump_unsigned(const char *name, uint64_t u)
 {
   print_name(name);
   m_ss << u;
+  item_done();
 }
 
 void JSONFormatter::dump_int(const char *name, int64_t s)
 {
   print_name(name);
   m_ss << s;
+  item_done();
 }
 
 void JSONFormatter::dump_float(const char *name, double d)
@@ -256,12 +268,14 @@ void JSONFormatter::dump_float(const char *name, double d)
   char foo[30];
   snprintf(foo, sizeof(foo), "%lf", d);
   m_ss << foo;
+  item_done();
 }
 
 void JSONFormatter::dump_string(const char *name, std::string s)
 {
   print_name(name);
   print_quoted_string(s.c_str());
+  item_done();
 }
 
 std::ostream& JSONFormatter::dump_stream(const char *name)
@@ -282,6 +296,7 @@ void JSONFormatter::dump_format_va(const char *name, const char *ns, bool quoted
   } else {
     m_ss << buf;
   }
+  item_done();
 }
 
 int JSONFormatter::get_len() const
@@ -362,6 +377,7 @@ void XMLFormatter::close_section()
   m_ss << "</" << section << ">";
   if (m_pretty)
     m_ss << "\n";
+  item_done();
 }
 
 void XMLFormatter::dump_unsigned(const char *name, uint64_t u)
@@ -371,6 +387,7 @@ void XMLFormatter::dump_unsigned(const char *name, uint64_t u)
   m_ss << "<" << e << ">" << u << "</" << e << ">";
   if (m_pretty)
     m_ss << "\n";
+  item_done();
 }
 
 void XMLFormatter::dump_int(const char *name, int64_t u)
@@ -380,6 +397,7 @@ void XMLFormatter::dump_int(const char *name, int64_t u)
   m_ss << "<" << e << ">" << u << "</" << e << ">";
   if (m_pretty)
     m_ss << "\n";
+  item_done();
 }
 
 void XMLFormatter::dump_float(const char *name, double d)
@@ -389,6 +407,7 @@ void XMLFormatter::dump_float(const char *name, double d)
   m_ss << "<" << e << ">" << d << "</" << e << ">";
   if (m_pretty)
     m_ss << "\n";
+  item_done();
 }
 
 void XMLFormatter::dump_string(const char *name, std::string s)
@@ -398,6 +417,7 @@ void XMLFormatter::dump_string(const char *name, std::string s)
   m_ss << "<" << e << ">" << escape_xml_str(s.c_str()) << "</" << e << ">";
   if (m_pretty)
     m_ss << "\n";
+  item_done();
 }
 
 void XMLFormatter::dump_string_with_attrs(const char *name, std::string s, const FormatterAttrs& attrs)
@@ -409,6 +429,7 @@ void XMLFormatter::dump_string_with_attrs(const char *name, std::string s, const
   m_ss << "<" << e << attrs_str << ">" << escape_xml_str(s.c_str()) << "</" << e << ">";
   if (m_pretty)
     m_ss << "\n";
+  item_done();
 }
 
 std::ostream& XMLFormatter::dump_stream(const char *name)
@@ -434,6 +455,7 @@ void XMLFormatter::dump_format_va(const char* name, const char *ns, bool quoted,
 
   if (m_pretty)
     m_ss << "\n";
+  item_done();
 }
 
 int XMLFormatter::get_len() const
@@ -24,9 +24,30 @@ struct FormatterAttrs {
 
 class Formatter {
  public:
+  /// takes output as it is produced; see set_sink()
+  class Sink {
+   public:
+    virtual ~Sink() {}
+    /// take a chunk of output; the sink may claim bl
+    virtual void write(bufferlist &bl) = 0;
+  };
+
   Formatter();
   virtual ~Formatter();
 
+  /**
+   * stream output to a sink
+   *
+   * Rather than buffering the whole document until flush(), hand what
+   * we have to the sink whenever at least threshold bytes have built up
+   * at the end of an item.  flush() then only returns the rest, which
+   * the caller must still pass on.  NULL turns streaming off again.
+   */
+  void set_sink(Sink *s, size_t threshold = 65536) {
+    m_sink = s;
+    m_sink_threshold = threshold;
+  }
+
   virtual void flush(std::ostream& os) = 0;
   void flush(bufferlist &bl) {
     std::stringstream os;
@@ -65,6 +86,29 @@ class Formatter {
   virtual void dump_string_with_attrs(const char *name, std::string s, const FormatterAttrs& attrs) {
     dump_string(name, s);
   }
+
+ protected:
+  /// called by implementations when an item is complete
+  void maybe_flush(size_t buffered) {
+    if (m_sink && buffered >= m_sink_threshold)
+      flush_to_sink();
+  }
+
+ private:
+  Sink *m_sink;
+  size_t m_sink_threshold;
+
+  void flush_to_sink();
+};
+
+/// a Formatter::Sink that appends to a bufferlist, chunk by chunk
+class BufferlistSink : public Formatter::Sink {
+  bufferlist *out;
+ public:
+  explicit BufferlistSink(bufferlist *o) : out(o) {}
+  void write(bufferlist &bl) {
+    out->claim_append(bl);
+  }
 };
 
 Formatter *new_formatter(const std::string &type);
@@ -99,6 +143,9 @@ class JSONFormatter : public Formatter {
   bool m_pretty;
   void open_section(const char *name, bool is_array);
   void print_quoted_string(const char *s);
+  void item_done() {
+    maybe_flush((size_t)m_ss.tellp());
+  }
   void print_name(const char *name);
   void print_comma(json_formatter_stack_entry_d& entry);
   void finish_pending_string();
@@ -137,6 +184,9 @@ class XMLFormatter : public Formatter {
   void open_section_in_ns(const char *name, const char *ns, const FormatterAttrs *attrs);
   void finish_pending_string();
   void print_spaces();
+  void item_done() {
+    maybe_flush((size_t)m_ss.tellp());
+  }
   static std::string escape_xml_str(const char *str);
   void get_attrs_str(const FormatterAttrs *attrs, std::string& attrs_str);
 
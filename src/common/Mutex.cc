@@ -24,7 +24,7 @@ Mutex::Mutex(const char *n, bool r, bool ld,
 	     bool bt,
 	     CephContext *cct) :
   name(n), id(-1), recursive(r), lockdep(ld), backtrace(bt),
-  nlock(0), locked_by(0), cct(cct), logger(0)
+  nlock(0), locked_by(0), cct(cct), logger(0), lstat(NULL), lstat_held(0)
 {
   if (cct) {
     PerfCountersBuilder b(cct, string("mutex-") + name,
@@ -79,12 +79,21 @@ Mutex::~Mutex() {
 void Mutex::Lock(bool no_lockdep) {
   utime_t start;
   int r;
+  uint64_t lstart = 0;
+  bool contended = false;
 
   if (lockdep && g_lockdep && !no_lockdep) _will_lock();
 
+  if (g_lockstat && lockstat_sample()) {
+    if (!lstat)
+      lstat = lockstat_lookup(name);
+    lstart = lockstat_now();
+  }
+
   if (TryLock()) {
     goto out;
   }
+  contended = true;
 
   if (logger && cct && cct->_conf->mutex_perf_counter)
     start = ceph_clock_now(cct);
@@ -97,7 +106,17 @@ void Mutex::Lock(bool no_lockdep) {
   _post_lock();
 
 out:
-  ;
+  if (lstart) {
+    uint64_t now = lockstat_now();
+    lockstat_wait(lstat, contended, now - lstart);
+    if (nlock == 1)
+      lstat_held = now;
+  }
+}
+
+void Mutex::_lockstat_unlock() {
+  lockstat_hold(lstat, lockstat_now() - lstat_held);
+  lstat_held = 0;
 }
 
 void Mutex::Unlock() {
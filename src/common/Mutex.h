@@ -17,6 +17,7 @@
 
 #include "include/assert.h"
 #include "lockdep.h"
+#include "lockstat.h"
 #include "common/ceph_context.h"
 
 #include <pthread.h>
@@ -44,6 +45,8 @@ private:
   pthread_t locked_by;
   CephContext *cct;
   PerfCounters *logger;
+  lockstat_t *lstat;
+  uint64_t lstat_held;   // when a sampled acquisition took the lock
 
   // don't allow copying.
   void operator=(const Mutex &M);
@@ -61,6 +64,7 @@ private:
   void _will_unlock() {  // about to unlock
     id = lockdep_will_unlock(name, id);
   }
+  void _lockstat_unlock();
 
 public:
   Mutex(const char *n, bool r = false, bool ld=true, bool bt=false,
@@ -95,6 +99,7 @@ public:
   void _pre_unlock() {
     assert(nlock > 0);
     --nlock;
+    if (lstat_held && nlock == 0) _lockstat_unlock();
     if (!recursive) {
       assert(locked_by == pthread_self());
       locked_by = 0;
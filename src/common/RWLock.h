@@ -20,6 +20,7 @@
 #include <pthread.h>
 #include <include/assert.h>
 #include "lockdep.h"
+#include "lockstat.h"
 #include "include/atomic.h"
 
 class RWLock
@@ -28,12 +29,27 @@ class RWLock
   const char *name;
   mutable int id;
   mutable atomic_t nrlock, nwlock;
+  mutable lockstat_t *lstat;
+  mutable uint64_t lstat_held;   // when a sampled write acquisition took the lock
+
+  // sampled acquisitions try first so we can tell if we had to wait
+  uint64_t _lockstat_begin() const {
+    if (!lstat)
+      lstat = lockstat_lookup(name);
+    return lockstat_now();
+  }
+  uint64_t _lockstat_end(uint64_t start, bool contended) const {
+    uint64_t now = lockstat_now();
+    lockstat_wait(lstat, contended, now - start);
+    return now;
+  }
 
 public:
   RWLock(const RWLock& other);
   const RWLock& operator=(const RWLock& other);
 
-  RWLock(const char *n) : name(n), id(-1), nrlock(0), nwlock(0) {
+  RWLock(const char *n) : name(n), id(-1), nrlock(0), nwlock(0),
+			  lstat(NULL), lstat_held(0) {
     pthread_rwlock_init(&L, NULL);
     if (g_lockdep) id = lockdep_register(name);
   }
@@ -54,6 +70,10 @@ public:
 
   void unlock(bool lockdep=true) const {
     if (nwlock.read() > 0) {
+      if (lstat_held) {
+	lockstat_hold(lstat, lockstat_now() - lstat_held);
+	lstat_held = 0;
+      }
       nwlock.dec();
     } else {
       assert(nrlock.read() > 0);
@@ -67,10 +87,20 @@ public:
   // read
   void get_read() const {
     if (g_lockdep) id = lockdep_will_lock(name, id);
-    int r = pthread_rwlock_rdlock(&L);
-    assert(r == 0);
+    uint64_t lstart = 0;
+    bool contended = false;
+    if (g_lockstat && lockstat_sample()) {
+      lstart = _lockstat_begin();
+      contended = pthread_rwlock_tryrdlock(&L) != 0;
+    }
+    if (!lstart || contended) {
+      int r = pthread_rwlock_rdlock(&L);
+      assert(r == 0);
+    }
     if (g_lockdep) id = lockdep_locked(name, id);
     nrlock.inc();
+    if (lstart)
+      _lockstat_end(lstart, contended);
   }
   bool try_get_read() const {
     if (pthread_rwlock_tryrdlock(&L) == 0) {
@@ -87,11 +117,20 @@ public:
   // write
   void get_write(bool lockdep=true) {
     if (lockdep && g_lockdep) id = lockdep_will_lock(name, id);
-    int r = pthread_rwlock_wrlock(&L);
-    assert(r == 0);
+    uint64_t lstart = 0;
+    bool contended = false;
+    if (g_lockstat && lockstat_sample()) {
+      lstart = _lockstat_begin();
+      contended = pthread_rwlock_trywrlock(&L) != 0;
+    }
+    if (!lstart || contended) {
+      int r = pthread_rwlock_wrlock(&L);
+      assert(r == 0);
+    }
     if (g_lockdep) id = lockdep_locked(name, id);
     nwlock.inc();
-
+    if (lstart)
+      lstat_held = _lockstat_end(lstart, contended);
   }
   bool try_get_write(bool lockdep=true) {
     if (pthread_rwlock_trywrlock(&L) == 0) {
@@ -7,6 +7,7 @@
 #include "Mutex.h"
 #include "Cond.h"
 #include <list>
+#include <map>
 #include "include/atomic.h"
 
 class CephContext;
@@ -45,6 +46,9 @@ public:
 
   int64_t get_max() { return max.read(); }
 
+  /// change the max without waiting; waiters recheck against it
+  void reset_max(int64_t m);
+
   bool wait(int64_t m = 0);
 
   int64_t take(int64_t c = 1);
@@ -98,4 +102,75 @@ private:
   SimpleThrottle *m_throttle;
 };
 
+class OrderedThrottle;
+
+class C_OrderedThrottle : public Context {
+public:
+  C_OrderedThrottle(OrderedThrottle *ordered_throttle, uint64_t tid)
+    : m_ordered_throttle(ordered_throttle), m_tid(tid) {
+  }
+protected:
+  virtual void finish(int r);
+private:
+  OrderedThrottle *m_ordered_throttle;
+  uint64_t m_tid;
+};
+
+/**
+ * @class OrderedThrottle
+ * Like SimpleThrottle, but the results are handed back in the order
+ * the operations were started.
+ *
+ * start_op() returns the Context to complete when the operation
+ * finishes, including when it could not be started.  Operations may
+ * finish in any order; their on_finish contexts are called in start
+ * order from the thread calling start_op() or wait_for_ret(), without
+ * the lock held, and must call end_op() with the final result.  This
+ * lets a caller keep a window of reads in flight and still stream the
+ * data out sequentially.
+ */
+class OrderedThrottle {
+public:
+  OrderedThrottle(uint64_t max, bool ignore_enoent);
+  ~OrderedThrottle();
+
+  C_OrderedThrottle *start_op(Context *on_finish);
+  void end_op(int r);
+
+  bool pending_error() const;
+  int wait_for_ret();
+
+protected:
+  friend class C_OrderedThrottle;
+
+  void finish_op(uint64_t tid, int r);
+
+private:
+  struct Result {
+    bool finished;
+    int ret_val;
+    Context *on_finish;
+
+    Result(Context *_on_finish = NULL)
+      : finished(false), ret_val(0), on_finish(_on_finish) {
+    }
+  };
+
+  typedef std::map<uint64_t, Result> TidResult;
+
+  mutable Mutex m_lock;
+  Cond m_cond;
+  uint64_t m_max;
+  uint64_t m_current;
+  int m_ret_val;
+  bool m_ignore_enoent;
+
+  uint64_t m_next_tid;
+  uint64_t m_complete_tid;
+
+  TidResult m_tid_result;
+
+  void complete_pending_ops();
+};
+
 #endif
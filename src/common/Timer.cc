@@ -24,6 +24,7 @@
 #undef dout_prefix
 #define dout_prefix *_dout << "timer(" << this << ")."
 
+#include <algorithm>
 #include <sstream>
 #include <signal.h>
 #include <sys/time.h>
@@ -42,13 +43,11 @@ public:
 
 
 
-typedef std::multimap < utime_t, Context *> scheduled_map_t;
-typedef std::map < Context*, scheduled_map_t::iterator > event_lookup_map_t;
-
 SafeTimer::SafeTimer(CephContext *cct_, Mutex &l, bool safe_callbacks)
   : cct(cct_), lock(l),
     safe_callbacks(safe_callbacks),
     thread(NULL),
+    schedule(ceph_clock_now(cct_)),
     stopping(false)
 {
 }
@@ -87,17 +86,12 @@ void SafeTimer::timer_thread()
   ldout(cct,10) << "timer_thread starting" << dendl;
   while (!stopping) {
     utime_t now = ceph_clock_now(cct);
-    
-    while (!schedule.empty()) {
-      scheduled_map_t::iterator p = schedule.begin();
-
-      // is the future now?
-      if (p->first > now)
-	break;
+    schedule.advance(now, &expired);
 
-      Context *callback = p->second;
-      events.erase(callback);
-      schedule.erase(p);
+    // these can still be cancelled until we get to them
+    while (!expired.empty()) {
+      Context *callback = expired.front();
+      expired.pop_front();
       ldout(cct,10) << "timer_thread executing " << callback << dendl;
       
       if (!safe_callbacks)
@@ -112,10 +106,11 @@ void SafeTimer::timer_thread()
       break;
 
     ldout(cct,20) << "timer_thread going to sleep" << dendl;
-    if (schedule.empty())
-      cond.Wait(lock);
+    utime_t next;
+    if (schedule.get_next(&next))
+      cond.WaitUntil(lock, next);
     else
-      cond.WaitUntil(lock, schedule.begin()->first);
+      cond.Wait(lock);
     ldout(cct,20) << "timer_thread awake" << dendl;
   }
   ldout(cct,10) << "timer_thread exiting" << dendl;
@@ -136,37 +131,35 @@ void SafeTimer::add_event_at(utime_t when, Context *callback)
   assert(lock.is_locked());
   ldout(cct,10) << "add_event_at " << when << " -> " << callback << dendl;
 
-  scheduled_map_t::value_type s_val(when, callback);
-  scheduled_map_t::iterator i = schedule.insert(s_val);
+  utime_t next;
+  bool have_next = schedule.get_next(&next);
 
-  event_lookup_map_t::value_type e_val(callback, i);
-  pair < event_lookup_map_t::iterator, bool > rval(events.insert(e_val));
+  /* If you hit an assert in here, you tried to insert the same Context*
+   * twice. */
+  schedule.add(when, callback);
 
-  /* If you hit this, you tried to insert the same Context* twice. */
-  assert(rval.second);
-
-  /* If the event we have just inserted comes before everything else, we need to
-   * adjust our timeout. */
-  if (i == schedule.begin())
+  /* If the event we have just inserted comes before the timer thread would
+   * otherwise wake up, we need to adjust its timeout. */
+  if (!have_next || when < next)
     cond.Signal();
-
 }
 
 bool SafeTimer::cancel_event(Context *callback)
 {
   assert(lock.is_locked());
   
-  std::map<Context*, std::multimap<utime_t, Context*>::iterator>::iterator p = events.find(callback);
-  if (p == events.end()) {
-    ldout(cct,10) << "cancel_event " << callback << " not found" << dendl;
-    return false;
+  if (!schedule.remove(callback)) {
+    std::list<Context*>::iterator p =
+      std::find(expired.begin(), expired.end(), callback);
+    if (p == expired.end()) {
+      ldout(cct,10) << "cancel_event " << callback << " not found" << dendl;
+      return false;
+    }
+    expired.erase(p);
   }
 
-  ldout(cct,10) << "cancel_event " << p->second->first << " -> " << callback << dendl;
-  delete p->first;
-
-  schedule.erase(p->second);
-  events.erase(p);
+  ldout(cct,10) << "cancel_event " << callback << dendl;
+  delete callback;
   return true;
 }
 
@@ -175,12 +168,11 @@ void SafeTimer::cancel_all_events()
   ldout(cct,10) << "cancel_all_events" << dendl;
   assert(lock.is_locked());
   
-  while (!events.empty()) {
-    std::map<Context*, std::multimap<utime_t, Context*>::iterator>::iterator p = events.begin();
-    ldout(cct,10) << " cancelled " << p->second->first << " -> " << p->first << dendl;
-    delete p->first;
-    schedule.erase(p->second);
-    events.erase(p);
+  schedule.clear(&expired);
+  while (!expired.empty()) {
+    ldout(cct,10) << " cancelled " << expired.front() << dendl;
+    delete expired.front();
+    expired.pop_front();
   }
 }
 
@@ -188,10 +180,56 @@ void SafeTimer::dump(const char *caller) const
 {
   if (!caller)
     caller = "";
-  ldout(cct,10) << "dump " << caller << dendl;
+  ostringstream ss;
+  schedule.dump(ss);
+  ldout(cct,10) << "dump " << caller << "\n" << ss.str() << dendl;
+}
+
+
+ShardedTimer::ShardedTimer(CephContext *cct, int num_shards, const char *name)
+  : started(false)
+{
+  if (num_shards < 1)
+    num_shards = 1;
+  for (int i = 0; i < num_shards; ++i)
+    shards.push_back(new Shard(cct, name));
+}
+
+ShardedTimer::~ShardedTimer()
+{
+  assert(!started);
+  for (std::vector<Shard*>::iterator p = shards.begin(); p != shards.end(); ++p)
+    delete *p;
+}
+
+void ShardedTimer::init()
+{
+  for (std::vector<Shard*>::iterator p = shards.begin(); p != shards.end(); ++p) {
+    Mutex::Locker l((*p)->lock);
+    (*p)->timer.init();
+  }
+  started = true;
+}
+
+void ShardedTimer::shutdown()
+{
+  for (std::vector<Shard*>::iterator p = shards.begin(); p != shards.end(); ++p) {
+    Mutex::Locker l((*p)->lock);
+    (*p)->timer.shutdown();
+  }
+  started = false;
+}
 
-  for (scheduled_map_t::const_iterator s = schedule.begin();
-       s != schedule.end();
-       ++s)
-    ldout(cct,10) << " " << s->first << "->" << s->second << dendl;
+void ShardedTimer::add_event_after(double seconds, Context *callback)
+{
+  Shard *s = get_shard(callback);
+  Mutex::Locker l(s->lock);
+  s->timer.add_event_after(seconds, callback);
+}
+
+bool ShardedTimer::cancel_event(Context *callback)
+{
+  Shard *s = get_shard(callback);
+  Mutex::Locker l(s->lock);
+  return s->timer.cancel_event(callback);
 }
@@ -18,8 +18,11 @@
 #include "Cond.h"
 #include "Mutex.h"
 #include "RWLock.h"
+#include "TimingWheel.h"
 
+#include <list>
 #include <map>
+#include <vector>
 
 class CephContext;
 class Context;
@@ -42,8 +45,8 @@ class SafeTimer
   void timer_thread();
   void _shutdown();
 
-  std::multimap<utime_t, Context*> schedule;
-  std::map<Context*, std::multimap<utime_t, Context*>::iterator> events;
+  TimingWheel schedule;
+  std::list<Context*> expired;  ///< taken off the wheel, about to run
   bool stopping;
 
   void dump(const char *caller = 0) const;
@@ -94,4 +97,47 @@ public:
 
 };
 
+/*
+ * ShardedTimer spreads events that are added and cancelled at a high
+ * rate, like per-op timeouts, over several SafeTimers with their own
+ * locks and threads.  The shard is picked by hashing the callback
+ * pointer.
+ *
+ * The shard locks are internal, so call without holding any lock a
+ * callback might take.  Callbacks run with no timer lock held, as with
+ * safe_callbacks = false.
+ */
+class ShardedTimer
+{
+  struct Shard {
+    Mutex lock;
+    SafeTimer timer;
+    Shard(CephContext *cct, const char *name)
+      : lock(name), timer(cct, lock, false) {}
+  };
+  std::vector<Shard*> shards;
+  bool started;
+
+  Shard *get_shard(Context *callback) {
+    // allocations are at least 16-byte aligned
+    uint64_t h = ((uintptr_t)callback >> 4) * 0x9e3779b97f4a7c15ull;
+    return shards[(h >> 32) % shards.size()];
+  }
+
+  // not copyable
+  ShardedTimer(const ShardedTimer &rhs);
+  ShardedTimer& operator=(const ShardedTimer &rhs);
+
+public:
+  /// name must be a string literal; it names the shard locks
+  ShardedTimer(CephContext *cct, int num_shards, const char *name);
+  ~ShardedTimer();
+
+  void init();
+  void shutdown();
+
+  void add_event_after(double seconds, Context *callback);
+  bool cancel_event(Context *callback);
+};
+
 #endif
@@ -0,0 +1,250 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "TimingWheel.h"
+
+#include "include/assert.h"
+#include "include/Context.h"
+
+#define SLOT_MASK ((uint64_t)TimingWheel::SLOTS - 1)
+
+// mask of the bits above idx
+static inline uint64_t bits_above(unsigned idx)
+{
+  return idx + 1 >= 64 ? 0 : ~0ull << (idx + 1);
+}
+
+TimingWheel::TimingWheel(utime_t now, uint64_t t)
+  : tick_usec(t)
+{
+  assert(tick_usec > 0);
+  // round down: anything added later is at or after this tick
+  cur = ((uint64_t)now.sec() * 1000000ull + now.usec()) / tick_usec;
+  memset(bitmap, 0, sizeof(bitmap));
+}
+
+TimingWheel::~TimingWheel()
+{
+  for (ceph::unordered_map<Context*, event_t*>::iterator p = events.begin();
+       p != events.end();
+       ++p)
+    delete p->second;
+}
+
+uint64_t TimingWheel::to_tick(utime_t t) const
+{
+  // round up, so we never fire early
+  uint64_t us = (uint64_t)t.sec() * 1000000ull + t.usec();
+  return (us + tick_usec - 1) / tick_usec;
+}
+
+TimingWheel::slot_t *TimingWheel::get_slot(event_t *e)
+{
+  switch (e->level) {
+  case LEVEL_DUE: return &due;
+  case LEVEL_OVERFLOW: return &overflow;
+  default: return &slots[e->level][e->idx];
+  }
+}
+
+void TimingWheel::place(event_t *e)
+{
+  if (e->tick <= cur) {
+    e->level = LEVEL_DUE;
+  } else {
+    // the lowest level whose window holds both cur and tick
+    uint64_t x = e->tick ^ cur;
+    unsigned level = (63 - __builtin_clzll(x)) / LEVEL_BITS;
+    if (level >= LEVELS) {
+      e->level = LEVEL_OVERFLOW;
+    } else {
+      e->level = level;
+      e->idx = (e->tick >> (level * LEVEL_BITS)) & SLOT_MASK;
+      bitmap[level] |= 1ull << e->idx;
+    }
+  }
+
+  slot_t *s = get_slot(e);
+  e->next = NULL;
+  e->prev = s->tail;
+  if (s->tail)
+    s->tail->next = e;
+  else
+    s->head = e;
+  s->tail = e;
+}
+
+void TimingWheel::unplace(event_t *e)
+{
+  slot_t *s = get_slot(e);
+  if (e->prev)
+    e->prev->next = e->next;
+  else
+    s->head = e->next;
+  if (e->next)
+    e->next->prev = e->prev;
+  else
+    s->tail = e->prev;
+  if (!s->head && e->level >= 0)
+    bitmap[e->level] &= ~(1ull << e->idx);
+}
+
+void TimingWheel::replace_all(slot_t *s)
+{
+  event_t *e = s->head;
+  if (!e)
+    return;
+  if (e->level >= 0)
+    bitmap[e->level] &= ~(1ull << e->idx);
+  s->head = s->tail = NULL;
+  while (e) {
+    event_t *next = e->next;
+    place(e);
+    e = next;
+  }
+}
+
+void TimingWheel::expire(slot_t *s, std::list<Context*> *out)
+{
+  event_t *e = s->head;
+  if (!e)
+    return;
+  if (e->level >= 0)
+    bitmap[e->level] &= ~(1ull << e->idx);
+  s->head = s->tail = NULL;
+  while (e) {
+    event_t *next = e->next;
+    events.erase(e->callback);
+    out->push_back(e->callback);
+    delete e;
+    e = next;
+  }
+}
+
+void TimingWheel::add(utime_t when, Context *c)
+{
+  event_t *e = new event_t;
+  e->tick = to_tick(when);
+  e->when = when;
+  e->callback = c;
+  bool inserted = events.insert(std::make_pair(c, e)).second;
+  assert(inserted);
+  place(e);
+}
+
+bool TimingWheel::remove(Context *c)
+{
+  ceph::unordered_map<Context*, event_t*>::iterator p = events.find(c);
+  if (p == events.end())
+    return false;
+  unplace(p->second);
+  delete p->second;
+  events.erase(p);
+  return true;
+}
+
+void TimingWheel::clear(std::list<Context*> *out)
+{
+  for (ceph::unordered_map<Context*, event_t*>::iterator p = events.begin();
+       p != events.end();
+       ++p) {
+    out->push_back(p->first);
+    delete p->second;
+  }
+  events.clear();
+  for (unsigned l = 0; l < LEVELS; ++l) {
+    for (unsigned i = 0; i < SLOTS; ++i)
+      slots[l][i] = slot_t();
+    bitmap[l] = 0;
+  }
+  overflow = slot_t();
+  due = slot_t();
+}
+
+/*
+ * The first tick after cur at which something happens: a level 0 slot
+ * expires, or a higher level slot is cascaded.  Occupied slots are
+ * always ahead of cur at their level, so the first set bit will do.
+ */
+uint64_t TimingWheel::next_tick() const
+{
+  uint64_t best = (uint64_t)-1;
+  uint64_t m = bitmap[0] & bits_above(cur & SLOT_MASK);
+  if (m)
+    best = (cur & ~SLOT_MASK) + __builtin_ctzll(m);
+  for (unsigned l = 1; l < LEVELS; ++l) {
+    if (!bitmap[l])
+      continue;
+    unsigned shift = l * LEVEL_BITS;
+    m = bitmap[l] & bits_above((cur >> shift) & SLOT_MASK);
+    if (!m)
+      continue;
+    uint64_t t = ((cur >> (shift + LEVEL_BITS)) << (shift + LEVEL_BITS)) +
+      ((uint64_t)__builtin_ctzll(m) << shift);
+    if (t < best)
+      best = t;
+  }
+  if (overflow.head) {
+    unsigned shift = LEVELS * LEVEL_BITS;
+    uint64_t t = ((cur >> shift) + 1) << shift;
+    if (t < best)
+      best = t;
+  }
+  return best;
+}
+
+void TimingWheel::advance(utime_t now, std::list<Context*> *out)
+{
+  uint64_t target = ((uint64_t)now.sec() * 1000000ull + now.usec()) / tick_usec;
+  expire(&due, out);
+  while (cur < target) {
+    uint64_t next = next_tick();
+    if (next > target) {
+      // nothing happens in between, so we may skip straight there
+      cur = target;
+      break;
+    }
+    cur = next;
+
+    // cascade any levels whose slot boundary we are on, top down
+    unsigned top = 0;
+    while (top < LEVELS &&
+	   (cur & ((1ull << ((top + 1) * LEVEL_BITS)) - 1)) == 0)
+      ++top;
+    if (top == LEVELS)
+      replace_all(&overflow);
+    for (unsigned l = (top < LEVELS ? top : LEVELS - 1); l >= 1; --l)
+      replace_all(&slots[l][(cur >> (l * LEVEL_BITS)) & SLOT_MASK]);
+
+    expire(&slots[0][cur & SLOT_MASK], out);
+    // cascading may have dropped some onto cur itself
+    expire(&due, out);
+  }
+}
+
+bool TimingWheel::get_next(utime_t *when) const
+{
+  if (events.empty())
+    return false;
+  uint64_t t = due.head ? cur : next_tick();
+  uint64_t us = t * tick_usec;
+  *when = utime_t(us / 1000000, (us % 1000000) * 1000);
+  return true;
+}
+
+void TimingWheel::dump(std::ostream &out) const
+{
+  for (ceph::unordered_map<Context*, event_t*>::const_iterator p = events.begin();
+       p != events.end();
+       ++p)
+    out << " " << p->second->when << "->" << p->first << "\n";
+}
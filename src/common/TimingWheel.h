@@ -0,0 +1,113 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_TIMINGWHEEL_H
+#define CEPH_TIMINGWHEEL_H
+
+#include <list>
+#include <ostream>
+
+#include "include/int_types.h"
+#include "include/unordered_map.h"
+#include "include/utime.h"
+
+class Context;
+
+/*
+ * A hierarchical timing wheel of Context callbacks.
+ *
+ * Time is cut into ticks (1ms by default).  Level 0 has one slot per
+ * tick for the current 64-tick window; level n has one slot per 64^n
+ * ticks.  An event lives at the lowest level whose window it falls in,
+ * and moves down a level each time the wheel reaches its slot.  add()
+ * and remove() are O(1); advance() is O(1) per expired event plus
+ * one step per 64 ticks skipped.  Events more than 64^6 ticks (about
+ * two years at 1ms) out wait in an overflow list.
+ *
+ * Events fire no earlier than their time, and at most a tick late.
+ * Events expiring in the same tick fire in the order they were added.
+ *
+ * Not thread safe; SafeTimer holds its lock around all of it.
+ */
+class TimingWheel {
+public:
+  static const unsigned LEVEL_BITS = 6;
+  static const unsigned SLOTS = 1 << LEVEL_BITS;
+  static const unsigned LEVELS = 6;
+
+private:
+  struct event_t {
+    uint64_t tick;
+    utime_t when;
+    Context *callback;
+    int level;       ///< or LEVEL_OVERFLOW or LEVEL_DUE
+    unsigned idx;
+    event_t *prev, *next;
+  };
+  enum { LEVEL_OVERFLOW = -1, LEVEL_DUE = -2 };
+  struct slot_t {
+    event_t *head, *tail;
+    slot_t() : head(NULL), tail(NULL) {}
+  };
+
+  uint64_t tick_usec;
+  uint64_t cur;                  ///< last tick we have expired
+  slot_t slots[LEVELS][SLOTS];
+  uint64_t bitmap[LEVELS];       ///< non-empty slots per level
+  slot_t overflow;
+  slot_t due;                    ///< added at or before cur
+  ceph::unordered_map<Context*, event_t*> events;
+
+  uint64_t to_tick(utime_t t) const;
+  slot_t *get_slot(event_t *e);
+  void place(event_t *e);
+  void unplace(event_t *e);
+  void replace_all(slot_t *s);
+  void expire(slot_t *s, std::list<Context*> *out);
+  uint64_t next_tick() const;
+
+  // not copyable
+  TimingWheel(const TimingWheel &rhs);
+  TimingWheel& operator=(const TimingWheel &rhs);
+
+public:
+  explicit TimingWheel(utime_t now, uint64_t tick_usec = 1000);
+  ~TimingWheel();
+
+  bool empty() const { return events.empty(); }
+  size_t size() const { return events.size(); }
+  bool contains(Context *c) const { return events.count(c); }
+
+  /// schedule c at when; c must not be scheduled already
+  void add(utime_t when, Context *c);
+  /// unschedule c, if present (it is not deleted)
+  bool remove(Context *c);
+  /// unschedule everything, appending the callbacks to *out
+  void clear(std::list<Context*> *out);
+
+  /// move time forward to now, appending expired callbacks to *out
+  void advance(utime_t now, std::list<Context*> *out);
+
+  /**
+   * when advance() will next have something to do
+   *
+   * This is when the first event expires, or earlier if events must
+   * move between levels first.
+   *
+   * @return false if there are no events
+   */
+  bool get_next(utime_t *when) const;
+
+  void dump(std::ostream &out) const;
+};
+
+#endif
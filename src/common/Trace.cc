@@ -0,0 +1,249 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sstream>
+
+#include "common/Trace.h"
+#include "include/compat.h"
+#include "common/Clock.h"
+#include "common/Formatter.h"
+#include "common/debug.h"
+#include "common/errno.h"
+#include "common/safe_io.h"
+
+#define dout_subsys ceph_subsys_
+#undef dout_prefix
+#define dout_prefix *_dout << "trace "
+
+void trace_ctx_t::encode(bufferlist &bl) const
+{
+  ENCODE_START(1, 1, bl);
+  ::encode(trace_id, bl);
+  ::encode(span_id, bl);
+  ::encode(flags, bl);
+  ENCODE_FINISH(bl);
+}
+
+void trace_ctx_t::decode(bufferlist::iterator &p)
+{
+  DECODE_START(1, p);
+  ::decode(trace_id, p);
+  ::decode(span_id, p);
+  ::decode(flags, p);
+  DECODE_FINISH(p);
+}
+
+void trace_ctx_t::dump(Formatter *f) const
+{
+  f->dump_unsigned("trace_id", trace_id);
+  f->dump_unsigned("span_id", span_id);
+  f->dump_unsigned("flags", flags);
+}
+
+void trace_ctx_t::generate_test_instances(list<trace_ctx_t*>& o)
+{
+  o.push_back(new trace_ctx_t);
+  o.push_back(new trace_ctx_t);
+  o.back()->trace_id = 0x1234567890abcdefull;
+  o.back()->span_id = 42;
+  o.back()->flags = FLAG_SAMPLED;
+}
+
+ostream& operator<<(ostream& out, const trace_ctx_t& t)
+{
+  if (!t.sampled())
+    return out << "trace(none)";
+  char buf[40];
+  snprintf(buf, sizeof(buf), "%016llx:%016llx",
+	   (unsigned long long)t.trace_id, (unsigned long long)t.span_id);
+  return out << "trace(" << buf << ")";
+}
+
+
+const std::string Tracer::name = "Tracer";
+
+Tracer::Tracer(CephContext *c)
+  : cct(c), lock("Tracer::lock"), fd(-1)
+{
+  utime_t now = ceph_clock_now(cct);
+  seed = ((uint64_t)getpid() << 32) ^ now.to_nsec() ^ (uint64_t)(uintptr_t)this;
+}
+
+Tracer::~Tracer()
+{
+  if (fd >= 0)
+    VOID_TEMP_FAILURE_RETRY(::close(fd));
+}
+
+Tracer *Tracer::get(CephContext *cct)
+{
+  Tracer *t;
+  cct->lookup_or_create_singleton_object<Tracer>(t, name);
+  return t;
+}
+
+uint64_t Tracer::new_id()
+{
+  // splitmix64 over a counter: unique per process, spread across processes
+  uint64_t z = seed + counter.inc() * 0x9e3779b97f4a7c15ull;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  z ^= z >> 31;
+  return z ? z : 1;
+}
+
+bool Tracer::should_sample()
+{
+  double rate = cct->_conf->trace_sample_rate;
+  if (rate <= 0)
+    return false;
+  if (rate >= 1)
+    return true;
+  return (double)(new_id() >> 11) / (double)(1ull << 53) < rate;
+}
+
+static void dump_id(Formatter *f, const char *name, uint64_t id)
+{
+  char buf[20];
+  snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)id);
+  f->dump_string(name, buf);
+}
+
+static uint64_t to_usec(utime_t t)
+{
+  return (uint64_t)t.sec() * 1000000ull + t.usec();
+}
+
+void Tracer::submit(const TraceSpan &s)
+{
+  JSONFormatter f;
+  f.open_object_section("span");
+  dump_id(&f, "traceId", s.ctx.trace_id);
+  dump_id(&f, "id", s.ctx.span_id);
+  if (s.parent_id)
+    dump_id(&f, "parentId", s.parent_id);
+  f.dump_string("name", s.name);
+  f.dump_unsigned("timestamp", to_usec(s.start));
+  f.dump_unsigned("duration", to_usec(s.end) - to_usec(s.start));
+  f.open_object_section("localEndpoint");
+  f.dump_string("serviceName", cct->_conf->name.to_str());
+  f.close_section();
+  f.open_array_section("annotations");
+  for (std::list<std::pair<utime_t, std::string> >::const_iterator p =
+	 s.events.begin();
+       p != s.events.end();
+       ++p) {
+    f.open_object_section("annotation");
+    f.dump_unsigned("timestamp", to_usec(p->first));
+    f.dump_string("value", p->second);
+    f.close_section();
+  }
+  f.close_section();
+  f.open_object_section("tags");
+  for (std::map<std::string, std::string>::const_iterator p = s.tags.begin();
+       p != s.tags.end();
+       ++p)
+    f.dump_string(p->first.c_str(), p->second);
+  f.close_section();
+  f.close_section();
+  std::ostringstream ss;
+  f.flush(ss);
+  ss << "\n";
+  std::string line = ss.str();
+
+  Mutex::Locker l(lock);
+  const std::string &want = cct->_conf->trace_file;
+  if (want != path) {
+    if (fd >= 0)
+      VOID_TEMP_FAILURE_RETRY(::close(fd));
+    path = want;
+    fd = -1;
+    if (path.length()) {
+      fd = ::open(path.c_str(), O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC, 0644);
+      if (fd < 0)
+	lderr(cct) << "unable to open trace_file " << path << ": "
+		   << cpp_strerror(errno) << dendl;
+    }
+  }
+  if (fd < 0)
+    return;
+  // one write per span, so concurrent writers don't interleave lines
+  int r = safe_write(fd, line.data(), line.length());
+  if (r < 0)
+    ldout(cct, 1) << "error writing " << path << ": " << cpp_strerror(r) << dendl;
+}
+
+
+void TraceSpan::init_root(CephContext *cct, const std::string &n)
+{
+  assert(!tracer);
+  // the common case: tracing is off, so don't take the singleton lock
+  if (cct->_conf->trace_sample_rate <= 0)
+    return;
+  init_root(Tracer::get(cct), n);
+}
+
+void TraceSpan::init_root(Tracer *t, const std::string &n)
+{
+  assert(!tracer);
+  if (!t->should_sample())
+    return;
+  tracer = t;
+  ctx.trace_id = t->new_id();
+  ctx.span_id = t->new_id();
+  ctx.flags = trace_ctx_t::FLAG_SAMPLED;
+  parent_id = 0;
+  name = n;
+  start = ceph_clock_now(t->cct);
+}
+
+void TraceSpan::init_child(CephContext *cct, const std::string &n,
+			   const trace_ctx_t &parent)
+{
+  assert(!tracer);
+  if (!parent.sampled())
+    return;
+  tracer = Tracer::get(cct);
+  ctx.trace_id = parent.trace_id;
+  ctx.span_id = tracer->new_id();
+  ctx.flags = parent.flags;
+  parent_id = parent.span_id;
+  name = n;
+  start = ceph_clock_now(cct);
+}
+
+void TraceSpan::event(const std::string &what, utime_t when)
+{
+  if (tracer)
+    events.push_back(make_pair(when, what));
+}
+
+void TraceSpan::event(const std::string &what)
+{
+  if (tracer)
+    event(what, ceph_clock_now(tracer->cct));
+}
+
+void TraceSpan::finish()
+{
+  if (!tracer)
+    return;
+  end = ceph_clock_now(tracer->cct);
+  tracer->submit(*this);
+  tracer = NULL;
+  events.clear();
+  tags.clear();
+}
@@ -0,0 +1,139 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COMMON_TRACE_H
+#define CEPH_COMMON_TRACE_H
+
+#include <list>
+#include <map>
+#include <string>
+
+#include "include/atomic.h"
+#include "include/encoding.h"
+#include "include/utime.h"
+#include "common/ceph_context.h"
+#include "common/Mutex.h"
+
+namespace ceph {
+  class Formatter;
+}
+
+/*
+ * Sampled end-to-end request tracing.
+ *
+ * A client decides whether to trace a request (trace_sample_rate) and
+ * sends the trace context along with the messages it causes; each hop
+ * that gets a sampled context opens a child span for its part of the
+ * work.  Spans are appended to trace_file, one Zipkin (v2 JSON) span
+ * per line, for a collector to pick up.  Unsampled requests carry an
+ * empty context and cost nothing beyond its encoding.
+ */
+
+struct trace_ctx_t {
+  enum {
+    FLAG_SAMPLED = 1,
+  };
+  uint64_t trace_id;
+  uint64_t span_id;   ///< the sender's span, parent of the receiver's
+  uint8_t flags;
+
+  trace_ctx_t() : trace_id(0), span_id(0), flags(0) {}
+
+  bool sampled() const { return flags & FLAG_SAMPLED; }
+
+  void encode(bufferlist &bl) const;
+  void decode(bufferlist::iterator &p);
+  void dump(Formatter *f) const;
+  static void generate_test_instances(list<trace_ctx_t*>& o);
+};
+WRITE_CLASS_ENCODER(trace_ctx_t)
+
+ostream& operator<<(ostream& out, const trace_ctx_t& t);
+
+class TraceSpan;
+
+/// per-CephContext span sink
+class Tracer : public CephContext::AssociatedSingletonObject {
+  CephContext *cct;
+  uint64_t seed;
+  atomic64_t counter;
+
+  Mutex lock;
+  std::string path;   ///< trace_file we opened (or failed to)
+  int fd;
+
+  friend class TraceSpan;
+
+ public:
+  static const std::string name;
+
+  explicit Tracer(CephContext *c);
+  ~Tracer();
+
+  static Tracer *get(CephContext *cct);
+
+  uint64_t new_id();
+  /// roll the dice for a new trace
+  bool should_sample();
+  /// write out a finished span
+  void submit(const TraceSpan &span);
+};
+
+/*
+ * One process's part of a traced request.  A span that was not
+ * sampled is invalid and all calls on it are no-ops.  Not thread safe;
+ * the owner serializes access.
+ */
+class TraceSpan {
+  Tracer *tracer;
+  trace_ctx_t ctx;
+  uint64_t parent_id;
+  std::string name;
+  utime_t start, end;
+  std::list<std::pair<utime_t, std::string> > events;
+  std::map<std::string, std::string> tags;
+
+  friend class Tracer;
+
+  // not copyable
+  TraceSpan(const TraceSpan &rhs);
+  TraceSpan& operator=(const TraceSpan &rhs);
+
+ public:
+  TraceSpan() : tracer(NULL), parent_id(0) {}
+  ~TraceSpan() {
+    finish();
+  }
+
+  bool valid() const { return tracer != NULL; }
+  const trace_ctx_t& get_ctx() const { return ctx; }
+
+  /// start a new trace, if the sampler says so
+  void init_root(CephContext *cct, const std::string &n);
+  /// same, with a Tracer the caller looked up once
+  void init_root(Tracer *t, const std::string &n);
+  /// continue the trace in parent, if it is sampled
+  void init_child(CephContext *cct, const std::string &n,
+		  const trace_ctx_t &parent);
+
+  void event(const std::string &what, utime_t when);
+  void event(const std::string &what);
+  void tag(const std::string &key, const std::string &val) {
+    if (tracer)
+      tags[key] = val;
+  }
+
+  /// submit the span; it becomes invalid
+  void finish();
+};
+
+#endif
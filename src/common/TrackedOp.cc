@@ -306,6 +306,11 @@ void OpTracker::RemoveOnDelete::operator()(TrackedOp *op) {
 
 void TrackedOp::mark_event(const string &event)
 {
+  // traced ops record their events even with tracking disabled
+  if (trace.valid()) {
+    Mutex::Locker l(lock);
+    trace.event(event, ceph_clock_now(g_ceph_context));
+  }
   if (!tracker->tracking_enabled)
     return;
 
@@ -21,6 +21,7 @@
 #include "include/xlist.h"
 #include "msg/Message.h"
 #include "include/memory.h"
+#include "common/Trace.h"
 
 class TrackedOp;
 typedef ceph::shared_ptr<TrackedOp> TrackedOpRef;
@@ -152,6 +153,8 @@ protected:
 
   uint32_t warn_interval_multiplier; // limits output of a given op warning
 
+  TraceSpan trace; /// our part of a sampled request trace; under lock
+
   TrackedOp(OpTracker *_tracker, const utime_t& initiated) :
     xitem(this),
     tracker(_tracker),
@@ -187,6 +190,10 @@ public:
   }
 
   void mark_event(const string &event);
+  /// context for messages we send on behalf of this op
+  const trace_ctx_t& get_trace_ctx() const {
+    return trace.get_ctx();
+  }
   virtual const char *state_string() const {
     return events.rbegin()->second.c_str();
   }
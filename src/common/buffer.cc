@@ -23,8 +23,10 @@
 #include "common/Mutex.h"
 #include "include/types.h"
 #include "include/compat.h"
+#include "common/Formatter.h"
 
 #include <errno.h>
+#include <pthread.h>
 #include <fstream>
 #include <sstream>
 #include <sys/uio.h>
@@ -80,6 +82,328 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
     return buffer_c_str_accesses.read();
   }
 
+  /*
+   * Size-classed free lists for buffer memory.
+   *
+   * Every thread keeps a short free list per size class and trades
+   * batches with a shared, spinlocked depot, so the common create/release
+   * pair takes neither a lock nor a trip to malloc.  Requests above the
+   * largest class go straight to the system allocator.  Setting
+   * CEPH_BUFFER_NOPOOL disables the free lists (e.g. for valgrind).
+   *
+   * Everything here is constant-initialized because buffers are created
+   * from other translation units' static constructors.
+   */
+#define BUFFER_POOL_MAX_CLASSES 20
+#define BUFFER_POOL_THREAD_CLASS_BYTES (128 << 10) // per class, per thread
+#define BUFFER_POOL_THREAD_BYTES (1 << 20)         // per thread, all classes
+#define BUFFER_POOL_DEPOT_CLASS_BYTES (4 << 20)    // per class, shared
+
+  struct buffer_pool_stats_t {
+    int64_t items;   // live allocations; per thread this is net of frees
+    int64_t bytes;
+    uint64_t allocs;
+    uint64_t hits;   // allocations served from a free list
+  };
+
+  struct buffer_pool_t {
+    const char *name;
+    int id;
+    bool aligned;    // chunks are page aligned
+    unsigned nclasses;
+    unsigned class_size[BUFFER_POOL_MAX_CLASSES];
+    simple_spinlock_t depot_lock[BUFFER_POOL_MAX_CLASSES];
+    void *depot_head[BUFFER_POOL_MAX_CLASSES];
+    unsigned depot_count[BUFFER_POOL_MAX_CLASSES];
+    buffer_pool_stats_t retired;  // from exited threads
+  };
+
+  enum {
+    BUFFER_POOL_DATA,
+    BUFFER_POOL_ALIGNED,
+    BUFFER_POOL_NUM
+  };
+
+  // raw_combined chunks, i.e. buffer::create() and buffer::copy()
+  static buffer_pool_t buffer_data_pool = {
+    "buffer_data", BUFFER_POOL_DATA, false, 19,
+    { 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072,
+      4096, 6144, 8192, 12288, 16384, 24576, 32768 }
+  };
+  // page aligned data for create_page_aligned() and append buffers
+  static buffer_pool_t buffer_aligned_pool = {
+    "buffer_aligned", BUFFER_POOL_ALIGNED, true, 16,
+    { 1 << 12, 2 << 12, 3 << 12, 4 << 12, 5 << 12, 6 << 12, 7 << 12, 8 << 12,
+      9 << 12, 10 << 12, 11 << 12, 12 << 12, 13 << 12, 14 << 12, 15 << 12,
+      16 << 12 }
+  };
+  static buffer_pool_t *buffer_pools[BUFFER_POOL_NUM] = {
+    &buffer_data_pool, &buffer_aligned_pool
+  };
+
+  // free chunks are chained through their first word
+  struct buffer_pool_cache_t {
+    void *head[BUFFER_POOL_NUM][BUFFER_POOL_MAX_CLASSES];
+    unsigned count[BUFFER_POOL_NUM][BUFFER_POOL_MAX_CLASSES];
+    uint64_t cached_bytes;
+    buffer_pool_stats_t stats[BUFFER_POOL_NUM];
+    buffer_pool_cache_t *prev, *next;
+  };
+
+  // zero-initialized to "enabled"; chunks from either mode may be freed in
+  // the other, as long as we only ever switch from pooled to unpooled
+  bool buffer_pool_disabled = get_env_bool("CEPH_BUFFER_NOPOOL");
+  static __thread buffer_pool_cache_t *buffer_pool_tls = NULL;
+  static pthread_key_t buffer_pool_key;
+  static pthread_once_t buffer_pool_key_once = PTHREAD_ONCE_INIT;
+  static simple_spinlock_t buffer_pool_registry_lock = SIMPLE_SPINLOCK_INITIALIZER;
+  static buffer_pool_cache_t *buffer_pool_registry = NULL;
+
+  static int pool_class(const buffer_pool_t *pool, size_t size)
+  {
+    if (buffer_pool_disabled)
+      return -1;
+    for (unsigned i = 0; i < pool->nclasses; ++i)
+      if (size <= pool->class_size[i])
+	return i;
+    return -1;
+  }
+
+  static unsigned pool_thread_max(const buffer_pool_t *pool, int cls)
+  {
+    unsigned n = BUFFER_POOL_THREAD_CLASS_BYTES / pool->class_size[cls];
+    return MAX(2, MIN(64, n));
+  }
+
+  static void *pool_system_alloc(const buffer_pool_t *pool, size_t size)
+  {
+    if (!pool->aligned)
+      return ::malloc(size);
+#ifdef DARWIN
+    return ::valloc(size);
+#else
+    void *p = NULL;
+    if (::posix_memalign(&p, CEPH_PAGE_SIZE, size))
+      return NULL;
+    return p;
+#endif
+  }
+
+  // hand n chunks to the depot, or back to the system past its limit
+  static void pool_depot_put(buffer_pool_t *pool, int cls, void *head, unsigned n)
+  {
+    unsigned max = BUFFER_POOL_DEPOT_CLASS_BYTES / pool->class_size[cls];
+    void *spill = NULL;
+    simple_spin_lock(&pool->depot_lock[cls]);
+    while (head) {
+      void *next = *(void**)head;
+      if (pool->depot_count[cls] < max) {
+	*(void**)head = pool->depot_head[cls];
+	pool->depot_head[cls] = head;
+	pool->depot_count[cls]++;
+      } else {
+	*(void**)head = spill;
+	spill = head;
+      }
+      head = next;
+    }
+    simple_spin_unlock(&pool->depot_lock[cls]);
+    while (spill) {
+      void *next = *(void**)spill;
+      ::free(spill);
+      spill = next;
+    }
+  }
+
+  // move the older half of a thread's list for cls to the depot
+  static void pool_spill(buffer_pool_cache_t *c, buffer_pool_t *pool, int cls)
+  {
+    unsigned keep = c->count[pool->id][cls] / 2;
+    void **pp = &c->head[pool->id][cls];
+    for (unsigned i = 0; i < keep; ++i)
+      pp = (void**)*pp;
+    void *tail = *pp;
+    *pp = NULL;
+    unsigned moved = c->count[pool->id][cls] - keep;
+    c->count[pool->id][cls] = keep;
+    c->cached_bytes -= (uint64_t)moved * pool->class_size[cls];
+    pool_depot_put(pool, cls, tail, moved);
+  }
+
+  static void pool_cache_destroy(void *arg)
+  {
+    buffer_pool_cache_t *c = (buffer_pool_cache_t*)arg;
+    buffer_pool_tls = NULL;
+    for (int i = 0; i < BUFFER_POOL_NUM; ++i) {
+      buffer_pool_t *pool = buffer_pools[i];
+      for (unsigned cls = 0; cls < pool->nclasses; ++cls) {
+	if (c->head[i][cls])
+	  pool_depot_put(pool, cls, c->head[i][cls], c->count[i][cls]);
+      }
+    }
+    simple_spin_lock(&buffer_pool_registry_lock);
+    for (int i = 0; i < BUFFER_POOL_NUM; ++i) {
+      buffer_pool_stats_t &r = buffer_pools[i]->retired;
+      r.items += c->stats[i].items;
+      r.bytes += c->stats[i].bytes;
+      r.allocs += c->stats[i].allocs;
+      r.hits += c->stats[i].hits;
+    }
+    if (c->prev)
+      c->prev->next = c->next;
+    else
+      buffer_pool_registry = c->next;
+    if (c->next)
+      c->next->prev = c->prev;
+    simple_spin_unlock(&buffer_pool_registry_lock);
+    ::free(c);
+  }
+
+  static void pool_make_key()
+  {
+    pthread_key_create(&buffer_pool_key, pool_cache_destroy);
+  }
+
+  static buffer_pool_cache_t *pool_get_cache()
+  {
+    buffer_pool_cache_t *c = buffer_pool_tls;
+    if (c)
+      return c;
+    pthread_once(&buffer_pool_key_once, pool_make_key);
+    c = (buffer_pool_cache_t*)::calloc(1, sizeof(*c));
+    if (!c)
+      return NULL;
+    simple_spin_lock(&buffer_pool_registry_lock);
+    c->next = buffer_pool_registry;
+    if (c->next)
+      c->next->prev = c;
+    buffer_pool_registry = c;
+    simple_spin_unlock(&buffer_pool_registry_lock);
+    pthread_setspecific(buffer_pool_key, c);
+    buffer_pool_tls = c;
+    return c;
+  }
+
+  static void *pool_alloc(buffer_pool_t *pool, size_t size)
+  {
+    int cls = pool_class(pool, size);
+    buffer_pool_cache_t *c = pool_get_cache();
+    if (cls < 0 || !c) {
+      void *p = pool_system_alloc(pool, size);
+      if (p && c) {
+	buffer_pool_stats_t &s = c->stats[pool->id];
+	s.items++;
+	s.bytes += size;
+	s.allocs++;
+      }
+      return p;
+    }
+
+    unsigned csize = pool->class_size[cls];
+    void **head = &c->head[pool->id][cls];
+    if (!*head) {
+      // refill from the depot
+      unsigned want = pool_thread_max(pool, cls) / 2;
+      simple_spin_lock(&pool->depot_lock[cls]);
+      while (want-- && pool->depot_head[cls]) {
+	void *p = pool->depot_head[cls];
+	pool->depot_head[cls] = *(void**)p;
+	pool->depot_count[cls]--;
+	*(void**)p = *head;
+	*head = p;
+	c->count[pool->id][cls]++;
+	c->cached_bytes += csize;
+      }
+      simple_spin_unlock(&pool->depot_lock[cls]);
+    }
+
+    buffer_pool_stats_t &s = c->stats[pool->id];
+    void *p = *head;
+    if (p) {
+      *head = *(void**)p;
+      c->count[pool->id][cls]--;
+      c->cached_bytes -= csize;
+      s.hits++;
+    } else {
+      p = pool_system_alloc(pool, csize);
+      if (!p)
+	return NULL;
+    }
+    s.items++;
+    s.bytes += csize;
+    s.allocs++;
+    return p;
+  }
+
+  static void pool_free(buffer_pool_t *pool, void *p, size_t size)
+  {
+    if (!p)
+      return;
+    int cls = pool_class(pool, size);
+    buffer_pool_cache_t *c = pool_get_cache();
+    if (c) {
+      buffer_pool_stats_t &s = c->stats[pool->id];
+      s.items--;
+      s.bytes -= cls < 0 ? size : pool->class_size[cls];
+    }
+    if (cls < 0 || !c) {
+      ::free(p);
+      return;
+    }
+
+    *(void**)p = c->head[pool->id][cls];
+    c->head[pool->id][cls] = p;
+    c->count[pool->id][cls]++;
+    c->cached_bytes += pool->class_size[cls];
+    if (c->count[pool->id][cls] > pool_thread_max(pool, cls) ||
+	c->cached_bytes > BUFFER_POOL_THREAD_BYTES)
+      pool_spill(c, pool, cls);
+  }
+
+  void buffer::dump_pools(Formatter *f) {
+    buffer_pool_stats_t total[BUFFER_POOL_NUM];
+    uint64_t cached_items[BUFFER_POOL_NUM], cached_bytes[BUFFER_POOL_NUM];
+    memset(total, 0, sizeof(total));
+    memset(cached_items, 0, sizeof(cached_items));
+    memset(cached_bytes, 0, sizeof(cached_bytes));
+
+    // other threads' counters are read racily; good enough for accounting
+    simple_spin_lock(&buffer_pool_registry_lock);
+    for (int i = 0; i < BUFFER_POOL_NUM; ++i)
+      total[i] = buffer_pools[i]->retired;
+    for (buffer_pool_cache_t *c = buffer_pool_registry; c; c = c->next) {
+      for (int i = 0; i < BUFFER_POOL_NUM; ++i) {
+	total[i].items += c->stats[i].items;
+	total[i].bytes += c->stats[i].bytes;
+	total[i].allocs += c->stats[i].allocs;
+	total[i].hits += c->stats[i].hits;
+	for (unsigned cls = 0; cls < buffer_pools[i]->nclasses; ++cls) {
+	  cached_items[i] += c->count[i][cls];
+	  cached_bytes[i] += (uint64_t)c->count[i][cls] * buffer_pools[i]->class_size[cls];
+	}
+      }
+    }
+    simple_spin_unlock(&buffer_pool_registry_lock);
+
+    for (int i = 0; i < BUFFER_POOL_NUM; ++i) {
+      buffer_pool_t *pool = buffer_pools[i];
+      for (unsigned cls = 0; cls < pool->nclasses; ++cls) {
+	simple_spin_lock(&pool->depot_lock[cls]);
+	cached_items[i] += pool->depot_count[cls];
+	cached_bytes[i] += (uint64_t)pool->depot_count[cls] * pool->class_size[cls];
+	simple_spin_unlock(&pool->depot_lock[cls]);
+      }
+      f->open_object_section(pool->name);
+      f->dump_int("items", total[i].items);
+      f->dump_int("bytes", total[i].bytes);
+      f->dump_unsigned("cached_items", cached_items[i]);
+      f->dump_unsigned("cached_bytes", cached_bytes[i]);
+      f->dump_unsigned("allocs", total[i].allocs);
+      f->dump_unsigned("hits", total[i].hits);
+      f->close_section();
+    }
+  }
+
   atomic_t buffer_max_pipe_size;
   int update_max_pipe_size() {
 #ifdef CEPH_HAVE_SETPIPE_SZ
@@ -231,25 +555,34 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
 
   class buffer::raw_posix_aligned : public buffer::raw {
     unsigned align;
+    bool pooled;
   public:
     raw_posix_aligned(unsigned l, unsigned _align) : raw(l) {
       align = _align;
       assert((align >= sizeof(void *)) && (align & (align - 1)) == 0);
+      pooled = align <= CEPH_PAGE_SIZE;
+      if (pooled) {
+	data = (char *)pool_alloc(&buffer_aligned_pool, len);
+      } else {
 #ifdef DARWIN
-      data = (char *) valloc (len);
+	data = (char *) valloc (len);
 #else
-      data = 0;
-      int r = ::posix_memalign((void**)(void*)&data, align, len);
-      if (r)
-	throw bad_alloc();
+	data = 0;
+	int r = ::posix_memalign((void**)(void*)&data, align, len);
+	if (r)
+	  throw bad_alloc();
 #endif /* DARWIN */
+      }
       if (!data)
 	throw bad_alloc();
       inc_total_alloc(len);
       bdout << "raw_posix_aligned " << this << " alloc " << (void *)data << " l=" << l << ", align=" << align << " total_alloc=" << buffer::get_total_alloc() << bendl;
     }
     ~raw_posix_aligned() {
-      ::free((void*)data);
+      if (pooled)
+	pool_free(&buffer_aligned_pool, data, len);
+      else
+	::free((void*)data);
       dec_total_alloc(len);
       bdout << "raw_posix_aligned " << this << " free " << (void *)data << " " << buffer::get_total_alloc() << bendl;
     }
@@ -492,22 +825,57 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
     }
   };
 
+  /*
+   * A raw_combined lives in the same pooled chunk as its data, right
+   * after it, so a small buffer costs one allocation instead of two.
+   */
+  class buffer::raw_combined : public buffer::raw {
+    unsigned chunk_len;
+    raw_combined(char *d, unsigned l, unsigned cl) : raw(d, l), chunk_len(cl) {
+      inc_total_alloc(len);
+      bdout << "raw_combined " << this << " alloc " << (void *)data << " " << l << " " << buffer::get_total_alloc() << bendl;
+    }
+  public:
+    ~raw_combined() {
+      dec_total_alloc(len);
+      bdout << "raw_combined " << this << " free " << (void *)data << " " << buffer::get_total_alloc() << bendl;
+    }
+    raw* clone_empty() {
+      return create(len);
+    }
+    static raw_combined *create(unsigned len) {
+      // keep the raw object suitably aligned behind the data
+      unsigned dlen = ROUND_UP_TO(len, sizeof(void*));
+      unsigned cl = dlen + sizeof(raw_combined);
+      char *chunk = (char *)pool_alloc(&buffer_data_pool, cl);
+      if (!chunk)
+	throw bad_alloc();
+      return new (chunk + dlen) raw_combined(chunk, len, cl);
+    }
+    // the chunk starts at our data; only data and chunk_len, both
+    // trivially destructible, are read after the destructor ran
+    static void operator delete(void *p) {
+      raw_combined *r = (raw_combined *)p;
+      pool_free(&buffer_data_pool, r->data, r->chunk_len);
+    }
+  };
+
   class buffer::raw_static : public buffer::raw {
   public:
     raw_static(const char *d, unsigned l) : raw((char*)d, l) { }
     ~raw_static() {}
     raw* clone_empty() {
-      return new buffer::raw_char(len);
+      return create(len);
     }
   };
 
   buffer::raw* buffer::copy(const char *c, unsigned len) {
-    raw* r = new raw_char(len);
+    raw* r = create(len);
     memcpy(r->data, c, len);
     return r;
   }
   buffer::raw* buffer::create(unsigned len) {
-    return new raw_char(len);
+    return raw_combined::create(len);
   }
   buffer::raw* buffer::claim_char(unsigned len, char *buf) {
     return new raw_char(len, buf);
@@ -936,7 +1304,7 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
     if (p == ls->end())
       seek(off);
     unsigned left = len;
-    for (std::list<ptr>::const_iterator i = otherl._buffers.begin();
+    for (buffers_t::const_iterator i = otherl._buffers.begin();
 	 i != otherl._buffers.end();
 	 ++i) {
       unsigned l = (*i).length();
@@ -970,8 +1338,8 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
 
     // buffer-wise comparison
     if (true) {
-      std::list<ptr>::const_iterator a = _buffers.begin();
-      std::list<ptr>::const_iterator b = other._buffers.begin();
+      buffers_t::const_iterator a = _buffers.begin();
+      buffers_t::const_iterator b = other._buffers.begin();
       unsigned aoff = 0, boff = 0;
       while (a != _buffers.end()) {
 	unsigned len = a->length() - aoff;
@@ -1010,7 +1378,7 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
 
   bool buffer::list::can_zero_copy() const
   {
-    for (std::list<ptr>::const_iterator it = _buffers.begin();
+    for (buffers_t::const_iterator it = _buffers.begin();
 	 it != _buffers.end();
 	 ++it)
       if (!it->can_zero_copy())
@@ -1020,7 +1388,7 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
 
   bool buffer::list::is_aligned(unsigned align) const
   {
-    for (std::list<ptr>::const_iterator it = _buffers.begin();
+    for (buffers_t::const_iterator it = _buffers.begin();
 	 it != _buffers.end();
 	 ++it) 
       if (!it->is_aligned(align))
@@ -1030,7 +1398,7 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
 
   bool buffer::list::is_n_align_sized(unsigned align) const
   {
-    for (std::list<ptr>::const_iterator it = _buffers.begin();
+    for (buffers_t::const_iterator it = _buffers.begin();
 	 it != _buffers.end();
 	 ++it) 
       if (!it->is_n_align_sized(align))
@@ -1039,7 +1407,7 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
   }
 
   bool buffer::list::is_zero() const {
-    for (std::list<ptr>::const_iterator it = _buffers.begin();
+    for (buffers_t::const_iterator it = _buffers.begin();
 	 it != _buffers.end();
 	 ++it) {
       if (!it->is_zero()) {
@@ -1051,7 +1419,7 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
 
   void buffer::list::zero()
   {
-    for (std::list<ptr>::iterator it = _buffers.begin();
+    for (buffers_t::iterator it = _buffers.begin();
 	 it != _buffers.end();
 	 ++it)
       it->zero();
@@ -1061,7 +1429,7 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
   {
     assert(o+l <= _len);
     unsigned p = 0;
-    for (std::list<ptr>::iterator it = _buffers.begin();
+    for (buffers_t::iterator it = _buffers.begin();
 	 it != _buffers.end();
 	 ++it) {
       if (p + it->length() > o) {
@@ -1106,7 +1474,7 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
   void buffer::list::rebuild(ptr& nb)
   {
     unsigned pos = 0;
-    for (std::list<ptr>::iterator it = _buffers.begin();
+    for (buffers_t::iterator it = _buffers.begin();
 	 it != _buffers.end();
 	 ++it) {
       nb.copy_in(pos, it->length(), it->c_str());
@@ -1125,7 +1493,7 @@ void buffer::list::rebuild_aligned(unsigned align)
 void buffer::list::rebuild_aligned_size_and_memory(unsigned align_size,
 						   unsigned align_memory)
 {
-  std::list<ptr>::iterator p = _buffers.begin();
+  buffers_t::iterator p = _buffers.begin();
   while (p != _buffers.end()) {
     // keep anything that's already align and sized aligned
     if (p->is_aligned(align_memory) && p->is_n_align_sized(align_size)) {
@@ -1274,6 +1642,25 @@ void buffer::list::rebuild_page_aligned()
     }
   }
 
+  char *buffer::list::append_reserve(unsigned len)
+  {
+    if (!append_buffer.have_raw() || append_buffer.unused_tail_length() < len) {
+      unsigned alen = CEPH_PAGE_SIZE * (((len-1) / CEPH_PAGE_SIZE) + 1);
+      append_buffer = create_page_aligned(alen);
+      append_buffer.set_length(0);   // unused, so far.
+    }
+    return append_buffer.c_str() + append_buffer.length();
+  }
+
+  void buffer::list::append_commit(unsigned len)
+  {
+    if (!len)
+      return;
+    assert(len <= append_buffer.unused_tail_length());
+    append_buffer.set_length(append_buffer.length() + len);
+    append(append_buffer, append_buffer.end() - len, len);
+  }
+
   void buffer::list::append(const ptr& bp)
   {
     if (bp.length())
@@ -1301,7 +1688,7 @@ void buffer::list::rebuild_page_aligned()
   void buffer::list::append(const list& bl)
   {
     _len += bl._len;
-    for (std::list<ptr>::const_iterator p = bl._buffers.begin();
+    for (buffers_t::const_iterator p = bl._buffers.begin();
 	 p != bl._buffers.end();
 	 ++p) 
       _buffers.push_back(*p);
@@ -1334,7 +1721,7 @@ void buffer::list::rebuild_page_aligned()
     if (n >= _len)
       throw end_of_buffer();
     
-    for (std::list<ptr>::const_iterator p = _buffers.begin();
+    for (buffers_t::const_iterator p = _buffers.begin();
 	 p != _buffers.end();
 	 ++p) {
       if (n >= p->length()) {
@@ -1354,7 +1741,7 @@ void buffer::list::rebuild_page_aligned()
     if (_buffers.empty())
       return 0;                         // no buffers
 
-    std::list<ptr>::const_iterator iter = _buffers.begin();
+    buffers_t::const_iterator iter = _buffers.begin();
     ++iter;
 
     if (iter != _buffers.end())
@@ -1372,7 +1759,7 @@ void buffer::list::rebuild_page_aligned()
     }
 
     unsigned off = orig_off;
-    std::list<ptr>::iterator curbuf = _buffers.begin();
+    buffers_t::iterator curbuf = _buffers.begin();
     while (off > 0 && off >= curbuf->length()) {
       off -= curbuf->length();
       ++curbuf;
@@ -1395,7 +1782,7 @@ void buffer::list::rebuild_page_aligned()
     clear();
 
     // skip off
-    std::list<ptr>::const_iterator curbuf = other._buffers.begin();
+    buffers_t::const_iterator curbuf = other._buffers.begin();
     while (off > 0 &&
 	   off >= curbuf->length()) {
       // skip this buffer
@@ -1438,7 +1825,7 @@ void buffer::list::rebuild_page_aligned()
     //cout << "splice off " << off << " len " << len << " ... mylen = " << length() << std::endl;
       
     // skip off
-    std::list<ptr>::iterator curbuf = _buffers.begin();
+    buffers_t::iterator curbuf = _buffers.begin();
     while (off > 0) {
       assert(curbuf != _buffers.end());
       if (off >= (*curbuf).length()) {
@@ -1494,7 +1881,7 @@ void buffer::list::rebuild_page_aligned()
   {
     list s;
     s.substr_of(*this, off, len);
-    for (std::list<ptr>::const_iterator it = s._buffers.begin(); 
+    for (buffers_t::const_iterator it = s._buffers.begin(); 
 	 it != s._buffers.end(); 
 	 ++it)
       if (it->length())
@@ -1640,7 +2027,7 @@ int buffer::list::write_fd(int fd) const
   int iovlen = 0;
   ssize_t bytes = 0;
 
-  std::list<ptr>::const_iterator p = _buffers.begin();
+  buffers_t::const_iterator p = _buffers.begin();
   while (p != _buffers.end()) {
     if (p->length() > 0) {
       iov[iovlen].iov_base = (void *)p->c_str();
@@ -1698,7 +2085,7 @@ int buffer::list::write_fd_zero_copy(int fd) const
     return (int) offset;
   if (offset == ESPIPE)
     off_p = NULL;
-  for (std::list<ptr>::const_iterator it = _buffers.begin();
+  for (buffers_t::const_iterator it = _buffers.begin();
        it != _buffers.end(); ++it) {
     int r = it->zero_copy_to_fd(fd, off_p);
     if (r < 0)
@@ -1711,7 +2098,7 @@ int buffer::list::write_fd_zero_copy(int fd) const
 
 __u32 buffer::list::crc32c(__u32 crc) const
 {
-  for (std::list<ptr>::const_iterator it = _buffers.begin();
+  for (buffers_t::const_iterator it = _buffers.begin();
        it != _buffers.end();
        ++it) {
     if (it->length()) {
@@ -1753,7 +2140,7 @@ __u32 buffer::list::crc32c(__u32 crc) const
  */
 void buffer::list::write_stream(std::ostream &out) const
 {
-  for (std::list<ptr>::const_iterator p = _buffers.begin(); p != _buffers.end(); ++p) {
+  for (buffers_t::const_iterator p = _buffers.begin(); p != _buffers.end(); ++p) {
     if (p->length() > 0) {
       out.write(p->c_str(), p->length());
     }
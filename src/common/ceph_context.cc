@@ -25,6 +25,7 @@
 #include "common/HeartbeatMap.h"
 #include "common/errno.h"
 #include "common/lockdep.h"
+#include "common/lockstat.h"
 #include "common/Formatter.h"
 #include "log/Log.h"
 #include "auth/Crypto.h"
@@ -113,6 +114,7 @@ public:
   const char** get_tracked_conf_keys() const {
     static const char *KEYS[] = {
       "log_file",
+      "log_binary",
       "log_max_new",
       "log_max_recent",
       "log_to_syslog",
@@ -139,7 +141,10 @@ public:
     }
 
     // file
-    if (changed.count("log_file")) {
+    if (changed.count("log_binary")) {
+      log->set_binary(conf->log_binary);
+    }
+    if (changed.count("log_file") || changed.count("log_binary")) {
       log->set_log_file(conf->log_file);
       log->reopen_log_file();
     }
@@ -176,6 +181,9 @@ void CephContext::do_command(std::string command, cmdmap_t& cmdmap,
   Formatter *f = new_formatter(format);
   if (!f)
     f = new_formatter("json-pretty");
+  // perf dump and config show get big; don't keep a second copy around
+  BufferlistSink sink(out);
+  f->set_sink(&sink);
   stringstream ss;
   for (cmdmap_t::iterator it = cmdmap.begin(); it != cmdmap.end(); ++it) {
     if (it->first != "prefix") {
@@ -186,6 +194,8 @@ void CephContext::do_command(std::string command, cmdmap_t& cmdmap,
 			 << ss.str() << dendl;
   if (command == "perfcounters_dump" || command == "1" ||
       command == "perf dump") {
+    if (g_lockstat)
+      lockstat_update_perf_counters();
     _perf_counters_collection->dump_formatted(f, false);
   }
   else if (command == "perfcounters_schema" || command == "2" ||
@@ -283,6 +293,15 @@ void CephContext::do_command(std::string command, cmdmap_t& cmdmap,
     else if (command == "log reopen") {
       _log->reopen_log_file();
     }
+    else if (command == "dump_mempools") {
+      buffer::dump_pools(f);
+    }
+    else if (command == "lock_stats") {
+      lockstat_dump(f);
+    }
+    else if (command == "lock_stats reset") {
+      lockstat_reset();
+    }
     else {
       assert(0 == "registered under wrong command?");    
     }
@@ -339,6 +358,9 @@ CephContext::CephContext(uint32_t module_type_)
   _admin_socket->register_command("log flush", "log flush", _admin_hook, "flush log entries to log file");
   _admin_socket->register_command("log dump", "log dump", _admin_hook, "dump recent log entries to log file");
   _admin_socket->register_command("log reopen", "log reopen", _admin_hook, "reopen log file");
+  _admin_socket->register_command("dump_mempools", "dump_mempools", _admin_hook, "dump buffer memory pool usage");
+  _admin_socket->register_command("lock_stats", "lock_stats", _admin_hook, "dump sampled lock wait and hold times");
+  _admin_socket->register_command("lock_stats reset", "lock_stats reset", _admin_hook, "clear sampled lock statistics");
 
   _crypto_none = new CryptoNone;
   _crypto_aes = new CryptoAES;
@@ -355,6 +377,7 @@ CephContext::~CephContext()
   if (_conf->lockdep) {
     lockdep_unregister_ceph_context(this);
   }
+  lockstat_unregister_ceph_context(this);
 
   _admin_socket->unregister_command("perfcounters_dump");
   _admin_socket->unregister_command("perf dump");
@@ -370,6 +393,9 @@ CephContext::~CephContext()
   _admin_socket->unregister_command("log flush");
   _admin_socket->unregister_command("log dump");
   _admin_socket->unregister_command("log reopen");
+  _admin_socket->unregister_command("dump_mempools");
+  _admin_socket->unregister_command("lock_stats");
+  _admin_socket->unregister_command("lock_stats reset");
   delete _admin_hook;
   delete _admin_socket;
 
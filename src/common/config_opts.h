@@ -23,6 +23,7 @@ OPTION(num_client, OPT_INT, 1)
 OPTION(monmap, OPT_STR, "")
 OPTION(mon_host, OPT_STR, "")
 OPTION(lockdep, OPT_BOOL, false)
+OPTION(lockstat, OPT_INT, 0)     // time every Nth lock acquisition per thread (0 = off); see lock_stats
 OPTION(run_dir, OPT_STR, "/var/run/ceph")       // the "/var/run/ceph" dir, created on daemon startup
 OPTION(admin_socket, OPT_STR, "$run_dir/$cluster-$name.asok") // default changed by common_preinit()
 
@@ -42,8 +43,12 @@ OPTION(err_to_stderr, OPT_BOOL, true) // default changed by common_preinit()
 OPTION(log_to_syslog, OPT_BOOL, false)
 OPTION(err_to_syslog, OPT_BOOL, false)
 OPTION(log_flush_on_exit, OPT_BOOL, true) // default changed by common_preinit()
+OPTION(log_binary, OPT_BOOL, false) // write log_file as binary records; read it with ceph-log-decode
 OPTION(log_stop_at_utilization, OPT_FLOAT, .97)  // stop logging at (near) full
 
+OPTION(trace_sample_rate, OPT_DOUBLE, 0) // fraction of client ops to trace end to end
+OPTION(trace_file, OPT_STR, "/var/log/ceph/$cluster-$name.trace") // sampled spans, Zipkin v2 JSON per line
+
 // options will take k/v pairs, or single-item that will be assumed as general
 // default for all, regardless of channel.
 // e.g., "info" would be taken as the same as "default=info"
@@ -141,6 +146,12 @@ OPTION(ms_inject_internal_delays, OPT_DOUBLE, 0)   // seconds
 OPTION(ms_dump_on_send, OPT_BOOL, false)           // hexdump msg to log on send
 OPTION(ms_dump_corrupt_message_level, OPT_INT, 1)  // debug level to hexdump undecodeable messages at
 OPTION(ms_async_op_threads, OPT_INT, 2)
+OPTION(ms_async_affinity_cores, OPT_STR, "")   // comma-separated cores; worker N is pinned to the Nth (mod count)
+OPTION(ms_async_shm, OPT_BOOL, false)   // move connections between co-located daemons onto a shared memory ring
+OPTION(ms_async_shm_dir, OPT_STR, "$run_dir")   // where the shm handshake unix sockets live
+OPTION(ms_async_shm_ring_size, OPT_U64, 4 << 20)   // bytes per direction; rounded up to a power of two
+OPTION(ms_async_shm_max_pending, OPT_INT, 128)   // shm channels handed to us but not yet claimed by a connection
+OPTION(ms_async_shm_handshake_timeout, OPT_DOUBLE, 1.0)   // give up on a shm handshake the peer has not finished (seconds)
 
 OPTION(inject_early_sigterm, OPT_BOOL, false)
 
@@ -301,6 +312,13 @@ OPTION(objecter_tick_interval, OPT_DOUBLE, 5.0)
 OPTION(objecter_timeout, OPT_DOUBLE, 10.0)    // before we ask for a map
 OPTION(objecter_inflight_op_bytes, OPT_U64, 1024*1024*100) // max in-flight data (both directions)
 OPTION(objecter_inflight_ops, OPT_U64, 1024)               // max in-flight ios
+OPTION(objecter_osd_inflight_ops, OPT_U64, 0)     // max in-flight ios per osd; 0 for no per-osd limit
+OPTION(objecter_osd_inflight_ops_min, OPT_U64, 8) // the per-osd limit never shrinks below this
+OPTION(objecter_osd_latency_factor, OPT_DOUBLE, 2.0) // halve an osd's limit when a reply takes this many times its average latency
+OPTION(objecter_hedged_reads, OPT_BOOL, false) // reissue slow snapshot and balanced reads to a replica
+OPTION(objecter_hedged_read_min_delay, OPT_DOUBLE, .01) // never hedge a read sooner than this (seconds)
+OPTION(objecter_hedged_read_latency_factor, OPT_DOUBLE, 3.0) // hedge once a read takes this many times its osd's average latency
+OPTION(objecter_timeout_shards, OPT_INT, 4)   // timer shards for per-op timeouts (rados_osd_op_timeout) and hedged reads
 OPTION(objecter_completion_locks_per_session, OPT_U64, 32) // num of completion locks per each session, for serializing same object responses
 OPTION(journaler_allow_split_entries, OPT_BOOL, true)
 OPTION(journaler_write_head_interval, OPT_INT, 15)
@@ -637,6 +655,8 @@ OPTION(rocksdb_disableWAL, OPT_BOOL, false)  // diable write ahead log
 OPTION(rocksdb_num_levels, OPT_INT, 0) // number of levels for this database
 OPTION(rocksdb_wal_dir, OPT_STR, "")  //  rocksdb write ahead log file
 OPTION(rocksdb_info_log_level, OPT_STR, "info")  // info log level : debug , info , warn, error, fatal
+OPTION(rocksdb_column_families, OPT_STR, "")  // prefixes kept in their own column family, e.g. "_USER_=omap _SYS_=meta"
+OPTION(rocksdb_column_family_options, OPT_STR, "")  // per column family tuning, e.g. "omap:write_buffer_size=67108864,num_levels=4;meta:..."
 
 /**
  * osd_client_op_priority and osd_recovery_op_priority adjust the relative
@@ -700,6 +720,7 @@ OPTION(filestore_debug_inject_read_err, OPT_BOOL, false)
 
 OPTION(filestore_debug_omap_check, OPT_BOOL, 0) // Expensive debugging check on sync
 OPTION(filestore_omap_header_cache_size, OPT_INT, 1024)
+OPTION(filestore_omap_header_cache_shards, OPT_INT, 16) // number of independently locked header cache shards
 
 // Use omap for xattrs for attrs over
 // filestore_max_inline_xattr_size or
@@ -720,12 +741,17 @@ OPTION(filestore_sloppy_crc_block_size, OPT_INT, 65536)
 OPTION(filestore_max_alloc_hint_size, OPT_U64, 1ULL << 20) // bytes
 
 OPTION(filestore_max_sync_interval, OPT_DOUBLE, 5)    // seconds
+OPTION(filestore_fsync_commit, OPT_BOOL, false)  // commit by fdatasync'ing dirty files instead of syncfs; needs a journaling fs (xfs, ext4) where fsync of commit_op_seq also commits earlier metadata
+OPTION(filestore_fsync_commit_threads, OPT_INT, 4)  // threads to fdatasync dirty files with at commit
+OPTION(filestore_fsync_commit_shards, OPT_INT, 16)  // number of shards of the dirty file set
+OPTION(filestore_fsync_commit_max_files, OPT_INT, 1024)  // keep at most this many dirty files open; past that, commit with syncfs
 OPTION(filestore_min_sync_interval, OPT_DOUBLE, .01)  // seconds
 OPTION(filestore_btrfs_snap, OPT_BOOL, true)
 OPTION(filestore_btrfs_clone_range, OPT_BOOL, true)
 OPTION(filestore_zfs_snap, OPT_BOOL, false) // zfsonlinux is still unstable
 OPTION(filestore_fsync_flushes_journal_data, OPT_BOOL, false)
 OPTION(filestore_fiemap, OPT_BOOL, false)     // (try to) use fiemap
+OPTION(filestore_seek_data_hole, OPT_BOOL, true)     // (try to) use lseek SEEK_DATA/SEEK_HOLE to find holes
 
 // (try to) use extsize for alloc hint
 // WARNING: extsize seems to trigger data corruption in xfs -- that is why it is
@@ -740,6 +766,7 @@ OPTION(filestore_queue_max_bytes, OPT_INT, 100 << 20)
 OPTION(filestore_queue_committing_max_ops, OPT_INT, 500)        // this is ON TOP of filestore_queue_max_*
 OPTION(filestore_queue_committing_max_bytes, OPT_INT, 100 << 20) //  "
 OPTION(filestore_op_threads, OPT_INT, 2)
+OPTION(filestore_finisher_threads, OPT_INT, 1) // >1 keeps completion order per sequencer only
 OPTION(filestore_op_thread_timeout, OPT_INT, 60)
 OPTION(filestore_op_thread_suicide_timeout, OPT_INT, 180)
 OPTION(filestore_commit_timeout, OPT_FLOAT, 600)
@@ -787,6 +814,9 @@ OPTION(journal_discard, OPT_BOOL, false) //using ssd disk as journal, whether su
 
 OPTION(rados_mon_op_timeout, OPT_DOUBLE, 0) // how many seconds to wait for a response from the monitor before returning an error from a rados operation. 0 means on limit.
 OPTION(rados_osd_op_timeout, OPT_DOUBLE, 0) // how many seconds to wait for a response from osds before returning an error from a rados operation. 0 means no limit.
+OPTION(rados_striper_buffer_appends, OPT_BOOL, false) // libradosstriper keeps small appends in memory until they reach a stripe unit boundary; written on flush or when the striper is destroyed
+OPTION(rados_striper_readahead_trigger_requests, OPT_INT, 10) // number of sequential reads of a striped object necessary to trigger readahead
+OPTION(rados_striper_readahead_max_bytes, OPT_LONGLONG, 0) // set to 0 to disable libradosstriper readahead
 
 OPTION(rbd_cache, OPT_BOOL, true) // whether to enable caching (writeback unless rbd_cache_max_dirty is 0)
 OPTION(rbd_cache_writethrough_until_flush, OPT_BOOL, true) // whether to make writeback caching writethrough until flush is called, to be sure the user of librbd will send flushs so that writeback is safe
@@ -796,6 +826,7 @@ OPTION(rbd_cache_target_dirty, OPT_LONGLONG, 16<<20) // target dirty limit in by
 OPTION(rbd_cache_max_dirty_age, OPT_FLOAT, 1.0)      // seconds in cache before writeback starts
 OPTION(rbd_cache_max_dirty_object, OPT_INT, 0)       // dirty limit for objects - set to 0 for auto calculate from rbd_cache_size
 OPTION(rbd_cache_block_writes_upfront, OPT_BOOL, false) // whether to block writes to the cache before the aio_write call completes (true), or block before the aio completion is called (false)
+OPTION(rbd_cache_shards, OPT_INT, 1) // split the cache by object into this many independently locked caches, each with its share of the size and dirty limits
 OPTION(rbd_concurrent_management_ops, OPT_INT, 10) // how many operations can be in flight for a management operation like deleting or resizing an image
 OPTION(rbd_balance_snap_reads, OPT_BOOL, false)
 OPTION(rbd_localize_snap_reads, OPT_BOOL, false)
@@ -804,6 +835,15 @@ OPTION(rbd_localize_parent_reads, OPT_BOOL, true)
 OPTION(rbd_readahead_trigger_requests, OPT_INT, 10) // number of sequential requests necessary to trigger readahead
 OPTION(rbd_readahead_max_bytes, OPT_LONGLONG, 512 * 1024) // set to 0 to disable readahead
 OPTION(rbd_readahead_disable_after_bytes, OPT_LONGLONG, 50 * 1024 * 1024) // how many bytes are read in total before readahead is disabled
+OPTION(rbd_op_threads, OPT_INT, 0) // threads submitting aio for all images; 0 submits in the caller's thread
+OPTION(rbd_op_thread_timeout, OPT_INT, 60)
+OPTION(rbd_clone_copy_on_read, OPT_BOOL, false) // copy an object up from the parent when a read has to go there
+OPTION(rbd_clone_copy_on_read_max_ops, OPT_INT, 4) // copy-on-read copyups in flight per image
+OPTION(rbd_persistent_cache, OPT_BOOL, false) // log writes to local storage and acknowledge them once they are there
+OPTION(rbd_persistent_cache_path, OPT_STR, "/var/lib/ceph/rbd-cache") // directory holding the per-image log files
+OPTION(rbd_persistent_cache_size, OPT_LONGLONG, 1<<30) // size of each image's log in bytes
+OPTION(rbd_persistent_cache_max_destage_ops, OPT_INT, 32) // writes in flight from the log to the image
+OPTION(rbd_persistent_cache_debug_no_destage, OPT_BOOL, false) // never write the log back, so close leaves it for the next open (for testing)
 
 /*
  * The following options change the behavior for librbd's image creation methods that
@@ -22,6 +22,8 @@
 
 #define dout(v) ldout((g_ceph_context), v)
 
+#define doutf(v, fmt, ...) ldoutf((g_ceph_context), v, fmt, ##__VA_ARGS__)
+
 #define pdout(v, p) lpdout((g_ceph_context), v, p)
 
 #define generic_dout(v) lgeneric_dout((g_ceph_context), v)
@@ -61,6 +61,32 @@ inline std::ostream& operator<<(std::ostream& out, _bad_endl_use_dendl_t) {
 #define lgeneric_dout(cct, v) dout_impl(cct, ceph_subsys_, v) *_dout
 #define lgeneric_derr(cct) dout_impl(cct, ceph_subsys_, -1) *_dout
 
+/*
+ * printf-style variants that hand the log a format id and the raw
+ * arguments; the text is only produced when the entry is written out.
+ * The format must be a string literal.  Unlike dout, no dout_prefix.
+ */
+static inline void _dout_check_format(const char *fmt, ...)
+  __attribute__((format(printf, 1, 2)));
+static inline void _dout_check_format(const char *fmt, ...) {}
+
+#define dout_binary_impl(cct, sub, v, fmt, ...)				\
+  do {									\
+    if (cct->_conf->subsys.should_gather(sub, v)) {			\
+      if (0) {								\
+	char __array[((v >= -1) && (v <= 200)) ? 0 : -1] __attribute__((unused)); \
+	_dout_check_format(fmt, ##__VA_ARGS__);				\
+      }									\
+      static int _dout_fmt = ceph::log::register_format(fmt);		\
+      cct->_log->submit_binary(v, sub, _dout_fmt, ##__VA_ARGS__);	\
+    }									\
+  } while (0)
+
+#define lsubdoutf(cct, sub, v, fmt, ...)				\
+  dout_binary_impl(cct, ceph_subsys_##sub, v, fmt, ##__VA_ARGS__)
+#define ldoutf(cct, v, fmt, ...)					\
+  dout_binary_impl(cct, dout_subsys, v, fmt, ##__VA_ARGS__)
+
 // NOTE: depend on magic value in _ASSERT_H so that we detect when
 // /usr/include/assert.h clobbers our fancier version.
 #define dendl std::flush;				\
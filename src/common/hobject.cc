@@ -104,15 +104,45 @@ string hobject_t::to_str() const
 
 void hobject_t::encode(bufferlist& bl) const
 {
-  ENCODE_START(4, 3, bl);
-  ::encode(key, bl);
-  ::encode(oid, bl);
-  ::encode(snap, bl);
-  ::encode(hash, bl);
-  ::encode(max, bl);
-  ::encode(nspace, bl);
-  ::encode(pool, bl);
-  ENCODE_FINISH(bl);
+  ::encode_via_bounded(*this, bl);
+}
+
+void hobject_t::bound_encode(size_t &s) const
+{
+  s += BOUNDED_ENCODE_START_SIZE;
+  ::bound_encode(key, s);
+  ::bound_encode(oid, s);
+  ::bound_encode(snap, s);
+  ::bound_encode(hash, s);
+  ::bound_encode(max, s);
+  ::bound_encode(nspace, s);
+  ::bound_encode(pool, s);
+}
+
+void hobject_t::encode_bounded(char *&p) const
+{
+  BOUNDED_ENCODE_START(4, 3, p);
+  ::encode_bounded(key, p);
+  ::encode_bounded(oid, p);
+  ::encode_bounded(snap, p);
+  ::encode_bounded(hash, p);
+  ::encode_bounded(max, p);
+  ::encode_bounded(nspace, p);
+  ::encode_bounded(pool, p);
+  BOUNDED_ENCODE_FINISH(p);
+}
+
+void hobject_t::decode_bounded(const char *&p, const char *end)
+{
+  BOUNDED_DECODE_START(4, 4, p, end);
+  ::decode_bounded(key, p, end);
+  ::decode_bounded(oid, p, end);
+  ::decode_bounded(snap, p, end);
+  ::decode_bounded(hash, p, end);
+  ::decode_bounded(max, p, end);
+  ::decode_bounded(nspace, p, end);
+  ::decode_bounded(pool, p, end);
+  BOUNDED_DECODE_FINISH(p);
 }
 
 void hobject_t::decode(bufferlist::iterator& bl)
@@ -196,17 +226,51 @@ ostream& operator<<(ostream& out, const hobject_t& o)
 // version 5.
 void ghobject_t::encode(bufferlist& bl) const
 {
-  ENCODE_START(5, 3, bl);
-  ::encode(hobj.key, bl);
-  ::encode(hobj.oid, bl);
-  ::encode(hobj.snap, bl);
-  ::encode(hobj.hash, bl);
-  ::encode(hobj.max, bl);
-  ::encode(hobj.nspace, bl);
-  ::encode(hobj.pool, bl);
-  ::encode(generation, bl);
-  ::encode(shard_id, bl);
-  ENCODE_FINISH(bl);
+  ::encode_via_bounded(*this, bl);
+}
+
+void ghobject_t::bound_encode(size_t &s) const
+{
+  s += BOUNDED_ENCODE_START_SIZE;
+  ::bound_encode(hobj.key, s);
+  ::bound_encode(hobj.oid, s);
+  ::bound_encode(hobj.snap, s);
+  ::bound_encode(hobj.hash, s);
+  ::bound_encode(hobj.max, s);
+  ::bound_encode(hobj.nspace, s);
+  ::bound_encode(hobj.pool, s);
+  ::bound_encode(generation, s);
+  ::bound_encode(shard_id, s);
+}
+
+void ghobject_t::encode_bounded(char *&p) const
+{
+  BOUNDED_ENCODE_START(5, 3, p);
+  ::encode_bounded(hobj.key, p);
+  ::encode_bounded(hobj.oid, p);
+  ::encode_bounded(hobj.snap, p);
+  ::encode_bounded(hobj.hash, p);
+  ::encode_bounded(hobj.max, p);
+  ::encode_bounded(hobj.nspace, p);
+  ::encode_bounded(hobj.pool, p);
+  ::encode_bounded(generation, p);
+  ::encode_bounded(shard_id, p);
+  BOUNDED_ENCODE_FINISH(p);
+}
+
+void ghobject_t::decode_bounded(const char *&p, const char *end)
+{
+  BOUNDED_DECODE_START(5, 5, p, end);
+  ::decode_bounded(hobj.key, p, end);
+  ::decode_bounded(hobj.oid, p, end);
+  ::decode_bounded(hobj.snap, p, end);
+  ::decode_bounded(hobj.hash, p, end);
+  ::decode_bounded(hobj.max, p, end);
+  ::decode_bounded(hobj.nspace, p, end);
+  ::decode_bounded(hobj.pool, p, end);
+  ::decode_bounded(generation, p, end);
+  ::decode_bounded(shard_id, p, end);
+  BOUNDED_DECODE_FINISH(p);
 }
 
 void ghobject_t::decode(bufferlist::iterator& bl)
@@ -195,6 +195,9 @@ public:
   void encode(bufferlist& bl) const;
   void decode(bufferlist::iterator& bl);
   void decode(json_spirit::Value& v);
+  void bound_encode(size_t &s) const;
+  void encode_bounded(char *&p) const;
+  void decode_bounded(const char *&p, const char *end);
   void dump(Formatter *f) const;
   static void generate_test_instances(list<hobject_t*>& o);
   friend bool operator<(const hobject_t&, const hobject_t&);
@@ -205,7 +208,7 @@ public:
   friend bool operator!=(const hobject_t&, const hobject_t&);
   friend struct ghobject_t;
 };
-WRITE_CLASS_ENCODER(hobject_t)
+WRITE_CLASS_ENCODER_BOUNDED(hobject_t)
 
 CEPH_HASH_NAMESPACE_START
   template<> struct hash<hobject_t> {
@@ -298,6 +301,9 @@ public:
   void encode(bufferlist& bl) const;
   void decode(bufferlist::iterator& bl);
   void decode(json_spirit::Value& v);
+  void bound_encode(size_t &s) const;
+  void encode_bounded(char *&p) const;
+  void decode_bounded(const char *&p, const char *end);
   void dump(Formatter *f) const;
   static void generate_test_instances(list<ghobject_t*>& o);
   friend bool operator<(const ghobject_t&, const ghobject_t&);
@@ -307,7 +313,7 @@ public:
   friend bool operator==(const ghobject_t&, const ghobject_t&);
   friend bool operator!=(const ghobject_t&, const ghobject_t&);
 };
-WRITE_CLASS_ENCODER(ghobject_t)
+WRITE_CLASS_ENCODER_BOUNDED(ghobject_t)
 
 CEPH_HASH_NAMESPACE_START
   template<> struct hash<ghobject_t> {
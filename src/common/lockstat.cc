@@ -0,0 +1,247 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <pthread.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/Formatter.h"
+#include "common/ceph_context.h"
+#include "common/perf_counters.h"
+#include "include/atomic.h"
+#include "include/utime.h"
+#include "lockstat.h"
+
+#define MAX_LOCKS     1024   // names beyond this are lumped together
+#define HIST_BUCKETS  32     // 2^31ns is about 2s; longer lands in the last
+
+enum {
+  l_lockstat_first = 999182,
+  l_lockstat_sampled,
+  l_lockstat_contended,
+  l_lockstat_wait,
+  l_lockstat_hold,
+  l_lockstat_last
+};
+
+struct lockstat_t {
+  std::string name;
+  atomic64_t sampled, contended, held;
+  atomic64_t wait_ns, hold_ns;
+  atomic64_t wait_hist[HIST_BUCKETS];  // bucket i covers [2^i, 2^(i+1)) ns
+  atomic64_t hold_hist[HIST_BUCKETS];
+  PerfCounters *logger;
+
+  explicit lockstat_t(const std::string &n) : name(n), logger(NULL) {}
+};
+
+/******* Globals **********/
+int g_lockstat = 0;
+__thread int lockstat_countdown = 0;
+
+// lockstat_mutex guards the name map and may be taken from inside any
+// lock; lockstat_perf_mutex guards the perf counters and is never taken
+// with lockstat_mutex held
+static pthread_mutex_t lockstat_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t lockstat_perf_mutex = PTHREAD_MUTEX_INITIALIZER;
+static CephContext *g_lockstat_ceph_ctx = NULL;
+static std::map<std::string, lockstat_t*> lock_stats;
+static lockstat_t *other_stats = NULL;
+
+/******* Functions **********/
+static unsigned hist_bucket(uint64_t ns)
+{
+  unsigned b = 0;
+  while (ns > 1 && b < HIST_BUCKETS - 1) {
+    ns >>= 1;
+    ++b;
+  }
+  return b;
+}
+
+static void add_perf_counters(CephContext *cct, lockstat_t *s)
+{
+  PerfCountersBuilder b(cct, "lockstat-" + s->name,
+			l_lockstat_first, l_lockstat_last);
+  b.add_u64_counter(l_lockstat_sampled, "sampled");
+  b.add_u64_counter(l_lockstat_contended, "contended");
+  b.add_time_avg(l_lockstat_wait, "wait");
+  b.add_time_avg(l_lockstat_hold, "hold");
+  PerfCounters *logger = b.create_perf_counters();
+  cct->get_perfcounters_collection()->add(logger);
+  // the hot path reads logger without any lock
+  __sync_synchronize();
+  s->logger = logger;
+}
+
+static void get_all(std::vector<lockstat_t*> *ls)
+{
+  pthread_mutex_lock(&lockstat_mutex);
+  for (std::map<std::string, lockstat_t*>::iterator p = lock_stats.begin();
+       p != lock_stats.end(); ++p)
+    ls->push_back(p->second);
+  if (other_stats)
+    ls->push_back(other_stats);
+  pthread_mutex_unlock(&lockstat_mutex);
+}
+
+void lockstat_register_ceph_context(CephContext *cct)
+{
+  pthread_mutex_lock(&lockstat_perf_mutex);
+  if (g_lockstat_ceph_ctx == NULL)
+    g_lockstat_ceph_ctx = cct;
+  pthread_mutex_unlock(&lockstat_perf_mutex);
+  lockstat_update_perf_counters();
+}
+
+void lockstat_unregister_ceph_context(CephContext *cct)
+{
+  pthread_mutex_lock(&lockstat_perf_mutex);
+  if (cct == g_lockstat_ceph_ctx) {
+    // this cct is going away; stop sampling and drop our counters.
+    // the stats themselves stay, since locks hold pointers to them.
+    g_lockstat = 0;
+    std::vector<lockstat_t*> ls;
+    get_all(&ls);
+    for (std::vector<lockstat_t*>::iterator p = ls.begin(); p != ls.end(); ++p) {
+      PerfCounters *logger = (*p)->logger;
+      if (!logger)
+	continue;
+      (*p)->logger = NULL;
+      cct->get_perfcounters_collection()->remove(logger);
+      delete logger;
+    }
+    g_lockstat_ceph_ctx = NULL;
+  }
+  pthread_mutex_unlock(&lockstat_perf_mutex);
+}
+
+lockstat_t *lockstat_lookup(const char *name)
+{
+  std::string n(name ? name : "(unnamed)");
+  lockstat_t *s;
+  pthread_mutex_lock(&lockstat_mutex);
+  std::map<std::string, lockstat_t*>::iterator p = lock_stats.find(n);
+  if (p != lock_stats.end()) {
+    s = p->second;
+  } else if (lock_stats.size() < MAX_LOCKS) {
+    s = new lockstat_t(n);
+    lock_stats[n] = s;
+  } else {
+    if (!other_stats)
+      other_stats = new lockstat_t("(other)");
+    s = other_stats;
+  }
+  pthread_mutex_unlock(&lockstat_mutex);
+  return s;
+}
+
+void lockstat_wait(lockstat_t *s, bool contended, uint64_t ns)
+{
+  s->sampled.inc();
+  if (contended)
+    s->contended.inc();
+  s->wait_ns.add(ns);
+  s->wait_hist[hist_bucket(ns)].inc();
+  PerfCounters *logger = s->logger;
+  if (logger) {
+    logger->inc(l_lockstat_sampled);
+    if (contended)
+      logger->inc(l_lockstat_contended);
+    logger->tinc(l_lockstat_wait, utime_t(ns / 1000000000ull, ns % 1000000000ull));
+  }
+}
+
+void lockstat_hold(lockstat_t *s, uint64_t ns)
+{
+  s->held.inc();
+  s->hold_ns.add(ns);
+  s->hold_hist[hist_bucket(ns)].inc();
+  PerfCounters *logger = s->logger;
+  if (logger)
+    logger->tinc(l_lockstat_hold, utime_t(ns / 1000000000ull, ns % 1000000000ull));
+}
+
+void lockstat_update_perf_counters()
+{
+  pthread_mutex_lock(&lockstat_perf_mutex);
+  if (g_lockstat_ceph_ctx) {
+    std::vector<lockstat_t*> ls;
+    get_all(&ls);
+    for (std::vector<lockstat_t*>::iterator p = ls.begin(); p != ls.end(); ++p)
+      if (!(*p)->logger)
+	add_perf_counters(g_lockstat_ceph_ctx, *p);
+  }
+  pthread_mutex_unlock(&lockstat_perf_mutex);
+}
+
+static void dump_hist(ceph::Formatter *f, const char *name, atomic64_t *hist)
+{
+  // trim empty buckets off the top
+  int last = HIST_BUCKETS - 1;
+  while (last >= 0 && hist[last].read() == 0)
+    --last;
+  f->open_array_section(name);
+  for (int i = 0; i <= last; ++i)
+    f->dump_unsigned("count", hist[i].read());
+  f->close_section();
+}
+
+static void dump_one(ceph::Formatter *f, lockstat_t *s)
+{
+  f->open_object_section("lock");
+  f->dump_string("name", s->name);
+  f->dump_unsigned("sampled", s->sampled.read());
+  f->dump_unsigned("contended", s->contended.read());
+  f->dump_unsigned("wait_ns", s->wait_ns.read());
+  f->dump_unsigned("held", s->held.read());
+  f->dump_unsigned("hold_ns", s->hold_ns.read());
+  dump_hist(f, "wait_hist", s->wait_hist);
+  dump_hist(f, "hold_hist", s->hold_hist);
+  f->close_section();
+}
+
+void lockstat_dump(ceph::Formatter *f)
+{
+  std::vector<lockstat_t*> ls;
+  get_all(&ls);
+  f->dump_int("sample_rate", g_lockstat);
+  f->dump_string("hist_buckets", "log2 nanoseconds");
+  f->open_array_section("locks");
+  for (std::vector<lockstat_t*>::iterator p = ls.begin(); p != ls.end(); ++p)
+    dump_one(f, *p);
+  f->close_section();
+}
+
+static void reset_one(lockstat_t *s)
+{
+  s->sampled.set(0);
+  s->contended.set(0);
+  s->held.set(0);
+  s->wait_ns.set(0);
+  s->hold_ns.set(0);
+  for (int i = 0; i < HIST_BUCKETS; ++i) {
+    s->wait_hist[i].set(0);
+    s->hold_hist[i].set(0);
+  }
+  if (s->logger)
+    s->logger->reset();
+}
+
+void lockstat_reset()
+{
+  std::vector<lockstat_t*> ls;
+  get_all(&ls);
+  for (std::vector<lockstat_t*>::iterator p = ls.begin(); p != ls.end(); ++p)
+    reset_one(*p);
+}
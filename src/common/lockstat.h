@@ -0,0 +1,69 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_LOCKSTAT_H
+#define CEPH_LOCKSTAT_H
+
+#include <time.h>
+#include "include/int_types.h"
+
+class CephContext;
+namespace ceph {
+  class Formatter;
+}
+
+/*
+ * Sampled lock contention statistics.
+ *
+ * With g_lockstat set to N, every Nth Mutex or RWLock acquisition on
+ * each thread is timed: how long we waited for the lock, whether we had
+ * to wait at all, and (for mutexes and write locks) how long it was then
+ * held.  Samples are aggregated per lock name into log2 histograms.
+ * With g_lockstat at 0 a lock pays a single load of the global.
+ */
+
+extern int g_lockstat;
+
+struct lockstat_t;
+
+/// counts down to the next sampled acquisition on this thread
+extern __thread int lockstat_countdown;
+
+static inline bool lockstat_sample() {
+  if (--lockstat_countdown > 0)
+    return false;
+  lockstat_countdown = g_lockstat;
+  return true;
+}
+
+static inline uint64_t lockstat_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+extern void lockstat_register_ceph_context(CephContext *cct);
+extern void lockstat_unregister_ceph_context(CephContext *cct);
+
+/// find or create the stats for a lock name
+extern lockstat_t *lockstat_lookup(const char *name);
+/// record a sampled acquisition that waited ns
+extern void lockstat_wait(lockstat_t *s, bool contended, uint64_t ns);
+/// record the hold time of a sampled acquisition
+extern void lockstat_hold(lockstat_t *s, uint64_t ns);
+
+/// add perf counters for any lock seen since the last call
+extern void lockstat_update_perf_counters();
+extern void lockstat_dump(ceph::Formatter *f);
+extern void lockstat_reset();
+
+#endif
@@ -19,6 +19,7 @@
 #include "common/config.h"
 #include "common/debug.h"
 #include "common/errno.h"
+#include "common/lockstat.h"
 #include "common/safe_io.h"
 #include "common/signal.h"
 #include "common/version.h"
@@ -117,6 +118,7 @@ void global_init(std::vector < const char * > *alt_def_args,
   global_pre_init(alt_def_args, args, module_type, code_env, flags);
 
   g_lockdep = g_ceph_context->_conf->lockdep;
+  g_lockstat = g_ceph_context->_conf->lockstat;
 
   // signal stuff
   int siglist[] = { SIGPIPE, 0 };
@@ -141,6 +143,9 @@ void global_init(std::vector < const char * > *alt_def_args,
   if (g_lockdep) {
     lockdep_register_ceph_context(g_ceph_context);
   }
+  if (g_lockstat) {
+    lockstat_register_ceph_context(g_ceph_context);
+  }
   register_assert_context(g_ceph_context);
 
   // call all observers now.  this has the side-effect of configuring
@@ -64,6 +64,8 @@
 
 namespace ceph {
 
+class Formatter;
+
 class CEPH_BUFFER_API buffer {
   /*
    * exceptions
@@ -119,6 +121,9 @@ public:
   /// enable/disable tracking of buffer::ptr::c_str() calls
   static void track_c_str(bool b);
 
+  /// dump usage of the buffer memory pools
+  static void dump_pools(Formatter *f);
+
 private:
  
   /* hack for memory utilization debugging. */
@@ -135,6 +140,7 @@ private:
   class raw_posix_aligned;
   class raw_hack_aligned;
   class raw_char;
+  class raw_combined;
   class raw_pipe;
 
   friend std::ostream& operator<<(std::ostream& out, const raw &r);
@@ -244,8 +250,12 @@ public:
    */
 
   class CEPH_BUFFER_API list {
+  public:
+    typedef std::list<ptr> buffers_t;
+
+  private:
     // my private bits
-    std::list<ptr> _buffers;
+    buffers_t _buffers;
     unsigned _len;
     unsigned _memcopy_count; //the total of memcopy using rebuild().
     ptr append_buffer;  // where i put small appends.
@@ -253,9 +263,9 @@ public:
   public:
     class CEPH_BUFFER_API iterator {
       list *bl;
-      std::list<ptr> *ls; // meh.. just here to avoid an extra pointer dereference..
+      buffers_t *ls; // meh.. just here to avoid an extra pointer dereference..
       unsigned off;  // in bl
-      std::list<ptr>::iterator p;
+      buffers_t::iterator p;
       unsigned p_off; // in *p
     public:
       // constructor.  position.
@@ -265,7 +275,7 @@ public:
 	bl(l), ls(&bl->_buffers), off(0), p(ls->begin()), p_off(0) {
 	advance(o);
       }
-      iterator(list *l, unsigned o, std::list<ptr>::iterator ip, unsigned po) : 
+      iterator(list *l, unsigned o, buffers_t::iterator ip, unsigned po) : 
 	bl(l), ls(&bl->_buffers), off(o), p(ip), p_off(po) { }
 
       iterator(const iterator& other) : bl(other.bl),
@@ -340,13 +350,13 @@ public:
     }
 
     unsigned get_memcopy_count() const {return _memcopy_count; }
-    const std::list<ptr>& buffers() const { return _buffers; }
+    const buffers_t& buffers() const { return _buffers; }
     void swap(list& other);
     unsigned length() const {
 #if 0
       // DEBUG: verify _len
       unsigned len = 0;
-      for (std::list<ptr>::const_iterator it = _buffers.begin();
+      for (buffers_t::const_iterator it = _buffers.begin();
 	   it != _buffers.end();
 	   it++) {
 	len += (*it).length();
@@ -434,6 +444,13 @@ public:
     void append(const list& bl);
     void append(std::istream& in);
     void append_zero(unsigned len);
+
+    /// return a pointer to len contiguous writable bytes at the tail;
+    /// nothing is appended until append_commit(), and nothing else may be
+    /// appended in between
+    char *append_reserve(unsigned len);
+    /// append the first len bytes of the region from append_reserve()
+    void append_commit(unsigned len);
     
     /*
      * get a char
@@ -278,6 +278,179 @@ inline void decode(T &o, bufferlist& bl)
 }
 
 
+// -----------------------------
+// bounded encoding
+
+/*
+ * A type that can put an upper bound on its encoded size can encode
+ * straight into one contiguous region reserved at the tail of the
+ * bufferlist, instead of appending field by field, and can decode off a
+ * plain pointer when its encoding sits in a single segment.  The bytes
+ * on the wire are exactly those of the regular encode()/decode().
+ *
+ * Such a type implements
+ *
+ *   void bound_encode(size_t &s) const;     // add an upper bound to s
+ *   void encode_bounded(char *&p) const;
+ *   void decode_bounded(const char *&p, const char *end);
+ *
+ * and uses WRITE_CLASS_BOUNDED, or WRITE_CLASS_ENCODER_BOUNDED to also
+ * route ::encode()/::decode() through them.  Its bufferlist decode() is
+ * kept: it handles fragmented input and encodings older than what
+ * decode_bounded() understands.
+ */
+
+inline void decode_bounded_check(const char *p, const char *end, size_t len)
+{
+  if ((size_t)(end - p) < len)
+    throw buffer::end_of_buffer();
+}
+
+#define WRITE_RAW_BOUNDED(type)						\
+  inline void bound_encode(const type &v, size_t &s) { s += sizeof(v); } \
+  inline void encode_bounded(const type &v, char *&p) {		\
+    memcpy(p, &v, sizeof(v));						\
+    p += sizeof(v);							\
+  }									\
+  inline void decode_bounded(type &v, const char *&p, const char *end) { \
+    decode_bounded_check(p, end, sizeof(v));				\
+    memcpy(&v, p, sizeof(v));						\
+    p += sizeof(v);							\
+  }
+
+WRITE_RAW_BOUNDED(__u8)
+WRITE_RAW_BOUNDED(__s8)
+WRITE_RAW_BOUNDED(char)
+
+inline void bound_encode(bool v, size_t &s) { s += 1; }
+inline void encode_bounded(bool v, char *&p) { *p++ = v; }
+inline void decode_bounded(bool &v, const char *&p, const char *end)
+{
+  decode_bounded_check(p, end, 1);
+  v = *p++;
+}
+
+#define WRITE_INTTYPE_BOUNDED(type, etype)				\
+  inline void bound_encode(type v, size_t &s) { s += sizeof(ceph_##etype); } \
+  inline void encode_bounded(type v, char *&p) {			\
+    ceph_##etype e;							\
+    e = v;								\
+    memcpy(p, &e, sizeof(e));						\
+    p += sizeof(e);							\
+  }									\
+  inline void decode_bounded(type &v, const char *&p, const char *end) { \
+    ceph_##etype e;							\
+    decode_bounded_check(p, end, sizeof(e));				\
+    memcpy(&e, p, sizeof(e));						\
+    p += sizeof(e);							\
+    v = e;								\
+  }
+
+WRITE_INTTYPE_BOUNDED(uint64_t, le64)
+WRITE_INTTYPE_BOUNDED(int64_t, le64)
+WRITE_INTTYPE_BOUNDED(uint32_t, le32)
+WRITE_INTTYPE_BOUNDED(int32_t, le32)
+WRITE_INTTYPE_BOUNDED(uint16_t, le16)
+WRITE_INTTYPE_BOUNDED(int16_t, le16)
+
+// string
+inline void bound_encode(const std::string& s, size_t &l)
+{
+  l += sizeof(ceph_le32) + s.length();
+}
+inline void encode_bounded(const std::string& s, char *&p)
+{
+  __u32 len = s.length();
+  encode_bounded(len, p);
+  memcpy(p, s.data(), len);
+  p += len;
+}
+inline void decode_bounded(std::string& s, const char *&p, const char *end)
+{
+  __u32 len;
+  decode_bounded(len, p, end);
+  decode_bounded_check(p, end, len);
+  s.assign(p, len);
+  p += len;
+}
+
+// bufferlist (encapsulated); decoding copies out of the source buffer
+inline void bound_encode(const bufferlist& s, size_t &l)
+{
+  l += sizeof(ceph_le32) + s.length();
+}
+inline void encode_bounded(const bufferlist& s, char *&p)
+{
+  __u32 len = s.length();
+  encode_bounded(len, p);
+  if (len)
+    s.copy(0, len, p);
+  p += len;
+}
+inline void decode_bounded(bufferlist& s, const char *&p, const char *end)
+{
+  __u32 len;
+  decode_bounded(len, p, end);
+  decode_bounded_check(p, end, len);
+  s.clear();
+  if (len)
+    s.append(p, len);
+  p += len;
+}
+
+/// encode o into a single reserved region at the tail of bl
+template<class T>
+inline void encode_via_bounded(const T &o, bufferlist &bl)
+{
+  size_t len = 0;
+  o.bound_encode(len);
+  char *start = bl.append_reserve(len);
+  char *p = start;
+  o.encode_bounded(p);
+  assert((size_t)(p - start) <= len);
+  bl.append_commit(p - start);
+}
+
+/// decode o off the current segment if everything left sits in it
+template<class T>
+inline void decode_via_bounded(T &o, bufferlist::iterator &p)
+{
+  if (!p.end()) {
+    buffer::ptr cur = p.get_current_ptr();
+    if (cur.length() == p.get_remaining()) {
+      const char *start = cur.c_str(), *q = start;
+      o.decode_bounded(q, start + cur.length());
+      p.advance(q - start);
+      return;
+    }
+  }
+  o.decode(p);
+}
+
+/// hand an encoding decode_bounded() doesn't know to the bufferlist decoder
+template<class T>
+inline void decode_bounded_legacy(T &o, const char *&p, const char *end)
+{
+  bufferlist bl;
+  bl.push_back(buffer::create_static(end - p, (char*)p));
+  bufferlist::iterator i = bl.begin();
+  o.decode(i);
+  p += i.get_off();
+}
+
+#define WRITE_CLASS_BOUNDED(cl)						\
+  inline void bound_encode(const cl &c, size_t &s) { c.bound_encode(s); } \
+  inline void encode_bounded(const cl &c, char *&p) { c.encode_bounded(p); } \
+  inline void decode_bounded(cl &c, const char *&p, const char *end) { \
+    c.decode_bounded(p, end); }
+
+#define WRITE_CLASS_ENCODER_BOUNDED(cl)					\
+  WRITE_CLASS_BOUNDED(cl)						\
+  inline void encode(const cl &c, bufferlist &bl, uint64_t features=0) { \
+    ENCODE_DUMP_PRE(); c.encode(bl); ENCODE_DUMP_POST(cl); }		\
+  inline void decode(cl &c, bufferlist::iterator &p) { ::decode_via_bounded(c, p); }
+
+
 // -----------------------------
 // STL container types
 
@@ -879,4 +1052,72 @@ inline void decode(std::deque<T>& ls, bufferlist::iterator& p)
       bl.advance(struct_end - bl.get_off());				\
   }
 
+/*
+ * guards for bounded encoding
+ */
+
+/// upper bound on what BOUNDED_ENCODE_START/FINISH add
+#define BOUNDED_ENCODE_START_SIZE (2 + sizeof(ceph_le32))
+
+/**
+ * start a bounded encoding block; same layout as ENCODE_START
+ *
+ * @param v current (code) version of the encoding
+ * @param compat oldest code version that can decode it
+ * @param p char *& cursor to encode to
+ */
+#define BOUNDED_ENCODE_START(v, compat, p)				\
+  *(p)++ = (__u8)(v);							\
+  *(p)++ = (__u8)(compat);						\
+  char *struct_len_p = (p);						\
+  (p) += sizeof(ceph_le32);						\
+  do {
+
+#define BOUNDED_ENCODE_FINISH_NEW_COMPAT(p, new_struct_compat)		\
+  } while (false);							\
+  {									\
+    ceph_le32 struct_len;						\
+    struct_len = (p) - struct_len_p - sizeof(struct_len);		\
+    memcpy(struct_len_p, &struct_len, sizeof(struct_len));		\
+    if (new_struct_compat)						\
+      struct_len_p[-1] = (__u8)(new_struct_compat);			\
+  }
+
+#define BOUNDED_ENCODE_FINISH(p) BOUNDED_ENCODE_FINISH_NEW_COMPAT(p, 0)
+
+/**
+ * start a bounded decoding block
+ *
+ * Encodings older than oldestv go to the type's bufferlist decode(), so
+ * only versions that carry the compat and length fields are handled
+ * here.  Must be used in a decode_bounded() member.
+ *
+ * @param v current version of the encoding that the code supports/encodes
+ * @param oldestv oldest version decoded here
+ * @param p const char *& cursor
+ * @param end end of the contiguous source
+ */
+#define BOUNDED_DECODE_START(v, oldestv, p, end)			\
+  if ((p) < (end) && (__u8)*(p) < (oldestv)) {				\
+    ::decode_bounded_legacy(*this, p, end);				\
+    return;								\
+  }									\
+  __u8 struct_v, struct_compat;						\
+  ::decode_bounded(struct_v, p, end);					\
+  ::decode_bounded(struct_compat, p, end);				\
+  if (v < struct_compat)						\
+    throw buffer::malformed_input(DECODE_ERR_VERSION(__PRETTY_FUNCTION__, v)); \
+  __u32 struct_len;							\
+  ::decode_bounded(struct_len, p, end);					\
+  if (struct_len > (size_t)((end) - (p)))				\
+    throw buffer::malformed_input(DECODE_ERR_PAST(__PRETTY_FUNCTION__)); \
+  const char *struct_end = (p) + struct_len;				\
+  do {
+
+#define BOUNDED_DECODE_FINISH(p)					\
+  } while (false);							\
+  if ((p) > struct_end)							\
+    throw buffer::malformed_input(DECODE_ERR_PAST(__PRETTY_FUNCTION__)); \
+  (p) = struct_end;
+
 #endif
@@ -50,8 +50,18 @@ struct object_t {
   void decode(bufferlist::iterator &bl) {
     ::decode(name, bl);
   }
+  void bound_encode(size_t &s) const {
+    ::bound_encode(name, s);
+  }
+  void encode_bounded(char *&p) const {
+    ::encode_bounded(name, p);
+  }
+  void decode_bounded(const char *&p, const char *end) {
+    ::decode_bounded(name, p, end);
+  }
 };
 WRITE_CLASS_ENCODER(object_t)
+WRITE_CLASS_BOUNDED(object_t)
 
 inline bool operator==(const object_t& l, const object_t& r) {
   return l.name == r.name;
@@ -119,6 +129,11 @@ struct snapid_t {
 
 inline void encode(snapid_t i, bufferlist &bl) { encode(i.val, bl); }
 inline void decode(snapid_t &i, bufferlist::iterator &p) { decode(i.val, p); }
+inline void bound_encode(snapid_t i, size_t &s) { bound_encode(i.val, s); }
+inline void encode_bounded(snapid_t i, char *&p) { encode_bounded(i.val, p); }
+inline void decode_bounded(snapid_t &i, const char *&p, const char *end) {
+  decode_bounded(i.val, p, end);
+}
 
 inline ostream& operator<<(ostream& out, snapid_t s) {
   if (s == CEPH_NOSNAP)
@@ -890,6 +890,36 @@ namespace librados
 		    ObjectReadOperation *op, int flags,
 		    bufferlist *pbl);
 
+    /**
+     * Schedule several async write operations at once
+     *
+     * Each operation is submitted and completes as if it had been
+     * passed to aio_operate() on its own, in the order given, but the
+     * ones that go to the same OSD are sent to it in a single message.
+     * This saves most of the per-op messaging cost when touching many
+     * small objects.
+     *
+     * @param oids the object each operation is on
+     * @param cs what to do when each operation is complete and safe
+     * @param ops which operations to perform on each object
+     * @param flags the OPERATION_* flags for all of the operations
+     * @returns 0 on success, negative error code on failure
+     */
+    int aio_operate_batch(const std::vector<std::string>& oids,
+			  const std::vector<AioCompletion*>& cs,
+			  const std::vector<ObjectWriteOperation*>& ops,
+			  int flags = 0);
+    /**
+     * Schedule several async read operations at once
+     *
+     * Like the write version; read results are returned through the
+     * buffers and return values given to each ObjectReadOperation.
+     */
+    int aio_operate_batch(const std::vector<std::string>& oids,
+			  const std::vector<AioCompletion*>& cs,
+			  const std::vector<ObjectReadOperation*>& ops,
+			  int flags = 0);
+
     // watch/notify
     int watch(const std::string& o, uint64_t ver, uint64_t *handle,
 	      librados::WatchCtx *ctx);
@@ -462,8 +462,18 @@ struct shard_id_t {
   void decode(bufferlist::iterator &bl) {
     ::decode(id, bl);
   }
+  void bound_encode(size_t &s) const {
+    ::bound_encode(id, s);
+  }
+  void encode_bounded(char *&p) const {
+    ::encode_bounded(id, p);
+  }
+  void decode_bounded(const char *&p, const char *end) {
+    ::decode_bounded(id, p, end);
+  }
 };
 WRITE_CLASS_ENCODER(shard_id_t)
+WRITE_CLASS_BOUNDED(shard_id_t)
 WRITE_EQ_OPERATORS_1(shard_id_t, id)
 WRITE_CMP_OPERATORS_1(shard_id_t, id)
 ostream &operator<<(ostream &lhs, const shard_id_t &rhs);
@@ -100,6 +100,17 @@ public:
     ::decode(tv.tv_sec, p);
     ::decode(tv.tv_nsec, p);
   }
+  void bound_encode(size_t &s) const {
+    s += sizeof(ceph_le32) * 2;
+  }
+  void encode_bounded(char *&p) const {
+    ::encode_bounded(tv.tv_sec, p);
+    ::encode_bounded(tv.tv_nsec, p);
+  }
+  void decode_bounded(const char *&p, const char *end) {
+    ::decode_bounded(tv.tv_sec, p, end);
+    ::decode_bounded(tv.tv_nsec, p, end);
+  }
 
   void encode_timeval(struct ceph_timespec *t) const {
     t->tv_sec = tv.tv_sec;
@@ -296,6 +307,7 @@ public:
   }
 };
 WRITE_CLASS_ENCODER(utime_t)
+WRITE_CLASS_BOUNDED(utime_t)
 
 
 // arithmetic operators
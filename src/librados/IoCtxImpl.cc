@@ -19,6 +19,7 @@
 #include "librados/AioCompletionImpl.h"
 #include "librados/PoolAsyncCompletionImpl.h"
 #include "librados/RadosClient.h"
+#include "messages/MWatchNotify.h"
 #include "include/assert.h"
 
 #define dout_subsys ceph_subsys_rados
@@ -590,6 +591,71 @@ int librados::IoCtxImpl::aio_operate(const object_t& oid,
   return 0;
 }
 
+int librados::IoCtxImpl::aio_operate_batch(
+  const vector<object_t>& oids,
+  const vector< ::ObjectOperation*>& ops,
+  const vector<AioCompletionImpl*>& cs,
+  const SnapContext& snap_context, int flags)
+{
+  if (oids.size() != ops.size() || oids.size() != cs.size())
+    return -EINVAL;
+  utime_t ut = ceph_clock_now(client->cct);
+  /* can't write to a snapshot */
+  if (snap_seq != CEPH_NOSNAP)
+    return -EROFS;
+
+  vector<Objecter::Op*> objecter_ops;
+  objecter_ops.reserve(ops.size());
+  for (size_t i = 0; i < ops.size(); ++i) {
+    AioCompletionImpl *c = cs[i];
+    Context *onack = new C_aio_Ack(c);
+    Context *oncommit = new C_aio_Safe(c);
+
+    c->io = this;
+    queue_aio_write(c);
+
+    objecter_ops.push_back(objecter->prepare_mutate_op(oids[i], oloc, *ops[i],
+						       snap_context, ut, flags,
+						       onack, oncommit,
+						       &c->objver));
+  }
+
+  vector<ceph_tid_t> tids;
+  objecter->op_submit_batch(objecter_ops, &tids);
+  for (size_t i = 0; i < cs.size(); ++i)
+    cs[i]->tid = tids[i];
+  return 0;
+}
+
+int librados::IoCtxImpl::aio_operate_read_batch(
+  const vector<object_t>& oids,
+  const vector< ::ObjectOperation*>& ops,
+  const vector<AioCompletionImpl*>& cs, int flags)
+{
+  if (oids.size() != ops.size() || oids.size() != cs.size())
+    return -EINVAL;
+
+  vector<Objecter::Op*> objecter_ops;
+  objecter_ops.reserve(ops.size());
+  for (size_t i = 0; i < ops.size(); ++i) {
+    AioCompletionImpl *c = cs[i];
+    Context *onack = new C_aio_Ack(c);
+
+    c->is_read = true;
+    c->io = this;
+
+    objecter_ops.push_back(objecter->prepare_read_op(oids[i], oloc, *ops[i],
+						     snap_seq, NULL, flags,
+						     onack, &c->objver));
+  }
+
+  vector<ceph_tid_t> tids;
+  objecter->op_submit_batch(objecter_ops, &tids);
+  for (size_t i = 0; i < cs.size(); ++i)
+    cs[i]->tid = tids[i];
+  return 0;
+}
+
 int librados::IoCtxImpl::aio_read(const object_t oid, AioCompletionImpl *c,
 				  bufferlist *pbl, size_t len, uint64_t off,
 				  uint64_t snapid)
@@ -1075,16 +1141,17 @@ int librados::IoCtxImpl::watch(const object_t& oid, uint64_t ver,
 
 
 /* this is called with IoCtxImpl::lock held */
-int librados::IoCtxImpl::_notify_ack(
+Objecter::Op *librados::IoCtxImpl::_prepare_notify_acks(
   const object_t& oid,
-  uint64_t notify_id, uint64_t ver,
-  uint64_t cookie)
+  const std::list<MWatchNotify*>& notifies)
 {
+  // one op acks all of them
   ::ObjectOperation rd;
   prepare_assert_ops(&rd);
-  rd.notify_ack(notify_id, ver, cookie);
-  objecter->read(oid, oloc, rd, snap_seq, (bufferlist*)NULL, 0, 0, 0);
-  return 0;
+  for (std::list<MWatchNotify*>::const_iterator p = notifies.begin();
+       p != notifies.end(); ++p)
+    rd.notify_ack((*p)->notify_id, (*p)->ver, (*p)->cookie);
+  return objecter->prepare_read_op(oid, oloc, rd, snap_seq, NULL, 0, NULL);
 }
 
 int librados::IoCtxImpl::unwatch(const object_t& oid, uint64_t cookie)
@@ -26,6 +26,8 @@
 #include "osd/osd_types.h"
 #include "osdc/Objecter.h"
 
+class MWatchNotify;
+
 class RadosClient;
 
 struct librados::IoCtxImpl {
@@ -148,6 +150,13 @@ struct librados::IoCtxImpl {
 		  int flags);
   int aio_operate_read(const object_t& oid, ::ObjectOperation *o,
 		       AioCompletionImpl *c, int flags, bufferlist *pbl);
+  int aio_operate_batch(const vector<object_t>& oids,
+			const vector< ::ObjectOperation*>& ops,
+			const vector<AioCompletionImpl*>& cs,
+			const SnapContext& snap_context, int flags);
+  int aio_operate_read_batch(const vector<object_t>& oids,
+			     const vector< ::ObjectOperation*>& ops,
+			     const vector<AioCompletionImpl*>& cs, int flags);
 
   struct C_aio_Ack : public Context {
     librados::AioCompletionImpl *c;
@@ -200,9 +209,8 @@ struct librados::IoCtxImpl {
   int watch(const object_t& oid, uint64_t ver, uint64_t *cookie, librados::WatchCtx *ctx);
   int unwatch(const object_t& oid, uint64_t cookie);
   int notify(const object_t& oid, uint64_t ver, bufferlist& bl);
-  int _notify_ack(
-    const object_t& oid, uint64_t notify_id, uint64_t ver,
-    uint64_t cookie);
+  Objecter::Op *_prepare_notify_acks(
+    const object_t& oid, const std::list<MWatchNotify*>& notifies);
 
   int set_alloc_hint(const object_t& oid,
                      uint64_t expected_object_size,
@@ -676,10 +676,9 @@ void librados::RadosClient::unregister_watch_notify_callback(uint64_t cookie)
 
 struct C_DoWatchNotify : public Context {
   librados::RadosClient *rados;
-  MWatchNotify *m;
-  C_DoWatchNotify(librados::RadosClient *r, MWatchNotify *m) : rados(r), m(m) {}
+  C_DoWatchNotify(librados::RadosClient *r) : rados(r) {}
   void finish(int r) {
-    rados->do_watch_notify(m);
+    rados->do_watch_notify();
   }
 };
 
@@ -689,8 +688,11 @@ void librados::RadosClient::handle_watch_notify(MWatchNotify *m)
 
   if (watch_notify_info.count(m->cookie)) {
     ldout(cct,10) << __func__ << " queueing async " << *m << dendl;
-    // deliver this async via a finisher thread
-    finisher.queue(new C_DoWatchNotify(this, m));
+    // deliver this async via a finisher thread, along with whatever
+    // else arrives before it gets to run
+    watch_notify_queue.push_back(m);
+    if (watch_notify_queue.size() == 1)
+      finisher.queue(new C_DoWatchNotify(this));
   } else {
     // drop it on the floor
     ldout(cct,10) << __func__ << " cookie " << m->cookie << " unknown" << dendl;
@@ -698,12 +700,33 @@ void librados::RadosClient::handle_watch_notify(MWatchNotify *m)
   }
 }
 
-void librados::RadosClient::do_watch_notify(MWatchNotify *m)
+/*
+ * Delivers the notifies queued so far.  Consecutive notifies for the
+ * same watched object are acked together, with one op, once the last
+ * of them has been called back.  The acks are sent before the callback
+ * for any other object runs, so a callback may wait on a notifier that
+ * is waiting for the acks of another object; it must not wait on the
+ * ack of an earlier notify to its own object.
+ */
+void librados::RadosClient::do_watch_notify()
 {
   Mutex::Locker l(lock);
-  map<uint64_t, WatchNotifyInfo *>::iterator iter =
-    watch_notify_info.find(m->cookie);
-  if (iter != watch_notify_info.end()) {
+  list<MWatchNotify*> ls;
+  ls.swap(watch_notify_queue);
+
+  // acks for the watched object we are on, not sent yet
+  pair<IoCtxImpl*, object_t> acking;
+  list<MWatchNotify*> acks;
+
+  for (list<MWatchNotify*>::iterator p = ls.begin(); p != ls.end(); ++p) {
+    MWatchNotify *m = *p;
+    map<uint64_t, WatchNotifyInfo *>::iterator iter =
+      watch_notify_info.find(m->cookie);
+    if (iter == watch_notify_info.end()) {
+      ldout(cct, 4) << __func__ << " unknown cookie " << m->cookie << dendl;
+      m->put();
+      continue;
+    }
     WatchNotifyInfo *wc = iter->second;
     assert(wc);
     if (wc->notify_lock) {
@@ -714,9 +737,13 @@ void librados::RadosClient::do_watch_notify(MWatchNotify *m)
       *wc->notify_rval = m->return_code;
       wc->notify_cond->Signal();
       wc->notify_lock->Unlock();
+      m->put();
     } else {
       // we are watcher and got a notify
       ldout(cct,10) << __func__ << " got notify " << *m << dendl;
+      pair<IoCtxImpl*, object_t> obj(wc->io_ctx_impl, wc->oid);
+      if (!acks.empty() && obj != acking)
+	_send_notify_acks(acking, acks);
       wc->get();
 
       // trigger the callback
@@ -724,16 +751,33 @@ void librados::RadosClient::do_watch_notify(MWatchNotify *m)
       wc->watch_ctx->notify(m->opcode, m->ver, m->bl);
       lock.Lock();
 
-      // send ACK back to the OSD
-      wc->io_ctx_impl->_notify_ack(wc->oid, m->notify_id, m->ver, m->cookie);
-
       ldout(cct,10) << __func__ << " notify done" << dendl;
+      // the watch may go once we drop our ref, its ioctx stays
+      if (acks.empty()) {
+	wc->io_ctx_impl->get();
+	acking = obj;
+      }
+      acks.push_back(m);
       wc->put();
     }
-  } else {
-    ldout(cct, 4) << __func__ << " unknown cookie " << m->cookie << dendl;
   }
-  m->put();
+
+  if (!acks.empty())
+    _send_notify_acks(acking, acks);
+}
+
+void librados::RadosClient::_send_notify_acks(
+  const pair<IoCtxImpl*, object_t>& obj,
+  list<MWatchNotify*>& acks)
+{
+  assert(lock.is_locked_by_me());
+  ldout(cct,10) << __func__ << " acking " << acks.size() << " notifies to "
+		<< obj.second << dendl;
+  objecter->op_submit(obj.first->_prepare_notify_acks(obj.second, acks));
+  for (list<MWatchNotify*>::iterator p = acks.begin(); p != acks.end(); ++p)
+    (*p)->put();
+  acks.clear();
+  obj.first->put();
 }
 
 
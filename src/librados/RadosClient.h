@@ -114,8 +114,14 @@ public:
   void register_watch_notify_callback(librados::WatchNotifyInfo *wc,
 				      uint64_t *cookie);
   void unregister_watch_notify_callback(uint64_t cookie);
+  /// notifies waiting for do_watch_notify()
+  list<MWatchNotify*> watch_notify_queue;
+
   void handle_watch_notify(MWatchNotify *m);
-  void do_watch_notify(MWatchNotify *m);
+  void do_watch_notify();
+  /// acks the given notifies to obj with one op, and drops them
+  void _send_notify_acks(const pair<librados::IoCtxImpl*, object_t>& obj,
+			 list<MWatchNotify*>& acks);
 
   int mon_command(const vector<string>& cmd, const bufferlist &inbl,
 	          bufferlist *outbl, string *outs);
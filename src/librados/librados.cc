@@ -1341,6 +1341,38 @@ int librados::IoCtx::aio_operate(const std::string& oid, AioCompletion *c,
 }
 
 
+int librados::IoCtx::aio_operate_batch(const std::vector<std::string>& oids,
+				       const std::vector<AioCompletion*>& cs,
+				       const std::vector<ObjectWriteOperation*>& ops,
+				       int flags)
+{
+  vector<object_t> objs(oids.begin(), oids.end());
+  vector< ::ObjectOperation*> o;
+  for (size_t i = 0; i < ops.size(); ++i)
+    o.push_back((::ObjectOperation*)ops[i]->impl);
+  vector<AioCompletionImpl*> c;
+  for (size_t i = 0; i < cs.size(); ++i)
+    c.push_back(cs[i]->pc);
+  return io_ctx_impl->aio_operate_batch(objs, o, c, io_ctx_impl->snapc,
+					translate_flags(flags));
+}
+
+int librados::IoCtx::aio_operate_batch(const std::vector<std::string>& oids,
+				       const std::vector<AioCompletion*>& cs,
+				       const std::vector<ObjectReadOperation*>& ops,
+				       int flags)
+{
+  vector<object_t> objs(oids.begin(), oids.end());
+  vector< ::ObjectOperation*> o;
+  for (size_t i = 0; i < ops.size(); ++i)
+    o.push_back((::ObjectOperation*)ops[i]->impl);
+  vector<AioCompletionImpl*> c;
+  for (size_t i = 0; i < cs.size(); ++i)
+    c.push_back(cs[i]->pc);
+  return io_ctx_impl->aio_operate_read_batch(objs, o, c,
+					     translate_flags(flags));
+}
+
 void librados::IoCtx::snap_set_read(snap_t seq)
 {
   io_ctx_impl->set_snap_read(seq);
@@ -74,6 +74,17 @@
  * considered as full of 0s. They are however not created until real data is written
  * to them.
  *
+ * Two optional layers sit in front of the rados operations :
+ *  - with rados_striper_buffer_appends, appends are kept in memory and written once
+ *    they reach a stripe unit boundary, or on aio_flush, or when the striper handle
+ *    is destroyed. Any other operation on the striped object writes them first.
+ *    Until then, they are neither visible to other clients nor safe : aio_appends
+ *    complete right away, but are only safe once their data are written
+ *  - with rados_striper_readahead_max_bytes, sequential reads of a striped object
+ *    are detected using common/Readahead and the next stripes are prefetched.
+ *    Prefetched data are dropped when the object is written through this striper,
+ *    but not when other clients write it
+ *
  * There are a number of missing features/improvements that could be implemented.
  * Here are some ideas :
  *    - asynchronous stat and deletion
@@ -105,6 +116,9 @@
 /// format of the extension of rados objects created for a given striped object
 #define RADOS_OBJECT_EXTENSION_FORMAT ".%016llx"
 
+/// number of striped objects whose sequential reads are tracked
+#define READAHEAD_MAX_OBJECTS 128
+
 /// default object layout (external declaration)
 extern ceph_file_layout g_default_file_layout;
 
@@ -181,6 +195,13 @@ void libradosstriper::RadosStriperImpl::WriteCompletionData::safe(int r) {
   if (m_safe) m_safe->finish(r);
 }
 
+libradosstriper::RadosStriperImpl::ReadaheadCompletionData::ReadaheadCompletionData
+(libradosstriper::RadosStriperImpl* striper,
+ const std::string& soid,
+ uint64_t off,
+ uint64_t gen) :
+  CompletionData(striper, soid, ""), m_off(off), m_gen(gen) {}
+
 ///////////////////////// RadosExclusiveLock /////////////////////////////
 
 libradosstriper::RadosStriperImpl::RadosExclusiveLock::RadosExclusiveLock(librados::IoCtx* ioCtx,
@@ -204,7 +225,28 @@ libradosstriper::RadosStriperImpl::RadosExclusiveLock::~RadosExclusiveLock() {
 
 libradosstriper::RadosStriperImpl::RadosStriperImpl(librados::IoCtx& ioctx, librados::IoCtxImpl *ioctx_impl) :
   m_refCnt(0),lock("RadosStriper Refcont", false, false), m_radosCluster(ioctx), m_ioCtx(ioctx), m_ioCtxImpl(ioctx_impl),
-  m_layout(g_default_file_layout) {}
+  m_layout(g_default_file_layout),
+  m_appendLock("RadosStriper::m_appendLock"),
+  m_bufferAppends(cct()->_conf->rados_striper_buffer_appends),
+  m_readaheadLock("RadosStriper::m_readaheadLock"),
+  m_readaheadMaxBytes(cct()->_conf->rados_striper_readahead_max_bytes) {}
+
+libradosstriper::RadosStriperImpl::~RadosStriperImpl()
+{
+  // the handles flush buffered appends when they are destroyed, so
+  // anything left here failed to be written
+  for (std::map<std::string, AppendBuffer>::iterator it = m_appendBuffers.begin();
+       it != m_appendBuffers.end();
+       ++it) {
+    if (it->second.m_bl.length())
+      lderr(cct()) << "RadosStriperImpl : dropping " << it->second.m_bl.length()
+		   << " buffered bytes appended to " << it->first << dendl;
+  }
+  for (std::map<std::string, ReadaheadState*>::iterator it = m_readaheads.begin();
+       it != m_readaheads.end();
+       ++it)
+    delete it->second;
+}
 
 ///////////////////////// layout /////////////////////////////
 
@@ -289,11 +331,14 @@ int libradosstriper::RadosStriperImpl::write(const std::string& soid,
 					     size_t len,
 					     uint64_t off) 
 {
+  // buffered appends go first
+  int rc = flush_appends(soid);
+  if (rc) return rc;
   // open the object. This will create it if needed, retrieve its layout
   // and size and take a shared lock on it
   ceph_file_layout layout;
   std::string lockCookie;
-  int rc = createAndOpenStripedObject(soid, &layout, len+off, &lockCookie, true);
+  rc = createAndOpenStripedObject(soid, &layout, len+off, &lockCookie, true);
   if (rc) return rc;
   return write_in_open_object(soid, layout, lockCookie, bl, len, off);
 }
@@ -302,6 +347,8 @@ int libradosstriper::RadosStriperImpl::append(const std::string& soid,
 					      const bufferlist& bl,
 					      size_t len) 
 {
+  if (m_bufferAppends)
+    return buffered_append(soid, bl, len);
   // open the object. This will create it if needed, retrieve its layout
   // and size and take a shared lock on it
   ceph_file_layout layout;
@@ -347,9 +394,11 @@ int libradosstriper::RadosStriperImpl::aio_write(const std::string& soid,
 						 size_t len,
 						 uint64_t off)
 {
+  int rc = flush_appends(soid);
+  if (rc) return rc;
   ceph_file_layout layout;
   std::string lockCookie;
-  int rc = createAndOpenStripedObject(soid, &layout, len+off, &lockCookie, true);
+  rc = createAndOpenStripedObject(soid, &layout, len+off, &lockCookie, true);
   if (rc) return rc;
   return aio_write_in_open_object(soid, c, layout, lockCookie, bl, len, off);
 }
@@ -359,6 +408,8 @@ int libradosstriper::RadosStriperImpl::aio_append(const std::string& soid,
 						  const bufferlist& bl,
 						  size_t len)
 {
+  if (m_bufferAppends)
+    return buffered_append(soid, bl, len, c);
   ceph_file_layout layout;
   uint64_t size = len;
   std::string lockCookie;
@@ -439,13 +490,33 @@ int libradosstriper::RadosStriperImpl::aio_read(const std::string& soid,
 						size_t len,
 						uint64_t off)
 {
+  // make buffered appends visible
+  int rc = flush_appends(soid);
+  if (rc) return rc;
+  if (m_readaheadMaxBytes && read_from_readahead(soid, c, bl, len, off))
+    return 0;
   // open the object. This will retrieve its layout and size
   // and take a shared lock on it
   ceph_file_layout layout;
   uint64_t size;
   std::string lockCookie;
-  int rc = openStripedObjectForRead(soid, &layout, &size, &lockCookie);
+  rc = openStripedObjectForRead(soid, &layout, &size, &lockCookie);
   if (rc) return rc;
+  rc = aio_read_in_open_object(soid, c, layout, size, lockCookie, bl, len, off);
+  if (!rc && m_readaheadMaxBytes)
+    readahead(soid, layout, size, off, len);
+  return rc;
+}
+
+int libradosstriper::RadosStriperImpl::aio_read_in_open_object(const std::string& soid,
+							       librados::AioCompletionImpl *c,
+							       const ceph_file_layout& layout,
+							       uint64_t size,
+							       const std::string& lockCookie,
+							       bufferlist* bl,
+							       size_t len,
+							       uint64_t off)
+{
   // find out the actual number of bytes we can read
   uint64_t read_len;
   if (off >= size) {
@@ -513,7 +584,10 @@ int libradosstriper::RadosStriperImpl::aio_read(const std::string& soid,
 
 int libradosstriper::RadosStriperImpl::aio_flush() 
 {
-  int ret;
+  // write buffered appends
+  int ret = flush_appends();
+  if (ret < 0)
+    return ret;
   // pass to the rados level
   ret = m_ioCtx.aio_flush();
   if (ret < 0)
@@ -526,14 +600,408 @@ int libradosstriper::RadosStriperImpl::aio_flush()
   return ret;
 }
 
+///////////////////////// buffered appends /////////////////////////////
+
+int libradosstriper::RadosStriperImpl::flush_appends(const std::string& soid,
+						     bool forget)
+{
+  std::list<WriteCompletionData*> written;
+  int rc = 0;
+  m_appendLock.Lock();
+  std::map<std::string, AppendBuffer>::iterator it = get_append_buffer(soid, false);
+  if (it != m_appendBuffers.end()) {
+    if (it->second.m_bl.length())
+      rc = write_append_buffer(soid, it->second, it->second.m_bl.length(), &written);
+    if (!rc && forget)
+      m_appendBuffers.erase(it);
+  }
+  m_appendLock.Unlock();
+  finish_appends(written, 0);
+  return rc;
+}
+
+int libradosstriper::RadosStriperImpl::flush_appends()
+{
+  std::list<WriteCompletionData*> written;
+  int ret = 0;
+  m_appendLock.Lock();
+  // the map may change while a buffer is being written
+  std::list<std::string> soids;
+  for (std::map<std::string, AppendBuffer>::iterator it = m_appendBuffers.begin();
+       it != m_appendBuffers.end();
+       ++it) {
+    if (it->second.m_bl.length() || it->second.m_writing)
+      soids.push_back(it->first);
+  }
+  for (std::list<std::string>::iterator p = soids.begin(); p != soids.end(); ++p) {
+    std::map<std::string, AppendBuffer>::iterator it = get_append_buffer(*p, false);
+    if (it == m_appendBuffers.end() || !it->second.m_bl.length())
+      continue;
+    int rc = write_append_buffer(*p, it->second, it->second.m_bl.length(), &written);
+    if (rc && !ret)
+      ret = rc;
+  }
+  m_appendLock.Unlock();
+  finish_appends(written, 0);
+  return ret;
+}
+
+void libradosstriper::RadosStriperImpl::discard_appends(int r)
+{
+  std::list<WriteCompletionData*> dropped;
+  m_appendLock.Lock();
+  while (!m_appendBuffers.empty()) {
+    std::string soid = m_appendBuffers.begin()->first;
+    std::map<std::string, AppendBuffer>::iterator it = get_append_buffer(soid, false);
+    if (it == m_appendBuffers.end())
+      continue;
+    if (it->second.m_bl.length())
+      lderr(cct()) << "RadosStriperImpl : dropping " << it->second.m_bl.length()
+		   << " buffered bytes appended to " << soid << dendl;
+    for (std::list<std::pair<uint64_t, WriteCompletionData*> >::iterator p =
+	   it->second.m_waiters.begin();
+	 p != it->second.m_waiters.end();
+	 ++p)
+      dropped.push_back(p->second);
+    m_appendBuffers.erase(it);
+  }
+  m_appendLock.Unlock();
+  finish_appends(dropped, r);
+}
+
+void libradosstriper::RadosStriperImpl::finish_appends(std::list<WriteCompletionData*>& ls,
+						       int r)
+{
+  for (std::list<WriteCompletionData*>::iterator p = ls.begin(); p != ls.end(); ++p) {
+    (*p)->safe(r);
+    (*p)->put();
+  }
+  ls.clear();
+}
+
+std::map<std::string, libradosstriper::RadosStriperImpl::AppendBuffer>::iterator
+libradosstriper::RadosStriperImpl::get_append_buffer(const std::string& soid,
+						     bool create)
+{
+  assert(m_appendLock.is_locked());
+  while (true) {
+    std::map<std::string, AppendBuffer>::iterator it = m_appendBuffers.find(soid);
+    if (it == m_appendBuffers.end()) {
+      if (!create)
+	return it;
+      it = m_appendBuffers.insert(std::make_pair(soid, AppendBuffer())).first;
+    }
+    if (!it->second.m_writing)
+      return it;
+    m_appendCond.Wait(m_appendLock);
+  }
+}
+
+int libradosstriper::RadosStriperImpl::buffered_append(const std::string& soid,
+						       const bufferlist& bl,
+						       size_t len,
+						       librados::AioCompletionImpl *c)
+{
+  std::list<WriteCompletionData*> written;
+  m_appendLock.Lock();
+  AppendBuffer& buffer = get_append_buffer(soid, true)->second;
+  uint64_t prevLen = buffer.m_bl.length();
+  bufferlist data;
+  data.substr_of(bl, 0, len);
+  buffer.m_bl.claim_append(data);
+  buffer.m_appended += len;
+  // write out what reaches a stripe unit boundary. As long as nobody else
+  // appends to the striped object, we know where the buffer will land and
+  // the rados writes then cover whole stripe units
+  uint64_t su = buffer.m_stripeUnit ? buffer.m_stripeUnit : (uint32_t)m_layout.fl_stripe_unit;
+  uint64_t toWrite = 0;
+  if (buffer.m_offKnown) {
+    uint64_t boundary = (buffer.m_off + buffer.m_bl.length()) / su * su;
+    if (boundary > buffer.m_off)
+      toWrite = boundary - buffer.m_off;
+  } else if (buffer.m_bl.length() >= su) {
+    toWrite = buffer.m_bl.length();
+  }
+  int rc = 0;
+  if (toWrite)
+    rc = write_append_buffer(soid, buffer, toWrite, &written);
+  if (rc) {
+    // this append failed, previous ones stay buffered
+    bufferlist prev;
+    prev.substr_of(buffer.m_bl, 0, prevLen);
+    buffer.m_bl.swap(prev);
+    buffer.m_appended -= len;
+  } else if (c) {
+    // the data are in memory, so the append is complete. It is safe
+    // once they are written
+    m_ioCtxImpl->get();
+    c->io = m_ioCtxImpl;
+    WriteCompletionData *cdata = new WriteCompletionData(this, soid, "", c);
+    cdata->complete(0);
+    if (buffer.m_written >= buffer.m_appended)
+      written.push_back(cdata);
+    else
+      buffer.m_waiters.push_back(std::make_pair(buffer.m_appended, cdata));
+  }
+  m_appendLock.Unlock();
+  finish_appends(written, 0);
+  return rc;
+}
+
+int libradosstriper::RadosStriperImpl::write_append_buffer(const std::string& soid,
+							   AppendBuffer& buffer,
+							   uint64_t len,
+							   std::list<WriteCompletionData*> *written)
+{
+  assert(m_appendLock.is_locked());
+  assert(!buffer.m_writing);
+  bufferlist data;
+  data.substr_of(buffer.m_bl, 0, len);
+  // nobody else touches the buffer until we are done, so it can't go
+  // away while we write without the lock
+  buffer.m_writing = true;
+  m_appendLock.Unlock();
+  // same as append
+  ceph_file_layout layout;
+  uint64_t size = len;
+  std::string lockCookie;
+  int rc = openStripedObjectForWrite(soid, &layout, &size, &lockCookie, false);
+  if (!rc)
+    rc = write_in_open_object(soid, layout, lockCookie, data, len, size);
+  m_appendLock.Lock();
+  buffer.m_writing = false;
+  m_appendCond.SignalAll();
+  if (rc) return rc;
+  ldout(cct(), 20) << "RadosStriperImpl::write_append_buffer : wrote "
+		   << size << "~" << len << " of " << soid << dendl;
+  bufferlist rest;
+  rest.substr_of(buffer.m_bl, len, buffer.m_bl.length() - len);
+  buffer.m_bl.swap(rest);
+  buffer.m_off = size + len;
+  buffer.m_offKnown = true;
+  buffer.m_stripeUnit = layout.fl_stripe_unit;
+  buffer.m_written += len;
+  while (!buffer.m_waiters.empty() &&
+	 buffer.m_waiters.front().first <= buffer.m_written) {
+    written->push_back(buffer.m_waiters.front().second);
+    buffer.m_waiters.pop_front();
+  }
+  return 0;
+}
+
+///////////////////////// readahead /////////////////////////////
+
+bool libradosstriper::RadosStriperImpl::read_from_readahead(const std::string& soid,
+							    librados::AioCompletionImpl *c,
+							    bufferlist* bl,
+							    size_t len,
+							    uint64_t off)
+{
+  ceph_file_layout layout;
+  uint64_t size;
+  {
+    Mutex::Locker l(m_readaheadLock);
+    std::map<std::string, ReadaheadState*>::iterator it = m_readaheads.find(soid);
+    if (it == m_readaheads.end() || !len)
+      return false;
+    ReadaheadState *state = it->second;
+    // find the extent holding off
+    std::map<uint64_t, bufferlist>::iterator p = state->m_extents.upper_bound(off);
+    if (p == state->m_extents.begin())
+      return false;
+    --p;
+    if (off + len > p->first + p->second.length())
+      return false;
+    ldout(cct(), 20) << "RadosStriperImpl::read_from_readahead : "
+		     << soid << " " << off << "~" << len << dendl;
+    bufferlist data;
+    data.substr_of(p->second, off - p->first, len);
+    if (bl->length() >= len) {
+      bl->copy_in(0, len, data);
+    } else {
+      bl->clear();
+      bl->claim_append(data);
+    }
+    layout = state->m_layout;
+    size = state->m_size;
+  }
+  c->is_read = true;
+  c->io = m_ioCtxImpl;
+  CompletionData *cdata = new CompletionData(this, soid, "", c);
+  cdata->complete(len);
+  cdata->put();
+  // keep the stream going
+  readahead(soid, layout, size, off, len);
+  return true;
+}
+
+static void striper_readahead_complete(rados_completion_t c, void *arg)
+{
+  libradosstriper::RadosStriperImpl::ReadaheadCompletionData *rdata =
+    reinterpret_cast<libradosstriper::RadosStriperImpl::ReadaheadCompletionData*>(arg);
+  librados::AioCompletionImpl *comp =
+    reinterpret_cast<librados::AioCompletionImpl*>(c);
+  rdata->m_striper->readahead_complete(rdata, comp->get_return_value());
+  comp->put();
+  rdata->put();
+}
+
+void libradosstriper::RadosStriperImpl::readahead(const std::string& soid,
+						  const ceph_file_layout& layout,
+						  uint64_t size,
+						  uint64_t off,
+						  size_t len)
+{
+  uint64_t gen;
+  Readahead::extent_t extent;
+  {
+    Mutex::Locker l(m_readaheadLock);
+    ReadaheadState *state;
+    std::map<std::string, ReadaheadState*>::iterator it = m_readaheads.find(soid);
+    if (it != m_readaheads.end()) {
+      state = it->second;
+    } else {
+      if (m_readaheads.size() >= READAHEAD_MAX_OBJECTS) {
+	// forget an idle striped object
+	for (it = m_readaheads.begin(); it != m_readaheads.end(); ++it) {
+	  if (!it->second->m_fetching) {
+	    delete it->second;
+	    m_readaheads.erase(it);
+	    break;
+	  }
+	}
+      }
+      state = new ReadaheadState;
+      // prefetch at least the next stripe, aligned on objects or stripes
+      uint64_t stripeWidth = (uint64_t)layout.fl_stripe_unit * layout.fl_stripe_count;
+      std::vector<uint64_t> alignments;
+      alignments.push_back((uint64_t)layout.fl_object_size * layout.fl_stripe_count);
+      alignments.push_back(stripeWidth);
+      alignments.push_back(layout.fl_stripe_unit);
+      state->m_readahead.set_alignments(alignments);
+      state->m_readahead.set_trigger_requests(cct()->_conf->rados_striper_readahead_trigger_requests);
+      state->m_readahead.set_min_readahead_size(std::min(stripeWidth, m_readaheadMaxBytes));
+      state->m_readahead.set_max_readahead_size(m_readaheadMaxBytes);
+      m_readaheads[soid] = state;
+    }
+    state->m_layout = layout;
+    state->m_size = size;
+    // forget what was read already
+    while (!state->m_extents.empty()) {
+      std::map<uint64_t, bufferlist>::iterator p = state->m_extents.begin();
+      uint64_t end = p->first + p->second.length();
+      if (end > off) {
+	if (p->first < off) {
+	  bufferlist rest;
+	  rest.substr_of(p->second, off - p->first, end - off);
+	  state->m_extents.erase(p);
+	  state->m_extents[off].swap(rest);
+	}
+	break;
+      }
+      state->m_extents.erase(p);
+    }
+    extent = state->m_readahead.update(off, len, size);
+    if (!extent.second)
+      return;
+    state->m_fetching++;
+    gen = state->m_gen;
+  }
+  ldout(cct(), 20) << "RadosStriperImpl::readahead : " << soid << " "
+		   << extent.first << "~" << extent.second << dendl;
+  // the prefetch takes its own shared lock, as any other read
+  ceph_file_layout curLayout;
+  uint64_t curSize;
+  std::string lockCookie;
+  int rc = openStripedObjectForRead(soid, &curLayout, &curSize, &lockCookie);
+  if (rc) {
+    Mutex::Locker l(m_readaheadLock);
+    std::map<std::string, ReadaheadState*>::iterator it = m_readaheads.find(soid);
+    if (it != m_readaheads.end())
+      it->second->m_fetching--;
+    return;
+  }
+  ReadaheadCompletionData *rdata = new ReadaheadCompletionData(this, soid, extent.first, gen);
+  rdata->m_bl.push_back(buffer::create(extent.second));
+  librados::AioCompletionImpl *c = new librados::AioCompletionImpl;
+  c->set_complete_callback(rdata, striper_readahead_complete);
+  rc = aio_read_in_open_object(soid, c, curLayout, curSize, lockCookie, &rdata->m_bl,
+			       extent.second, extent.first);
+  if (rc < 0) {
+    // the completion still fires, but with partial data
+    Mutex::Locker l(m_readaheadLock);
+    std::map<std::string, ReadaheadState*>::iterator it = m_readaheads.find(soid);
+    if (it != m_readaheads.end())
+      it->second->m_gen++;
+  }
+}
+
+void libradosstriper::RadosStriperImpl::readahead_complete(ReadaheadCompletionData *rdata,
+							   int r)
+{
+  Mutex::Locker l(m_readaheadLock);
+  std::map<std::string, ReadaheadState*>::iterator it = m_readaheads.find(rdata->m_soid);
+  assert(it != m_readaheads.end());
+  ReadaheadState *state = it->second;
+  state->m_fetching--;
+  if (r <= 0 || rdata->m_gen != state->m_gen) {
+    ldout(cct(), 20) << "RadosStriperImpl::readahead_complete : dropping "
+		     << rdata->m_soid << " " << rdata->m_off << " r = " << r << dendl;
+    return;
+  }
+  uint64_t off = rdata->m_off;
+  uint64_t end = off + rdata->m_bl.length();
+  std::map<uint64_t, bufferlist>::iterator next = state->m_extents.lower_bound(off);
+  std::map<uint64_t, bufferlist>::iterator prev = next;
+  if (prev != state->m_extents.begin())
+    --prev;
+  else
+    prev = state->m_extents.end();
+  // data overlapping what we have are of no use
+  if ((prev != state->m_extents.end() && prev->first + prev->second.length() > off) ||
+      (next != state->m_extents.end() && next->first < end))
+    return;
+  // merge with the adjacent extents
+  bufferlist bl;
+  if (prev != state->m_extents.end() && prev->first + prev->second.length() == off) {
+    off = prev->first;
+    bl.claim(prev->second);
+    state->m_extents.erase(prev);
+  }
+  bl.claim_append(rdata->m_bl);
+  if (next != state->m_extents.end() && next->first == end) {
+    bl.claim_append(next->second);
+    state->m_extents.erase(next);
+  }
+  state->m_extents[off].swap(bl);
+}
+
+void libradosstriper::RadosStriperImpl::invalidate_readahead(const std::string& soid)
+{
+  Mutex::Locker l(m_readaheadLock);
+  std::map<std::string, ReadaheadState*>::iterator it = m_readaheads.find(soid);
+  if (it == m_readaheads.end())
+    return;
+  if (it->second->m_fetching) {
+    it->second->m_gen++;
+    it->second->m_extents.clear();
+  } else {
+    delete it->second;
+    m_readaheads.erase(it);
+  }
+}
+
 ///////////////////////// stat and deletion /////////////////////////////
 
 int libradosstriper::RadosStriperImpl::stat(const std::string& soid, uint64_t *psize, time_t *pmtime)
 {
+  // buffered appends count in the size
+  int rc = flush_appends(soid);
+  if (rc) return rc;
   // get pmtime as the pmtime of the first object
   std::string firstObjOid = getObjectId(soid, 0);
   uint64_t obj_size;
-  int rc = m_ioCtx.stat(firstObjOid, &obj_size, pmtime);
+  rc = m_ioCtx.stat(firstObjOid, &obj_size, pmtime);
   if (rc < 0) return rc;
   // get the pmsize from the first object attributes
   bufferlist bl;
@@ -552,6 +1020,9 @@ int libradosstriper::RadosStriperImpl::stat(const std::string& soid, uint64_t *p
 
 int libradosstriper::RadosStriperImpl::remove(const std::string& soid)
 {
+  int rcf = flush_appends(soid, true);
+  if (rcf) return rcf;
+  invalidate_readahead(soid);
   std::string firstObjOid = getObjectId(soid, 0);
   try {
     // lock the object in exclusive mode. Will be released when leaving the scope
@@ -609,6 +1080,9 @@ int libradosstriper::RadosStriperImpl::remove(const std::string& soid)
 
 int libradosstriper::RadosStriperImpl::trunc(const std::string& soid, uint64_t size)
 {
+  int rcf = flush_appends(soid, true);
+  if (rcf) return rcf;
+  invalidate_readahead(soid);
   // lock the object in exclusive mode. Will be released when leaving the scope
   std::string firstObjOid = getObjectId(soid, 0);
   try {
@@ -753,6 +1227,8 @@ libradosstriper::RadosStriperImpl::internal_aio_write(const std::string& soid,
 						      uint64_t off,
 						      const ceph_file_layout& layout)
 {
+  // whatever was prefetched may be stale now
+  invalidate_readahead(soid);
   // get list of extents to be written to
   vector<ObjectExtent> extents;
   std::string format = soid + RADOS_OBJECT_EXTENSION_FORMAT;
@@ -26,6 +26,7 @@
 
 #include "librados/IoCtxImpl.h"
 #include "common/RefCountedObj.h"
+#include "common/Readahead.h"
 
 struct libradosstriper::RadosStriperImpl {
 
@@ -120,6 +121,65 @@ struct libradosstriper::RadosStriperImpl {
     bufferlist *m_bl;
   };
 
+  /**
+   * struct handling the data needed to pass to the call back
+   * function of a readahead request
+   */
+  struct ReadaheadCompletionData : CompletionData {
+    /// where the prefetched data start in the striped object
+    uint64_t m_off;
+    /// generation of the readahead state when the request was sent
+    uint64_t m_gen;
+    /// prefetched data
+    bufferlist m_bl;
+    /// constructor
+    ReadaheadCompletionData(libradosstriper::RadosStriperImpl * striper,
+			    const std::string& soid,
+			    uint64_t off,
+			    uint64_t gen);
+  };
+
+  /**
+   * appends of a striped object that were not written yet,
+   * see rados_striper_buffer_appends
+   */
+  struct AppendBuffer {
+    AppendBuffer() : m_off(0), m_offKnown(false), m_stripeUnit(0),
+		     m_writing(false), m_appended(0), m_written(0) {};
+    /// data appended but not yet written
+    bufferlist m_bl;
+    /// where m_bl should land in the striped object, valid if m_offKnown
+    uint64_t m_off;
+    bool m_offKnown;
+    /// stripe unit of the striped object, 0 until we first wrote to it
+    uint32_t m_stripeUnit;
+    /// being written without m_appendLock; wait on m_appendCond
+    bool m_writing;
+    /// bytes ever appended to and written from this buffer
+    uint64_t m_appended;
+    uint64_t m_written;
+    /// buffered aio_appends by m_appended at their end, safe once written
+    std::list<std::pair<uint64_t, WriteCompletionData*> > m_waiters;
+  };
+
+  /**
+   * sequential read detection and prefetched data of a striped object,
+   * see rados_striper_readahead_max_bytes
+   */
+  struct ReadaheadState {
+    ReadaheadState() : m_size(0), m_gen(0), m_fetching(0) {};
+    Readahead m_readahead;
+    /// layout and size of the striped object when last opened
+    ceph_file_layout m_layout;
+    uint64_t m_size;
+    /// prefetched data by offset, adjacent extents being merged
+    std::map<uint64_t, bufferlist> m_extents;
+    /// bumped by writes, so that prefetched data they overtake are dropped
+    uint64_t m_gen;
+    /// number of readahead requests in flight
+    int m_fetching;
+  };
+
   /**
    * exception wrapper around an error code
    */
@@ -153,7 +213,7 @@ struct libradosstriper::RadosStriperImpl {
    */
   RadosStriperImpl(librados::IoCtx& ioctx, librados::IoCtxImpl *ioctx_impl);
   /// Destructor
-  ~RadosStriperImpl() {};
+  ~RadosStriperImpl();
 
   // configuration
   int setObjectLayoutStripeUnit(unsigned int stripe_unit);
@@ -185,6 +245,20 @@ struct libradosstriper::RadosStriperImpl {
 	       char* buf, size_t len, uint64_t off);
   int aio_flush();
 
+  // buffered appends
+  /**
+   * writes the buffered appends of soid
+   * @param forget also drop what we know of the striped object, as its
+   * size is about to change under us
+   */
+  int flush_appends(const std::string& soid, bool forget = false);
+  int flush_appends();
+  /**
+   * drops all buffered appends, failing the aio_appends still waiting
+   * for them with r. For when they can't be written
+   */
+  void discard_appends(int r);
+
   // stat, deletion and truncation
   int stat(const std::string& soid, uint64_t *psize, time_t *pmtime);
   int remove(const std::string& soid);
@@ -231,6 +305,14 @@ struct libradosstriper::RadosStriperImpl {
 			       const bufferlist& bl,
 			       size_t len,
 			       uint64_t off);
+  int aio_read_in_open_object(const std::string& soid,
+			      librados::AioCompletionImpl *c,
+			      const ceph_file_layout& layout,
+			      uint64_t size,
+			      const std::string& lockCookie,
+			      bufferlist* bl,
+			      size_t len,
+			      uint64_t off);
   int internal_aio_write(const std::string& soid,
 			 libradosstriper::MultiAioCompletionImpl *c,
 			 const bufferlist& bl,
@@ -311,6 +393,65 @@ struct libradosstriper::RadosStriperImpl {
 	   uint64_t size,
 	   ceph_file_layout &layout);
   
+  /**
+   * adds len bytes of bl to the append buffer of soid, and writes out
+   * everything up to the last stripe unit boundary it reaches.
+   * If c is given, it is completed right away and made safe once the
+   * data are written
+   */
+  int buffered_append(const std::string& soid,
+		      const bufferlist& bl,
+		      size_t len,
+		      librados::AioCompletionImpl *c = 0);
+
+  /**
+   * waits until nobody is writing the append buffer of soid and
+   * returns it, or m_appendBuffers.end() if there is none and create is
+   * false. m_appendLock must be held
+   */
+  std::map<std::string, AppendBuffer>::iterator
+  get_append_buffer(const std::string& soid, bool create);
+
+  /**
+   * appends the first len bytes of the given buffer to its striped object
+   * and drops them from the buffer. m_appendLock must be held; it is
+   * dropped during the write, while the buffer is marked as being written.
+   * The aio_appends this made safe are added to written
+   */
+  int write_append_buffer(const std::string& soid,
+			  AppendBuffer& buffer,
+			  uint64_t len,
+			  std::list<WriteCompletionData*> *written);
+
+  /// makes the given aio_appends safe with r and drops them
+  static void finish_appends(std::list<WriteCompletionData*>& ls, int r);
+
+  /**
+   * completes c with len bytes read at off if they were prefetched
+   * @return true if c was completed
+   */
+  bool read_from_readahead(const std::string& soid,
+			   librados::AioCompletionImpl *c,
+			   bufferlist* bl,
+			   size_t len,
+			   uint64_t off);
+
+  /**
+   * records a read of soid and sends the readahead request it triggers,
+   * if any
+   */
+  void readahead(const std::string& soid,
+		 const ceph_file_layout& layout,
+		 uint64_t size,
+		 uint64_t off,
+		 size_t len);
+
+  /// keeps the data of a readahead request, unless a write overtook it
+  void readahead_complete(ReadaheadCompletionData *rdata, int r);
+
+  /// drops the prefetched data of soid
+  void invalidate_readahead(const std::string& soid);
+
   /**
    * creates a unique identifier
    */
@@ -333,6 +474,19 @@ struct libradosstriper::RadosStriperImpl {
 
   // Default layout
   ceph_file_layout m_layout;
+
+  // Buffered appends, protected by m_appendLock. A buffer is written
+  // without the lock, and appends to that striped object wait on
+  // m_appendCond meanwhile, so that they stay in order
+  Mutex m_appendLock;
+  Cond m_appendCond;
+  std::map<std::string, AppendBuffer> m_appendBuffers;
+  bool m_bufferAppends;
+
+  // Readahead, protected by m_readaheadLock
+  Mutex m_readaheadLock;
+  std::map<std::string, ReadaheadState*> m_readaheads;
+  uint64_t m_readaheadMaxBytes;
 };
 
 #endif
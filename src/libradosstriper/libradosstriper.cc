@@ -142,8 +142,13 @@ libradosstriper::RadosStriper& libradosstriper::RadosStriper::operator=(const Ra
 
 libradosstriper::RadosStriper::~RadosStriper()
 {
-  if (rados_striper_impl)
+  if (rados_striper_impl) {
+    // write buffered appends, or fail the aio_appends waiting for them
+    int rc = rados_striper_impl->flush_appends();
+    if (rc < 0)
+      rados_striper_impl->discard_appends(rc);
     rados_striper_impl->put();
+  }
   rados_striper_impl = 0;
 }
 
@@ -318,6 +323,9 @@ extern "C" int rados_striper_create(rados_ioctx_t ioctx,
 extern "C" void rados_striper_destroy(rados_striper_t striper)
 {
   libradosstriper::RadosStriperImpl *impl = (libradosstriper::RadosStriperImpl *)striper;
+  int rc = impl->flush_appends();
+  if (rc < 0)
+    impl->discard_appends(rc);
   impl->put();
 }
 
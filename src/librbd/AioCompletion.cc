@@ -5,6 +5,7 @@
 
 #include "common/ceph_context.h"
 #include "common/dout.h"
+#include "common/errno.h"
 
 #include "librbd/AioRequest.h"
 #include "librbd/internal.h"
@@ -34,6 +35,18 @@ namespace librbd {
     lock.Unlock();
   }
 
+  void AioCompletion::fail(ImageCtx *i, aio_type_t t, int r)
+  {
+    lderr(i->cct) << "AioCompletion::fail() " << (void*)this << ": "
+		  << cpp_strerror(r) << dendl;
+    get();
+    init_time(i, t);
+    add_request();
+    finish_adding_requests(i->cct);
+    complete_request(i->cct, r);
+    put();
+  }
+
   int AioCompletion::wait_for_complete() {
     tracepoint(librbd, aio_wait_for_complete_enter, this);
     lock.Lock();
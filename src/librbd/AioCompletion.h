@@ -100,6 +100,9 @@ namespace librbd {
 
     void complete_request(CephContext *cct, ssize_t r);
 
+    /// complete with an error found before any requests were added
+    void fail(ImageCtx *i, aio_type_t t, int r);
+
     bool is_complete();
 
     ssize_t get_return_value();
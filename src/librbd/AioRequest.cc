@@ -3,6 +3,7 @@
 
 #include "common/ceph_context.h"
 #include "common/dout.h"
+#include "common/errno.h"
 #include "common/Mutex.h"
 #include "common/RWLock.h"
 
@@ -54,6 +55,23 @@ namespace librbd {
 
   /** read **/
 
+  class C_CopyOnRead : public Context {
+  public:
+    C_CopyOnRead(ImageCtx *ictx, uint64_t object_no)
+      : m_ictx(ictx), m_object_no(object_no) {}
+    virtual void finish(int r) {
+      if (r < 0)
+	lderr(m_ictx->cct) << "copy-on-read of object " << m_object_no
+			   << " failed: " << cpp_strerror(r) << dendl;
+      else
+	m_ictx->perfcounter->inc(l_librbd_copy_on_read);
+      m_ictx->finish_copy_on_read(m_object_no);
+    }
+  private:
+    ImageCtx *m_ictx;
+    uint64_t m_object_no;
+  };
+
   bool AioRead::should_complete(int r)
   {
     ldout(m_ictx->cct, 20) << "should_complete " << this << " " << m_oid << " " << m_object_off << "~" << m_object_len
@@ -82,9 +100,48 @@ namespace librbd {
       }
     }
 
+    if (m_tried_parent && r >= 0)
+      copy_on_read();
     return true;
   }
 
+  void AioRead::copy_on_read()
+  {
+    if (!m_ictx->cct->_conf->rbd_clone_copy_on_read ||
+	m_ictx->read_only || m_snap_id != CEPH_NOSNAP)
+      return;
+
+    RWLock::RLocker l(m_ictx->snap_lock);
+    RWLock::RLocker l2(m_ictx->parent_lock);
+    if (m_ictx->snap_id != CEPH_NOSNAP || !m_ictx->parent)
+      return;
+
+    // the whole object, as far as the parent overlaps it
+    vector<pair<uint64_t,uint64_t> > objectx;
+    Striper::extent_to_file(m_ictx->cct, &m_ictx->layout,
+			    m_object_no, 0, m_ictx->layout.fl_object_size,
+			    objectx);
+    uint64_t object_overlap =
+      m_ictx->prune_parent_extents(objectx, m_ictx->parent_md.overlap);
+    if (!object_overlap)
+      return;
+
+    // this is extra I/O on top of the read; keep it bounded, and let a
+    // later read of the object try again if we are busy
+    if (!m_ictx->start_copy_on_read(m_object_no))
+      return;
+
+    ldout(m_ictx->cct, 20) << "copy_on_read " << m_oid << " overlap "
+			   << object_overlap << dendl;
+    AioCopyup *req = new AioCopyup(m_ictx, m_oid, m_object_no,
+				   objectx, object_overlap,
+				   m_ictx->snapc, CEPH_NOSNAP,
+				   new C_CopyOnRead(m_ictx, m_object_no));
+    int r = req->send();
+    if (r < 0)
+      req->complete(r);
+  }
+
   int AioRead::send() {
     ldout(m_ictx->cct, 20) << "send " << this << " " << m_oid << " " << m_object_off << "~" << m_object_len << dendl;
 
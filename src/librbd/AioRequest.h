@@ -83,6 +83,8 @@ namespace librbd {
     friend class C_AioRead;
 
   private:
+    void copy_on_read();
+
     vector<pair<uint64_t,uint64_t> > m_buffer_extents;
     bool m_tried_parent;
     bool m_sparse;
@@ -174,6 +176,34 @@ namespace librbd {
     ceph::bufferlist m_write_data;
   };
 
+  /**
+   * Copy an object up from the parent, unless the child has it by now.
+   * This is a write with nothing to write: it goes through the same
+   * guard and copyup states, for copy-on-read.
+   */
+  class AioCopyup : public AbstractWrite {
+  public:
+    AioCopyup(ImageCtx *ictx, const std::string &oid, uint64_t object_no,
+	      vector<pair<uint64_t,uint64_t> >& objectx, uint64_t object_overlap,
+	      const ::SnapContext &snapc, librados::snap_t snap_id,
+	      Context *completion)
+      : AbstractWrite(ictx, oid,
+		      object_no, 0, 0,
+		      objectx, object_overlap,
+		      snapc, snap_id, completion,
+		      false) {
+      guard_write();
+    }
+    virtual ~AioCopyup() {}
+
+  protected:
+    virtual void add_copyup_ops() {
+      // if the parent range was all zeroes there is no copyup call;
+      // an empty object reads the same
+      m_copyup.create(false);
+    }
+  };
+
   class AioRemove : public AbstractWrite {
   public:
     AioRemove(ImageCtx *ictx, const std::string &oid,
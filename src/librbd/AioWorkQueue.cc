@@ -0,0 +1,193 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "common/ceph_context.h"
+#include "common/dout.h"
+
+#include "librbd/ImageCtx.h"
+#include "librbd/internal.h"
+
+#include "librbd/AioWorkQueue.h"
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::AioWorkQueue: "
+
+namespace librbd {
+
+  namespace {
+    // lives as long as the CephContext
+    class ThreadPoolSingleton : public CephContext::AssociatedSingletonObject {
+    public:
+      ThreadPool tp;
+      AioDispatchWQ wq;
+
+      explicit ThreadPoolSingleton(CephContext *cct)
+	: tp(cct, "librbd::thread_pool", cct->_conf->rbd_op_threads,
+	     "rbd_op_threads"),
+	  wq(cct, &tp) {
+	tp.start();
+      }
+      virtual ~ThreadPoolSingleton() {
+	tp.stop();
+      }
+    };
+  }
+
+  AioDispatchWQ::AioDispatchWQ(CephContext *cct, ThreadPool *tp)
+    : ThreadPool::WorkQueue<AioWorkQueue>("librbd::AioDispatchWQ",
+					  cct->_conf->rbd_op_thread_timeout,
+					  0, tp)
+  {
+  }
+
+  bool AioDispatchWQ::_enqueue(AioWorkQueue *q)
+  {
+    m_ready.push_back(q);
+    return true;
+  }
+
+  void AioDispatchWQ::_dequeue(AioWorkQueue *q)
+  {
+    assert(0);
+  }
+
+  AioWorkQueue *AioDispatchWQ::_dequeue()
+  {
+    if (m_ready.empty())
+      return NULL;
+    AioWorkQueue *q = m_ready.front();
+    m_ready.pop_front();
+    assert(!q->m_current);
+    assert(!q->m_ops.empty());
+    q->m_current = q->m_ops.front();
+    q->m_ops.pop_front();
+    return q;
+  }
+
+  bool AioDispatchWQ::_empty()
+  {
+    return m_ready.empty();
+  }
+
+  void AioDispatchWQ::_clear()
+  {
+    // images are closed, and so drained, before the CephContext goes
+    assert(m_ready.empty());
+  }
+
+  void AioDispatchWQ::_process(AioWorkQueue *q)
+  {
+    q->process(q->m_current);
+  }
+
+  void AioDispatchWQ::_process_finish(AioWorkQueue *q)
+  {
+    delete q->m_current;
+    q->m_current = NULL;
+    q->m_cond.SignalAll();
+    // the image's next op goes to the back of the line
+    if (!q->m_ops.empty())
+      m_ready.push_back(q);
+  }
+
+  AioWorkQueue::AioWorkQueue(ImageCtx *ictx)
+    : m_ictx(ictx), m_current(NULL)
+  {
+    ThreadPoolSingleton *tps;
+    ictx->cct->lookup_or_create_singleton_object<ThreadPoolSingleton>(
+      tps, "librbd::thread_pool");
+    m_tp = &tps->tp;
+    m_wq = &tps->wq;
+  }
+
+  AioWorkQueue::~AioWorkQueue()
+  {
+    assert(m_ops.empty());
+    assert(!m_current);
+  }
+
+  void AioWorkQueue::aio_read(uint64_t off, uint64_t len, char *buf,
+			      bufferlist *pbl, AioCompletion *c)
+  {
+    ldout(m_ictx->cct, 20) << "aio_read " << off << "~" << len << dendl;
+    AioOp *op = new AioOp(AIO_TYPE_READ, off, len, c);
+    op->buf = buf;
+    op->pbl = pbl;
+    queue(op);
+  }
+
+  void AioWorkQueue::aio_write(uint64_t off, uint64_t len, const char *buf,
+			       AioCompletion *c)
+  {
+    ldout(m_ictx->cct, 20) << "aio_write " << off << "~" << len << dendl;
+    AioOp *op = new AioOp(AIO_TYPE_WRITE, off, len, c);
+    op->bl.append(buf, len);
+    queue(op);
+  }
+
+  void AioWorkQueue::aio_write(uint64_t off, uint64_t len, bufferlist &bl,
+			       AioCompletion *c)
+  {
+    ldout(m_ictx->cct, 20) << "aio_write " << off << "~" << len << dendl;
+    AioOp *op = new AioOp(AIO_TYPE_WRITE, off, len, c);
+    op->bl.substr_of(bl, 0, len);
+    queue(op);
+  }
+
+  void AioWorkQueue::aio_discard(uint64_t off, uint64_t len, AioCompletion *c)
+  {
+    ldout(m_ictx->cct, 20) << "aio_discard " << off << "~" << len << dendl;
+    queue(new AioOp(AIO_TYPE_DISCARD, off, len, c));
+  }
+
+  void AioWorkQueue::aio_flush(AioCompletion *c)
+  {
+    ldout(m_ictx->cct, 20) << "aio_flush" << dendl;
+    queue(new AioOp(AIO_TYPE_FLUSH, 0, 0, c));
+  }
+
+  void AioWorkQueue::drain()
+  {
+    ldout(m_ictx->cct, 20) << "drain" << dendl;
+    m_tp->lock();
+    while (!m_ops.empty() || m_current)
+      m_tp->wait(m_cond);
+    m_tp->unlock();
+  }
+
+  void AioWorkQueue::queue(AioOp *op)
+  {
+    m_tp->lock();
+    m_ops.push_back(op);
+    // otherwise we are already in line, or will be once m_current is done
+    if (m_ops.size() == 1 && !m_current) {
+      m_wq->_enqueue(this);
+      m_wq->_wake();
+    }
+    m_tp->unlock();
+  }
+
+  void AioWorkQueue::process(AioOp *op)
+  {
+    int r = 0;
+    switch (op->type) {
+    case AIO_TYPE_READ:
+      r = librbd::aio_read(m_ictx, op->off, op->len, op->buf, op->pbl, op->c);
+      break;
+    case AIO_TYPE_WRITE:
+      r = librbd::aio_write(m_ictx, op->off, op->len, op->bl.c_str(), op->c);
+      break;
+    case AIO_TYPE_DISCARD:
+      r = librbd::aio_discard(m_ictx, op->off, op->len, op->c);
+      break;
+    case AIO_TYPE_FLUSH:
+      r = librbd::aio_flush(m_ictx, op->c);
+      break;
+    default:
+      assert(0);
+    }
+    if (r < 0)
+      op->c->fail(m_ictx, op->type, r);
+  }
+}
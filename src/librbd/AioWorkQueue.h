@@ -0,0 +1,101 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#ifndef CEPH_LIBRBD_AIOWORKQUEUE_H
+#define CEPH_LIBRBD_AIOWORKQUEUE_H
+
+#include "include/int_types.h"
+
+#include <list>
+
+#include "common/Cond.h"
+#include "common/WorkQueue.h"
+#include "include/buffer.h"
+
+#include "librbd/AioCompletion.h"
+
+namespace librbd {
+
+  struct ImageCtx;
+  class AioWorkQueue;
+
+  /// an aio call waiting to be submitted
+  struct AioOp {
+    aio_type_t type;
+    uint64_t off, len;
+    bufferlist bl;       ///< data to write
+    char *buf;           ///< or where to read to
+    bufferlist *pbl;
+    AioCompletion *c;
+
+    AioOp(aio_type_t t, uint64_t o, uint64_t l, AioCompletion *c)
+      : type(t), off(o), len(l), buf(NULL), pbl(NULL), c(c) {}
+  };
+
+  /// the images with ops ready to submit, shared by all images
+  class AioDispatchWQ : public ThreadPool::WorkQueue<AioWorkQueue> {
+  public:
+    AioDispatchWQ(CephContext *cct, ThreadPool *tp);
+
+  private:
+    friend class AioWorkQueue;
+
+    std::list<AioWorkQueue*> m_ready;
+
+    virtual bool _enqueue(AioWorkQueue *q);
+    virtual void _dequeue(AioWorkQueue *q);
+    virtual AioWorkQueue *_dequeue();
+    virtual bool _empty();
+    virtual void _clear();
+    virtual void _process(AioWorkQueue *q);
+    virtual void _process_finish(AioWorkQueue *q);
+  };
+
+  /**
+   * Queue for the public aio calls of one image.
+   *
+   * With rbd_op_threads set, rbd_aio_read() and friends only queue the
+   * request here, and a librbd thread does the mapping, cache and
+   * Objecter work, so the caller never waits on image locks or on the
+   * Objecter throttle.  Errors are reported through the completion.
+   *
+   * The threads are shared by all images of a CephContext.  The ops of
+   * one image are submitted one at a time and in order, so a flush
+   * still covers every write queued before it; different images are
+   * submitted in parallel.
+   */
+  class AioWorkQueue {
+  public:
+    AioWorkQueue(ImageCtx *ictx);
+    ~AioWorkQueue();
+
+    void aio_read(uint64_t off, uint64_t len, char *buf, bufferlist *pbl,
+		  AioCompletion *c);
+    /// copies buf, as librbd::aio_write() does
+    void aio_write(uint64_t off, uint64_t len, const char *buf,
+		   AioCompletion *c);
+    void aio_write(uint64_t off, uint64_t len, bufferlist &bl,
+		   AioCompletion *c);
+    void aio_discard(uint64_t off, uint64_t len, AioCompletion *c);
+    void aio_flush(AioCompletion *c);
+
+    /// wait until everything queued so far has been submitted
+    void drain();
+
+  private:
+    friend class AioDispatchWQ;
+
+    ImageCtx *m_ictx;
+    ThreadPool *m_tp;
+    AioDispatchWQ *m_wq;
+
+    // protected by the thread pool lock
+    std::list<AioOp*> m_ops;
+    AioOp *m_current;     ///< being submitted
+    Cond m_cond;
+
+    void queue(AioOp *op);
+    void process(AioOp *op);
+  };
+}
+
+#endif
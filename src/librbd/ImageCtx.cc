@@ -3,12 +3,15 @@
 #include <errno.h>
 
 #include "common/ceph_context.h"
+#include "include/ceph_hash.h"
 #include "common/dout.h"
 #include "common/errno.h"
 #include "common/perf_counters.h"
 
+#include "librbd/AioWorkQueue.h"
 #include "librbd/internal.h"
 #include "librbd/WatchCtx.h"
+#include "librbd/WriteLog.h"
 
 #include "librbd/ImageCtx.h"
 
@@ -41,17 +44,18 @@ namespace librbd {
       refresh_seq(0),
       last_refresh(0),
       md_lock("librbd::ImageCtx::md_lock"),
-      cache_lock("librbd::ImageCtx::cache_lock"),
       snap_lock("librbd::ImageCtx::snap_lock"),
       parent_lock("librbd::ImageCtx::parent_lock"),
       refresh_lock("librbd::ImageCtx::refresh_lock"),
+      copy_on_read_lock("librbd::ImageCtx::copy_on_read_lock"),
       extra_read_flags(0),
       old_format(true),
       order(0), size(0), features(0),
       format_string(NULL),
       id(image_id), parent(NULL),
       stripe_unit(0), stripe_count(0),
-      object_cacher(NULL), writeback_handler(NULL), object_set(NULL),
+      write_log(NULL),
+      aio_work_queue(NULL),
       readahead(),
       total_bytes_read(0)
   {
@@ -70,15 +74,21 @@ namespace librbd {
     }
     perf_start(pname);
 
+    if (cct->_conf->rbd_op_threads > 0)
+      aio_work_queue = new AioWorkQueue(this);
+
     if (cct->_conf->rbd_cache) {
-      Mutex::Locker l(cache_lock);
       ldout(cct, 20) << "enabling caching..." << dendl;
-      writeback_handler = new LibrbdWriteback(this, cache_lock);
+      int shards = MAX(cct->_conf->rbd_cache_shards, 1);
+      cache_shards.resize(shards);
+      for (int i = 0; i < shards; ++i)
+	cache_shards[i] = new CacheShard;
 
       uint64_t init_max_dirty = cct->_conf->rbd_cache_max_dirty;
       if (cct->_conf->rbd_cache_writethrough_until_flush)
 	init_max_dirty = 0;
       ldout(cct, 20) << "Initial cache settings:"
+		     << " shards=" << shards
 		     << " size=" << cct->_conf->rbd_cache_size
 		     << " num_objects=" << 10
 		     << " max_dirty=" << init_max_dirty
@@ -86,33 +96,61 @@ namespace librbd {
 		     << " max_dirty_age="
 		     << cct->_conf->rbd_cache_max_dirty_age << dendl;
 
-      object_cacher = new ObjectCacher(cct, pname, *writeback_handler, cache_lock,
-				       NULL, NULL,
-				       cct->_conf->rbd_cache_size,
-				       10,  /* reset this in init */
-				       init_max_dirty,
-				       cct->_conf->rbd_cache_target_dirty,
-				       cct->_conf->rbd_cache_max_dirty_age,
-				       cct->_conf->rbd_cache_block_writes_upfront);
-      object_set = new ObjectCacher::ObjectSet(NULL, data_ctx.get_id(), 0);
-      object_set->return_enoent = true;
-      object_cacher->start();
+      for (int i = 0; i < shards; ++i) {
+	CacheShard *shard = cache_shards[i];
+	Mutex::Locker l(shard->lock);
+	shard->writeback_handler = new LibrbdWriteback(this, shard->lock);
+
+	// keep the perf counters where they were for an unsharded cache
+	string shard_name = pname;
+	if (shards > 1) {
+	  ostringstream ss;
+	  ss << pname << "-" << i;
+	  shard_name = ss.str();
+	}
+	shard->object_cacher =
+	  new ObjectCacher(cct, shard_name, *shard->writeback_handler,
+			   shard->lock, NULL, NULL,
+			   per_cache_shard(cct->_conf->rbd_cache_size),
+			   10,  /* reset this in init */
+			   per_cache_shard(init_max_dirty),
+			   per_cache_shard(cct->_conf->rbd_cache_target_dirty),
+			   cct->_conf->rbd_cache_max_dirty_age,
+			   cct->_conf->rbd_cache_block_writes_upfront);
+	shard->object_set = new ObjectCacher::ObjectSet(NULL,
+							data_ctx.get_id(), 0);
+	shard->object_set->return_enoent = true;
+	shard->object_cacher->start();
+      }
     }
   }
 
+  ImageCtx::CacheShard::CacheShard()
+    : lock("librbd::ImageCtx::cache_lock"),
+      writeback_handler(NULL), object_cacher(NULL), object_set(NULL)
+  {
+  }
+
+  ImageCtx::CacheShard::~CacheShard() {
+    delete object_cacher;
+    delete writeback_handler;
+    delete object_set;
+  }
+
   ImageCtx::~ImageCtx() {
-    perf_stop();
-    if (object_cacher) {
-      delete object_cacher;
-      object_cacher = NULL;
+    if (aio_work_queue) {
+      delete aio_work_queue;
+      aio_work_queue = NULL;
     }
-    if (writeback_handler) {
-      delete writeback_handler;
-      writeback_handler = NULL;
-    }
-    if (object_set) {
-      delete object_set;
-      object_set = NULL;
+    perf_stop();
+    for (vector<CacheShard*>::iterator p = cache_shards.begin();
+	 p != cache_shards.end();
+	 ++p)
+      delete *p;
+    cache_shards.clear();
+    if (write_log) {
+      delete write_log;
+      write_log = NULL;
     }
     delete[] format_string;
   }
@@ -196,7 +234,7 @@ namespace librbd {
     }
 
     // size object cache appropriately
-    if (object_cacher) {
+    if (has_cache()) {
       uint64_t obj = cct->_conf->rbd_cache_max_dirty_object;
       if (!obj) {
         obj = cct->_conf->rbd_cache_size / (1ull << order);
@@ -204,7 +242,12 @@ namespace librbd {
       }
       ldout(cct, 10) << " cache bytes " << cct->_conf->rbd_cache_size << " order " << (int)order
 		     << " -> about " << obj << " objects" << dendl;
-      object_cacher->set_max_objects(obj);
+      for (vector<CacheShard*>::iterator p = cache_shards.begin();
+	   p != cache_shards.end();
+	   ++p) {
+	Mutex::Locker l((*p)->lock);
+	(*p)->object_cacher->set_max_objects(MAX(per_cache_shard(obj), 10));
+      }
     }
 
     ldout(cct, 10) << "init_layout stripe_unit " << stripe_unit
@@ -246,6 +289,11 @@ namespace librbd {
     plb.add_u64_counter(l_librbd_resize, "resize");
     plb.add_u64_counter(l_librbd_readahead, "readahead");
     plb.add_u64_counter(l_librbd_readahead_bytes, "readahead_bytes");
+    plb.add_u64_counter(l_librbd_wlog_append, "wlog_append");
+    plb.add_u64_counter(l_librbd_wlog_append_bytes, "wlog_append_bytes");
+    plb.add_time_avg(l_librbd_wlog_commit_latency, "wlog_commit_latency");
+    plb.add_u64_counter(l_librbd_wlog_destage_bytes, "wlog_destage_bytes");
+    plb.add_u64_counter(l_librbd_copy_on_read, "copy_on_read");
 
     perfcounter = plb.create_perf_counters();
     cct->get_perfcounters_collection()->add(perfcounter);
@@ -471,28 +519,44 @@ namespace librbd {
     return -ENOENT;
   }
 
+  ImageCtx::CacheShard *ImageCtx::get_cache_shard(const object_t &o) const {
+    assert(has_cache());
+    if (cache_shards.size() == 1)
+      return cache_shards[0];
+    uint32_t h = ceph_str_hash_rjenkins(o.name.c_str(), o.name.length());
+    return cache_shards[h % cache_shards.size()];
+  }
+
+  uint64_t ImageCtx::per_cache_shard(uint64_t total) const {
+    if (!total)
+      return 0;
+    return MAX(total / cache_shards.size(), 1);
+  }
+
   void ImageCtx::aio_read_from_cache(object_t o, bufferlist *bl, size_t len,
 				     uint64_t off, Context *onfinish) {
+    CacheShard *shard = get_cache_shard(o);
     snap_lock.get_read();
-    ObjectCacher::OSDRead *rd = object_cacher->prepare_read(snap_id, bl, 0);
+    ObjectCacher::OSDRead *rd = shard->object_cacher->prepare_read(snap_id,
+								   bl, 0);
     snap_lock.put_read();
     ObjectExtent extent(o, 0 /* a lie */, off, len, 0);
     extent.oloc.pool = data_ctx.get_id();
     extent.buffer_extents.push_back(make_pair(0, len));
     rd->extents.push_back(extent);
-    cache_lock.Lock();
-    int r = object_cacher->readx(rd, object_set, onfinish);
-    cache_lock.Unlock();
+    shard->lock.Lock();
+    int r = shard->object_cacher->readx(rd, shard->object_set, onfinish);
+    shard->lock.Unlock();
     if (r != 0)
       onfinish->complete(r);
   }
 
   void ImageCtx::write_to_cache(object_t o, bufferlist& bl, size_t len,
-				uint64_t off, Context *onfinish) {
-    snap_lock.get_read();
-    ObjectCacher::OSDWrite *wr = object_cacher->prepare_write(snapc, bl,
-							      utime_t(), 0);
-    snap_lock.put_read();
+				uint64_t off, const ::SnapContext& write_snapc,
+				Context *onfinish) {
+    CacheShard *shard = get_cache_shard(o);
+    ObjectCacher::OSDWrite *wr =
+      shard->object_cacher->prepare_write(write_snapc, bl, utime_t(), 0);
     ObjectExtent extent(o, 0, off, len, 0);
     extent.oloc.pool = data_ctx.get_id();
     // XXX: nspace is always default, io_ctx_impl field private
@@ -500,8 +564,9 @@ namespace librbd {
     extent.buffer_extents.push_back(make_pair(0, len));
     wr->extents.push_back(extent);
     {
-      Mutex::Locker l(cache_lock);
-      object_cacher->writex(wr, object_set, cache_lock, onfinish);
+      Mutex::Locker l(shard->lock);
+      shard->object_cacher->writex(wr, shard->object_set, shard->lock,
+				   onfinish);
     }
   }
 
@@ -521,7 +586,7 @@ namespace librbd {
   }
 
   void ImageCtx::user_flushed() {
-    if (object_cacher && cct->_conf->rbd_cache_writethrough_until_flush) {
+    if (has_cache() && cct->_conf->rbd_cache_writethrough_until_flush) {
       md_lock.get_read();
       bool flushed_before = flush_encountered;
       md_lock.put_read();
@@ -533,16 +598,25 @@ namespace librbd {
 	md_lock.put_write();
 
 	ldout(cct, 10) << "saw first user flush, enabling writeback" << dendl;
-	Mutex::Locker l(cache_lock);
-	object_cacher->set_max_dirty(max_dirty);
+	for (vector<CacheShard*>::iterator p = cache_shards.begin();
+	     p != cache_shards.end();
+	     ++p) {
+	  Mutex::Locker l((*p)->lock);
+	  (*p)->object_cacher->set_max_dirty(per_cache_shard(max_dirty));
+	}
       }
     }
   }
 
   void ImageCtx::flush_cache_aio(Context *onfinish) {
-    cache_lock.Lock();
-    object_cacher->flush_set(object_set, onfinish);
-    cache_lock.Unlock();
+    C_GatherBuilder gather(cct, onfinish);
+    for (vector<CacheShard*>::iterator p = cache_shards.begin();
+	 p != cache_shards.end();
+	 ++p) {
+      Mutex::Locker l((*p)->lock);
+      (*p)->object_cacher->flush_set((*p)->object_set, gather.new_sub());
+    }
+    gather.activate();
   }
 
   int ImageCtx::flush_cache() {
@@ -566,26 +640,40 @@ namespace librbd {
     md_lock.get_write();
     invalidate_cache();
     md_lock.put_write();
-    object_cacher->stop();
+    for (vector<CacheShard*>::iterator p = cache_shards.begin();
+	 p != cache_shards.end();
+	 ++p)
+      (*p)->object_cacher->stop();
   }
 
   int ImageCtx::invalidate_cache() {
-    if (!object_cacher)
+    if (!has_cache())
       return 0;
-    cache_lock.Lock();
-    object_cacher->release_set(object_set);
-    cache_lock.Unlock();
+    for (vector<CacheShard*>::iterator p = cache_shards.begin();
+	 p != cache_shards.end();
+	 ++p) {
+      Mutex::Locker l((*p)->lock);
+      (*p)->object_cacher->release_set((*p)->object_set);
+    }
     int r = flush_cache();
     if (r == -EBLACKLISTED) {
-      Mutex::Locker l(cache_lock);
       lderr(cct) << "Blacklisted during flush!  Purging cache..." << dendl;
-      object_cacher->purge_set(object_set);
+      for (vector<CacheShard*>::iterator p = cache_shards.begin();
+	   p != cache_shards.end();
+	   ++p) {
+	Mutex::Locker l((*p)->lock);
+	(*p)->object_cacher->purge_set((*p)->object_set);
+      }
     } else if (r) {
       lderr(cct) << "flush_cache returned " << r << dendl;
     }
-    cache_lock.Lock();
-    loff_t unclean = object_cacher->release_set(object_set);
-    cache_lock.Unlock();
+    loff_t unclean = 0;
+    for (vector<CacheShard*>::iterator p = cache_shards.begin();
+	 p != cache_shards.end();
+	 ++p) {
+      Mutex::Locker l((*p)->lock);
+      unclean += (*p)->object_cacher->release_set((*p)->object_set);
+    }
     if (unclean) {
       lderr(cct) << "could not release all objects from cache: "
                  << unclean << " bytes remain" << dendl;
@@ -595,11 +683,33 @@ namespace librbd {
   }
 
   void ImageCtx::clear_nonexistence_cache() {
-    if (!object_cacher)
+    for (vector<CacheShard*>::iterator p = cache_shards.begin();
+	 p != cache_shards.end();
+	 ++p) {
+      Mutex::Locker l((*p)->lock);
+      (*p)->object_cacher->clear_nonexistence((*p)->object_set);
+    }
+  }
+
+  void ImageCtx::discard_cache(vector<ObjectExtent>& extents) {
+    if (cache_shards.size() == 1) {
+      Mutex::Locker l(cache_shards[0]->lock);
+      cache_shards[0]->object_cacher->discard_set(cache_shards[0]->object_set,
+						  extents);
       return;
-    cache_lock.Lock();
-    object_cacher->clear_nonexistence(object_set);
-    cache_lock.Unlock();
+    }
+    map<CacheShard*, vector<ObjectExtent> > by_shard;
+    for (vector<ObjectExtent>::iterator p = extents.begin();
+	 p != extents.end();
+	 ++p)
+      by_shard[get_cache_shard(p->oid)].push_back(*p);
+    for (map<CacheShard*, vector<ObjectExtent> >::iterator p =
+	   by_shard.begin();
+	 p != by_shard.end();
+	 ++p) {
+      Mutex::Locker l(p->first->lock);
+      p->first->object_cacher->discard_set(p->first->object_set, p->second);
+    }
   }
 
   int ImageCtx::register_watch() {
@@ -653,4 +763,35 @@ namespace librbd {
 		   << " from image extents " << objectx << dendl;
     return len;
  }
+
+  /**
+   * claim an object for copy-on-read
+   *
+   * @return false if it is already being copied up, or if
+   * rbd_clone_copy_on_read_max_ops copyups are in flight already
+   */
+  bool ImageCtx::start_copy_on_read(uint64_t object_no)
+  {
+    Mutex::Locker l(copy_on_read_lock);
+    if (copy_on_read_objects.count(object_no) ||
+	copy_on_read_objects.size() >=
+	  (unsigned)cct->_conf->rbd_clone_copy_on_read_max_ops)
+      return false;
+    copy_on_read_objects.insert(object_no);
+    return true;
+  }
+
+  void ImageCtx::finish_copy_on_read(uint64_t object_no)
+  {
+    Mutex::Locker l(copy_on_read_lock);
+    copy_on_read_objects.erase(object_no);
+    copy_on_read_cond.Signal();
+  }
+
+  void ImageCtx::wait_for_copy_on_read()
+  {
+    Mutex::Locker l(copy_on_read_lock);
+    while (!copy_on_read_objects.empty())
+      copy_on_read_cond.Wait(copy_on_read_lock);
+  }
 }
@@ -10,6 +10,7 @@
 #include <string>
 #include <vector>
 
+#include "common/Cond.h"
 #include "common/Mutex.h"
 #include "common/Readahead.h"
 #include "common/RWLock.h"
@@ -30,7 +31,9 @@ class PerfCounters;
 
 namespace librbd {
 
+  class AioWorkQueue;
   class WatchCtx;
+  class WriteLog;
 
   struct ImageCtx {
     CephContext *cct;
@@ -61,15 +64,18 @@ namespace librbd {
 
     /**
      * Lock ordering:
-     * md_lock, cache_lock, snap_lock, parent_lock, refresh_lock
+     * md_lock, CacheShard::lock, snap_lock, parent_lock, refresh_lock,
+     * copy_on_read_lock
+     *
+     * At most one CacheShard::lock is held at a time.
      */
     RWLock md_lock; // protects access to the mutable image metadata that
                    // isn't guarded by other locks below
                    // (size, features, image locks, etc)
-    Mutex cache_lock; // used as client_lock for the ObjectCacher
     RWLock snap_lock; // protects snapshot-related member variables:
     RWLock parent_lock; // protects parent_md and parent
     Mutex refresh_lock; // protects refresh_seq and last_refresh
+    Mutex copy_on_read_lock; // protects copy_on_read_objects
 
     unsigned extra_read_flags;
 
@@ -87,13 +93,30 @@ namespace librbd {
 
     ceph_file_layout layout;
 
-    ObjectCacher *object_cacher;
-    LibrbdWriteback *writeback_handler;
-    ObjectCacher::ObjectSet *object_set;
+    /**
+     * The cache is split by object into rbd_cache_shards ObjectCachers,
+     * each with its own lock, writeback handler and object set, so I/O
+     * to different objects doesn't serialize on one lock.  The size and
+     * dirty limits are divided evenly between the shards.
+     */
+    struct CacheShard {
+      Mutex lock; // used as client_lock for the ObjectCacher
+      LibrbdWriteback *writeback_handler;
+      ObjectCacher *object_cacher;
+      ObjectCacher::ObjectSet *object_set;
+      CacheShard();
+      ~CacheShard();
+    };
+    std::vector<CacheShard*> cache_shards; // empty if caching is off
+    WriteLog *write_log;   // persistent cache, in front of the above
+    AioWorkQueue *aio_work_queue;  // in front of all of it, if enabled
 
     Readahead readahead;
     uint64_t total_bytes_read;
 
+    std::set<uint64_t> copy_on_read_objects; // copyups in flight
+    Cond copy_on_read_cond;
+
     /**
      * Either image_name or image_id must be set.
      * If id is not known, pass the empty std::string,
@@ -140,10 +163,15 @@ namespace librbd {
     uint64_t get_parent_snap_id(librados::snap_t in_snap_id) const;
     int get_parent_overlap(librados::snap_t in_snap_id,
 			   uint64_t *overlap) const;
+    bool has_cache() const {
+      return !cache_shards.empty();
+    }
+    CacheShard *get_cache_shard(const object_t &o) const;
+    uint64_t per_cache_shard(uint64_t total) const;
     void aio_read_from_cache(object_t o, bufferlist *bl, size_t len,
 			     uint64_t off, Context *onfinish);
     void write_to_cache(object_t o, bufferlist& bl, size_t len, uint64_t off,
-			Context *onfinish);
+			const ::SnapContext& write_snapc, Context *onfinish);
     int read_from_cache(object_t o, bufferlist *bl, size_t len, uint64_t off);
     void user_flushed();
     void flush_cache_aio(Context *onfinish);
@@ -151,12 +179,16 @@ namespace librbd {
     void shutdown_cache();
     int invalidate_cache();
     void clear_nonexistence_cache();
+    void discard_cache(vector<ObjectExtent>& extents);
     int register_watch();
     void unregister_watch();
     size_t parent_io_len(uint64_t offset, size_t length,
 			 librados::snap_t in_snap_id);
     uint64_t prune_parent_extents(vector<pair<uint64_t,uint64_t> >& objectx,
 				  uint64_t overlap);
+    bool start_copy_on_read(uint64_t object_no);
+    void finish_copy_on_read(uint64_t object_no);
+    void wait_for_copy_on_read();
 
   };
 }
@@ -0,0 +1,776 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "common/ceph_context.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/perf_counters.h"
+#include "common/safe_io.h"
+#include "include/Context.h"
+#include "include/compat.h"
+#include "include/stringify.h"
+
+#include "librbd/AioCompletion.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/internal.h"
+
+#include "librbd/WriteLog.h"
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::WriteLog: "
+
+#define SUPER_SLOT_LEN  4096
+#define SUPER_LEN       (2 * SUPER_SLOT_LEN)   // two slots, written in turn
+#define SUPER_MAGIC     0x72627763             // "rbwc"
+#define RECORD_MAGIC    0x776c6732             // "wlg2"
+#define HEADER_LEN      44
+#define HEADER_CRC_LEN  40
+
+using std::map;
+using std::multimap;
+using std::pair;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace librbd {
+
+  struct WriteLog::C_Destaged : public Context {
+    WriteLog *wl;
+    Entry *e;
+    C_Destaged(WriteLog *w, Entry *e) : wl(w), e(e) {}
+    void finish(int r) {
+      wl->destaged(e, r);
+    }
+  };
+
+  WriteLog::WriteLog(ImageCtx *ictx, const string &path, uint64_t size,
+		     int max_destage_ops)
+    : append_thread(this), destage_thread(this),
+      ictx(ictx), cct(ictx->cct), path(path), fd(-1),
+      max_destage_ops(max_destage_ops),
+      no_destage(ictx->cct->_conf->rbd_persistent_cache_debug_no_destage),
+      max_chunk(0),
+      lock("librbd::WriteLog::lock"),
+      stopping(false), error(0), next_seq(1), head(0),
+      issued_seq(0), destaged_seq(0), sync_requested(false), backoff(false),
+      max_write_len(0)
+  {
+    super.log_size = size;
+  }
+
+  WriteLog::~WriteLog()
+  {
+    for (map<uint64_t, Entry*>::iterator p = live.begin(); p != live.end(); ++p)
+      delete p->second;
+    if (fd >= 0)
+      VOID_TEMP_FAILURE_RETRY(::close(fd));
+  }
+
+  int WriteLog::init()
+  {
+    uint64_t want_size = super.log_size;
+    if (want_size < (1 << 20)) {
+      lderr(cct) << "rbd_persistent_cache_size must be at least 1MB" << dendl;
+      return -EINVAL;
+    }
+    string key = stringify(ictx->data_ctx.get_id()) + "." + ictx->object_prefix;
+    path += "/" + key + ".wlog";
+
+    fd = ::open(path.c_str(), O_RDWR|O_CREAT, 0600);
+    if (fd < 0) {
+      int r = -errno;
+      lderr(cct) << "error opening " << path << ": " << cpp_strerror(r) << dendl;
+      return r;
+    }
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    if (::flock(fd, LOCK_EX|LOCK_NB) < 0) {
+      int r = -errno;
+      lderr(cct) << path << " is in use by another client: "
+		 << cpp_strerror(r) << dendl;
+      return r;
+    }
+
+    int r = read_super();
+    if (r == -ENOENT) {
+      // new log; make sure nothing older in the file can pass for a record
+      ldout(cct, 1) << "creating " << path << dendl;
+      if (::ftruncate(fd, 0) < 0) {
+	r = -errno;
+	lderr(cct) << "error truncating " << path << ": " << cpp_strerror(r) << dendl;
+	return r;
+      }
+      super = wlog_super_t();
+      super.image_key = key;
+      super.log_size = want_size;
+      r = write_super(super);
+    }
+    if (r < 0)
+      return r;
+    if (super.image_key != key) {
+      lderr(cct) << path << " belongs to image " << super.image_key << dendl;
+      return -EINVAL;
+    }
+
+    r = replay();
+    if (r < 0)
+      return r;
+
+    if (live.empty() && super.log_size != want_size) {
+      ldout(cct, 1) << "resizing log from " << super.log_size << " to "
+		    << want_size << dendl;
+      wlog_super_t s = super;
+      s.log_size = want_size;
+      s.tail = 0;
+      s.tail_seq = next_seq;
+      r = write_super(s);
+      if (r < 0)
+	return r;
+      super = s;
+      head = 0;
+    }
+    // keep a few records in the log at once
+    max_chunk = MIN(super.log_size / 4, 4ull << 20);
+
+    append_thread.create();
+    destage_thread.create();
+    return 0;
+  }
+
+  int WriteLog::shut_down()
+  {
+    ldout(cct, 10) << "shut_down" << dendl;
+    int r = flush();
+
+    lock.Lock();
+    stopping = true;
+    append_cond.Signal();
+    destage_cond.Signal();
+    lock.Unlock();
+
+    append_thread.join();
+    destage_thread.join();
+    return r;
+  }
+
+  uint64_t WriteLog::phys(uint64_t pos) const
+  {
+    return SUPER_LEN + pos % super.log_size;
+  }
+
+  int WriteLog::read_log(uint64_t pos, char *buf, uint64_t len)
+  {
+    uint64_t first = MIN(len, super.log_size - pos % super.log_size);
+    int r = safe_pread_exact(fd, buf, first, phys(pos));
+    if (r == 0 && first < len)
+      r = safe_pread_exact(fd, buf + first, len - first, SUPER_LEN);
+    return r;
+  }
+
+  int WriteLog::write_log(uint64_t pos, bufferlist &bl)
+  {
+    const char *buf = bl.c_str();
+    uint64_t len = bl.length();
+    uint64_t first = MIN(len, super.log_size - pos % super.log_size);
+    int r = safe_pwrite(fd, buf, first, phys(pos));
+    if (r == 0 && first < len)
+      r = safe_pwrite(fd, buf + first, len - first, SUPER_LEN);
+    if (r == 0 && ::fdatasync(fd) < 0)
+      r = -errno;
+    return r;
+  }
+
+  int WriteLog::read_super()
+  {
+    bool found = false;
+    for (int slot = 0; slot < 2; ++slot) {
+      bufferptr bp(SUPER_SLOT_LEN);
+      int r = safe_pread_exact(fd, bp.c_str(), SUPER_SLOT_LEN,
+			       slot * SUPER_SLOT_LEN);
+      if (r < 0)
+	continue;
+      bufferlist bl;
+      bl.append(bp);
+      bufferlist::iterator p = bl.begin();
+      try {
+	uint32_t magic, crc;
+	bufferlist sbl;
+	::decode(magic, p);
+	if (magic != SUPER_MAGIC)
+	  continue;
+	::decode(sbl, p);
+	::decode(crc, p);
+	if (sbl.crc32c(0) != crc) {
+	  ldout(cct, 1) << path << " super block slot " << slot
+			<< " is damaged" << dendl;
+	  continue;
+	}
+	wlog_super_t s;
+	bufferlist::iterator q = sbl.begin();
+	::decode(s, q);
+	if (!found || s.gen > super.gen)
+	  super = s;
+	found = true;
+      } catch (buffer::error& e) {
+	continue;
+      }
+    }
+    if (!found)
+      return -ENOENT;
+    ldout(cct, 10) << "super gen " << super.gen << " tail " << super.tail
+		   << " seq " << super.tail_seq << dendl;
+    return 0;
+  }
+
+  int WriteLog::write_super(wlog_super_t &s)
+  {
+    s.gen++;
+    bufferlist sbl, bl;
+    ::encode(s, sbl);
+    ::encode((uint32_t)SUPER_MAGIC, bl);
+    ::encode(sbl, bl);
+    ::encode(sbl.crc32c(0), bl);
+    assert(bl.length() <= SUPER_SLOT_LEN);
+    bl.append_zero(SUPER_SLOT_LEN - bl.length());
+    int r = safe_pwrite(fd, bl.c_str(), bl.length(),
+			(s.gen % 2) * SUPER_SLOT_LEN);
+    if (r == 0 && ::fdatasync(fd) < 0)
+      r = -errno;
+    if (r < 0)
+      lderr(cct) << "error writing super block to " << path << ": "
+		 << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  uint64_t WriteLog::record_len(int type, uint64_t len, uint32_t snapc_len)
+  {
+    uint64_t n = HEADER_LEN + snapc_len;
+    if (type == ENTRY_WRITE)
+      n += len;
+    return (n + 7) & ~7ull;
+  }
+
+  void WriteLog::encode_record(Entry *e, bufferlist &bl)
+  {
+    bufferlist h;
+    ::encode((uint32_t)RECORD_MAGIC, h);
+    ::encode((uint32_t)e->type, h);
+    ::encode(e->seq, h);
+    ::encode(e->off, h);
+    ::encode(e->len, h);
+    ::encode(e->snapc_len, h);
+    uint32_t dcrc = e->snapc_bl.crc32c(0);
+    if (e->type == ENTRY_WRITE)
+      dcrc = e->data.crc32c(dcrc);
+    ::encode(dcrc, h);
+    uint32_t hcrc = h.crc32c(0);
+    ::encode(hcrc, h);
+    assert(h.length() == HEADER_LEN);
+    bl.claim_append(h);
+    uint64_t pad = e->rec_len - HEADER_LEN - e->snapc_len;
+    bl.claim_append(e->snapc_bl);
+    if (e->type == ENTRY_WRITE) {
+      pad -= e->data.length();
+      bl.claim_append(e->data);
+    }
+    bl.append_zero(pad);
+  }
+
+  int WriteLog::replay()
+  {
+    head = super.tail;
+    next_seq = super.tail_seq;
+    char hdr[HEADER_LEN];
+    while (head - super.tail + HEADER_LEN <= super.log_size) {
+      if (read_log(head, hdr, HEADER_LEN) < 0)
+	break;
+      bufferlist bl;
+      bl.append(hdr, HEADER_LEN);
+      bufferlist::iterator p = bl.begin();
+      uint32_t magic, type, snapc_len, dcrc, hcrc;
+      uint64_t seq, off, len;
+      ::decode(magic, p);
+      ::decode(type, p);
+      ::decode(seq, p);
+      ::decode(off, p);
+      ::decode(len, p);
+      ::decode(snapc_len, p);
+      ::decode(dcrc, p);
+      ::decode(hcrc, p);
+      bufferlist hbl;
+      hbl.substr_of(bl, 0, HEADER_CRC_LEN);
+      if (magic != RECORD_MAGIC || seq != next_seq ||
+	  hbl.crc32c(0) != hcrc ||
+	  type < ENTRY_WRITE || type > ENTRY_FLUSH)
+	break;
+      uint64_t rec_len = record_len(type, len, snapc_len);
+      if (head - super.tail + rec_len > super.log_size)
+	break;
+      uint64_t dlen = snapc_len + (type == ENTRY_WRITE ? len : 0);
+      bufferptr bp(dlen);
+      if (read_log(head + HEADER_LEN, bp.c_str(), dlen) < 0)
+	break;
+      bufferlist dbl, sbl;
+      dbl.append(bp);
+      if (dbl.crc32c(0) != dcrc)
+	break;
+      sbl.substr_of(dbl, 0, snapc_len);
+      ::SnapContext snapc;
+      if (snapc_len) {
+	try {
+	  bufferlist::iterator q = sbl.begin();
+	  ::decode(snapc, q);
+	} catch (buffer::error& err) {
+	  break;
+	}
+      }
+      Entry *e = new Entry(type, off, len);
+      e->snapc = snapc;
+      e->snapc_len = snapc_len;
+      e->seq = seq;
+      e->pos = head;
+      e->rec_len = rec_len;
+      live[seq] = e;
+      dirty.push_back(e);
+      index(e);
+      head += rec_len;
+      ++next_seq;
+    }
+    issued_seq = destaged_seq = super.tail_seq - 1;
+    if (!live.empty())
+      ldout(cct, 0) << "replaying " << live.size() << " entries ("
+		    << head - super.tail << " bytes) from " << path << dendl;
+    return 0;
+  }
+
+  void WriteLog::queue(Entry *e)
+  {
+    e->start = ceph_clock_now(cct);
+    if (e->type != ENTRY_FLUSH) {
+      ::encode(e->snapc, e->snapc_bl);
+      e->snapc_len = e->snapc_bl.length();
+    }
+    e->rec_len = record_len(e->type, e->len, e->snapc_len);
+    lock.Lock();
+    if (error) {
+      int r = error;
+      lock.Unlock();
+      if (e->on_commit)
+	e->on_commit->complete(r);
+      delete e;
+      return;
+    }
+    e->seq = next_seq++;
+    append_q.push_back(e);
+    append_cond.Signal();
+    lock.Unlock();
+  }
+
+  void WriteLog::aio_write(uint64_t off, uint64_t len, const char *buf,
+			   const ::SnapContext& snapc, AioCompletion *c)
+  {
+    ldout(cct, 20) << "aio_write " << off << "~" << len << dendl;
+    for (uint64_t done = 0; done < len; ) {
+      uint64_t n = MIN(len - done, max_chunk);
+      Entry *e = new Entry(ENTRY_WRITE, off + done, n);
+      e->data.append(buf + done, n);
+      e->snapc = snapc;
+      c->add_request();
+      e->on_commit = new C_AioWrite(cct, c);
+      queue(e);
+      done += n;
+    }
+  }
+
+  void WriteLog::aio_discard(uint64_t off, uint64_t len,
+			     const ::SnapContext& snapc, AioCompletion *c)
+  {
+    ldout(cct, 20) << "aio_discard " << off << "~" << len << dendl;
+    Entry *e = new Entry(ENTRY_DISCARD, off, len);
+    e->snapc = snapc;
+    c->add_request();
+    e->on_commit = new C_AioWrite(cct, c);
+    queue(e);
+  }
+
+  void WriteLog::aio_flush(Context *onfinish)
+  {
+    ldout(cct, 20) << "aio_flush" << dendl;
+    Entry *e = new Entry(ENTRY_FLUSH, 0, 0);
+    e->on_commit = onfinish;
+    queue(e);
+  }
+
+  int WriteLog::flush()
+  {
+    Mutex::Locker l(lock);
+    if (no_destage)
+      return error;
+    uint64_t want = next_seq - 1;
+    ldout(cct, 20) << "flush through seq " << want << dendl;
+    while (super.tail_seq <= want && !error) {
+      sync_requested = true;
+      destage_cond.Signal();
+      flush_cond.Wait(lock);
+    }
+    return error;
+  }
+
+  uint64_t WriteLog::read_blocker(const vector<pair<uint64_t,uint64_t> >& image_extents)
+  {
+    Mutex::Locker l(lock);
+    uint64_t seq = 0;
+    for (vector<pair<uint64_t,uint64_t> >::const_iterator p = image_extents.begin();
+	 p != image_extents.end();
+	 ++p) {
+      uint64_t off = p->first, end = p->first + p->second;
+      if (off == end)
+	continue;
+      multimap<uint64_t, Entry*>::iterator q =
+	pending_writes.lower_bound(off > max_write_len ? off - max_write_len : 0);
+      for (; q != pending_writes.end() && q->first < end; ++q) {
+	if (q->first + q->second->len > off)
+	  seq = MAX(seq, q->second->seq);
+      }
+      for (set<Entry*>::iterator q = pending_discards.begin();
+	   q != pending_discards.end();
+	   ++q) {
+	if ((*q)->off < end && (*q)->off + (*q)->len > off)
+	  seq = MAX(seq, (*q)->seq);
+      }
+    }
+    if (seq)
+      ldout(cct, 20) << "read_blocker " << image_extents << " waits for seq "
+		     << seq << dendl;
+    return seq;
+  }
+
+  void WriteLog::wait_destaged(uint64_t seq, Context *onfinish)
+  {
+    lock.Lock();
+    if (destaged_seq < seq) {
+      read_waiters[seq].push_back(onfinish);
+      lock.Unlock();
+      return;
+    }
+    lock.Unlock();
+    onfinish->complete(0);
+  }
+
+  void WriteLog::index(Entry *e)
+  {
+    if (e->type == ENTRY_WRITE) {
+      pending_writes.insert(make_pair(e->off, e));
+      max_write_len = MAX(max_write_len, e->len);
+    } else if (e->type == ENTRY_DISCARD) {
+      pending_discards.insert(e);
+    }
+  }
+
+  void WriteLog::unindex(Entry *e)
+  {
+    if (e->type == ENTRY_WRITE) {
+      pair<multimap<uint64_t, Entry*>::iterator,
+	   multimap<uint64_t, Entry*>::iterator> r =
+	pending_writes.equal_range(e->off);
+      for (multimap<uint64_t, Entry*>::iterator p = r.first; p != r.second; ++p) {
+	if (p->second == e) {
+	  pending_writes.erase(p);
+	  break;
+	}
+      }
+    } else if (e->type == ENTRY_DISCARD) {
+      pending_discards.erase(e);
+    }
+  }
+
+  void WriteLog::append_entry()
+  {
+    ldout(cct, 10) << "append thread start" << dendl;
+    lock.Lock();
+    while (true) {
+      if (append_q.empty()) {
+	if (stopping)
+	  break;
+	append_cond.Wait(lock);
+	continue;
+      }
+      if (error) {
+	// fail anything queued before the error was noticed
+	std::list<Entry*> failed;
+	failed.swap(append_q);
+	int r = error;
+	lock.Unlock();
+	for (std::list<Entry*>::iterator p = failed.begin(); p != failed.end(); ++p) {
+	  if ((*p)->on_commit)
+	    (*p)->on_commit->complete(r);
+	  delete *p;
+	}
+	lock.Lock();
+	continue;
+      }
+
+      // take everything that fits
+      std::list<Entry*> batch;
+      uint64_t start = head, pos = head;
+      while (!append_q.empty()) {
+	Entry *e = append_q.front();
+	if (pos + e->rec_len - super.tail > super.log_size)
+	  break;
+	e->pos = pos;
+	pos += e->rec_len;
+	batch.push_back(e);
+	append_q.pop_front();
+      }
+      if (batch.empty()) {
+	ldout(cct, 10) << "log full, waiting for destage" << dendl;
+	sync_requested = true;
+	destage_cond.Signal();
+	append_cond.Wait(lock);
+	continue;
+      }
+      lock.Unlock();
+
+      bufferlist bl;
+      uint64_t bytes = 0;
+      std::list<pair<Context*, utime_t> > commits;
+      for (std::list<Entry*>::iterator p = batch.begin(); p != batch.end(); ++p) {
+	if ((*p)->type == ENTRY_WRITE)
+	  bytes += (*p)->len;
+	if ((*p)->on_commit)
+	  commits.push_back(make_pair((*p)->on_commit, (*p)->start));
+	(*p)->on_commit = NULL;
+	encode_record(*p, bl);
+      }
+      int r = write_log(start, bl);
+      ldout(cct, 20) << "appended " << batch.size() << " entries at " << start
+		     << ": " << cpp_strerror(r) << dendl;
+
+      lock.Lock();
+      if (r < 0) {
+	lderr(cct) << "error writing to " << path << ": " << cpp_strerror(r)
+		   << dendl;
+	error = r;
+	flush_cond.SignalAll();
+	for (std::list<Entry*>::iterator p = batch.begin(); p != batch.end(); ++p)
+	  delete *p;
+      } else {
+	head = pos;
+	for (std::list<Entry*>::iterator p = batch.begin(); p != batch.end(); ++p) {
+	  live[(*p)->seq] = *p;
+	  dirty.push_back(*p);
+	  index(*p);
+	}
+	destage_cond.Signal();
+      }
+      lock.Unlock();
+
+      utime_t now = ceph_clock_now(cct);
+      ictx->perfcounter->inc(l_librbd_wlog_append, batch.size());
+      ictx->perfcounter->inc(l_librbd_wlog_append_bytes, bytes);
+      for (std::list<pair<Context*, utime_t> >::iterator p = commits.begin();
+	   p != commits.end();
+	   ++p) {
+	ictx->perfcounter->tinc(l_librbd_wlog_commit_latency, now - p->second);
+	p->first->complete(r);
+      }
+      lock.Lock();
+    }
+    lock.Unlock();
+    ldout(cct, 10) << "append thread finish" << dendl;
+  }
+
+  void WriteLog::destage_entry()
+  {
+    ldout(cct, 10) << "destage thread start" << dendl;
+    lock.Lock();
+    while (true) {
+      if (no_destage) {
+	// leave it all for the next open, as if we had crashed
+	if (stopping)
+	  break;
+	destage_cond.Wait(lock);
+	continue;
+      }
+      if (backoff) {
+	// the cluster said no; give it a moment before trying again
+	backoff = false;
+	destage_cond.WaitInterval(cct, lock, utime_t(1, 0));
+	continue;
+      }
+      bool idle = dirty.empty() && in_flight.empty();
+      if (in_flight.empty() && destaged_seq >= super.tail_seq && !error &&
+	  (sync_requested || idle)) {
+	sync();
+	continue;
+      }
+      if (stopping && in_flight.empty() && (idle || error))
+	break;
+      if (!dirty.empty() && (int)in_flight.size() < max_destage_ops) {
+	Entry *e = dirty.front();
+	if (e->type == ENTRY_FLUSH) {
+	  if (!in_flight.empty()) {
+	    destage_cond.Wait(lock);
+	    continue;
+	  }
+	  // everything before the flush is below us; make it stable
+	  dirty.pop_front();
+	  issued_seq = e->seq;
+	  std::list<Context*> ls;
+	  finish_destaged(&ls);
+	  if (!ls.empty()) {
+	    lock.Unlock();
+	    finish_contexts(cct, ls, 0);
+	    lock.Lock();
+	  }
+	  sync();
+	  continue;
+	}
+	// don't let overlapping writes race each other
+	bool overlaps = false;
+	for (set<uint64_t>::iterator p = in_flight.begin(); p != in_flight.end(); ++p) {
+	  Entry *o = live[*p];
+	  if (o->off < e->off + e->len && e->off < o->off + o->len) {
+	    overlaps = true;
+	    break;
+	  }
+	}
+	if (overlaps) {
+	  destage_cond.Wait(lock);
+	  continue;
+	}
+	dirty.pop_front();
+	issued_seq = e->seq;
+	in_flight.insert(e->seq);
+	lock.Unlock();
+	issue(e);
+	lock.Lock();
+	continue;
+      }
+      destage_cond.Wait(lock);
+    }
+    lock.Unlock();
+    ldout(cct, 10) << "destage thread finish" << dendl;
+  }
+
+  void WriteLog::issue(Entry *e)
+  {
+    ldout(cct, 20) << "destaging seq " << e->seq << " " << e->off << "~"
+		   << e->len << " snapc " << e->snapc << dendl;
+    Context *ctx = new C_Destaged(this, e);
+    AioCompletion *c = aio_create_completion_internal(ctx, rbd_ctx_cb);
+    int r;
+    if (e->type == ENTRY_WRITE) {
+      bufferptr bp(e->len);
+      r = read_log(e->pos + HEADER_LEN + e->snapc_len, bp.c_str(), e->len);
+      if (r < 0)
+	lderr(cct) << "error reading " << path << ": " << cpp_strerror(r)
+		   << dendl;
+      else
+	r = librbd::aio_write(ictx, e->off, e->len, bp.c_str(), c, &e->snapc);
+    } else {
+      r = librbd::aio_discard(ictx, e->off, e->len, c, &e->snapc);
+    }
+    if (r < 0) {
+      c->release();
+      delete ctx;
+      destaged(e, r);
+    }
+  }
+
+  void WriteLog::destaged(Entry *e, int r)
+  {
+    ldout(cct, 20) << "destaged seq " << e->seq << ": " << cpp_strerror(r)
+		   << dendl;
+    std::list<Context*> ls;
+    lock.Lock();
+    in_flight.erase(e->seq);
+    if (r == -EINVAL) {
+      // the image shrank underneath this write
+      ldout(cct, 1) << "dropping " << e->off << "~" << e->len
+		    << " past the end of the image" << dendl;
+      r = 0;
+    }
+    if (r < 0) {
+      lderr(cct) << "error destaging " << e->off << "~" << e->len << ": "
+		 << cpp_strerror(r) << ", will retry" << dendl;
+      std::list<Entry*>::iterator p = dirty.begin();
+      while (p != dirty.end() && (*p)->seq < e->seq)
+	++p;
+      dirty.insert(p, e);
+      backoff = true;
+    } else {
+      unindex(e);
+      if (e->type == ENTRY_WRITE)
+	ictx->perfcounter->inc(l_librbd_wlog_destage_bytes, e->len);
+    }
+    finish_destaged(&ls);
+    destage_cond.Signal();
+    lock.Unlock();
+    finish_contexts(cct, ls, 0);
+  }
+
+  void WriteLog::finish_destaged(std::list<Context*> *ls)
+  {
+    assert(lock.is_locked());
+    uint64_t seq = issued_seq;
+    if (!in_flight.empty())
+      seq = MIN(seq, *in_flight.begin() - 1);
+    if (!dirty.empty())
+      seq = MIN(seq, dirty.front()->seq - 1);
+    destaged_seq = seq;
+    while (!read_waiters.empty() && read_waiters.begin()->first <= seq) {
+      ls->splice(ls->end(), read_waiters.begin()->second);
+      read_waiters.erase(read_waiters.begin());
+    }
+  }
+
+  int WriteLog::flush_lower()
+  {
+    if (ictx->has_cache())
+      return ictx->flush_cache();
+    return ictx->data_ctx.aio_flush();
+  }
+
+  void WriteLog::sync()
+  {
+    assert(lock.is_locked());
+    uint64_t seq = destaged_seq;
+    ldout(cct, 20) << "sync through seq " << seq << dendl;
+    lock.Unlock();
+    int r = flush_lower();
+    lock.Lock();
+    if (r < 0) {
+      lderr(cct) << "error flushing destaged writes: " << cpp_strerror(r)
+		 << dendl;
+      backoff = true;
+      return;
+    }
+
+    // the space must not be reused until the new tail is on disk
+    wlog_super_t s = super;
+    map<uint64_t, Entry*>::iterator p = live.begin();
+    while (p != live.end() && p->first <= seq) {
+      s.tail = p->second->pos + p->second->rec_len;
+      delete p->second;
+      live.erase(p++);
+    }
+    s.tail_seq = seq + 1;
+    lock.Unlock();
+    r = write_super(s);
+    lock.Lock();
+    if (r < 0) {
+      error = r;
+    } else {
+      super = s;
+    }
+    sync_requested = false;
+    append_cond.Signal();
+    flush_cond.SignalAll();
+  }
+}
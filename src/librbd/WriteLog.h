@@ -0,0 +1,221 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#ifndef CEPH_LIBRBD_WRITELOG_H
+#define CEPH_LIBRBD_WRITELOG_H
+
+#include "include/int_types.h"
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
+#include "common/snap_types.h"
+#include "include/buffer.h"
+#include "include/encoding.h"
+
+class Context;
+
+namespace librbd {
+
+  struct AioCompletion;
+  struct ImageCtx;
+
+  /// the log file starts with two copies of this, written in turn
+  struct wlog_super_t {
+    std::string image_key;  ///< pool id and object prefix of the image
+    uint64_t log_size;      ///< bytes of record space after the super block
+    uint64_t tail;          ///< log position of the oldest live record
+    uint64_t tail_seq;      ///< and its sequence number
+    uint64_t gen;           ///< picks the newer of the two copies
+
+    wlog_super_t() : log_size(0), tail(0), tail_seq(1), gen(0) {}
+
+    void encode(bufferlist &bl) const {
+      ENCODE_START(1, 1, bl);
+      ::encode(image_key, bl);
+      ::encode(log_size, bl);
+      ::encode(tail, bl);
+      ::encode(tail_seq, bl);
+      ::encode(gen, bl);
+      ENCODE_FINISH(bl);
+    }
+    void decode(bufferlist::iterator &p) {
+      DECODE_START(1, p);
+      ::decode(image_key, p);
+      ::decode(log_size, p);
+      ::decode(tail, p);
+      ::decode(tail_seq, p);
+      ::decode(gen, p);
+      DECODE_FINISH(p);
+    }
+  };
+
+  /**
+   * A persistent write-back log for an image on a local file.
+   *
+   * Writes, discards and flushes are appended to the log in the order
+   * they are submitted and acknowledged once the log is fdatasync'ed,
+   * so a guest flush costs a local sync rather than a round trip to
+   * the OSDs.  Appends that queue up behind a sync share the next one.
+   *
+   * A destage thread replays the log onto the image in the background.
+   * Entries between two flushes are written concurrently; a flush entry
+   * waits for everything before it and then flushes the layers below
+   * (the ObjectCacher and librados), so the image in RADOS always holds
+   * a state the guest could have seen after a crash.  The log tail only
+   * moves past entries that are stable below it.
+   *
+   * Reads that overlap entries not yet destaged wait until they are.
+   *
+   * If the client dies, the next open of the image on this host replays
+   * whatever is left in the log.  Each write and discard is destaged
+   * under the snap context it was logged with, so a snapshot taken
+   * while it sat in the log does not pick it up, replay or not.
+   *
+   * Log records are a fixed 44 byte header (magic, type, sequence
+   * number, image extent, snap context length, data and header crc)
+   * followed by the snap context and the data.
+   * Replay stops at the first record that fails its checks, which is
+   * where the log was when the client went away.
+   */
+  class WriteLog {
+  public:
+    WriteLog(ImageCtx *ictx, const std::string &path, uint64_t size,
+	     int max_destage_ops);
+    ~WriteLog();
+
+    /// open or create the log and start replaying what is in it
+    int init();
+    /// destage everything and stop
+    int shut_down();
+
+    void aio_write(uint64_t off, uint64_t len, const char *buf,
+		   const ::SnapContext& snapc, AioCompletion *c);
+    void aio_discard(uint64_t off, uint64_t len, const ::SnapContext& snapc,
+		     AioCompletion *c);
+    /// onfinish runs once everything before it is in the log
+    void aio_flush(Context *onfinish);
+
+    /// destage everything submitted so far and flush it below us
+    int flush();
+
+    /**
+     * find what a read must wait for
+     *
+     * @return the seq of the newest entry not yet destaged that overlaps
+     * image_extents, or 0 if the read can go ahead
+     */
+    uint64_t read_blocker(const std::vector<std::pair<uint64_t,uint64_t> >& image_extents);
+    /// complete onfinish once entries through seq are destaged, now if
+    /// they already are
+    void wait_destaged(uint64_t seq, Context *onfinish);
+
+  private:
+    enum {
+      ENTRY_WRITE = 1,
+      ENTRY_DISCARD = 2,
+      ENTRY_FLUSH = 3,
+    };
+
+    struct Entry {
+      int type;
+      uint64_t seq;
+      uint64_t off, len;   ///< image extent
+      uint64_t pos;        ///< log position of the record
+      uint64_t rec_len;    ///< header, snap context and data, padded
+      ::SnapContext snapc; ///< to destage under
+      bufferlist snapc_bl; ///< encoded snapc, until it is in the log
+      uint32_t snapc_len;
+      bufferlist data;     ///< until it is in the log
+      Context *on_commit;
+      utime_t start;
+
+      Entry(int t, uint64_t o, uint64_t l)
+	: type(t), seq(0), off(o), len(l), pos(0), rec_len(0), snapc_len(0),
+	  on_commit(NULL) {}
+    };
+
+    class AppendThread : public Thread {
+      WriteLog *wl;
+    public:
+      AppendThread(WriteLog *w) : wl(w) {}
+      void *entry() {
+	wl->append_entry();
+	return 0;
+      }
+    } append_thread;
+
+    class DestageThread : public Thread {
+      WriteLog *wl;
+    public:
+      DestageThread(WriteLog *w) : wl(w) {}
+      void *entry() {
+	wl->destage_entry();
+	return 0;
+      }
+    } destage_thread;
+
+    struct C_Destaged;
+
+    ImageCtx *ictx;
+    CephContext *cct;
+    std::string path;
+    int fd;
+    int max_destage_ops;
+    bool no_destage;        ///< rbd_persistent_cache_debug_no_destage
+    wlog_super_t super;
+    uint64_t max_chunk;     ///< largest write we log as one record
+
+    Mutex lock;
+    Cond append_cond, destage_cond, flush_cond;
+    bool stopping;
+    int error;              ///< sticky log write error
+
+    uint64_t next_seq;
+    uint64_t head;                        ///< where the next record goes
+    std::list<Entry*> append_q;           ///< waiting to be logged
+    std::map<uint64_t, Entry*> live;      ///< logged and not yet trimmed
+    std::list<Entry*> dirty;              ///< logged, destage not started
+    std::set<uint64_t> in_flight;         ///< being destaged
+    uint64_t issued_seq;                  ///< last entry handed to destage
+    uint64_t destaged_seq;                ///< all before are below us
+    bool sync_requested;
+    bool backoff;                         ///< destage failed; wait a bit
+
+    // not yet destaged, for read_blocker
+    std::multimap<uint64_t, Entry*> pending_writes;
+    std::set<Entry*> pending_discards;
+    uint64_t max_write_len;
+    std::map<uint64_t, std::list<Context*> > read_waiters;
+
+    uint64_t phys(uint64_t pos) const;
+    int read_log(uint64_t pos, char *buf, uint64_t len);
+    int write_log(uint64_t pos, bufferlist &bl);
+    int read_super();
+    int write_super(wlog_super_t &s);
+    int replay();
+    static uint64_t record_len(int type, uint64_t len, uint32_t snapc_len);
+    void encode_record(Entry *e, bufferlist &bl);
+
+    void queue(Entry *e);
+    void append_entry();
+
+    void destage_entry();
+    void issue(Entry *e);
+    void destaged(Entry *e, int r);
+    void finish_destaged(std::list<Context*> *ls);
+    int flush_lower();
+    void sync();
+    void index(Entry *e);
+    void unindex(Entry *e);
+  };
+}
+
+WRITE_CLASS_ENCODER(librbd::wlog_super_t)
+
+#endif
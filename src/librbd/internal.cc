@@ -16,7 +16,9 @@
 
 #include "librbd/AioCompletion.h"
 #include "librbd/AioRequest.h"
+#include "librbd/AioWorkQueue.h"
 #include "librbd/ImageCtx.h"
+#include "librbd/WriteLog.h"
 
 #include "librbd/internal.h"
 #include "librbd/parent_types.h"
@@ -1547,8 +1549,15 @@ reprotect_and_return_err:
       return r;
     }
 
+    if (ictx->write_log) {
+      // destage before the objects go away underneath the log
+      r = ictx->write_log->flush();
+      if (r < 0)
+	return r;
+    }
+
     RWLock::WLocker l(ictx->md_lock);
-    if (size < ictx->size && ictx->object_cacher) {
+    if (size < ictx->size && ictx->has_cache()) {
       // need to invalidate since we're deleting objects, and
       // ObjectCacher doesn't track non-existent objects
       r = ictx->invalidate_cache();
@@ -2106,7 +2115,9 @@ reprotect_and_return_err:
     // ignore return value, since we may be set to a non-existent
     // snapshot and the user is trying to fix that
     ictx_check(ictx);
-    if (ictx->object_cacher) {
+    if (ictx->write_log)
+      ictx->write_log->flush();
+    if (ictx->has_cache()) {
       // complete pending writes before we're set to a snapshot and
       // get -EROFS for writes
       RWLock::WLocker l(ictx->md_lock);
@@ -2144,6 +2155,23 @@ reprotect_and_return_err:
     if ((r = _snap_set(ictx, ictx->snap_name.c_str())) < 0)
       goto err_close;
 
+    if (ictx->cct->_conf->rbd_persistent_cache && !ictx->read_only &&
+	ictx->snap_id == CEPH_NOSNAP) {
+      // replays anything a previous client left behind
+      WriteLog *wl = new WriteLog(ictx,
+				  ictx->cct->_conf->rbd_persistent_cache_path,
+				  ictx->cct->_conf->rbd_persistent_cache_size,
+				  ictx->cct->_conf->rbd_persistent_cache_max_destage_ops);
+      r = wl->init();
+      if (r < 0) {
+	lderr(ictx->cct) << "error opening persistent cache: "
+			 << cpp_strerror(r) << dendl;
+	delete wl;
+	goto err_close;
+      }
+      ictx->write_log = wl;
+    }
+
     return 0;
 
   err_close:
@@ -2155,9 +2183,19 @@ reprotect_and_return_err:
   {
     ldout(ictx->cct, 20) << "close_image " << ictx << dendl;
 
+    if (ictx->aio_work_queue)
+      ictx->aio_work_queue->drain();
     ictx->readahead.wait_for_pending();
+    ictx->wait_for_copy_on_read();
+
+    if (ictx->write_log) {
+      ictx->write_log->shut_down();
+      // anything after this goes straight to the image
+      delete ictx->write_log;
+      ictx->write_log = NULL;
+    }
 
-    if (ictx->object_cacher)
+    if (ictx->has_cache())
       ictx->shutdown_cache(); // implicitly flushes
     else
       flush(ictx);
@@ -2886,7 +2924,10 @@ reprotect_and_return_err:
     c->add_request();
     c->init_time(ictx, AIO_TYPE_FLUSH);
     C_AioWrite *req_comp = new C_AioWrite(cct, c);
-    if (ictx->object_cacher) {
+    if (ictx->write_log) {
+      // everything before this is durable once it is in the log
+      ictx->write_log->aio_flush(req_comp);
+    } else if (ictx->has_cache()) {
       ictx->flush_cache_aio(req_comp);
     } else {
       librados::AioCompletion *rados_completion =
@@ -2911,8 +2952,17 @@ reprotect_and_return_err:
       return r;
     }
 
+    if (ictx->aio_work_queue)
+      ictx->aio_work_queue->drain();
+
     ictx->user_flushed();
-    r = _flush(ictx);
+    if (ictx->write_log) {
+      C_SaferCond ctx;
+      ictx->write_log->aio_flush(&ctx);
+      r = ctx.wait();
+    } else {
+      r = _flush(ictx);
+    }
     ictx->perfcounter->inc(l_librbd_flush);
     return r;
   }
@@ -2922,7 +2972,10 @@ reprotect_and_return_err:
     CephContext *cct = ictx->cct;
     int r;
     // flush any outstanding writes
-    if (ictx->object_cacher) {
+    if (ictx->write_log) {
+      // destaging flushes the cache and librados for us
+      r = ictx->write_log->flush();
+    } else if (ictx->has_cache()) {
       r = ictx->flush_cache();
     } else {
       r = ictx->data_ctx.aio_flush();
@@ -2950,13 +3003,15 @@ reprotect_and_return_err:
   }
 
   int aio_write(ImageCtx *ictx, uint64_t off, size_t len, const char *buf,
-		AioCompletion *c)
+		AioCompletion *c, const ::SnapContext *destage_snapc)
   {
     CephContext *cct = ictx->cct;
     ldout(cct, 20) << "aio_write " << ictx << " off = " << off << " len = "
 		   << len << " buf = " << (void*)buf << dendl;
 
-    int r = ictx_check(ictx);
+    // the destage may run while md_lock is held for a refresh
+    bool bypass_log = destage_snapc != NULL;
+    int r = bypass_log ? 0 : ictx_check(ictx);
     if (r < 0) {
       return r;
     }
@@ -2975,11 +3030,24 @@ reprotect_and_return_err:
     ictx->get_parent_overlap(ictx->snap_id, &overlap);
     ictx->parent_lock.put_read();
     ictx->snap_lock.put_read();
+    if (destage_snapc)
+      snapc = *destage_snapc;
 
     if (snap_id != CEPH_NOSNAP || ictx->read_only) {
       return -EROFS;
     }
 
+    if (ictx->write_log && !bypass_log) {
+      c->get();
+      c->init_time(ictx, AIO_TYPE_WRITE);
+      ictx->write_log->aio_write(off, mylen, buf, snapc, c);
+      c->finish_adding_requests(cct);
+      c->put();
+      ictx->perfcounter->inc(l_librbd_aio_wr);
+      ictx->perfcounter->inc(l_librbd_aio_wr_bytes, mylen);
+      return 0;
+    }
+
     ldout(cct, 20) << "  parent overlap " << overlap << dendl;
 
     // map
@@ -3003,9 +3071,10 @@ reprotect_and_return_err:
       }
 
       C_AioWrite *req_comp = new C_AioWrite(cct, c);
-      if (ictx->object_cacher) {
+      if (ictx->has_cache()) {
 	c->add_request();
-	ictx->write_to_cache(p->oid, bl, p->length, p->offset, req_comp);
+	ictx->write_to_cache(p->oid, bl, p->length, p->offset, snapc,
+			     req_comp);
       } else {
 	// reverse map this object extent onto the parent
 	vector<pair<uint64_t,uint64_t> > objectx;
@@ -3027,20 +3096,24 @@ reprotect_and_return_err:
     c->finish_adding_requests(ictx->cct);
     c->put();
 
-    ictx->perfcounter->inc(l_librbd_aio_wr);
-    ictx->perfcounter->inc(l_librbd_aio_wr_bytes, mylen);
+    if (!bypass_log) {
+      ictx->perfcounter->inc(l_librbd_aio_wr);
+      ictx->perfcounter->inc(l_librbd_aio_wr_bytes, mylen);
+    }
 
     /* FIXME: cleanup all the allocated stuff */
     return r;
   }
 
-  int aio_discard(ImageCtx *ictx, uint64_t off, uint64_t len, AioCompletion *c)
+  int aio_discard(ImageCtx *ictx, uint64_t off, uint64_t len, AioCompletion *c,
+		  const ::SnapContext *destage_snapc)
   {
     CephContext *cct = ictx->cct;
     ldout(cct, 20) << "aio_discard " << ictx << " off = " << off << " len = "
 		   << len << dendl;
 
-    int r = ictx_check(ictx);
+    bool bypass_log = destage_snapc != NULL;
+    int r = bypass_log ? 0 : ictx_check(ictx);
     if (r < 0) {
       return r;
     }
@@ -3059,11 +3132,24 @@ reprotect_and_return_err:
     ictx->get_parent_overlap(ictx->snap_id, &overlap);
     ictx->parent_lock.put_read();
     ictx->snap_lock.put_read();
+    if (destage_snapc)
+      snapc = *destage_snapc;
 
     if (snap_id != CEPH_NOSNAP || ictx->read_only) {
       return -EROFS;
     }
 
+    if (ictx->write_log && !bypass_log) {
+      c->get();
+      c->init_time(ictx, AIO_TYPE_DISCARD);
+      ictx->write_log->aio_discard(off, len, snapc, c);
+      c->finish_adding_requests(cct);
+      c->put();
+      ictx->perfcounter->inc(l_librbd_aio_discard);
+      ictx->perfcounter->inc(l_librbd_aio_discard_bytes, len);
+      return 0;
+    }
+
     // map
     vector<ObjectExtent> extents;
     if (len > 0) {
@@ -3108,16 +3194,16 @@ reprotect_and_return_err:
     }
     r = 0;
   done:
-    if (ictx->object_cacher) {
-      Mutex::Locker l(ictx->cache_lock);
-      ictx->object_cacher->discard_set(ictx->object_set, extents);
-    }
+    if (ictx->has_cache())
+      ictx->discard_cache(extents);
 
     c->finish_adding_requests(ictx->cct);
     c->put();
 
-    ictx->perfcounter->inc(l_librbd_aio_discard);
-    ictx->perfcounter->inc(l_librbd_aio_discard_bytes, len);
+    if (!bypass_log) {
+      ictx->perfcounter->inc(l_librbd_aio_discard);
+      ictx->perfcounter->inc(l_librbd_aio_discard_bytes, len);
+    }
 
     /* FIXME: cleanup all the allocated stuff */
     return r;
@@ -3198,6 +3284,23 @@ reprotect_and_return_err:
     }
   }
 
+  struct C_RetryRead : public Context {
+    ImageCtx *ictx;
+    vector<pair<uint64_t,uint64_t> > image_extents;
+    char *buf;
+    bufferlist *pbl;
+    AioCompletion *c;
+    C_RetryRead(ImageCtx *ictx,
+		const vector<pair<uint64_t,uint64_t> >& image_extents,
+		char *buf, bufferlist *pbl, AioCompletion *c)
+      : ictx(ictx), image_extents(image_extents), buf(buf), pbl(pbl), c(c) {}
+    void finish(int r) {
+      r = aio_read(ictx, image_extents, buf, pbl, c);
+      if (r < 0)
+	c->fail(ictx, AIO_TYPE_READ, r);
+    }
+  };
+
   int aio_read(ImageCtx *ictx, const vector<pair<uint64_t,uint64_t> >& image_extents,
 	       char *buf, bufferlist *pbl, AioCompletion *c)
   {
@@ -3214,7 +3317,7 @@ reprotect_and_return_err:
 
     // readahead
     const md_config_t *conf = ictx->cct->_conf;
-    if (ictx->object_cacher && conf->rbd_readahead_max_bytes > 0) {
+    if (ictx->has_cache() && conf->rbd_readahead_max_bytes > 0) {
       readahead(ictx, image_extents, conf);
     }
 
@@ -3238,6 +3341,16 @@ reprotect_and_return_err:
       buffer_ofs += len;
     }
 
+    if (ictx->write_log) {
+      uint64_t seq = ictx->write_log->read_blocker(image_extents);
+      if (seq) {
+	// comes back here once the writes it overlaps are destaged
+	ictx->write_log->wait_destaged(seq, new C_RetryRead(ictx, image_extents,
+							    buf, pbl, c));
+	return buffer_ofs;
+      }
+    }
+
     int64_t ret;
 
     c->read_buf = buf;
@@ -3259,7 +3372,7 @@ reprotect_and_return_err:
 	req_comp->set_req(req);
 	c->add_request();
 
-	if (ictx->object_cacher) {
+	if (ictx->has_cache()) {
 	  C_CacheRead *cache_comp = new C_CacheRead(req);
 	  ictx->aio_read_from_cache(q->oid, &req->data(),
 				    q->length, q->offset,
@@ -10,6 +10,7 @@
 #include <string>
 #include <vector>
 
+#include "common/snap_types.h"
 #include "include/buffer.h"
 #include "include/rbd/librbd.hpp"
 #include "include/rbd_types.h"
@@ -50,6 +51,13 @@ enum {
   l_librbd_readahead,
   l_librbd_readahead_bytes,
 
+  l_librbd_wlog_append,
+  l_librbd_wlog_append_bytes,
+  l_librbd_wlog_commit_latency,
+  l_librbd_wlog_destage_bytes,
+
+  l_librbd_copy_on_read,     // objects copied up from the parent on read
+
   l_librbd_last,
 };
 
@@ -182,9 +190,13 @@ namespace librbd {
 	       char *buf, bufferlist *pbl);
   ssize_t write(ImageCtx *ictx, uint64_t off, size_t len, const char *buf);
   int discard(ImageCtx *ictx, uint64_t off, uint64_t len);
+  // destage_snapc is for the persistent cache's destage of its own
+  // entries: skip the log and write under the snap context they were
+  // logged with
   int aio_write(ImageCtx *ictx, uint64_t off, size_t len, const char *buf,
-		AioCompletion *c);
-  int aio_discard(ImageCtx *ictx, uint64_t off, uint64_t len, AioCompletion *c);
+		AioCompletion *c, const ::SnapContext *destage_snapc=NULL);
+  int aio_discard(ImageCtx *ictx, uint64_t off, uint64_t len, AioCompletion *c,
+		  const ::SnapContext *destage_snapc=NULL);
   int aio_read(ImageCtx *ictx, uint64_t off, size_t len,
 	       char *buf, bufferlist *pbl, AioCompletion *c);
   int aio_read(ImageCtx *ictx, const vector<pair<uint64_t,uint64_t> >& image_extents,
@@ -25,6 +25,7 @@
 #include "osdc/ObjectCacher.h"
 
 #include "librbd/AioCompletion.h"
+#include "librbd/AioWorkQueue.h"
 #include "cls/rbd/cls_rbd_client.h"
 #include "librbd/ImageCtx.h"
 #include "librbd/internal.h"
@@ -663,8 +664,13 @@ namespace librbd {
       tracepoint(librbd, aio_write_exit, -EINVAL);
       return -EINVAL;
     }
-    int r = librbd::aio_write(ictx, off, len, bl.c_str(),
-			     (librbd::AioCompletion *)c->pc);
+    int r = 0;
+    if (ictx->aio_work_queue)
+      ictx->aio_work_queue->aio_write(off, len, bl,
+				      (librbd::AioCompletion *)c->pc);
+    else
+      r = librbd::aio_write(ictx, off, len, bl.c_str(),
+			    (librbd::AioCompletion *)c->pc);
     tracepoint(librbd, aio_write_exit, r);
     return r;
   }
@@ -673,7 +679,11 @@ namespace librbd {
   {
     ImageCtx *ictx = (ImageCtx *)ctx;
     tracepoint(librbd, aio_discard_enter, ictx, ictx->name.c_str(), ictx->snap_name.c_str(), ictx->read_only, off, len, c->pc);
-    int r = librbd::aio_discard(ictx, off, len, (librbd::AioCompletion *)c->pc);
+    int r = 0;
+    if (ictx->aio_work_queue)
+      ictx->aio_work_queue->aio_discard(off, len, (librbd::AioCompletion *)c->pc);
+    else
+      r = librbd::aio_discard(ictx, off, len, (librbd::AioCompletion *)c->pc);
     tracepoint(librbd, aio_discard_exit, r);
     return r;
   }
@@ -685,7 +695,13 @@ namespace librbd {
     tracepoint(librbd, aio_read_enter, ictx, ictx->name.c_str(), ictx->snap_name.c_str(), ictx->read_only, off, len, bl.c_str(), c->pc);
     ldout(ictx->cct, 10) << "Image::aio_read() buf=" << (void *)bl.c_str() << "~"
 			 << (void *)(bl.c_str() + len - 1) << dendl;
-    int r = librbd::aio_read(ictx, off, len, NULL, &bl, (librbd::AioCompletion *)c->pc);
+    int r = 0;
+    if (ictx->aio_work_queue)
+      ictx->aio_work_queue->aio_read(off, len, NULL, &bl,
+				     (librbd::AioCompletion *)c->pc);
+    else
+      r = librbd::aio_read(ictx, off, len, NULL, &bl,
+			   (librbd::AioCompletion *)c->pc);
     tracepoint(librbd, aio_read_exit, r);
     return r;
   }
@@ -703,7 +719,11 @@ namespace librbd {
   {
     ImageCtx *ictx = (ImageCtx *)ctx;
     tracepoint(librbd, aio_flush_enter, ictx, ictx->name.c_str(), ictx->snap_name.c_str(), ictx->read_only, c->pc);
-    int r = librbd::aio_flush(ictx, (librbd::AioCompletion *)c->pc);
+    int r = 0;
+    if (ictx->aio_work_queue)
+      ictx->aio_work_queue->aio_flush((librbd::AioCompletion *)c->pc);
+    else
+      r = librbd::aio_flush(ictx, (librbd::AioCompletion *)c->pc);
     tracepoint(librbd, aio_flush_exit, r);
     return r;
   }
@@ -1493,8 +1513,13 @@ extern "C" int rbd_aio_write(rbd_image_t image, uint64_t off, size_t len,
   librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
   librbd::RBD::AioCompletion *comp = (librbd::RBD::AioCompletion *)c;
   tracepoint(librbd, aio_write_enter, ictx, ictx->name.c_str(), ictx->snap_name.c_str(), ictx->read_only, off, len, buf, comp->pc);
-  int r = librbd::aio_write(ictx, off, len, buf,
-			   (librbd::AioCompletion *)comp->pc);
+  int r = 0;
+  if (ictx->aio_work_queue)
+    ictx->aio_work_queue->aio_write(off, len, buf,
+				    (librbd::AioCompletion *)comp->pc);
+  else
+    r = librbd::aio_write(ictx, off, len, buf,
+			  (librbd::AioCompletion *)comp->pc);
   tracepoint(librbd, aio_write_exit, r);
   return r;
 }
@@ -1505,7 +1530,12 @@ extern "C" int rbd_aio_discard(rbd_image_t image, uint64_t off, uint64_t len,
   librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
   librbd::RBD::AioCompletion *comp = (librbd::RBD::AioCompletion *)c;
   tracepoint(librbd, aio_discard_enter, ictx, ictx->name.c_str(), ictx->snap_name.c_str(), ictx->read_only, off, len, comp->pc);
-  int r = librbd::aio_discard(ictx, off, len, (librbd::AioCompletion *)comp->pc);
+  int r = 0;
+  if (ictx->aio_work_queue)
+    ictx->aio_work_queue->aio_discard(off, len,
+				      (librbd::AioCompletion *)comp->pc);
+  else
+    r = librbd::aio_discard(ictx, off, len, (librbd::AioCompletion *)comp->pc);
   tracepoint(librbd, aio_discard_exit, r);
   return r;
 }
@@ -1516,8 +1546,13 @@ extern "C" int rbd_aio_read(rbd_image_t image, uint64_t off, size_t len,
   librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
   librbd::RBD::AioCompletion *comp = (librbd::RBD::AioCompletion *)c;
   tracepoint(librbd, aio_read_enter, ictx, ictx->name.c_str(), ictx->snap_name.c_str(), ictx->read_only, off, len, buf, comp->pc);
-  int r = librbd::aio_read(ictx, off, len, buf, NULL,
-			  (librbd::AioCompletion *)comp->pc);
+  int r = 0;
+  if (ictx->aio_work_queue)
+    ictx->aio_work_queue->aio_read(off, len, buf, NULL,
+				   (librbd::AioCompletion *)comp->pc);
+  else
+    r = librbd::aio_read(ictx, off, len, buf, NULL,
+			 (librbd::AioCompletion *)comp->pc);
   tracepoint(librbd, aio_read_exit, r);
   return r;
 }
@@ -1536,7 +1571,11 @@ extern "C" int rbd_aio_flush(rbd_image_t image, rbd_completion_t c)
   librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
   librbd::RBD::AioCompletion *comp = (librbd::RBD::AioCompletion *)c;
   tracepoint(librbd, aio_flush_enter, ictx, ictx->name.c_str(), ictx->snap_name.c_str(), ictx->read_only, comp->pc);
-  int r = librbd::aio_flush(ictx, (librbd::AioCompletion *)comp->pc);
+  int r = 0;
+  if (ictx->aio_work_queue)
+    ictx->aio_work_queue->aio_flush((librbd::AioCompletion *)comp->pc);
+  else
+    r = librbd::aio_flush(ictx, (librbd::AioCompletion *)comp->pc);
   tracepoint(librbd, aio_flush_exit, r);
   return r;
 }
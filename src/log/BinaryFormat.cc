@@ -0,0 +1,411 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "BinaryFormat.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "include/encoding.h"
+#include "Entry.h"
+
+#define MAX_FORMATS 16384
+
+namespace ceph {
+namespace log {
+
+struct format_info_t {
+  const char *fmt;
+  std::string kinds;  ///< how each argument is stored, see parse_conv()
+  bool ok;            ///< false if we can't pack this format
+};
+
+// Slots are filled once and never change, so packers can read them
+// without the lock; the id reaches them through a thread-safe static.
+static pthread_mutex_t format_lock = PTHREAD_MUTEX_INITIALIZER;
+static format_info_t *formats[MAX_FORMATS];
+static int num_formats = 0;
+
+struct conv_t {
+  size_t len;  ///< length of the conversion spec, including the '%'
+  char kind;   ///< 0 for "%%", else the argument kind
+  bool star_width, star_prec;  ///< '*' takes an int argument before ours
+};
+
+/*
+ * Parse the conversion spec starting at fmt[i] == '%'.  Argument kinds
+ * are 'i' (int), 'l' (long), 'L' (long long), 'j' (intmax_t), 'z'
+ * (size_t), 't' (ptrdiff_t), 'd' (double), 'p' (pointer) and 's'
+ * (string).  A '*' width or precision is an extra 'i' argument.
+ */
+static bool parse_conv(const char *fmt, size_t i, conv_t *c)
+{
+  size_t j = i + 1;
+  c->star_width = c->star_prec = false;
+  if (fmt[j] == '%') {
+    c->len = 2;
+    c->kind = 0;
+    return true;
+  }
+  while (fmt[j] && strchr("-+ #0'", fmt[j]))
+    ++j;
+  if (fmt[j] == '*') {
+    c->star_width = true;
+    ++j;
+  } else {
+    while (isdigit(fmt[j]))
+      ++j;
+  }
+  if (fmt[j] == '.') {
+    ++j;
+    if (fmt[j] == '*') {
+      c->star_prec = true;
+      ++j;
+    } else {
+      while (isdigit(fmt[j]))
+	++j;
+    }
+  }
+  char lmod = 0;  // 'D' is long double
+  switch (fmt[j]) {
+  case 'h':
+    lmod = 'h';
+    if (fmt[++j] == 'h')
+      ++j;
+    break;
+  case 'l':
+    lmod = 'l';
+    if (fmt[++j] == 'l') {
+      lmod = 'L';
+      ++j;
+    }
+    break;
+  case 'q':
+    lmod = 'L';
+    ++j;
+    break;
+  case 'j':
+  case 'z':
+  case 't':
+    lmod = fmt[j++];
+    break;
+  case 'L':
+    lmod = 'D';
+    ++j;
+    break;
+  }
+
+  char conv = fmt[j];
+  if (!conv)
+    return false;
+  c->len = j + 1 - i;
+  if (strchr("diouxXc", conv)) {
+    if (lmod == 'D')
+      return false;
+    c->kind = (lmod == 0 || lmod == 'h') ? 'i' : lmod;
+  } else if (strchr("eEfFgGaA", conv)) {
+    if (lmod != 0 && lmod != 'l')
+      return false;
+    c->kind = 'd';
+  } else if (conv == 's') {
+    if (lmod)
+      return false;
+    c->kind = 's';
+  } else if (conv == 'p') {
+    c->kind = 'p';
+  } else {
+    return false;
+  }
+  return true;
+}
+
+int register_format(const char *fmt)
+{
+  format_info_t *f = new format_info_t;
+  f->fmt = fmt;
+  f->ok = true;
+  for (size_t i = 0; fmt[i]; ) {
+    if (fmt[i] != '%') {
+      ++i;
+      continue;
+    }
+    conv_t c;
+    if (!parse_conv(fmt, i, &c)) {
+      f->ok = false;
+      f->kinds.clear();
+      break;
+    }
+    if (c.star_width)
+      f->kinds.push_back('i');
+    if (c.star_prec)
+      f->kinds.push_back('i');
+    if (c.kind)
+      f->kinds.push_back(c.kind);
+    i += c.len;
+  }
+
+  pthread_mutex_lock(&format_lock);
+  int id = num_formats < MAX_FORMATS ? num_formats++ : -1;
+  if (id >= 0)
+    formats[id] = f;
+  pthread_mutex_unlock(&format_lock);
+  if (id < 0)
+    delete f;
+  return id;
+}
+
+const char *get_format(int id)
+{
+  if (id < 0 || id >= MAX_FORMATS || !formats[id])
+    return "(unregistered log format)";
+  return formats[id]->fmt;
+}
+
+template<typename T>
+static void put(std::streambuf *out, T v)
+{
+  out->sputn((const char *)&v, sizeof(v));
+}
+
+void pack_args(int id, std::streambuf *out, va_list ap)
+{
+  const format_info_t *f = formats[id];
+  for (std::string::const_iterator k = f->kinds.begin();
+       k != f->kinds.end();
+       ++k) {
+    switch (*k) {
+    case 'i': put<int32_t>(out, va_arg(ap, int)); break;
+    case 'l': put<int64_t>(out, va_arg(ap, long)); break;
+    case 'L': put<int64_t>(out, va_arg(ap, long long)); break;
+    case 'j': put<int64_t>(out, va_arg(ap, intmax_t)); break;
+    case 'z': put<int64_t>(out, va_arg(ap, size_t)); break;
+    case 't': put<int64_t>(out, va_arg(ap, ptrdiff_t)); break;
+    case 'd': put<double>(out, va_arg(ap, double)); break;
+    case 'p': put<uint64_t>(out, (uintptr_t)va_arg(ap, void *)); break;
+    case 's':
+      {
+	const char *s = va_arg(ap, const char *);
+	if (!s)
+	  s = "(null)";
+	uint32_t len = strlen(s);
+	put(out, len);
+	out->sputn(s, len);
+      }
+      break;
+    }
+  }
+}
+
+template<typename T>
+static bool take(const char *&p, const char *end, T *v)
+{
+  if ((size_t)(end - p) < sizeof(*v))
+    return false;
+  memcpy(v, p, sizeof(*v));
+  p += sizeof(*v);
+  return true;
+}
+
+template<typename T>
+static void append_conv(std::string &out, const std::string &spec, T v)
+{
+  char buf[128];
+  int n = snprintf(buf, sizeof(buf), spec.c_str(), v);
+  if (n < 0)
+    return;
+  if ((size_t)n < sizeof(buf)) {
+    out.append(buf, n);
+    return;
+  }
+  std::vector<char> big(n + 1);
+  snprintf(&big[0], big.size(), spec.c_str(), v);
+  out.append(&big[0], n);
+}
+
+std::string format_args(const char *fmt, const std::string &packed)
+{
+  std::string out;
+  const char *p = packed.data(), *end = p + packed.size();
+  size_t i = 0, lit = 0;
+  while (fmt[i]) {
+    if (fmt[i] != '%') {
+      ++i;
+      continue;
+    }
+    out.append(fmt + lit, i - lit);
+    conv_t c;
+    if (!parse_conv(fmt, i, &c))
+      return fmt;
+    std::string spec(fmt + i, c.len);
+    i += c.len;
+    lit = i;
+
+    // substitute the packed '*' values, so spec takes a single argument
+    int32_t width, prec;
+    if ((c.star_width && !take(p, end, &width)) ||
+	(c.star_prec && !take(p, end, &prec))) {
+      out += "<truncated>";
+      return out;
+    }
+    if (c.star_width) {
+      // a negative width is the '-' flag plus its magnitude, as in printf
+      std::ostringstream ss;
+      ss << width;
+      spec.replace(spec.find('*'), 1, ss.str());
+    }
+    if (c.star_prec) {
+      size_t dot = spec.find(".*");
+      if (prec < 0) {
+	// a negative precision is taken as if it were omitted
+	spec.erase(dot, 2);
+      } else {
+	std::ostringstream ss;
+	ss << prec;
+	spec.replace(dot + 1, 1, ss.str());
+      }
+    }
+
+    int64_t iv;
+    bool ok = true;
+    switch (c.kind) {
+    case 0:
+      out += '%';
+      break;
+    case 'i':
+      {
+	int32_t v;
+	if ((ok = take(p, end, &v)))
+	  append_conv(out, spec, (int)v);
+      }
+      break;
+    case 'd':
+      {
+	double v;
+	if ((ok = take(p, end, &v)))
+	  append_conv(out, spec, v);
+      }
+      break;
+    case 's':
+      {
+	uint32_t len;
+	if ((ok = (take(p, end, &len) && (size_t)(end - p) >= len))) {
+	  std::string s(p, len);
+	  p += len;
+	  append_conv(out, spec, s.c_str());
+	}
+      }
+      break;
+    default:
+      if (!(ok = take(p, end, &iv)))
+	break;
+      switch (c.kind) {
+      case 'l': append_conv(out, spec, (long)iv); break;
+      case 'L': append_conv(out, spec, (long long)iv); break;
+      case 'j': append_conv(out, spec, (intmax_t)iv); break;
+      case 'z': append_conv(out, spec, (size_t)iv); break;
+      case 't': append_conv(out, spec, (ptrdiff_t)iv); break;
+      case 'p': append_conv(out, spec, (void *)(uintptr_t)iv); break;
+      }
+    }
+    if (!ok) {
+      out += "<truncated>";
+      return out;
+    }
+  }
+  out.append(fmt + lit, i - lit);
+  return out;
+}
+
+void encode_format_record(int id, const char *fmt, bufferlist &bl)
+{
+  __u8 type = 'F';
+  ::encode(type, bl);
+  ::encode((int32_t)id, bl);
+  ::encode(fmt, bl);
+}
+
+void encode_entry_record(const Entry *e, bufferlist &bl)
+{
+  __u8 type = 'E';
+  ::encode(type, bl);
+  ::encode(e->m_stamp, bl);
+  ::encode((uint64_t)e->m_thread, bl);
+  ::encode((int16_t)e->m_prio, bl);
+  ::encode((int16_t)e->m_subsys, bl);
+  ::encode((int32_t)e->m_fmt, bl);
+  ::encode(e->get_raw(), bl);
+}
+
+int decode_binary_log(bufferlist &bl, std::ostream &out)
+{
+  unsigned mlen = strlen(CEPH_LOG_BINARY_MAGIC);
+  std::string magic;
+  if (bl.length() < mlen)
+    return -EINVAL;
+  bl.copy(0, mlen, magic);
+  if (magic != CEPH_LOG_BINARY_MAGIC)
+    return -EINVAL;
+
+  std::map<int, std::string> fmts;
+  bufferlist::iterator p = bl.begin();
+  p.advance(mlen);
+  try {
+    while (!p.end()) {
+      __u8 type;
+      ::decode(type, p);
+      if (type == 'F') {
+	int32_t id;
+	std::string fmt;
+	::decode(id, p);
+	::decode(fmt, p);
+	fmts[id] = fmt;
+      } else if (type == 'E') {
+	utime_t stamp;
+	uint64_t thread;
+	int16_t prio, subsys;
+	int32_t fmt;
+	std::string raw;
+	::decode(stamp, p);
+	::decode(thread, p);
+	::decode(prio, p);
+	::decode(subsys, p);
+	::decode(fmt, p);
+	::decode(raw, p);
+
+	// same layout as Log::_flush()
+	char buf[80];
+	int buflen = stamp.sprintf(buf, sizeof(buf));
+	buflen += snprintf(buf + buflen, sizeof(buf)-buflen, " %lx %2d ",
+			   (unsigned long)thread, prio);
+	out.write(buf, buflen);
+	if (fmt < 0) {
+	  out << raw;
+	} else {
+	  std::map<int, std::string>::iterator f = fmts.find(fmt);
+	  if (f == fmts.end())
+	    out << "(unknown log format " << fmt << ")";
+	  else
+	    out << format_args(f->second.c_str(), raw);
+	}
+	out << "\n";
+      } else {
+	return -EINVAL;
+      }
+    }
+  } catch (buffer::error& e) {
+    return -EINVAL;
+  }
+  return 0;
+}
+
+}
+}
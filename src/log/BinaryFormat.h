@@ -0,0 +1,62 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef __CEPH_LOG_BINARYFORMAT_H
+#define __CEPH_LOG_BINARYFORMAT_H
+
+#include <stdarg.h>
+#include <iosfwd>
+#include <streambuf>
+#include <string>
+
+#include "include/buffer.h"
+
+/*
+ * Binary log entries carry a printf-style format id and the packed
+ * arguments instead of the formatted text, so that the caller pays for a
+ * few stores rather than for the formatting.  The text is produced when
+ * (and if) the entry is written out, or offline from a binary log file.
+ *
+ * Supported conversions are those of printf minus %n, positional
+ * arguments and long double.  A format using anything else is logged
+ * verbatim.
+ */
+
+#define CEPH_LOG_BINARY_MAGIC "ceph binary log v1\n"
+
+namespace ceph {
+namespace log {
+
+struct Entry;
+
+/// register a format string (which must outlive the process); return its id
+int register_format(const char *fmt);
+
+/// return the format string for an id
+const char *get_format(int id);
+
+/// pack the arguments for format id from ap
+void pack_args(int id, std::streambuf *out, va_list ap);
+
+/// render packed arguments with a format string
+std::string format_args(const char *fmt, const std::string &packed);
+
+/// append a binary log file record for a format string
+void encode_format_record(int id, const char *fmt, bufferlist &bl);
+
+/// append a binary log file record for an entry
+void encode_entry_record(const Entry *e, bufferlist &bl);
+
+/**
+ * print the contents of a binary log file as text
+ *
+ * @param bl the file contents
+ * @param out where to put the lines
+ * @return 0 on success, -EINVAL if bl is not (entirely) a binary log
+ */
+int decode_binary_log(bufferlist &bl, std::ostream &out);
+
+}
+}
+
+#endif
@@ -6,6 +6,7 @@
 
 #include "include/utime.h"
 #include "common/PrebufferedStreambuf.h"
+#include "BinaryFormat.h"
 #include <pthread.h>
 #include <string>
 
@@ -18,6 +19,7 @@ struct Entry {
   utime_t m_stamp;
   pthread_t m_thread;
   short m_prio, m_subsys;
+  int m_fmt;     ///< binary format id, or -1 if m_streambuf holds text
   Entry *m_next;
 
   char m_static_buf[CEPH_LOG_ENTRY_PREALLOC];
@@ -25,13 +27,13 @@ struct Entry {
 
   Entry()
     : m_thread(0), m_prio(0), m_subsys(0),
-      m_next(NULL),
+      m_fmt(-1), m_next(NULL),
       m_streambuf(m_static_buf, sizeof(m_static_buf))
   {}
   Entry(utime_t s, pthread_t t, short pr, short sub,
 	const char *msg = NULL)
     : m_stamp(s), m_thread(t), m_prio(pr), m_subsys(sub),
-      m_next(NULL),
+      m_fmt(-1), m_next(NULL),
       m_streambuf(m_static_buf, sizeof(m_static_buf))
   {
     if (msg) {
@@ -46,6 +48,13 @@ struct Entry {
   }
 
   std::string get_str() const {
+    if (m_fmt >= 0)
+      return format_args(get_format(m_fmt), m_streambuf.get_str());
+    return m_streambuf.get_str();
+  }
+
+  /// the text, or the packed arguments of a binary entry
+  std::string get_raw() const {
     return m_streambuf.get_str();
   }
 };
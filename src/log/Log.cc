@@ -4,8 +4,11 @@
 #include "Log.h"
 
 #include <errno.h>
+#include <stdarg.h>
 #include <syslog.h>
+#include <sys/stat.h>
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -21,11 +24,29 @@
 
 #define PREALLOC 1000000
 
+#define THREAD_QUEUE_LEN 512
+#define BINARY_WRITE_CHUNK 65536
+
 namespace ceph {
 namespace log {
 
 static OnExitManager exit_callbacks;
 
+struct Log::ThreadQueue {
+  Entry *m_ring[THREAD_QUEUE_LEN];
+  volatile unsigned m_head;  ///< only advanced by the owning thread
+  volatile unsigned m_tail;  ///< only advanced under m_queue_mutex
+  volatile bool m_dead;      ///< the owning thread has exited
+  ThreadQueue *m_next;
+
+  ThreadQueue() : m_head(0), m_tail(0), m_dead(false), m_next(NULL) {}
+};
+
+static bool entry_stamp_lt(const Entry *a, const Entry *b)
+{
+  return a->m_stamp < b->m_stamp;
+}
+
 static void log_on_exit(void *p)
 {
   Log *l = *(Log **)p;
@@ -40,6 +61,10 @@ Log::Log(SubsystemMap *s)
     m_queue_mutex_holder(0),
     m_flush_mutex_holder(0),
     m_new(), m_recent(),
+    m_thread_queues(NULL),
+    m_flusher_waiting(0),
+    m_ring_len(0),
+    m_binary(false),
     m_fd(-1),
     m_syslog_log(-2), m_syslog_crash(-2),
     m_stderr_log(1), m_stderr_crash(-1),
@@ -62,6 +87,9 @@ Log::Log(SubsystemMap *s)
   ret = pthread_cond_init(&m_cond_flusher, NULL);
   assert(ret == 0);
 
+  ret = pthread_key_create(&m_queue_key, _thread_queue_exit);
+  assert(ret == 0);
+
   // kludge for prealloc testing
   if (false)
     for (int i=0; i < PREALLOC; i++)
@@ -78,6 +106,15 @@ Log::~Log()
   if (m_fd >= 0)
     VOID_TEMP_FAILURE_RETRY(::close(m_fd));
 
+  pthread_key_delete(m_queue_key);
+  while (m_thread_queues) {
+    ThreadQueue *q = m_thread_queues;
+    m_thread_queues = q->m_next;
+    for (unsigned i = q->m_tail; i != q->m_head; ++i)
+      delete q->m_ring[i % THREAD_QUEUE_LEN];
+    delete q;
+  }
+
   pthread_mutex_destroy(&m_queue_mutex);
   pthread_mutex_destroy(&m_flush_mutex);
   pthread_cond_destroy(&m_cond_loggers);
@@ -114,8 +151,17 @@ void Log::set_log_file(string fn)
   m_log_file = fn;
 }
 
+void Log::set_binary(bool b)
+{
+  pthread_mutex_lock(&m_flush_mutex);
+  m_binary = b;
+  pthread_mutex_unlock(&m_flush_mutex);
+}
+
 void Log::reopen_log_file()
 {
+  pthread_mutex_lock(&m_flush_mutex);
+  m_flush_mutex_holder = pthread_self();
   if (m_fd >= 0)
     VOID_TEMP_FAILURE_RETRY(::close(m_fd));
   if (m_log_file.length()) {
@@ -123,6 +169,19 @@ void Log::reopen_log_file()
   } else {
     m_fd = -1;
   }
+
+  // a new binary file starts with the magic, and any file we (re)open
+  // needs the format records again
+  m_fmt_written.clear();
+  struct stat st;
+  if (m_binary && m_fd >= 0 && ::fstat(m_fd, &st) == 0 && st.st_size == 0) {
+    int r = safe_write(m_fd, CEPH_LOG_BINARY_MAGIC,
+		       strlen(CEPH_LOG_BINARY_MAGIC));
+    if (r < 0)
+      cerr << "problem writing to " << m_log_file << ": " << cpp_strerror(r) << std::endl;
+  }
+  m_flush_mutex_holder = 0;
+  pthread_mutex_unlock(&m_flush_mutex);
 }
 
 void Log::set_syslog_level(int log, int crash)
@@ -141,8 +200,108 @@ void Log::set_stderr_level(int log, int crash)
   pthread_mutex_unlock(&m_flush_mutex);
 }
 
+void Log::_thread_queue_exit(void *p)
+{
+  // the flusher frees it once it is drained
+  __sync_synchronize();
+  ((ThreadQueue *)p)->m_dead = true;
+}
+
+Log::ThreadQueue *Log::_get_thread_queue()
+{
+  ThreadQueue *q = (ThreadQueue *)pthread_getspecific(m_queue_key);
+  if (!q) {
+    q = new ThreadQueue;
+    pthread_setspecific(m_queue_key, q);
+    pthread_mutex_lock(&m_queue_mutex);
+    q->m_next = m_thread_queues;
+    m_thread_queues = q;
+    pthread_mutex_unlock(&m_queue_mutex);
+  }
+  return q;
+}
+
+bool Log::_have_queued()
+{
+  if (!m_new.empty())
+    return true;
+  __sync_synchronize();
+  for (ThreadQueue *q = m_thread_queues; q; q = q->m_next)
+    if (q->m_head != q->m_tail)
+      return true;
+  return false;
+}
+
+void Log::_take_new(EntryQueue *t)
+{
+  t->swap(m_new);
+  int sources = t->empty() ? 0 : 1;
+
+  ThreadQueue **pq = &m_thread_queues;
+  while (*pq) {
+    ThreadQueue *q = *pq;
+    // check for exit first; anything queued before it is below head
+    bool dead = q->m_dead;
+    __sync_synchronize();
+    unsigned head = q->m_head;
+    if (head != q->m_tail) {
+      __sync_synchronize();
+      for (unsigned i = q->m_tail; i != head; ++i)
+	t->enqueue(q->m_ring[i % THREAD_QUEUE_LEN]);
+      // done reading the slots before the owner may reuse them
+      __sync_synchronize();
+      __sync_fetch_and_sub(&m_ring_len, (int)(head - q->m_tail));
+      q->m_tail = head;
+      ++sources;
+    }
+    if (dead) {
+      *pq = q->m_next;
+      delete q;
+      continue;
+    }
+    pq = &q->m_next;
+  }
+
+  if (sources > 1) {
+    // interleave the threads' entries in time order
+    vector<Entry*> v;
+    v.reserve(t->m_len);
+    Entry *e;
+    while ((e = t->dequeue()) != NULL)
+      v.push_back(e);
+    std::stable_sort(v.begin(), v.end(), entry_stamp_lt);
+    for (vector<Entry*>::iterator p = v.begin(); p != v.end(); ++p)
+      t->enqueue(*p);
+  }
+}
+
 void Log::submit_entry(Entry *e)
 {
+  ThreadQueue *q = m_inject_segv ? NULL : _get_thread_queue();
+  // past m_max_new queued entries we take the locked path and wait
+  if (q && m_ring_len < m_max_new &&
+      q->m_head - q->m_tail < THREAD_QUEUE_LEN) {
+    // count it before the flusher can see (and uncount) it
+    __sync_fetch_and_add(&m_ring_len, 1);
+    // don't fill the slot before we've seen the flusher free it
+    __sync_synchronize();
+    q->m_ring[q->m_head % THREAD_QUEUE_LEN] = e;
+    __sync_synchronize();
+    q->m_head = q->m_head + 1;
+    // publish the head before checking whether the flusher is asleep;
+    // it sets m_flusher_waiting before its last look at the queues
+    __sync_synchronize();
+    if (m_flusher_waiting &&
+	__sync_bool_compare_and_swap(&m_flusher_waiting, 1, 0)) {
+      pthread_mutex_lock(&m_queue_mutex);
+      pthread_cond_signal(&m_cond_flusher);
+      pthread_mutex_unlock(&m_queue_mutex);
+    }
+    return;
+  }
+
+  // too much is queued, our ring is full, or we want to crash: queue it
+  // the slow way
   pthread_mutex_lock(&m_queue_mutex);
   m_queue_mutex_holder = pthread_self();
 
@@ -150,8 +309,10 @@ void Log::submit_entry(Entry *e)
     *(int *)(0) = 0xdead;
 
   // wait for flush to catch up
-  while (m_new.m_len > m_max_new)
+  while (m_new.m_len + m_ring_len > m_max_new) {
+    pthread_cond_signal(&m_cond_flusher);
     pthread_cond_wait(&m_cond_loggers, &m_queue_mutex);
+  }
 
   m_new.enqueue(e);
   pthread_cond_signal(&m_cond_flusher);
@@ -159,6 +320,21 @@ void Log::submit_entry(Entry *e)
   pthread_mutex_unlock(&m_queue_mutex);
 }
 
+void Log::submit_binary(int level, int subsys, int fmt, ...)
+{
+  Entry *e = create_entry(level, subsys);
+  if (fmt >= 0) {
+    va_list ap;
+    va_start(ap, fmt);
+    pack_args(fmt, &e->m_streambuf, ap);
+    va_end(ap);
+    e->m_fmt = fmt;
+  } else {
+    e->set_str("(too many binary log formats)");
+  }
+  submit_entry(e);
+}
+
 Entry *Log::create_entry(int level, int subsys)
 {
   if (true) {
@@ -183,7 +359,7 @@ void Log::flush()
   pthread_mutex_lock(&m_queue_mutex);
   m_queue_mutex_holder = pthread_self();
   EntryQueue t;
-  t.swap(m_new);
+  _take_new(&t);
   pthread_cond_broadcast(&m_cond_loggers);
   m_queue_mutex_holder = 0;
   pthread_mutex_unlock(&m_queue_mutex);
@@ -198,10 +374,33 @@ void Log::flush()
   pthread_mutex_unlock(&m_flush_mutex);
 }
 
+void Log::_encode_binary(Entry *e, bufferlist &bl)
+{
+  int fmt = e->m_fmt;
+  if (fmt >= 0) {
+    if ((unsigned)fmt >= m_fmt_written.size())
+      m_fmt_written.resize(fmt + 1);
+    if (!m_fmt_written[fmt]) {
+      encode_format_record(fmt, get_format(fmt), bl);
+      m_fmt_written[fmt] = true;
+    }
+  }
+  encode_entry_record(e, bl);
+}
+
+void Log::_write_binary(bufferlist &bl)
+{
+  int r = bl.write_fd(m_fd);
+  if (r < 0)
+    cerr << "problem writing to " << m_log_file << ": " << cpp_strerror(r) << std::endl;
+  bl.clear();
+}
+
 void Log::_flush(EntryQueue *t, EntryQueue *requeue, bool crash)
 {
   Entry *e;
   char buf[80];
+  bufferlist binbl;
   while ((e = t->dequeue()) != NULL) {
     unsigned sub = e->m_subsys;
 
@@ -210,6 +409,14 @@ void Log::_flush(EntryQueue *t, EntryQueue *requeue, bool crash)
     bool do_syslog = m_syslog_crash >= e->m_prio && should_log;
     bool do_stderr = m_stderr_crash >= e->m_prio && should_log;
 
+    if (do_fd && m_binary) {
+      // no formatting at all unless something else wants the text
+      _encode_binary(e, binbl);
+      if (binbl.length() >= BINARY_WRITE_CHUNK)
+	_write_binary(binbl);
+      do_fd = false;
+    }
+
     if (do_fd || do_syslog || do_stderr) {
       int buflen = 0;
 
@@ -243,11 +450,18 @@ void Log::_flush(EntryQueue *t, EntryQueue *requeue, bool crash)
 
     requeue->enqueue(e);
   }
+  if (binbl.length())
+    _write_binary(binbl);
 }
 
 void Log::_log_message(const char *s, bool crash)
 {
-  if (m_fd >= 0) {
+  if (m_fd >= 0 && m_binary) {
+    Entry e(ceph_clock_now(NULL), pthread_self(), -1, 0, s);
+    bufferlist bl;
+    _encode_binary(&e, bl);
+    _write_binary(bl);
+  } else if (m_fd >= 0) {
     int r = safe_write(m_fd, s, strlen(s));
     if (r >= 0)
       r = safe_write(m_fd, "\n", 1);
@@ -272,7 +486,7 @@ void Log::dump_recent()
   m_queue_mutex_holder = pthread_self();
 
   EntryQueue t;
-  t.swap(m_new);
+  _take_new(&t);
 
   m_queue_mutex_holder = 0;
   pthread_mutex_unlock(&m_queue_mutex);
@@ -333,7 +547,7 @@ void *Log::entry()
   pthread_mutex_lock(&m_queue_mutex);
   m_queue_mutex_holder = pthread_self();
   while (!m_stop) {
-    if (!m_new.empty()) {
+    if (_have_queued()) {
       m_queue_mutex_holder = 0;
       pthread_mutex_unlock(&m_queue_mutex);
       flush();
@@ -342,7 +556,15 @@ void *Log::entry()
       continue;
     }
 
+    // lock-free submitters only signal us if they see this set
+    m_flusher_waiting = 1;
+    __sync_synchronize();
+    if (_have_queued()) {
+      m_flusher_waiting = 0;
+      continue;
+    }
     pthread_cond_wait(&m_cond_flusher, &m_queue_mutex);
+    m_flusher_waiting = 0;
   }
   m_queue_mutex_holder = 0;
   pthread_mutex_unlock(&m_queue_mutex);
@@ -7,6 +7,7 @@
 #include "common/Thread.h"
 
 #include <pthread.h>
+#include <vector>
 
 #include "Entry.h"
 #include "EntryQueue.h"
@@ -32,6 +33,22 @@ class Log : private Thread
   EntryQueue m_new;    ///< new entries
   EntryQueue m_recent; ///< recent (less new) entries we've already written at low detail
 
+  /**
+   * Each submitting thread gets its own single-producer ring, so the
+   * common case of submit_entry() takes no lock.  The flusher drains the
+   * rings under m_queue_mutex, which also protects the list of rings.
+   * Entries that don't fit in a ring, or that would take the total
+   * past m_max_new, go through m_new and wait there as before.
+   */
+  struct ThreadQueue;
+  pthread_key_t m_queue_key;
+  ThreadQueue *m_thread_queues;
+  volatile int m_flusher_waiting;  ///< flusher is (about to be) asleep
+  volatile int m_ring_len;         ///< entries in the rings, counts against m_max_new
+
+  bool m_binary;                   ///< write binary records to m_fd
+  std::vector<bool> m_fmt_written; ///< format records already in m_fd
+
   std::string m_log_file;
   int m_fd;
 
@@ -46,7 +63,14 @@ class Log : private Thread
 
   void *entry();
 
+  static void _thread_queue_exit(void *p);
+  ThreadQueue *_get_thread_queue();
+  bool _have_queued();
+  void _take_new(EntryQueue *t);
+
   void _flush(EntryQueue *q, EntryQueue *requeue, bool crash);
+  void _encode_binary(Entry *e, bufferlist &bl);
+  void _write_binary(bufferlist &bl);
 
   void _log_message(const char *s, bool crash);
 
@@ -59,6 +83,7 @@ public:
   void set_max_new(int n);
   void set_max_recent(int n);
   void set_log_file(std::string fn);
+  void set_binary(bool b);
   void reopen_log_file();
 
   void flush(); 
@@ -71,6 +96,9 @@ public:
   Entry *create_entry(int level, int subsys);
   void submit_entry(Entry *e);
 
+  /// submit an entry whose text is formatted later (see BinaryFormat.h)
+  void submit_binary(int level, int subsys, int fmt, ...);
+
   void start();
   void stop();
 
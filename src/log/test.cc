@@ -1,8 +1,12 @@
 #include <gtest/gtest.h>
 
+#include <stdarg.h>
+#include <unistd.h>
+
 #include "log/Log.h"
 #include "common/Clock.h"
 #include "common/PrebufferedStreambuf.h"
+#include "include/atomic.h"
 
 using namespace ceph::log;
 
@@ -209,3 +213,174 @@ TEST(Log, InternalSegv)
 {
   ASSERT_DEATH(do_segv(), ".*");
 }
+
+static Entry *binary_entry(int id, ...)
+{
+  Entry *e = new Entry(ceph_clock_now(NULL), pthread_self(), 10, 1);
+  va_list ap;
+  va_start(ap, id);
+  pack_args(id, &e->m_streambuf, ap);
+  va_end(ap);
+  e->m_fmt = id;
+  return e;
+}
+
+TEST(Log, BinaryFormat)
+{
+  static const char *fmt = "%d %5.2f [%-4s] %llx %zu %c %% %s";
+  int id = register_format(fmt);
+  ASSERT_LE(0, id);
+  ASSERT_EQ(string(fmt), get_format(id));
+  Entry *e = binary_entry(id, -7, 3.14159, "ab", 0xbeefull, (size_t)12, 'z',
+			  (const char *)NULL);
+  ASSERT_EQ("-7  3.14 [ab  ] beef 12 z % (null)", e->get_str());
+  delete e;
+
+  // long strings spill out of the entry's static buffer
+  string big(1000, 'x');
+  e = binary_entry(register_format("<%s>"), big.c_str());
+  ASSERT_EQ("<" + big + ">", e->get_str());
+  delete e;
+
+  // '*' width and precision take their own int arguments
+  e = binary_entry(register_format("[%*d] [%-*s] [%.*f] [%*.*s]"),
+		   5, 42, -4, "ab", 2, 2.71828, 6, 3, "abcdef");
+  ASSERT_EQ("[   42] [ab  ] [2.72] [   abc]", e->get_str());
+  delete e;
+  e = binary_entry(register_format("[%.*s]"), -1, "abc");
+  ASSERT_EQ("[abc]", e->get_str());
+  delete e;
+
+  // unsupported conversions are passed through verbatim
+  e = binary_entry(register_format("%1$d %n"), 1, 2);
+  ASSERT_EQ("%1$d %n", e->get_str());
+  delete e;
+
+  // and short data doesn't overrun
+  ASSERT_EQ("x=<truncated>", format_args("x=%d", "ab"));
+}
+
+static int decode_file(const char *fn, string *text)
+{
+  bufferlist bl;
+  string err;
+  int r = bl.read_file(fn, &err);
+  if (r < 0)
+    return r;
+  ostringstream out;
+  r = decode_binary_log(bl, out);
+  *text = out.str();
+  return r;
+}
+
+TEST(Log, BinaryFile)
+{
+  const char *fn = "/tmp/ceph_test_log_binary";
+  ::unlink(fn);
+  SubsystemMap subs;
+  subs.add(1, "foo", 20, 20);
+  Log log(&subs);
+  log.set_stderr_level(-1, -1);
+  log.set_binary(true);
+  log.set_log_file(fn);
+  log.reopen_log_file();
+  log.start();
+
+  int id = register_format("value %d of %s");
+  for (int i = 0; i < 3; ++i)
+    log.submit_binary(5, 1, id, i, "three");
+  log.submit_entry(new Entry(ceph_clock_now(NULL), pthread_self(), 5, 1,
+			     "plain text"));
+  log.flush();
+  log.stop();
+
+  string text;
+  ASSERT_EQ(0, decode_file(fn, &text));
+  ASSERT_NE(string::npos, text.find(" 5 value 0 of three\n"));
+  ASSERT_NE(string::npos, text.find(" 5 value 2 of three\n"));
+  ASSERT_NE(string::npos, text.find(" 5 plain text\n"));
+  ::unlink(fn);
+}
+
+struct LogThread : public Thread {
+  Log *log;
+  int n;
+  LogThread(Log *l, int n) : log(l), n(n) {}
+  void *entry() {
+    static int id = register_format("thread entry %d");
+    for (int i = 0; i < n; ++i)
+      log->submit_binary(10, 1, id, i);
+    return NULL;
+  }
+};
+
+struct CountingLogThread : public Thread {
+  Log *log;
+  int n;
+  atomic_t done;
+  CountingLogThread(Log *l, int n) : log(l), n(n) {}
+  void *entry() {
+    static int id = register_format("counted entry %d");
+    for (int i = 0; i < n; ++i) {
+      log->submit_binary(10, 1, id, i);
+      done.inc();
+    }
+    return NULL;
+  }
+};
+
+TEST(Log, MaxNew)
+{
+  SubsystemMap subs;
+  subs.add(1, "foo", 20, 20);
+  Log log(&subs);
+  log.set_stderr_level(-1, -1);
+  log.set_max_new(4);
+
+  // with no flusher running, the submitter stops once max_new are queued
+  CountingLogThread t(&log, 20);
+  t.create();
+  usleep(200000);
+  ASSERT_GE(5u, t.done.read());
+  log.start();
+  t.join();
+  ASSERT_EQ(20u, t.done.read());
+  log.flush();
+  log.stop();
+}
+
+TEST(Log, ManyThreads)
+{
+  const char *fn = "/tmp/ceph_test_log_threads";
+  ::unlink(fn);
+  SubsystemMap subs;
+  subs.add(1, "foo", 20, 20);
+  Log log(&subs);
+  log.set_stderr_level(-1, -1);
+  log.set_binary(true);
+  log.set_log_file(fn);
+  log.reopen_log_file();
+  log.start();
+
+  vector<LogThread*> threads;
+  for (int i = 0; i < 8; ++i) {
+    threads.push_back(new LogThread(&log, many));
+    threads.back()->create();
+  }
+  for (unsigned i = 0; i < threads.size(); ++i) {
+    threads[i]->join();
+    delete threads[i];
+  }
+  log.flush();
+  log.stop();
+
+  // nothing is lost, whether it went through a ring or the locked queue
+  string text;
+  ASSERT_EQ(0, decode_file(fn, &text));
+  int lines = 0;
+  for (size_t p = text.find("thread entry"); p != string::npos;
+       p = text.find("thread entry", p + 1))
+    ++lines;
+  ASSERT_EQ(8 * many, lines);
+  ::unlink(fn);
+}
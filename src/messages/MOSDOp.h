@@ -32,7 +32,7 @@ class OSD;
 
 class MOSDOp : public Message {
 
-  static const int HEAD_VERSION = 4;
+  static const int HEAD_VERSION = 5;
   static const int COMPAT_VERSION = 3;
 
 private:
@@ -251,6 +251,7 @@ struct ceph_osd_request_head {
       ::encode(snaps, payload);
 
       ::encode(retry_attempt, payload);
+      ::encode(trace, payload);
     }
   }
 
@@ -332,6 +333,9 @@ struct ceph_osd_request_head {
 	::decode(retry_attempt, p);
       else
 	retry_attempt = -1;
+
+      if (header.version >= 5)
+	::decode(trace, p);
     }
 
     OSDOp::split_osd_op_vector_in_data(ops, data);
@@ -372,6 +376,8 @@ struct ceph_osd_request_head {
       out << " snapc " << get_snap_seq() << "=" << snaps;
     out << " " << ceph_osd_flag_string(get_flags());
     out << " e" << osdmap_epoch;
+    if (trace.sampled())
+      out << " " << trace;
     out << ")";
   }
 };
@@ -0,0 +1,79 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MOSDOPBATCH_H
+#define CEPH_MOSDOPBATCH_H
+
+#include "msg/Message.h"
+
+/*
+ * Several MOSDOps for the same OSD in one message.  The OSD unpacks
+ * them and handles each as if it had arrived on its own, so every op
+ * still gets its own MOSDOpReply.  Only sent to OSDs with
+ * CEPH_FEATURE_OSD_OP_BATCH.
+ */
+class MOSDOpBatch : public Message {
+  static const int HEAD_VERSION = 1;
+  static const int COMPAT_VERSION = 1;
+
+public:
+  list<Message*> ops;
+
+  MOSDOpBatch()
+    : Message(MSG_OSD_OP_BATCH, HEAD_VERSION, COMPAT_VERSION) {}
+  MOSDOpBatch(list<Message*>& o)
+    : Message(MSG_OSD_OP_BATCH, HEAD_VERSION, COMPAT_VERSION) {
+    ops.swap(o);
+    for (list<Message*>::iterator p = ops.begin(); p != ops.end(); ++p) {
+      if ((*p)->get_priority() > get_priority())
+	set_priority((*p)->get_priority());
+    }
+  }
+private:
+  ~MOSDOpBatch() {
+    for (list<Message*>::iterator p = ops.begin(); p != ops.end(); ++p)
+      (*p)->put();
+  }
+
+public:
+  void encode_payload(uint64_t features) {
+    __u32 n = ops.size();
+    ::encode(n, payload);
+    for (list<Message*>::iterator p = ops.begin(); p != ops.end(); ++p)
+      encode_message(*p, features, payload);
+  }
+  void decode_payload() {
+    bufferlist::iterator p = payload.begin();
+    __u32 n;
+    ::decode(n, p);
+    while (n--) {
+      // peek at the type first: only ops are ever decoded, so a batch
+      // can neither nest nor carry anything else
+      bufferlist::iterator q = p;
+      ceph_msg_header h;
+      ::decode(h, q);
+      if (h.type != CEPH_MSG_OSD_OP)
+	throw buffer::malformed_input("non-op in MOSDOpBatch");
+      Message *m = decode_message(NULL, p);
+      if (!m)
+	throw buffer::malformed_input("bad op in MOSDOpBatch");
+      ops.push_back(m);
+    }
+  }
+
+  const char *get_type_name() const { return "osd_op_batch"; }
+  void print(ostream& out) const {
+    out << "osd_op_batch(" << ops.size() << " ops)";
+  }
+};
+
+#endif
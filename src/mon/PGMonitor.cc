@@ -1517,6 +1517,9 @@ bool PGMonitor::preprocess_command(MMonCommand *m)
     if (what.empty())
       what.insert("all");
     if (f) {
+      // stream into rdata rather than building one huge string first
+      BufferlistSink sink(&rdata);
+      f->set_sink(&sink);
       vector<string> dumpcontents;
       if (cmd_getval(g_ceph_context, cmdmap, "dumpcontents", dumpcontents)) {
 	copy(dumpcontents.begin(), dumpcontents.end(),
@@ -1549,7 +1552,8 @@ bool PGMonitor::preprocess_command(MMonCommand *m)
 	  f->close_section();
 	}
       }
-      f->flush(ds);
+      f->flush(rdata);
+      f->set_sink(NULL);
     } else {
       // plain format ignores dumpcontents
       pg_map.dump(ds);
@@ -63,6 +63,7 @@ using namespace std;
 #include "messages/MOSDPing.h"
 #include "messages/MOSDOp.h"
 #include "messages/MOSDOpReply.h"
+#include "messages/MOSDOpBatch.h"
 #include "messages/MOSDSubOp.h"
 #include "messages/MOSDSubOpReply.h"
 #include "messages/MOSDMap.h"
@@ -483,6 +484,9 @@ Message *decode_message(CephContext *cct, ceph_msg_header& header, ceph_msg_foot
   case MSG_OSD_EC_READ_REPLY:
     m = new MOSDECSubOpReadReply;
     break;
+  case MSG_OSD_OP_BATCH:
+    m = new MOSDOpBatch;
+    break;
    // auth
   case CEPH_MSG_AUTH:
     m = new MAuth;
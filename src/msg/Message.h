@@ -33,6 +33,7 @@
 
 #include "common/debug.h"
 #include "common/config.h"
+#include "common/Trace.h"
 
 // monitor internal
 #define MSG_MON_SCRUB              64
@@ -114,6 +115,8 @@
 #define MSG_OSD_EC_READ        110
 #define MSG_OSD_EC_READ_REPLY  111
 
+#define MSG_OSD_OP_BATCH       112
+
 // *** MDS ***
 
 #define MSG_MDS_BEACON             100  // to monitor
@@ -192,6 +195,10 @@ protected:
 
   uint32_t magic;
 
+  /* trace context of the request this message is part of; only
+   * carried on the wire by message types that encode it */
+  trace_ctx_t trace;
+
 public:
   class CompletionHook : public Context {
   protected:
@@ -284,6 +291,9 @@ public:
   void set_footer(const ceph_msg_footer &e) { footer = e; }
   ceph_msg_footer &get_footer() { return footer; }
 
+  const trace_ctx_t& get_trace() const { return trace; }
+  void set_trace(const trace_ctx_t& t) { trace = t; }
+
   uint32_t get_magic() { return magic; }
   void set_magic(int _magic) { magic = _magic; }
 
@@ -16,12 +16,14 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #include "include/Context.h"
 #include "common/errno.h"
 #include "AsyncMessenger.h"
 #include "AsyncConnection.h"
+#include "ShmChannel.h"
 
 // Constant to limit starting sequence number to 2^31.  Nothing special about it, just a big number.  PLR
 #define SEQ_MASK  0x7fffffff 
@@ -82,18 +84,42 @@ class C_handle_remote_reset : public EventCallback {
 };
 
 class C_handle_dispatch : public EventCallback {
-  AsyncMessenger *msgr;
-  Message *m;
+  AsyncConnectionRef conn;
 
  public:
-  C_handle_dispatch(AsyncMessenger *msgr, Message *m): msgr(msgr), m(m) {}
+  C_handle_dispatch(AsyncConnectionRef c): conn(c) {}
   void do_request(int id) {
-    //msgr->ms_fast_preprocess(m);
-    //if (msgr->ms_can_fast_dispatch(m)) {
-    //  msgr->ms_fast_dispatch(m);
-    //} else {
-      msgr->ms_deliver_dispatch(m);
-    //}
+    conn->process_dispatch();
+  }
+};
+
+class C_handle_shm_event : public EventCallback {
+  AsyncConnectionRef conn;
+
+ public:
+  C_handle_shm_event(AsyncConnectionRef c): conn(c) {}
+  void do_request(int fd) {
+    conn->handle_shm_event();
+  }
+};
+
+class C_handle_shm_sd : public EventCallback {
+  AsyncConnectionRef conn;
+
+ public:
+  C_handle_shm_sd(AsyncConnectionRef c): conn(c) {}
+  void do_request(int fd) {
+    conn->handle_shm_sd();
+  }
+};
+
+class C_handle_shm_ack : public EventCallback {
+  AsyncConnectionRef conn;
+
+ public:
+  C_handle_shm_ack(AsyncConnectionRef c): conn(c) {}
+  void do_request(int fd_or_id) {
+    conn->handle_shm_ack();
   }
 };
 
@@ -170,28 +196,39 @@ AsyncConnection::AsyncConnection(CephContext *cct, AsyncMessenger *m, EventCente
     lock("AsyncConnection::lock"), open_write(false), keepalive(false),
     stop_lock("AsyncConnection::stop_lock"),
     got_bad_auth(false), authorizer(NULL),
-    state_buffer(4096), state_offset(0), net(cct), center(c)
+    state_buffer(4096), state_offset(0),
+    shm(NULL), shm_cookie(0), shm_in(false), shm_out(false),
+    shm_connecting(NULL), shm_connect_sd(-1),
+    net(cct), center(c)
 {
   read_handler.reset(new C_handle_read(this));
   write_handler.reset(new C_handle_write(this));
   reset_handler.reset(new C_handle_reset(async_msgr, this));
   remote_reset_handler.reset(new C_handle_remote_reset(async_msgr, this));
   stop_handler.reset(new C_handle_stop(this));
+  dispatch_handler.reset(new C_handle_dispatch(this));
   signal_handler.reset(new C_handle_signal(this));
   connect_handler.reset(new C_handle_connect(async_msgr, this));
   accept_handler.reset(new C_handle_connect(async_msgr, this));
+  shm_handler.reset(new C_handle_shm_event(this));
+  shm_sd_handler.reset(new C_handle_shm_sd(this));
+  shm_ack_handler.reset(new C_handle_shm_ack(this));
   memset(msgvec, 0, sizeof(msgvec));
 }
 
 AsyncConnection::~AsyncConnection()
 {
   assert(!authorizer);
+  delete shm;
 }
 
 /* return -1 means `fd` occurs error or closed, it should be closed
  * return 0 means EAGAIN or EINTR */
 int AsyncConnection::read_bulk(int fd, char *buf, int len)
 {
+  if (shm_in && fd == sd)
+    return shm->read(buf, len);
+
   int nread = ::read(fd, buf, len);
   if (nread == -1) {
     if (errno == EAGAIN || errno == EINTR) {
@@ -232,7 +269,8 @@ int AsyncConnection::do_sendmsg(struct msghdr &msg, int len, bool more)
     if (len == 0) break;
 
     // hrmph.  trim r bytes off the front of our message.
-    ldout(async_msgr->cct, 20) << __func__ << " short write did " << r << ", still have " << len << dendl;
+    ldoutf(async_msgr->cct, 20, "conn(%p sd=%d). %s short write did %d, still have %llu",
+           this, sd, __func__, r, (unsigned long long)len);
     while (r > 0) {
       if (msg.msg_iov[0].iov_len <= (size_t)r) {
         // lose this whole item
@@ -281,10 +319,50 @@ int AsyncConnection::_try_send(bufferlist send_bl, bool send)
     return -EINTR;
   }
 
+  int r;
+  if (shm_out) {
+    // whatever was queued before the switch drains on the socket first
+    r = _send_socket(tcp_outcoming_bl);
+    if (r == 0 && outcoming_bl.length())
+      r = _send_shm(outcoming_bl);
+  } else {
+    r = _send_socket(outcoming_bl);
+  }
+  if (r < 0)
+    return r;
+
+  // with shm the ring's eventfd wakes us up instead of the socket
+  bool want_write = shm_out ? tcp_outcoming_bl.length() : is_queued();
+  if (!open_write && want_write) {
+    center->create_file_event(sd, EVENT_WRITABLE, write_handler);
+    open_write = true;
+  }
+
+  if (open_write && !want_write) {
+    center->delete_file_event(sd, EVENT_WRITABLE);
+    open_write = false;
+  }
+
+  return outcoming_bl.length() + tcp_outcoming_bl.length();
+}
+
+static void trim_sent(bufferlist &bl, uint64_t sent)
+{
+  if (sent) {
+    bufferlist left;
+    if (sent < bl.length())
+      bl.splice(sent, bl.length()-sent, &left);
+    left.swap(bl);
+  }
+}
+
+// return the remaining bytes of bl, < 0 means error
+int AsyncConnection::_send_socket(bufferlist &bl)
+{
   int r = 0;
   uint64_t sended = 0;
-  list<bufferptr>::const_iterator pb = outcoming_bl.buffers().begin();
-  uint64_t left_pbrs = outcoming_bl.buffers().size();
+  bufferlist::buffers_t::const_iterator pb = bl.buffers().begin();
+  uint64_t left_pbrs = bl.buffers().size();
   while (left_pbrs) {
     struct msghdr msg;
     uint64_t size = MIN(left_pbrs, IOV_LEN);
@@ -317,28 +395,32 @@ int AsyncConnection::_try_send(bufferlist send_bl, bool send)
     // only "r" == 0 continue
   }
 
-  // trim already sent for outcoming_bl
-  if (sended) {
-    bufferlist bl;
-    if (sended < outcoming_bl.length())
-      outcoming_bl.splice(sended, outcoming_bl.length()-sended, &bl);
-    bl.swap(outcoming_bl);
-  }
-
-  ldout(async_msgr->cct, 20) << __func__ << " send bytes " << sended
-                             << " remaining bytes " << outcoming_bl.length() << dendl;
+  // trim already sent for bl
+  trim_sent(bl, sended);
 
-  if (!open_write && is_queued()) {
-    center->create_file_event(sd, EVENT_WRITABLE, write_handler);
-    open_write = true;
-  }
+  ldoutf(async_msgr->cct, 20, "conn(%p sd=%d). %s send bytes %llu remaining bytes %u",
+         this, sd, __func__, (unsigned long long)sended, bl.length());
+  return bl.length();
+}
 
-  if (open_write && !is_queued()) {
-    center->delete_file_event(sd, EVENT_WRITABLE);
-    open_write = false;
+// copy as much of bl as fits into the shm ring; return the remaining bytes
+int AsyncConnection::_send_shm(bufferlist &bl)
+{
+  uint64_t sent = 0;
+  for (bufferlist::buffers_t::const_iterator pb = bl.buffers().begin();
+       pb != bl.buffers().end(); ++pb) {
+    int r = shm->write(pb->c_str(), pb->length());
+    if (r < 0)
+      return r;
+    sent += r;
+    if (r < (int)pb->length())
+      break;
   }
+  trim_sent(bl, sent);
 
-  return outcoming_bl.length();
+  ldoutf(async_msgr->cct, 20, "conn(%p sd=%d). %s send bytes %llu remaining bytes %u",
+         this, sd, __func__, (unsigned long long)sent, bl.length());
+  return bl.length();
 }
 
 // Because this func will be called multi times to populate
@@ -367,8 +449,8 @@ int AsyncConnection::read_until(uint64_t needed, bufferptr &p)
   } while (r > 0);
 
   state_offset = offset;
-  ldout(async_msgr->cct, 20) << __func__ << " read " << r << " bytes, state is "
-                      << get_state_name(state) << dendl;
+  ldoutf(async_msgr->cct, 20, "conn(%p sd=%d). %s read %d bytes, state is %s",
+         this, sd, __func__, r, get_state_name(state));
   return needed - offset;
 }
 
@@ -407,6 +489,8 @@ void AsyncConnection::process()
             state = STATE_OPEN_MESSAGE_HEADER;
           } else if (tag == CEPH_MSGR_TAG_CLOSE) {
             state = STATE_OPEN_TAG_CLOSE;
+          } else if (tag == CEPH_MSGR_TAG_SHM && !shm_in) {
+            state = STATE_OPEN_TAG_SHM;
           } else {
             ldout(async_msgr->cct, 0) << __func__ << " bad tag " << (int)tag << dendl;
             goto fail;
@@ -471,6 +555,50 @@ void AsyncConnection::process()
           break;
         }
 
+      case STATE_OPEN_TAG_SHM:
+        {
+          ceph_le64 *cookie;
+          r = read_until(sizeof(*cookie), state_buffer);
+          if (r < 0) {
+            ldout(async_msgr->cct, 1) << __func__ << " read shm cookie failed" << dendl;
+            goto fail;
+          } else if (r > 0) {
+            break;
+          }
+
+          cookie = (ceph_le64*)(state_buffer.c_str());
+          ldout(async_msgr->cct, 10) << __func__ << " got SHM cookie " << *cookie << dendl;
+          if (shm) {
+            // the server's answer to our announcement; the rest of its
+            // stream is in the ring
+            if (*cookie != shm_cookie) {
+              ldout(async_msgr->cct, 0) << __func__ << " shm cookie mismatch" << dendl;
+              goto fail;
+            }
+            _shm_switch_in();
+          } else {
+            shm = async_msgr->shm_claim(*cookie);
+            if (!shm) {
+              ldout(async_msgr->cct, 0) << __func__ << " no shm channel for cookie "
+                                        << *cookie << dendl;
+              goto fail;
+            }
+            shm_cookie = *cookie;
+            _shm_switch_in();
+
+            // answer on the socket, then move our direction over as well
+            bufferlist bl;
+            bl.append((char)CEPH_MSGR_TAG_SHM);
+            bl.append((char*)cookie, sizeof(*cookie));
+            _try_send(bl, false);
+            _shm_switch_out();
+            if (_try_send(bufferlist()) < 0)
+              goto fail;
+          }
+          state = STATE_OPEN;
+          break;
+        }
+
       case STATE_OPEN_MESSAGE_HEADER:
         {
           ldout(async_msgr->cct, 20) << __func__ << " begin MSG" << dendl;
@@ -578,7 +706,8 @@ void AsyncConnection::process()
             }
 
             front.push_back(ptr);
-            ldout(async_msgr->cct, 20) << __func__ << " got front " << front.length() << dendl;
+            ldoutf(async_msgr->cct, 20, "conn(%p sd=%d). %s got front %u",
+                   this, sd, __func__, front.length());
           }
           state = STATE_OPEN_MESSAGE_READ_MIDDLE;
           break;
@@ -598,7 +727,8 @@ void AsyncConnection::process()
               break;
             }
             middle.push_back(ptr);
-            ldout(async_msgr->cct, 20) << __func__ << " got middle " << middle.length() << dendl;
+            ldoutf(async_msgr->cct, 20, "conn(%p sd=%d). %s got middle %u",
+                   this, sd, __func__, middle.length());
           }
 
           state = STATE_OPEN_MESSAGE_READ_DATA_PREPARE;
@@ -695,8 +825,8 @@ void AsyncConnection::process()
             goto fail;
           }
 
-          ldout(async_msgr->cct, 20) << __func__ << " got " << front.length() << " + " << middle.length()
-                              << " + " << data.length() << " byte message" << dendl;
+          ldoutf(async_msgr->cct, 20, "conn(%p sd=%d). %s got %u + %u + %u byte message",
+                 this, sd, __func__, front.length(), middle.length(), data.length());
           Message *message = decode_message(async_msgr->cct, current_header, footer, front, middle, data);
           if (!message) {
             ldout(async_msgr->cct, 1) << __func__ << " decode message failed " << dendl;
@@ -762,7 +892,10 @@ void AsyncConnection::process()
             async_msgr->ms_fast_dispatch(message);
             lock.Lock();
           } else {
-            center->create_time_event(1, EventCallbackRef(new C_handle_dispatch(async_msgr, message)));
+            // everything read in this pass is delivered by one event
+            if (dispatch_q.empty())
+              center->create_time_event(1, dispatch_handler);
+            dispatch_q.push_back(message);
           }
 
           break;
@@ -1143,6 +1276,9 @@ int AsyncConnection::_process_connection()
           session_security.reset();
         }
 
+        if (_shm_connect() < 0)
+          goto fail;
+
         center->dispatch_event_external(connect_handler);
         async_msgr->ms_deliver_handle_fast_connect(this);
 
@@ -1815,6 +1951,8 @@ void AsyncConnection::fault()
     center->delete_file_event(sd, EVENT_READABLE|EVENT_WRITABLE);
   }
   open_write = false;
+  // a new session renegotiates shm from scratch
+  _shm_close();
 
   // requeue sent items
   requeue_sent();
@@ -1876,16 +2014,219 @@ void AsyncConnection::_stop()
   discard_out_queue();
   outcoming_bl.clear();
   open_write = false;
+  _shm_close();
   state = STATE_CLOSED;
   ::close(sd);
   sd = -1;
-  async_msgr->unregister_conn(peer_addr);
+  async_msgr->unregister_conn(this);
   // Here we need to dispatch "signal" event, because we want to ensure signal
   // it after all events called by this "_stop" has be done.
   center->dispatch_event_external(signal_handler);
   put();
 }
 
+void AsyncConnection::process_dispatch()
+{
+  list<Message*> q;
+  {
+    Mutex::Locker l(lock);
+    q.swap(dispatch_q);
+  }
+  ldout(async_msgr->cct, 20) << __func__ << " delivering " << q.size() << " messages" << dendl;
+  for (list<Message*>::iterator p = q.begin(); p != q.end(); ++p)
+    async_msgr->ms_deliver_dispatch(*p);
+}
+
+// Offer the peer a shared memory channel if it lives on our host.  The
+// channel travels over the peer's unix socket; once the peer acks it,
+// handle_shm_ack sends CEPH_MSGR_TAG_SHM on the TCP stream to mark where
+// our bytes continue in the ring.  We keep talking TCP meanwhile, and
+// any failure short of a socket error just leaves the connection there.
+int AsyncConnection::_shm_connect()
+{
+  const md_config_t *conf = async_msgr->cct->_conf;
+  if (!conf->ms_async_shm || shm || shm_connecting)
+    return 0;
+
+  entity_addr_t me, peer;
+  socklen_t len = sizeof(me.ss_addr());
+  if (::getsockname(sd, (sockaddr*)&me.ss_addr(), &len) < 0)
+    return 0;
+  len = sizeof(peer.ss_addr());
+  if (::getpeername(sd, (sockaddr*)&peer.ss_addr(), &len) < 0)
+    return 0;
+  if (!me.is_same_host(peer))
+    return 0;
+
+  string path = async_msgr->get_shm_path(get_peer_addr());
+  struct sockaddr_un sa;
+  memset(&sa, 0, sizeof(sa));
+  if (path.length() >= sizeof(sa.sun_path))
+    return 0;
+  sa.sun_family = AF_UNIX;
+  strcpy(sa.sun_path, path.c_str());
+  int usd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (usd < 0)
+    return 0;
+  if (::connect(usd, (sockaddr*)&sa, sizeof(sa)) < 0) {
+    ldout(async_msgr->cct, 10) << __func__ << " peer takes no shm channels at "
+                               << path << ": " << cpp_strerror(errno) << dendl;
+    ::close(usd);
+    return 0;
+  }
+
+  uint64_t ring_size = 4096;
+  while (ring_size < conf->ms_async_shm_ring_size)
+    ring_size <<= 1;
+  uint64_t cookie;
+  ShmChannel *ch = new ShmChannel(async_msgr->cct);
+  int r = get_random_bytes((char*)&cookie, sizeof(cookie));
+  if (r == 0)
+    r = ch->create(ring_size);
+  if (r == 0)
+    r = ch->connect(usd, cookie);
+  if (r < 0) {
+    ldout(async_msgr->cct, 1) << __func__ << " shm handshake failed: "
+                              << cpp_strerror(r) << dendl;
+    ::close(usd);
+    delete ch;
+    return 0;
+  }
+
+  // wait for the ack on our event loop, not in recv
+  ldout(async_msgr->cct, 10) << __func__ << " offered shm, cookie " << cookie << dendl;
+  shm_connecting = ch;
+  shm_connect_sd = usd;
+  shm_connect_cookie = cookie;
+  shm_connect_deadline = ceph_clock_now(async_msgr->cct);
+  shm_connect_deadline += conf->ms_async_shm_handshake_timeout;
+  center->create_file_event(usd, EVENT_READABLE, shm_ack_handler);
+  center->create_time_event(
+    (uint64_t)(conf->ms_async_shm_handshake_timeout * 1000000) + 1,
+    shm_ack_handler);
+  return 0;
+}
+
+void AsyncConnection::handle_shm_ack()
+{
+  Mutex::Locker l(lock);
+  if (!shm_connecting)
+    return;
+  int r = shm_connecting->finish_connect(shm_connect_sd);
+  if (r == -EAGAIN) {
+    // a timeout event from an earlier handshake may fire early
+    if (ceph_clock_now(async_msgr->cct) < shm_connect_deadline)
+      return;
+    r = -ETIMEDOUT;
+  }
+  ShmChannel *ch = shm_connecting;
+  shm_connecting = NULL;
+  _shm_connect_close();
+  if (r < 0 || state != STATE_OPEN) {
+    ldout(async_msgr->cct, 1) << __func__ << " shm handshake failed: "
+                              << cpp_strerror(r) << dendl;
+    delete ch;
+    return;
+  }
+
+  ldout(async_msgr->cct, 10) << __func__ << " switching to shm, cookie "
+                             << shm_connect_cookie << dendl;
+  shm = ch;
+  shm_cookie = shm_connect_cookie;
+  ceph_le64 c;
+  c = shm_cookie;
+  bufferlist bl;
+  bl.append((char)CEPH_MSGR_TAG_SHM);
+  bl.append((char*)&c, sizeof(c));
+  _try_send(bl, false);
+  _shm_switch_out();
+  if (_try_send(bufferlist()) < 0)
+    fault();
+}
+
+void AsyncConnection::_shm_connect_close()
+{
+  if (shm_connect_sd < 0)
+    return;
+  center->delete_file_event(shm_connect_sd, EVENT_READABLE);
+  ::close(shm_connect_sd);
+  shm_connect_sd = -1;
+}
+
+void AsyncConnection::_shm_switch_in()
+{
+  assert(shm && !shm_in);
+  if (!shm_out)
+    center->create_file_event(shm->get_event_fd(), EVENT_READABLE, shm_handler);
+  shm_in = true;
+  // nothing but EOF or garbage can arrive on the socket now
+  center->delete_file_event(sd, EVENT_READABLE);
+  center->create_file_event(sd, EVENT_READABLE, shm_sd_handler);
+}
+
+void AsyncConnection::_shm_switch_out()
+{
+  assert(shm && !shm_out);
+  if (!shm_in)
+    center->create_file_event(shm->get_event_fd(), EVENT_READABLE, shm_handler);
+  shm_out = true;
+  // everything up to and including our TAG_SHM still belongs to TCP
+  tcp_outcoming_bl.claim_append(outcoming_bl);
+}
+
+void AsyncConnection::_shm_close()
+{
+  if (shm_connecting) {
+    _shm_connect_close();
+    delete shm_connecting;
+    shm_connecting = NULL;
+  }
+  if (!shm)
+    return;
+  ldout(async_msgr->cct, 10) << __func__ << dendl;
+  if (shm_in || shm_out)
+    center->delete_file_event(shm->get_event_fd(), EVENT_READABLE);
+  delete shm;
+  shm = NULL;
+  shm_cookie = 0;
+  shm_in = shm_out = false;
+  tcp_outcoming_bl.clear();
+}
+
+void AsyncConnection::handle_shm_event()
+{
+  bool want_write;
+  {
+    Mutex::Locker l(lock);
+    if (!shm)
+      return;
+    shm->clear_event();
+    want_write = shm_out && is_queued();
+  }
+  process();
+  if (want_write)
+    handle_write();
+
+  Mutex::Locker l(lock);
+  // process() stops early when throttled and won't rearm the eventfd
+  if (shm_in && shm->has_data())
+    center->create_time_event(1000, shm_handler);
+}
+
+void AsyncConnection::handle_shm_sd()
+{
+  Mutex::Locker l(lock);
+  if (!shm_in)
+    return;
+  char c;
+  int r = ::recv(sd, &c, 1, MSG_PEEK|MSG_DONTWAIT);
+  if (r < 0 && (errno == EAGAIN || errno == EINTR))
+    return;
+  ldout(async_msgr->cct, 1) << __func__ << " peer socket "
+                            << (r == 0 ? "closed" : "misbehaved") << dendl;
+  fault();
+}
+
 int AsyncConnection::_send(Message *m)
 {
   m->set_seq(++out_seq);
@@ -32,6 +32,7 @@ using namespace std;
 #include "msg/Messenger.h"
 
 class AsyncMessenger;
+class ShmChannel;
 
 /*
  * AsyncConnection maintains a logic session between two endpoints. In other
@@ -48,6 +49,8 @@ class AsyncConnection : public Connection {
   // if "send" is false, it will only append bl to send buffer
   // the main usage is avoid error happen outside messenger threads
   int _try_send(bufferlist bl, bool send=true);
+  int _send_socket(bufferlist &bl);
+  int _send_shm(bufferlist &bl);
   int _send(Message *m);
   int read_until(uint64_t needed, bufferptr &p);
   int _process_connection();
@@ -64,6 +67,12 @@ class AsyncConnection : public Connection {
   void handle_ack(uint64_t seq);
   void _send_keepalive_or_ack(bool ack=false, utime_t *t=NULL);
   int write_message(ceph_msg_header& header, ceph_msg_footer& footer, bufferlist& blist);
+  // shared memory transport, see CEPH_MSGR_TAG_SHM
+  int _shm_connect();
+  void _shm_connect_close();
+  void _shm_switch_in();
+  void _shm_switch_out();
+  void _shm_close();
   int _reply_accept(char tag, ceph_msg_connect &connect, ceph_msg_connect_reply &reply,
                     bufferlist authorizer_reply) {
     bufferlist reply_bl;
@@ -82,7 +91,7 @@ class AsyncConnection : public Connection {
     return 0;
   }
   bool is_queued() {
-    return !out_q.empty() || outcoming_bl.length();
+    return !out_q.empty() || outcoming_bl.length() || tcp_outcoming_bl.length();
   }
   void shutdown_socket() {
     if (sd >= 0)
@@ -158,6 +167,7 @@ class AsyncConnection : public Connection {
     STATE_OPEN_KEEPALIVE2,
     STATE_OPEN_KEEPALIVE2_ACK,
     STATE_OPEN_TAG_ACK,
+    STATE_OPEN_TAG_SHM,
     STATE_OPEN_MESSAGE_HEADER,
     STATE_OPEN_MESSAGE_THROTTLE_MESSAGE,
     STATE_OPEN_MESSAGE_THROTTLE_BYTES,
@@ -194,6 +204,7 @@ class AsyncConnection : public Connection {
                                         "STATE_OPEN_KEEPALIVE2",
                                         "STATE_OPEN_KEEPALIVE2_ACK",
                                         "STATE_OPEN_TAG_ACK",
+                                        "STATE_OPEN_TAG_SHM",
                                         "STATE_OPEN_MESSAGE_HEADER",
                                         "STATE_OPEN_MESSAGE_THROTTLE_MESSAGE",
                                         "STATE_OPEN_MESSAGE_THROTTLE_BYTES",
@@ -252,6 +263,8 @@ class AsyncConnection : public Connection {
   EventCallbackRef fast_accept_handler;
   EventCallbackRef stop_handler;
   EventCallbackRef signal_handler;
+  EventCallbackRef dispatch_handler;
+  list<Message*> dispatch_q;  // read but not yet delivered to ms_deliver_dispatch
   bool keepalive;
   struct iovec msgvec[IOV_LEN];
   Mutex stop_lock; // used to protect `mark_down_cond`
@@ -281,6 +294,22 @@ class AsyncConnection : public Connection {
   // used only by "read_until"
   uint64_t state_offset;
   bufferlist outcoming_bl;
+  // Shared memory state.  Once shm_out is set outcoming_bl goes into the
+  // ring, and tcp_outcoming_bl holds what must still drain on the socket
+  // ahead of it.  Once shm_in is set we read from the ring and only watch
+  // sd for the peer going away.
+  ShmChannel *shm;
+  uint64_t shm_cookie;
+  bool shm_in, shm_out;
+  bufferlist tcp_outcoming_bl;
+  EventCallbackRef shm_handler;
+  EventCallbackRef shm_sd_handler;
+  // a channel offered to the peer, waiting for its ack on shm_connect_sd
+  ShmChannel *shm_connecting;
+  int shm_connect_sd;
+  uint64_t shm_connect_cookie;
+  utime_t shm_connect_deadline;
+  EventCallbackRef shm_ack_handler;
   NetHandler net;
   EventCenter *center;
   ceph::shared_ptr<AuthSessionHandler> session_security;
@@ -289,6 +318,10 @@ class AsyncConnection : public Connection {
   // used by eventcallback
   void handle_write();
   void process();
+  void process_dispatch();
+  void handle_shm_event();
+  void handle_shm_sd();
+  void handle_shm_ack();
   // Helper: only called by C_handle_stop
   void stop() {
     Mutex::Locker l(lock);
@@ -18,6 +18,7 @@
 #include <iostream>
 #include <fstream>
 #include <poll.h>
+#include <sys/un.h>
 
 #include "AsyncMessenger.h"
 
@@ -26,6 +27,7 @@
 #include "common/errno.h"
 #include "auth/Crypto.h"
 #include "include/Spinlock.h"
+#include "include/str_list.h"
 
 #define dout_subsys ceph_subsys_ms
 #undef dout_prefix
@@ -54,6 +56,47 @@ class C_handle_accept : public EventCallback {
   }
 };
 
+// Receives the channel once the unix socket turns readable, or gives up
+// when the timeout event fires first.
+class C_handle_shm_hello : public EventCallback {
+  AsyncMessenger *msgr;
+  EventCenter *center;
+  int fd;
+  utime_t deadline;
+
+ public:
+  C_handle_shm_hello(AsyncMessenger *m, EventCenter *c, int s, utime_t d)
+    : msgr(m), center(c), fd(s), deadline(d) {}
+  void do_request(int id) {
+    if (fd < 0)
+      return;
+    int r = msgr->shm_accept(fd);
+    if (r == -EAGAIN && ceph_clock_now(msgr->cct) < deadline)
+      return;
+    center->delete_file_event(fd, EVENT_READABLE);
+    msgr->shm_accept_finish(fd);
+    fd = -1;
+  }
+};
+
+class C_handle_shm_accept : public EventCallback {
+  AsyncMessenger *msgr;
+  EventCenter *center;
+  int fd;
+
+ public:
+  C_handle_shm_accept(AsyncMessenger *m, EventCenter *c, int s)
+    : msgr(m), center(c), fd(s) {}
+  void do_request(int id) {
+    double timeout = msgr->cct->_conf->ms_async_shm_handshake_timeout;
+    utime_t deadline = ceph_clock_now(msgr->cct);
+    deadline += timeout;
+    EventCallbackRef h(new C_handle_shm_hello(msgr, center, fd, deadline));
+    center->create_file_event(fd, EVENT_READABLE, h);
+    center->create_time_event((uint64_t)(timeout * 1000000) + 1, h);
+  }
+};
+
 class C_handle_connect : public EventCallback {
   AsyncConnectionRef conn;
   const entity_addr_t addr;
@@ -175,10 +218,55 @@ int Processor::bind(const entity_addr_t &bind_addr, const set<int>& avoid_ports)
 
   msgr->init_local_connection();
 
+  if (conf->ms_async_shm)
+    bind_shm();
+
   ldout(msgr->cct,1) << __func__ << " bind my_inst.addr is " << msgr->get_myaddr() << dendl;
   return 0;
 }
 
+void Processor::bind_shm()
+{
+  shm_path = msgr->get_shm_path(msgr->get_myaddr());
+  struct sockaddr_un sa;
+  memset(&sa, 0, sizeof(sa));
+  if (shm_path.length() >= sizeof(sa.sun_path)) {
+    lderr(msgr->cct) << __func__ << " path " << shm_path << " too long, "
+                     << "not accepting shared memory connections" << dendl;
+    return;
+  }
+  sa.sun_family = AF_UNIX;
+  strcpy(sa.sun_path, shm_path.c_str());
+
+  shm_listen_sd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (shm_listen_sd < 0) {
+    lderr(msgr->cct) << __func__ << " unable to create socket: "
+                     << cpp_strerror(errno) << dendl;
+    return;
+  }
+  // our nonce is unique, so anything there is left over from a crash
+  ::unlink(shm_path.c_str());
+  if (::bind(shm_listen_sd, (struct sockaddr*)&sa, sizeof(sa)) < 0 ||
+      ::listen(shm_listen_sd, 128) < 0) {
+    lderr(msgr->cct) << __func__ << " unable to listen on " << shm_path << ": "
+                     << cpp_strerror(errno) << dendl;
+    ::close(shm_listen_sd);
+    shm_listen_sd = -1;
+    return;
+  }
+  ldout(msgr->cct, 10) << __func__ << " accepting shared memory channels on "
+                       << shm_path << dendl;
+}
+
+void Processor::close_shm()
+{
+  if (shm_listen_sd >= 0) {
+    ::close(shm_listen_sd);
+    shm_listen_sd = -1;
+    ::unlink(shm_path.c_str());
+  }
+}
+
 int Processor::rebind(const set<int>& avoid_ports)
 {
   ldout(msgr->cct, 1) << __func__ << " rebind avoid " << avoid_ports << dendl;
@@ -216,22 +304,38 @@ void *Processor::entry()
   ldout(msgr->cct, 10) << __func__ << " starting" << dendl;
   int errors = 0;
 
-  struct pollfd pfd;
-  pfd.fd = listen_sd;
-  pfd.events = POLLIN | POLLERR | POLLNVAL | POLLHUP;
+  struct pollfd pfd[2];
+  pfd[0].fd = listen_sd;
+  pfd[0].events = POLLIN | POLLERR | POLLNVAL | POLLHUP;
+  pfd[1].fd = shm_listen_sd;
+  pfd[1].events = POLLIN | POLLERR | POLLNVAL | POLLHUP;
+  int nfds = shm_listen_sd >= 0 ? 2 : 1;
   while (!done) {
     ldout(msgr->cct, 20) << __func__ << " calling poll" << dendl;
-    int r = poll(&pfd, 1, -1);
+    int r = poll(pfd, nfds, -1);
     if (r < 0)
       break;
     ldout(msgr->cct,20) << __func__ << " poll got " << r << dendl;
 
-    if (pfd.revents & (POLLERR | POLLNVAL | POLLHUP))
+    if (pfd[0].revents & (POLLERR | POLLNVAL | POLLHUP))
       break;
 
-    ldout(msgr->cct,10) << __func__ << " pfd.revents=" << pfd.revents << dendl;
+    ldout(msgr->cct,10) << __func__ << " pfd.revents=" << pfd[0].revents << dendl;
     if (done) break;
 
+    if (nfds > 1 && pfd[1].revents) {
+      if (pfd[1].revents & POLLIN) {
+        int sd = ::accept(shm_listen_sd, NULL, NULL);
+        if (sd >= 0)
+          msgr->add_shm_accept(sd);
+      } else {
+        // stop watching a broken unix socket, keep serving TCP
+        nfds = 1;
+      }
+    }
+    if (!(pfd[0].revents & POLLIN))
+      continue;
+
     // accept
     entity_addr_t addr;
     socklen_t slen = sizeof(addr.ss_addr());
@@ -255,6 +359,7 @@ void *Processor::entry()
     ::close(listen_sd);
     listen_sd = -1;
   }
+  close_shm();
   ldout(msgr->cct,10) << __func__ << " stopping" << dendl;
   return 0;
 }
@@ -267,6 +372,9 @@ void Processor::stop()
   if (listen_sd >= 0) {
     ::shutdown(listen_sd, SHUT_RDWR);
   }
+  if (shm_listen_sd >= 0) {
+    ::shutdown(shm_listen_sd, SHUT_RDWR);
+  }
 
   // wait for thread to stop before closing the socket, to avoid
   // racing against fd re-use.
@@ -278,6 +386,7 @@ void Processor::stop()
     ::close(listen_sd);
     listen_sd = -1;
   }
+  close_shm();
   done = false;
 }
 
@@ -288,11 +397,40 @@ void Worker::stop()
   center.wakeup();
 }
 
+void Worker::set_affinity()
+{
+  list<string> cores;
+  get_str_list(cct->_conf->ms_async_affinity_cores, cores);
+  if (cores.empty())
+    return;
+  list<string>::iterator p = cores.begin();
+  for (int i = id % cores.size(); i > 0; --i)
+    ++p;
+  int core = atoi(p->c_str());
+#if defined(__linux__)
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  CPU_SET(core, &cpuset);
+  int r = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+  if (r != 0) {
+    lderr(cct) << __func__ << " failed to pin to core " << core << ": "
+               << cpp_strerror(r) << dendl;
+    return;
+  }
+  ldout(cct, 1) << __func__ << " worker " << id << " pinned to core " << core << dendl;
+#else
+  ldout(cct, 1) << __func__ << " cpu affinity not supported, ignoring core "
+                << core << dendl;
+#endif
+}
+
 void *Worker::entry()
 {
   ldout(cct, 10) << __func__ << " starting" << dendl;
   int r;
 
+  set_affinity();
+
   while (!done) {
     ldout(cct, 20) << __func__ << " calling event process" << dendl;
 
@@ -316,7 +454,7 @@ const string WorkerPool::name = "AsyncMessenger::WorkerPool";
 WorkerPool::WorkerPool(CephContext *c): cct(c), seq(0), started(false)
 {
   for (int i = 0; i < cct->_conf->ms_async_op_threads; ++i) {
-    Worker *w = new Worker(cct);
+    Worker *w = new Worker(cct, i);
     workers.push_back(w);
   }
 }
@@ -349,13 +487,15 @@ AsyncMessenger::AsyncMessenger(CephContext *cct, entity_name_t name,
                                string mname, uint64_t _nonce)
   : SimplePolicyMessenger(cct, name,mname, _nonce),
     processor(this, _nonce),
-    lock("AsyncMessenger::lock"),
+    lock("AsyncMessenger::lock"), my_addr(NULL),
     nonce(_nonce), did_bind(false),
-    global_seq(0),
+    global_seq(0), shm_lock("AsyncMessenger::shm_lock"), shm_accepting(0),
     cluster_protocol(0), stopped(true)
 {
   ceph_spin_init(&global_seq_lock);
   cct->lookup_or_create_singleton_object<WorkerPool>(pool, WorkerPool::name);
+  for (unsigned i = 0; i < pool->get_num_workers(); ++i)
+    conn_shards.push_back(new ConnShard);
   local_connection = new AsyncConnection(cct, this, &pool->get_worker()->center);
   init_local_connection();
 }
@@ -367,6 +507,17 @@ AsyncMessenger::AsyncMessenger(CephContext *cct, entity_name_t name,
 AsyncMessenger::~AsyncMessenger()
 {
   assert(!did_bind); // either we didn't bind or we shut down the Processor
+  for (unsigned i = 0; i < conn_shards.size(); ++i) {
+    assert(conn_shards[i]->conns.empty());
+    assert(conn_shards[i]->accepting_conns.empty());
+    delete conn_shards[i];
+  }
+  for (map<uint64_t, pair<utime_t, ShmChannel*> >::iterator p = shm_pending.begin();
+       p != shm_pending.end(); ++p)
+    delete p->second.second;
+  for (vector<entity_addr_t*>::iterator p = my_addr_copies.begin();
+       p != my_addr_copies.end(); ++p)
+    delete *p;
 }
 
 void AsyncMessenger::ready()
@@ -463,17 +614,15 @@ void AsyncMessenger::wait()
   did_bind = false;
   ldout(cct,20) << __func__ << ": stopped processor thread" << dendl;
 
-  // close all connections
-  lock.Lock();
-  {
-    ldout(cct, 10) << __func__ << ": closing connections" << dendl;
+  // the processor is gone, so no new handshakes can be queued
+  shm_lock.Lock();
+  while (shm_accepting)
+    shm_cond.Wait(shm_lock);
+  shm_lock.Unlock();
 
-    while (!conns.empty()) {
-      AsyncConnectionRef p = conns.begin()->second;
-      _stop_conn(p);
-    }
-  }
-  lock.Unlock();
+  // close all connections
+  ldout(cct, 10) << __func__ << ": closing connections" << dendl;
+  _mark_down_all(false);
 
   ldout(cct, 10) << __func__ << ": done." << dendl;
   ldout(cct, 1) << __func__ << " complete." << dendl;
@@ -482,42 +631,138 @@ void AsyncMessenger::wait()
 
 AsyncConnectionRef AsyncMessenger::add_accept(int sd)
 {
-  lock.Lock();
   Worker *w = pool->get_worker();
   AsyncConnectionRef conn = new AsyncConnection(cct, this, &w->center);
+  {
+    ConnShard *shard = get_accepting_shard(conn.get());
+    Mutex::Locker l(shard->lock);
+    shard->accepting_conns.insert(conn);
+  }
   w->center.dispatch_event_external(EventCallbackRef(new C_handle_accept(conn, sd)));
-  accepting_conns.insert(conn);
-  lock.Unlock();
   return conn;
 }
 
+string AsyncMessenger::get_shm_path(const entity_addr_t& addr)
+{
+  // port and nonce are enough to tell local messengers apart
+  ostringstream ss;
+  ss << cct->_conf->ms_async_shm_dir << "/shm-" << addr.get_port()
+     << "-" << addr.nonce << ".sock";
+  return ss.str();
+}
+
+void AsyncMessenger::add_shm_accept(int sd)
+{
+  {
+    Mutex::Locker l(shm_lock);
+    if (shm_accepting + shm_pending.size() >=
+	(unsigned)cct->_conf->ms_async_shm_max_pending) {
+      ldout(cct, 1) << __func__ << " too many shm handshakes pending, "
+		    << "refusing one" << dendl;
+      ::close(sd);
+      return;
+    }
+    ++shm_accepting;
+  }
+  Worker *w = pool->get_worker();
+  w->center.dispatch_event_external(
+    EventCallbackRef(new C_handle_shm_accept(this, &w->center, sd)));
+}
+
+void AsyncMessenger::shm_accept_finish(int sd)
+{
+  ::close(sd);
+  Mutex::Locker l(shm_lock);
+  if (--shm_accepting == 0)
+    shm_cond.Signal();
+}
+
+int AsyncMessenger::shm_accept(int sd)
+{
+  ShmChannel *ch = new ShmChannel(cct);
+  uint64_t cookie;
+  int r = ch->accept(sd, &cookie);
+  if (r < 0) {
+    if (r != -EAGAIN)
+      ldout(cct, 1) << __func__ << " failed to receive channel: " << cpp_strerror(r) << dendl;
+    else
+      ldout(cct, 20) << __func__ << " channel not sent yet" << dendl;
+    delete ch;
+    return r;
+  }
+
+  utime_t now = ceph_clock_now(cct);
+  {
+    Mutex::Locker l(shm_lock);
+    // drop channels whose client never showed up on TCP
+    map<uint64_t, pair<utime_t, ShmChannel*> >::iterator p = shm_pending.begin();
+    while (p != shm_pending.end()) {
+      if (now - p->second.first > utime_t(10, 0)) {
+        delete p->second.second;
+        shm_pending.erase(p++);
+      } else {
+        ++p;
+      }
+    }
+    if (shm_pending.count(cookie)) {
+      ldout(cct, 1) << __func__ << " duplicate cookie " << cookie << dendl;
+      delete ch;
+      return -EEXIST;
+    }
+    shm_pending[cookie] = make_pair(now, ch);
+  }
+
+  ldout(cct, 10) << __func__ << " parked channel " << ch << " cookie " << cookie << dendl;
+  // only now may the client announce the channel on its connection
+  char ack = 0;
+  if (::write(sd, &ack, 1) != 1) {
+    delete shm_claim(cookie);
+    return -EPIPE;
+  }
+  return 0;
+}
+
+ShmChannel *AsyncMessenger::shm_claim(uint64_t cookie)
+{
+  Mutex::Locker l(shm_lock);
+  map<uint64_t, pair<utime_t, ShmChannel*> >::iterator p = shm_pending.find(cookie);
+  if (p == shm_pending.end())
+    return NULL;
+  ShmChannel *ch = p->second.second;
+  shm_pending.erase(p);
+  return ch;
+}
+
 AsyncConnectionRef AsyncMessenger::create_connect(const entity_addr_t& addr, int type)
 {
-  assert(lock.is_locked());
-  assert(addr != my_inst.addr);
+  assert(!is_my_addr(addr));
 
   ldout(cct, 10) << __func__ << " " << addr
                  << ", creating connection and registering" << dendl;
 
-  // create connection
-  Worker *w = pool->get_worker();
+  // create connection on the worker that owns addr's shard
+  unsigned i = get_conn_shard_index(addr);
+  ConnShard *shard = conn_shards[i];
+  assert(shard->lock.is_locked());
+  Worker *w = pool->get_worker(i);
   AsyncConnectionRef conn = new AsyncConnection(cct, this, &w->center);
   conn->connect(addr, type);
-  assert(!conns.count(addr));
-  conns[addr] = conn;
+  assert(!shard->conns.count(addr));
+  shard->conns[addr] = conn;
 
   return conn;
 }
 
 ConnectionRef AsyncMessenger::get_connection(const entity_inst_t& dest)
 {
-  Mutex::Locker l(lock);
-  if (my_inst.addr == dest.addr) {
+  if (is_my_addr(dest.addr)) {
     // local
     return local_connection;
   }
 
-  AsyncConnectionRef conn = _lookup_conn(dest.addr);
+  ConnShard *shard = get_conn_shard(dest.addr);
+  Mutex::Locker l(shard->lock);
+  AsyncConnectionRef conn = _lookup_conn(shard, dest.addr);
   if (conn) {
     ldout(cct, 10) << __func__ << " " << dest << " existing " << conn << dendl;
   } else {
@@ -546,7 +791,7 @@ int AsyncMessenger::_send_message(Message *m, const entity_inst_t& dest)
     return -EINVAL;
   }
 
-  AsyncConnectionRef conn = _lookup_conn(dest.addr);
+  AsyncConnectionRef conn = lookup_conn(dest.addr);
   submit_message(m, conn, dest.addr, dest.name.type());
   return 0;
 }
@@ -573,7 +818,7 @@ void AsyncMessenger::submit_message(Message *m, AsyncConnectionRef con,
   }
 
   // local?
-  if (my_inst.addr == dest_addr) {
+  if (is_my_addr(dest_addr)) {
     // local
     ldout(cct, 20) << __func__ << " " << *m << " local" << dendl;
     m->set_connection(local_connection.get());
@@ -625,45 +870,68 @@ int AsyncMessenger::send_keepalive(Connection *con)
   return 0;
 }
 
-void AsyncMessenger::mark_down_all()
+void AsyncMessenger::_mark_down_all(bool reset)
 {
-  ldout(cct,1) << __func__ << " " << dendl;
-  lock.Lock();
-  for (set<AsyncConnectionRef>::iterator q = accepting_conns.begin();
-       q != accepting_conns.end(); ++q) {
-    AsyncConnectionRef p = *q;
-    ldout(cct, 5) << __func__ << " accepting_conn " << p << dendl;
-    p->mark_down();
-    p->get();
-    ms_deliver_handle_reset(p.get());
-  }
-  accepting_conns.clear();
+  for (unsigned i = 0; i < conn_shards.size(); ++i) {
+    ConnShard *shard = conn_shards[i];
+    set<AsyncConnectionRef> accepting;
+    ceph::unordered_map<entity_addr_t, AsyncConnectionRef> conns;
+    {
+      // mark_down waits on the connection's worker, which may need the
+      // shard lock to unregister, so drop it first
+      Mutex::Locker l(shard->lock);
+      accepting.swap(shard->accepting_conns);
+      conns.swap(shard->conns);
+    }
 
-  while (!conns.empty()) {
-    ceph::unordered_map<entity_addr_t, AsyncConnectionRef>::iterator it = conns.begin();
-    AsyncConnectionRef p = it->second;
-    ldout(cct, 5) << __func__ << " " << it->first << " " << p << dendl;
-    conns.erase(it);
-    p->mark_down();
-    p->get();
-    ms_deliver_handle_reset(p.get());
+    for (set<AsyncConnectionRef>::iterator q = accepting.begin();
+         q != accepting.end(); ++q) {
+      AsyncConnectionRef p = *q;
+      ldout(cct, 5) << __func__ << " accepting_conn " << p << dendl;
+      p->mark_down();
+      if (reset) {
+        p->get();
+        ms_deliver_handle_reset(p.get());
+      }
+    }
+
+    for (ceph::unordered_map<entity_addr_t, AsyncConnectionRef>::iterator it = conns.begin();
+         it != conns.end(); ++it) {
+      AsyncConnectionRef p = it->second;
+      ldout(cct, 5) << __func__ << " " << it->first << " " << p << dendl;
+      p->mark_down();
+      if (reset) {
+        p->get();
+        ms_deliver_handle_reset(p.get());
+      }
+    }
   }
-  lock.Unlock();
+}
+
+void AsyncMessenger::mark_down_all()
+{
+  ldout(cct,1) << __func__ << " " << dendl;
+  _mark_down_all(true);
 }
 
 void AsyncMessenger::mark_down(const entity_addr_t& addr)
 {
-  lock.Lock();
-  AsyncConnectionRef p = _lookup_conn(addr);
+  ConnShard *shard = get_conn_shard(addr);
+  AsyncConnectionRef p;
+  {
+    Mutex::Locker l(shard->lock);
+    p = _lookup_conn(shard, addr);
+    if (p)
+      shard->conns.erase(addr);
+  }
   if (p) {
     ldout(cct, 1) << __func__ << " " << addr << " -- " << p << dendl;
-    _stop_conn(p);
+    p->mark_down();
     p->get();
     ms_deliver_handle_reset(p.get());
   } else {
     ldout(cct, 1) << __func__ << " " << addr << " -- connection dne" << dendl;
   }
-  lock.Unlock();
 }
 
 int AsyncMessenger::get_proto_version(int peer_type, bool connect)
@@ -695,8 +963,9 @@ int AsyncMessenger::get_proto_version(int peer_type, bool connect)
 
 void AsyncMessenger::learned_addr(const entity_addr_t &peer_addr_for_me)
 {
-  // be careful here: multiple threads may block here, and readers of
-  // my_inst.addr do NOT hold any lock.
+  // be careful here: multiple threads may block here.  readers of
+  // my_inst.addr on the send paths go through is_my_addr(), which sees
+  // the new address once _init_local_connection() publishes it.
 
   // this always goes from true -> false under the protection of the
   // mutex.  if it is already false, we need not retake the mutex at
@@ -36,6 +36,7 @@ using namespace std;
 #include "include/assert.h"
 #include "AsyncConnection.h"
 #include "Event.h"
+#include "ShmChannel.h"
 
 
 class AsyncMessenger;
@@ -49,9 +50,16 @@ class Processor : public Thread {
   bool done;
   int listen_sd;
   uint64_t nonce;
+  /// unix socket local clients hand us shared memory channels through
+  int shm_listen_sd;
+  string shm_path;
+
+  void bind_shm();
+  void close_shm();
 
  public:
-  Processor(AsyncMessenger *r, uint64_t n) : msgr(r), done(false), listen_sd(-1), nonce(n) {}
+  Processor(AsyncMessenger *r, uint64_t n)
+    : msgr(r), done(false), listen_sd(-1), nonce(n), shm_listen_sd(-1) {}
 
   void *entry();
   void stop();
@@ -64,10 +72,14 @@ class Processor : public Thread {
 class Worker : public Thread {
   CephContext *cct;
   bool done;
+  int id;
+
+  /// pin ourselves to the core ms_async_affinity_cores assigns us, if any
+  void set_affinity();
 
  public:
   EventCenter center;
-  Worker(CephContext *c): cct(c), done(false), center(c) {
+  Worker(CephContext *c, int i): cct(c), done(false), id(i), center(c) {
     center.init(5000);
   }
   void *entry();
@@ -79,7 +91,7 @@ class WorkerPool: CephContext::AssociatedSingletonObject {
   WorkerPool(const WorkerPool &);
   WorkerPool& operator=(const WorkerPool &);
   CephContext *cct;
-  uint64_t seq;
+  atomic_t seq;
   vector<Worker*> workers;
   // Used to indicate whether thread started
   bool started;
@@ -89,7 +101,13 @@ class WorkerPool: CephContext::AssociatedSingletonObject {
   virtual ~WorkerPool();
   void start();
   Worker *get_worker() {
-    return workers[(seq++)%workers.size()];
+    return workers[seq.inc() % workers.size()];
+  }
+  Worker *get_worker(unsigned i) {
+    return workers[i % workers.size()];
+  }
+  unsigned get_num_workers() const {
+    return workers.size();
   }
   // uniq name for CephContext to distinguish differnt object
   static const string name;
@@ -165,8 +183,6 @@ public:
    * @{
    */
   virtual int send_message(Message *m, const entity_inst_t& dest) {
-          Mutex::Locker l(lock);
-
     return _send_message(m, dest);
   }
 
@@ -189,7 +205,6 @@ public:
    */
 
   Connection *create_anon_connection() {
-    Mutex::Locker l(lock);
     Worker *w = pool->get_worker();
     return new AsyncConnection(cct, this, &w->center);
   }
@@ -255,8 +270,33 @@ private:
   Processor processor;
   friend class Processor;
 
-  /// overall lock used for AsyncMessenger data structures
+  /// lock for my_inst and startup/shutdown state; not the connection tables
   Mutex lock;
+
+  /**
+   * my_inst.addr is rewritten under lock when we bind or learn our
+   * address, but is_my_addr() runs on every send and must not take lock.
+   * Each change publishes an immutable copy instead.  The old copies are
+   * kept until we go away, since a reader may still be looking at one;
+   * the address only changes a handful of times.
+   */
+  entity_addr_t * volatile my_addr;
+  vector<entity_addr_t*> my_addr_copies;
+
+  void _publish_my_addr() {
+    assert(lock.is_locked());
+    if (my_addr && *my_addr == my_inst.addr)
+      return;
+    entity_addr_t *a = new entity_addr_t(my_inst.addr);
+    my_addr_copies.push_back(a);
+    // the copy must be complete before a reader can find it
+    __sync_synchronize();
+    my_addr = a;
+  }
+  bool is_my_addr(const entity_addr_t& addr) {
+    entity_addr_t *a = my_addr;
+    return a && *a == addr;
+  }
   // AsyncMessenger stuff
   /// approximately unique ID set by the Constructor for use in entity_addr_t
   uint64_t nonce;
@@ -278,20 +318,57 @@ private:
   ceph_spinlock_t global_seq_lock;
 
   /**
-   * hash map of addresses to Asyncconnection
-   *
-   * NOTE: a Asyncconnection* with state CLOSED may still be in the map but is considered
-   * invalid and can be replaced by anyone holding the msgr lock
+   * The connection tables are split into one shard per worker, so that
+   * looking up, accepting and marking down connections never takes the
+   * messenger-wide lock.  Connections we initiate run on the worker
+   * matching the shard of their peer address.
    */
-  ceph::unordered_map<entity_addr_t, AsyncConnectionRef> conns;
+  struct ConnShard {
+    Mutex lock;
+    /**
+     * hash map of addresses to Asyncconnection
+     *
+     * NOTE: a Asyncconnection* with state CLOSED may still be in the map but
+     * is considered invalid and can be replaced by anyone holding the
+     * shard lock
+     */
+    ceph::unordered_map<entity_addr_t, AsyncConnectionRef> conns;
+    /**
+     * connections in the process of accepting, sharded by pointer since
+     * their peer address is not known yet
+     *
+     * These are not yet in any conns map.
+     */
+    set<AsyncConnectionRef> accepting_conns;
+    ConnShard() : lock("AsyncMessenger::ConnShard::lock") {}
+  };
+  vector<ConnShard*> conn_shards;
+
+  unsigned get_conn_shard_index(const entity_addr_t& addr) {
+    static CEPH_HASH_NAMESPACE::hash<entity_addr_t> H;
+    return H(addr) % conn_shards.size();
+  }
+  ConnShard *get_conn_shard(const entity_addr_t& addr) {
+    return conn_shards[get_conn_shard_index(addr)];
+  }
+  ConnShard *get_accepting_shard(AsyncConnection *conn) {
+    return conn_shards[((uintptr_t)conn >> 4) % conn_shards.size()];
+  }
+
+  /// mark down every connection in every shard, optionally telling dispatchers
+  void _mark_down_all(bool reset);
 
   /**
-   * list of connection are in teh process of accepting
-   *
-   * These are not yet in the conns map.
+   * Shared memory channels handed to us by local clients, keyed by the
+   * cookie the client will quote in CEPH_MSGR_TAG_SHM on its TCP
+   * connection.  Entries nobody claims within a few seconds are dropped.
    */
-  // FIXME clear up
-  set<AsyncConnectionRef> accepting_conns;
+  Mutex shm_lock;
+  map<uint64_t, pair<utime_t, ShmChannel*> > shm_pending;
+  /// handshakes queued on a worker but not finished; wait() drains these.
+  /// Together with shm_pending bounded by ms_async_shm_max_pending.
+  unsigned shm_accepting;
+  Cond shm_cond;
 
   /// internal cluster protocol version, if any, for talking to entities of the same type.
   int cluster_protocol;
@@ -299,26 +376,20 @@ private:
   Cond  stop_cond;
   bool stopped;
 
-  AsyncConnectionRef _lookup_conn(const entity_addr_t& k) {
-    assert(lock.is_locked());
-    ceph::unordered_map<entity_addr_t, AsyncConnectionRef>::iterator p = conns.find(k);
-    if (p == conns.end())
+  AsyncConnectionRef _lookup_conn(ConnShard *shard, const entity_addr_t& k) {
+    assert(shard->lock.is_locked());
+    ceph::unordered_map<entity_addr_t, AsyncConnectionRef>::iterator p =
+      shard->conns.find(k);
+    if (p == shard->conns.end())
       return NULL;
 
     assert(p->second->is_connected());
     return p->second;
   }
 
-  void _stop_conn(AsyncConnectionRef c) {
-    assert(lock.is_locked());
-    if (c) {
-      c->mark_down();
-      conns.erase(c->peer_addr);
-    }
-  }
-
   void _init_local_connection() {
     assert(lock.is_locked());
+    _publish_my_addr();
     local_connection->peer_addr = my_inst.addr;
     local_connection->peer_type = my_inst.name.type();
     ms_deliver_handle_fast_connect(local_connection.get());
@@ -338,19 +409,38 @@ public:
    * This wraps _lookup_conn.
    */
   AsyncConnectionRef lookup_conn(const entity_addr_t& k) {
-    Mutex::Locker l(lock);
-    return _lookup_conn(k);
+    ConnShard *shard = get_conn_shard(k);
+    Mutex::Locker l(shard->lock);
+    return _lookup_conn(shard, k);
   }
 
   void accept_conn(AsyncConnectionRef conn) {
-    Mutex::Locker l(lock);
-    conns[conn->peer_addr] = conn;
-    accepting_conns.erase(conn);
+    {
+      ConnShard *shard = get_conn_shard(conn->peer_addr);
+      Mutex::Locker l(shard->lock);
+      shard->conns[conn->peer_addr] = conn;
+    }
+    ConnShard *shard = get_accepting_shard(conn.get());
+    Mutex::Locker l(shard->lock);
+    shard->accepting_conns.erase(conn);
   }
 
   void learned_addr(const entity_addr_t &peer_addr_for_me);
   AsyncConnectionRef add_accept(int sd);
 
+  /// path of the unix socket the messenger at addr takes shm channels on
+  string get_shm_path(const entity_addr_t& addr);
+  /// hand an accepted unix socket to a worker, which runs shm_accept on
+  /// it once it turns readable
+  void add_shm_accept(int sd);
+  /// receive a channel on a connected unix socket and park it for
+  /// shm_claim; -EAGAIN if the client has not sent it yet
+  int shm_accept(int sd);
+  /// close a socket from add_shm_accept once the handshake is over
+  void shm_accept_finish(int sd);
+  /// take the channel parked under cookie; NULL if there is none
+  ShmChannel *shm_claim(uint64_t cookie);
+
   /**
    * This wraps ms_deliver_get_authorizer. We use it for AsyncConnection.
    */
@@ -398,11 +488,21 @@ public:
   }
 
   /**
-   * Unregister connection from `conns`
+   * Unregister connection from `conns` (unless it has been replaced
+   * there already) and from the accepting set
    */
-  void unregister_conn(const entity_addr_t &addr) {
-    Mutex::Locker l(lock);
-    conns.erase(addr);
+  void unregister_conn(AsyncConnectionRef conn) {
+    {
+      ConnShard *shard = get_conn_shard(conn->peer_addr);
+      Mutex::Locker l(shard->lock);
+      ceph::unordered_map<entity_addr_t, AsyncConnectionRef>::iterator p =
+	shard->conns.find(conn->peer_addr);
+      if (p != shard->conns.end() && p->second == conn)
+	shard->conns.erase(p);
+    }
+    ConnShard *shard = get_accepting_shard(conn.get());
+    Mutex::Locker l(shard->lock);
+    shard->accepting_conns.erase(conn);
   }
   /**
    * @} // AsyncMessenger Internals
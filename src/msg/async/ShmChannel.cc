@@ -0,0 +1,381 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/param.h>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#endif
+
+#include "include/assert.h"
+#include "include/compat.h"
+#include "common/debug.h"
+#include "common/errno.h"
+#include "ShmChannel.h"
+
+#define dout_subsys ceph_subsys_ms
+#undef dout_prefix
+#define dout_prefix *_dout << "ShmChannel(" << this << ") "
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MSG_CMSG_CLOEXEC
+#define MSG_CMSG_CLOEXEC 0
+#endif
+
+// what connect() sends along with the descriptors
+struct shm_hello_t {
+  uint64_t cookie;
+  uint64_t ring_size;
+};
+
+void ShmRing::init(void *base, uint64_t ring_size)
+{
+  assert((ring_size & (ring_size - 1)) == 0);
+  h = (shm_ring_header_t*)base;
+  data = (char*)base + sizeof(shm_ring_header_t);
+  size = ring_size;
+}
+
+int64_t ShmRing::write(const char *buf, uint64_t len)
+{
+  uint64_t head = h->head;
+  uint64_t used = head - h->tail;
+  if (used > size)
+    return -EIO;
+  uint64_t n = MIN(len, size - used);
+  if (!n)
+    return 0;
+  // the tail load above must not be reordered after our stores into data
+  __sync_synchronize();
+  uint64_t off = head & (size - 1);
+  uint64_t first = MIN(n, size - off);
+  memcpy(data + off, buf, first);
+  if (n > first)
+    memcpy(data, buf + first, n - first);
+  // publish the bytes before the new head
+  __sync_synchronize();
+  h->head = head + n;
+  return n;
+}
+
+int64_t ShmRing::read(char *buf, uint64_t len)
+{
+  uint64_t tail = h->tail;
+  uint64_t used = h->head - tail;
+  if (used > size)
+    return -EIO;
+  uint64_t n = MIN(len, used);
+  if (!n)
+    return 0;
+  // don't read data ahead of the head that covers it
+  __sync_synchronize();
+  uint64_t off = tail & (size - 1);
+  uint64_t first = MIN(n, size - off);
+  memcpy(buf, data + off, first);
+  if (n > first)
+    memcpy(buf + first, data, n - first);
+  // finish copying out before the writer may reuse the space
+  __sync_synchronize();
+  h->tail = tail + n;
+  return n;
+}
+
+bool ShmRing::wait_readable()
+{
+  h->reader_waiting = 1;
+  __sync_synchronize();
+  if (get_used()) {
+    h->reader_waiting = 0;
+    return false;
+  }
+  return true;
+}
+
+bool ShmRing::wait_writable()
+{
+  h->writer_waiting = 1;
+  __sync_synchronize();
+  // a corrupt ring is for write() to report, not to wait on
+  if (get_space() || is_corrupt()) {
+    h->writer_waiting = 0;
+    return false;
+  }
+  return true;
+}
+
+bool ShmRing::take_reader_waiting()
+{
+  __sync_synchronize();
+  if (h->reader_waiting) {
+    h->reader_waiting = 0;
+    return true;
+  }
+  return false;
+}
+
+bool ShmRing::take_writer_waiting()
+{
+  __sync_synchronize();
+  if (h->writer_waiting) {
+    h->writer_waiting = 0;
+    return true;
+  }
+  return false;
+}
+
+
+ShmChannel::ShmChannel(CephContext *c)
+  : cct(c), mem_fd(-1), my_efd(-1), peer_efd(-1), base(NULL), map_len(0)
+{
+}
+
+ShmChannel::~ShmChannel()
+{
+  if (base)
+    ::munmap(base, map_len);
+  if (mem_fd >= 0)
+    VOID_TEMP_FAILURE_RETRY(::close(mem_fd));
+  if (my_efd >= 0)
+    VOID_TEMP_FAILURE_RETRY(::close(my_efd));
+  if (peer_efd >= 0)
+    VOID_TEMP_FAILURE_RETRY(::close(peer_efd));
+}
+
+int ShmChannel::map(uint64_t ring_size, bool client)
+{
+  uint64_t footprint = ShmRing::get_footprint(ring_size);
+  map_len = footprint * 2;
+  base = ::mmap(NULL, map_len, PROT_READ|PROT_WRITE, MAP_SHARED, mem_fd, 0);
+  if (base == MAP_FAILED) {
+    int r = -errno;
+    base = NULL;
+    lderr(cct) << __func__ << " mmap failed: " << cpp_strerror(r) << dendl;
+    return r;
+  }
+  // ring 0 carries client->server, ring 1 server->client
+  char *r0 = (char*)base, *r1 = (char*)base + footprint;
+  if (client) {
+    out.init(r0, ring_size);
+    in.init(r1, ring_size);
+  } else {
+    in.init(r0, ring_size);
+    out.init(r1, ring_size);
+  }
+  return 0;
+}
+
+int ShmChannel::create(uint64_t ring_size)
+{
+#ifdef __linux__
+  if (ring_size < 4096 || (ring_size & (ring_size - 1)))
+    return -EINVAL;
+
+#ifdef __NR_memfd_create
+  mem_fd = ::syscall(__NR_memfd_create, "ceph-msgr", MFD_CLOEXEC);
+#endif
+  if (mem_fd < 0) {
+    // no memfd; an unlinked file on tmpfs does just as well
+    char path[] = "/dev/shm/ceph-msgr-XXXXXX";
+    mem_fd = ::mkstemp(path);
+    if (mem_fd < 0) {
+      int r = -errno;
+      ldout(cct, 1) << __func__ << " unable to create segment: " << cpp_strerror(r) << dendl;
+      return r;
+    }
+    ::unlink(path);
+    ::fcntl(mem_fd, F_SETFD, FD_CLOEXEC);
+  }
+  if (::ftruncate(mem_fd, ShmRing::get_footprint(ring_size) * 2) < 0) {
+    int r = -errno;
+    ldout(cct, 1) << __func__ << " ftruncate failed: " << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  my_efd = ::eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+  peer_efd = ::eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+  if (my_efd < 0 || peer_efd < 0) {
+    int r = -errno;
+    ldout(cct, 1) << __func__ << " eventfd failed: " << cpp_strerror(r) << dendl;
+    return r;
+  }
+  return map(ring_size, true);
+#else
+  return -EOPNOTSUPP;
+#endif
+}
+
+int ShmChannel::connect(int sock, uint64_t cookie)
+{
+  assert(base);
+  shm_hello_t hello;
+  hello.cookie = cookie;
+  hello.ring_size = map_len / 2 - sizeof(shm_ring_header_t);
+
+  struct iovec iov;
+  iov.iov_base = &hello;
+  iov.iov_len = sizeof(hello);
+  int fds[3] = { mem_fd, my_efd, peer_efd };
+  char cbuf[CMSG_SPACE(sizeof(fds))];
+  memset(cbuf, 0, sizeof(cbuf));
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf;
+  msg.msg_controllen = sizeof(cbuf);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  // a fresh unix socket has room for this, so it never blocks
+  if (::sendmsg(sock, &msg, MSG_NOSIGNAL|MSG_DONTWAIT) != (ssize_t)sizeof(hello)) {
+    int r = errno ? -errno : -EIO;
+    ldout(cct, 1) << __func__ << " sendmsg failed: " << cpp_strerror(r) << dendl;
+    return r;
+  }
+  return 0;
+}
+
+int ShmChannel::finish_connect(int sock)
+{
+  // the server acks once the channel is registered under our cookie
+  char ack = -1;
+  ssize_t n = ::recv(sock, &ack, 1, MSG_DONTWAIT);
+  if (n < 0 && (errno == EAGAIN || errno == EINTR))
+    return -EAGAIN;
+  if (n != 1 || ack != 0) {
+    ldout(cct, 1) << __func__ << " no ack from peer" << dendl;
+    return -ECONNREFUSED;
+  }
+  return 0;
+}
+
+int ShmChannel::accept(int sock, uint64_t *cookie)
+{
+  assert(!base);
+  shm_hello_t hello;
+  struct iovec iov;
+  iov.iov_base = &hello;
+  iov.iov_len = sizeof(hello);
+  int fds[3];
+  char cbuf[CMSG_SPACE(sizeof(fds))];
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf;
+  msg.msg_controllen = sizeof(cbuf);
+
+  ssize_t n = ::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC|MSG_DONTWAIT);
+  if (n < 0) {
+    if (errno == EAGAIN || errno == EINTR)
+      return -EAGAIN;
+    int r = -errno;
+    ldout(cct, 1) << __func__ << " recvmsg failed: " << cpp_strerror(r) << dendl;
+    return r;
+  }
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+    return -EINVAL;
+  int nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+  memcpy(fds, CMSG_DATA(cmsg), MIN(nfds, 3) * sizeof(int));
+  if (nfds != 3 || n != (ssize_t)sizeof(hello)) {
+    for (int i = 0; i < MIN(nfds, 3); ++i)
+      VOID_TEMP_FAILURE_RETRY(::close(fds[i]));
+    return -EINVAL;
+  }
+  // the client's end is our peer
+  mem_fd = fds[0];
+  peer_efd = fds[1];
+  my_efd = fds[2];
+
+  uint64_t ring_size = hello.ring_size;
+  struct stat st;
+  if (ring_size < 4096 || (ring_size & (ring_size - 1)) ||
+      ::fstat(mem_fd, &st) < 0 ||
+      (uint64_t)st.st_size != ShmRing::get_footprint(ring_size) * 2) {
+    ldout(cct, 1) << __func__ << " bad segment from peer" << dendl;
+    return -EINVAL;
+  }
+  int r = map(ring_size, false);
+  if (r < 0)
+    return r;
+  *cookie = hello.cookie;
+  return 0;
+}
+
+void ShmChannel::notify_peer()
+{
+  uint64_t v = 1;
+  int r = ::write(peer_efd, &v, sizeof(v));
+  // EAGAIN means the counter is saturated, i.e. a wakeup is pending anyway
+  if (r < 0 && errno != EAGAIN)
+    ldout(cct, 1) << __func__ << " eventfd write failed: " << cpp_strerror(errno) << dendl;
+}
+
+void ShmChannel::clear_event()
+{
+  uint64_t v;
+  while (::read(my_efd, &v, sizeof(v)) > 0) ;
+}
+
+int ShmChannel::read(char *buf, int len)
+{
+  int64_t r = in.read(buf, len);
+  if (!r) {
+    if (in.wait_readable())
+      return 0;
+    r = in.read(buf, len);
+  }
+  if (r < 0) {
+    lderr(cct) << __func__ << " peer corrupted the ring" << dendl;
+    return r;
+  }
+  if (r && in.take_writer_waiting())
+    notify_peer();
+  return r;
+}
+
+int ShmChannel::write(const char *buf, int len)
+{
+  int64_t r = 0;
+  while (1) {
+    int64_t n = out.write(buf + r, len - r);
+    if (n < 0) {
+      lderr(cct) << __func__ << " peer corrupted the ring" << dendl;
+      return n;
+    }
+    r += n;
+    // stop once everything is in or a wakeup is armed for the rest
+    if (r == len || out.wait_writable())
+      break;
+  }
+  if (r && out.take_reader_waiting())
+    notify_peer();
+  return r;
+}
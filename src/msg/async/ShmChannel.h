@@ -0,0 +1,127 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MSG_SHMCHANNEL_H
+#define CEPH_MSG_SHMCHANNEL_H
+
+#include "include/int_types.h"
+
+class CephContext;
+
+/*
+ * Control block at the start of each ring.  head is only advanced by the
+ * producer and tail only by the consumer; both are free running byte
+ * counters.  The waiting flags are set by a side that found the ring
+ * empty (reader) or full (writer) and wants an eventfd wakeup.  Each
+ * field sits in its own cache line so the two ends don't bounce them.
+ */
+struct shm_ring_header_t {
+  volatile uint64_t head;
+  char pad0[56];
+  volatile uint64_t tail;
+  char pad1[56];
+  volatile uint32_t reader_waiting;
+  char pad2[60];
+  volatile uint32_t writer_waiting;
+  char pad3[60];
+};
+
+/*
+ * A single-producer/single-consumer byte ring over shared memory.  The
+ * data area size is a power of two.  The control block is writable by
+ * the peer, so head and tail are loaded once and a ring holding more
+ * than size bytes is reported as corrupt rather than trusted.
+ */
+class ShmRing {
+  shm_ring_header_t *h;
+  char *data;
+  uint64_t size;
+
+ public:
+  ShmRing() : h(NULL), data(NULL), size(0) {}
+  void init(void *base, uint64_t ring_size);
+  static uint64_t get_footprint(uint64_t ring_size) {
+    return sizeof(shm_ring_header_t) + ring_size;
+  }
+
+  uint64_t get_used() const { return h->head - h->tail; }
+  bool is_corrupt() const { return get_used() > size; }
+  uint64_t get_space() const {
+    uint64_t used = get_used();
+    return used > size ? 0 : size - used;
+  }
+
+  // copy as much as fits; return the number of bytes moved, or -EIO if
+  // the peer has corrupted the ring
+  int64_t write(const char *buf, uint64_t len);
+  int64_t read(char *buf, uint64_t len);
+
+  // arm a wakeup and return true if the condition still holds afterwards,
+  // i.e. the caller really has to wait
+  bool wait_readable();
+  bool wait_writable();
+  // consume a pending wakeup request from the other side
+  bool take_reader_waiting();
+  bool take_writer_waiting();
+};
+
+/*
+ * ShmChannel is a bidirectional byte stream between two processes on the
+ * same host: one memfd holding two ShmRings (client->server and
+ * server->client) and one eventfd per end.  The client end creates
+ * everything and hands the three descriptors to the server end over a
+ * unix domain socket.  None of the handshake calls block; the caller
+ * polls the socket and retries on -EAGAIN.
+ *
+ * read() and write() never block.  A short read or write arms a wakeup on
+ * our eventfd, which the peer signals once it has produced data or freed
+ * space; the owner polls get_event_fd() and calls clear_event() when it
+ * fires.
+ */
+class ShmChannel {
+  CephContext *cct;
+  int mem_fd;
+  int my_efd;
+  int peer_efd;
+  void *base;
+  uint64_t map_len;
+  ShmRing in, out;
+
+  int map(uint64_t ring_size, bool client);
+  void notify_peer();
+
+ public:
+  explicit ShmChannel(CephContext *c);
+  ~ShmChannel();
+
+  /// client end: allocate the segment and eventfds
+  int create(uint64_t ring_size);
+  /// client end: pass our descriptors and cookie
+  int connect(int sock, uint64_t cookie);
+  /// client end: take the server's ack; -EAGAIN if it has not come yet
+  int finish_connect(int sock);
+  /// server end: receive a channel from connect(), -EAGAIN if it has not
+  /// come yet; the caller acks
+  int accept(int sock, uint64_t *cookie);
+
+  int get_event_fd() const { return my_efd; }
+  void clear_event();
+  bool has_data() const { return in.get_used() > 0; }
+
+  /// return bytes read, 0 if the ring is empty (a wakeup is armed),
+  /// or -EIO if the peer broke the ring protocol
+  int read(char *buf, int len);
+  /// return bytes written, possibly short (a wakeup is armed), or -EIO
+  int write(const char *buf, int len);
+};
+
+#endif
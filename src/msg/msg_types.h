@@ -109,11 +109,24 @@ public:
     ::decode(_type, bl);
     ::decode(_num, bl);
   }
+  void bound_encode(size_t &s) const {
+    ::bound_encode(_type, s);
+    ::bound_encode(_num, s);
+  }
+  void encode_bounded(char *&p) const {
+    ::encode_bounded(_type, p);
+    ::encode_bounded(_num, p);
+  }
+  void decode_bounded(const char *&p, const char *end) {
+    ::decode_bounded(_type, p, end);
+    ::decode_bounded(_num, p, end);
+  }
   void dump(Formatter *f) const;
 
   static void generate_test_instances(list<entity_name_t*>& o);
 };
 WRITE_CLASS_ENCODER(entity_name_t)
+WRITE_CLASS_BOUNDED(entity_name_t)
 
 inline bool operator== (const entity_name_t& l, const entity_name_t& r) { 
   return (l.type() == r.type()) && (l.num() == r.num()); }
@@ -17,6 +17,7 @@
 
 #include "common/debug.h"
 #include "common/config.h"
+#include "common/perf_counters.h"
 #include "include/assert.h"
 
 #define dout_subsys ceph_subsys_filestore
@@ -776,6 +777,36 @@ int DBObjectMap::rm_keys(const ghobject_t &oid,
   return db->submit_transaction(t);
 }
 
+int DBObjectMap::rm_key_range(const ghobject_t &oid,
+			      const string &first,
+			      const string &last,
+			      const SequencerPosition *spos)
+{
+  set<string> to_clear;
+  {
+    MapHeaderLock hl(this, oid);
+    Header header = lookup_map_header(hl, oid);
+    if (!header)
+      return -ENOENT;
+    if (!header->parent) {
+      // Every key lives under our own prefix, drop the range in one go
+      KeyValueDB::Transaction t = db->get_transaction();
+      if (check_spos(oid, header, spos))
+	return 0;
+      t->rm_range_keys(user_prefix(header), first, last);
+      return db->submit_transaction(t);
+    }
+
+    // Keys may come from the parent, let rm_keys copy up around them
+    DBObjectMapIterator iter = _get_iterator(header);
+    for (iter->lower_bound(first); iter->valid() && iter->key() < last;
+	 iter->next()) {
+      to_clear.insert(iter->key());
+    }
+  }
+  return rm_keys(oid, to_clear, spos);
+}
+
 int DBObjectMap::clear_keys_header(const ghobject_t &oid,
 				   const SequencerPosition *spos)
 {
@@ -1138,21 +1169,81 @@ int DBObjectMap::write_state(KeyValueDB::Transaction _t) {
 }
 
 
-DBObjectMap::Header DBObjectMap::_lookup_map_header(
+DBObjectMap::DBObjectMap(KeyValueDB *db)
+  : db(db), header_lock("DBOBjectMap"), logger(NULL)
+{
+  unsigned num_shards = g_conf->filestore_omap_header_cache_shards;
+  if (num_shards < 1)
+    num_shards = 1;
+  size_t shard_cache_size =
+    (g_conf->filestore_omap_header_cache_size + num_shards - 1) / num_shards;
+  for (unsigned i = 0; i < num_shards; ++i) {
+    map_header_shards.push_back(new MapHeaderShard(shard_cache_size));
+    seq_shards.push_back(new SeqShard);
+  }
+
+  PerfCountersBuilder plb(g_ceph_context, "dbobjectmap",
+			  l_dbom_first, l_dbom_last);
+  plb.add_u64_counter(l_dbom_header_cache_hit, "header_cache_hit");
+  plb.add_u64_counter(l_dbom_header_cache_miss, "header_cache_miss");
+  plb.add_u64_counter(l_dbom_map_header_lock_wait, "map_header_lock_wait");
+  logger = plb.create_perf_counters();
+  g_ceph_context->get_perfcounters_collection()->add(logger);
+}
+
+DBObjectMap::~DBObjectMap()
+{
+  g_ceph_context->get_perfcounters_collection()->remove(logger);
+  delete logger;
+  for (unsigned i = 0; i < map_header_shards.size(); ++i) {
+    assert(map_header_shards[i]->in_use.empty());
+    delete map_header_shards[i];
+  }
+  for (unsigned i = 0; i < seq_shards.size(); ++i) {
+    assert(seq_shards[i]->in_use.empty());
+    delete seq_shards[i];
+  }
+}
+
+DBObjectMap::MapHeaderLock::MapHeaderLock(DBObjectMap *db,
+					  const ghobject_t &oid)
+  : db(db), locked(oid)
+{
+  MapHeaderShard *shard = db->get_map_header_shard(oid);
+  Mutex::Locker l(shard->lock);
+  if (shard->in_use.count(oid)) {
+    db->logger->inc(l_dbom_map_header_lock_wait);
+    while (shard->in_use.count(oid))
+      shard->cond.Wait(shard->lock);
+  }
+  shard->in_use.insert(oid);
+}
+
+DBObjectMap::MapHeaderLock::~MapHeaderLock()
+{
+  if (locked) {
+    MapHeaderShard *shard = db->get_map_header_shard(*locked);
+    Mutex::Locker l(shard->lock);
+    assert(shard->in_use.count(*locked));
+    shard->in_use.erase(*locked);
+    shard->cond.SignalAll();
+  }
+}
+
+DBObjectMap::Header DBObjectMap::lookup_map_header(
   const MapHeaderLock &l,
   const ghobject_t &oid)
 {
   assert(l.get_locked() == oid);
 
+  MapHeaderShard *shard = get_map_header_shard(oid);
   _Header *header = new _Header();
-  {
-    Mutex::Locker l(cache_lock);
-    if (caches.lookup(oid, header)) {
-      assert(!in_use.count(header->seq));
-      in_use.insert(header->seq);
-      return Header(header, RemoveOnDelete(this));
-    }
+  if (shard->cache.lookup(oid, header)) {
+    logger->inc(l_dbom_header_cache_hit);
+    pin_seq(header->seq);
+    return Header(header, RemoveOnDelete(this));
   }
+  logger->inc(l_dbom_header_cache_miss);
 
   map<string, bufferlist> out;
   set<string> to_get;
@@ -1163,17 +1254,12 @@ DBObjectMap::Header DBObjectMap::_lookup_map_header(
     return Header();
   }
 
-  Header ret(header, RemoveOnDelete(this));
   bufferlist::iterator iter = out.begin()->second.begin();
-  ret->decode(iter);
-  {
-    Mutex::Locker l(cache_lock);
-    caches.add(oid, *ret);
-  }
+  header->decode(iter);
+  shard->cache.add(oid, *header);
 
-  assert(!in_use.count(header->seq));
-  in_use.insert(header->seq);
-  return ret;
+  pin_seq(header->seq);
+  return Header(header, RemoveOnDelete(this));
 }
 
 DBObjectMap::Header DBObjectMap::_generate_new_header(const ghobject_t &oid,
@@ -1187,8 +1273,7 @@ DBObjectMap::Header DBObjectMap::_generate_new_header(const ghobject_t &oid,
   }
   header->num_children = 1;
   header->oid = oid;
-  assert(!in_use.count(header->seq));
-  in_use.insert(header->seq);
+  pin_seq(header->seq);
 
   write_state();
   return header;
@@ -1196,9 +1281,16 @@ DBObjectMap::Header DBObjectMap::_generate_new_header(const ghobject_t &oid,
 
 DBObjectMap::Header DBObjectMap::lookup_parent(Header input)
 {
-  Mutex::Locker l(header_lock);
-  while (in_use.count(input->parent))
-    header_cond.Wait(header_lock);
+  SeqShard *shard = get_seq_shard(input->parent);
+  {
+    Mutex::Locker l(shard->lock);
+    while (shard->in_use.count(input->parent))
+      shard->cond.Wait(shard->lock);
+    shard->in_use.insert(input->parent);
+  }
+  Header header = Header(new _Header(), RemoveOnDelete(this));
+  header->seq = input->parent;
+
   map<string, bufferlist> out;
   set<string> keys;
   keys.insert(HEADER_KEY);
@@ -1215,13 +1307,10 @@ DBObjectMap::Header DBObjectMap::lookup_parent(Header input)
     return Header();
   }
 
-  Header header = Header(new _Header(), RemoveOnDelete(this));
-  header->seq = input->parent;
   bufferlist::iterator iter = out.begin()->second.begin();
   header->decode(iter);
   dout(20) << "lookup_parent: parent seq is " << header->seq << " with parent "
        << header->parent << dendl;
-  in_use.insert(header->seq);
   return header;
 }
 
@@ -1230,10 +1319,9 @@ DBObjectMap::Header DBObjectMap::lookup_create_map_header(
   const ghobject_t &oid,
   KeyValueDB::Transaction t)
 {
-  Mutex::Locker l(header_lock);
-  Header header = _lookup_map_header(hl, oid);
+  Header header = lookup_map_header(hl, oid);
   if (!header) {
-    header = _generate_new_header(oid, Header());
+    header = generate_new_header(oid, Header());
     set_map_header(hl, oid, *header, t);
   }
   return header;
@@ -1271,10 +1359,7 @@ void DBObjectMap::remove_map_header(
   set<string> to_remove;
   to_remove.insert(map_header_key(oid));
   t->rmkeys(HOBJECT_TO_SEQ, to_remove);
-  {
-    Mutex::Locker l(cache_lock);
-    caches.clear(oid);
-  }
+  get_map_header_shard(oid)->cache.clear(oid);
 }
 
 void DBObjectMap::set_map_header(
@@ -1289,10 +1374,7 @@ void DBObjectMap::set_map_header(
   map<string, bufferlist> to_set;
   header.encode(to_set[map_header_key(oid)]);
   t->set(HOBJECT_TO_SEQ, to_set);
-  {
-    Mutex::Locker l(cache_lock);
-    caches.add(oid, header);
-  }
+  get_map_header_shard(oid)->cache.add(oid, header);
 }
 
 bool DBObjectMap::check_spos(const ghobject_t &oid,
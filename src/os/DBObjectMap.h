@@ -19,6 +19,16 @@
 #include "common/simple_cache.hpp"
 #include <boost/optional.hpp>
 
+class PerfCounters;
+
+enum {
+  l_dbom_first = 34500,
+  l_dbom_header_cache_hit,
+  l_dbom_header_cache_miss,
+  l_dbom_map_header_lock_wait,
+  l_dbom_last,
+};
+
 /**
  * DBObjectMap: Implements ObjectMap in terms of KeyValueDB
  *
@@ -58,21 +68,13 @@ public:
   boost::scoped_ptr<KeyValueDB> db;
 
   /**
-   * Serializes access to next_seq as well as the in_use set
+   * Serializes access to next_seq
    */
   Mutex header_lock;
-  Cond header_cond;
-  Cond map_header_cond;
-
-  /**
-   * Set of headers currently in use
-   */
-  set<uint64_t> in_use;
-  set<ghobject_t> map_header_in_use;
 
   /**
-   * Takes the map_header_in_use entry in constructor, releases in
-   * destructor
+   * Takes the object's entry in its shard's in_use set in constructor,
+   * releases in destructor
    */
   class MapHeaderLock {
     DBObjectMap *db;
@@ -82,12 +84,7 @@ public:
     MapHeaderLock &operator=(const MapHeaderLock &);
   public:
     MapHeaderLock(DBObjectMap *db) : db(db) {}
-    MapHeaderLock(DBObjectMap *db, const ghobject_t &oid) : db(db), locked(oid) {
-      Mutex::Locker l(db->header_lock);
-      while (db->map_header_in_use.count(*locked))
-	db->map_header_cond.Wait(db->header_lock);
-      db->map_header_in_use.insert(*locked);
-    }
+    MapHeaderLock(DBObjectMap *db, const ghobject_t &oid);
 
     const ghobject_t &get_locked() const {
       assert(locked);
@@ -103,20 +100,11 @@ public:
       locked = _locked;
     }
 
-    ~MapHeaderLock() {
-      if (locked) {
-	Mutex::Locker l(db->header_lock);
-	assert(db->map_header_in_use.count(*locked));
-	db->map_header_cond.Signal();
-	db->map_header_in_use.erase(*locked);
-      }
-    }
+    ~MapHeaderLock();
   };
 
-  DBObjectMap(KeyValueDB *db) : db(db), header_lock("DBOBjectMap"),
-                                cache_lock("DBObjectMap::CacheLock"),
-                                caches(g_conf->filestore_omap_header_cache_size)
-    {}
+  DBObjectMap(KeyValueDB *db);
+  ~DBObjectMap();
 
   int set_keys(
     const ghobject_t &oid,
@@ -151,6 +139,13 @@ public:
     const SequencerPosition *spos=0
     );
 
+  int rm_key_range(
+    const ghobject_t &oid,
+    const string &first,
+    const string &last,
+    const SequencerPosition *spos=0
+    );
+
   int get(
     const ghobject_t &oid,
     bufferlist *header,
@@ -327,8 +322,50 @@ public:
 private:
   /// Implicit lock on Header->seq
   typedef ceph::shared_ptr<_Header> Header;
-  Mutex cache_lock;
-  SimpleLRU<ghobject_t, _Header> caches;
+
+  /**
+   * Per-object state, spread over shards by object hash: the objects
+   * whose map header is locked (@see MapHeaderLock) and a cache of their
+   * leaf headers.  Operations on different objects only share a shard
+   * mutex by chance, and never take a map-wide lock.
+   */
+  struct MapHeaderShard {
+    Mutex lock;
+    Cond cond;
+    set<ghobject_t> in_use;
+    SimpleLRU<ghobject_t, _Header> cache;
+    MapHeaderShard(size_t cache_size)
+      : lock("DBObjectMap::MapHeaderShard::lock"), cache(cache_size) {}
+  };
+  vector<MapHeaderShard*> map_header_shards;
+
+  MapHeaderShard *get_map_header_shard(const ghobject_t &oid) {
+    // the low bits of the hash are the same for every object in a pg
+    return map_header_shards[hobject_t::_reverse_nibbles(oid.hobj.hash) %
+			     map_header_shards.size()];
+  }
+
+  /// Headers (by seq) currently in use, sharded by seq
+  struct SeqShard {
+    Mutex lock;
+    Cond cond;
+    set<uint64_t> in_use;
+    SeqShard() : lock("DBObjectMap::SeqShard::lock") {}
+  };
+  vector<SeqShard*> seq_shards;
+
+  SeqShard *get_seq_shard(uint64_t seq) {
+    return seq_shards[seq % seq_shards.size()];
+  }
+  /// Marks seq in use; it must not be already
+  void pin_seq(uint64_t seq) {
+    SeqShard *shard = get_seq_shard(seq);
+    Mutex::Locker l(shard->lock);
+    assert(!shard->in_use.count(seq));
+    shard->in_use.insert(seq);
+  }
+
+  PerfCounters *logger;
 
   string map_header_key(const ghobject_t &oid);
   string header_key(uint64_t seq);
@@ -459,15 +496,9 @@ private:
   }
 
   /// Lookup leaf header for c oid
-  Header _lookup_map_header(
+  Header lookup_map_header(
     const MapHeaderLock &l,
     const ghobject_t &oid);
-  Header lookup_map_header(
-    const MapHeaderLock &l2,
-    const ghobject_t &oid) {
-    Mutex::Locker l(header_lock);
-    return _lookup_map_header(l2, oid);
-  }
 
   /// Lookup header node for input
   Header lookup_parent(Header input);
@@ -518,10 +549,13 @@ private:
     RemoveOnDelete(DBObjectMap *db) :
       db(db) {}
     void operator() (_Header *header) {
-      Mutex::Locker l(db->header_lock);
-      assert(db->in_use.count(header->seq));
-      db->in_use.erase(header->seq);
-      db->header_cond.Signal();
+      SeqShard *shard = db->get_seq_shard(header->seq);
+      {
+	Mutex::Locker l(shard->lock);
+	assert(shard->in_use.count(header->seq));
+	shard->in_use.erase(header->seq);
+	shard->cond.SignalAll();
+      }
       delete header;
     }
   };
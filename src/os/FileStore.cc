@@ -195,6 +195,8 @@ int FileStore::lfn_truncate(coll_t cid, const ghobject_t& oid, off_t length)
     int rc = backend->_crc_update_truncate(**fd, length);
     assert(rc >= 0);
   }
+  if (r >= 0)
+    _mark_dirty(oid, fd);
   assert(!m_filestore_fail_eio || r != -EIO);
   return r;
 }
@@ -502,7 +504,8 @@ FileStore::FileStore(const std::string &base, const std::string &jdev, osflagbit
   basedir_fd(-1), current_fd(-1),
   backend(NULL),
   index_manager(do_update),
-  ondisk_finisher(g_ceph_context),
+  ondisk_finisher(g_ceph_context, "filestore-ondisk",
+		  g_conf->filestore_finisher_threads),
   lock("FileStore::lock"),
   force_sync(false), sync_epoch(0),
   sync_entry_timeo_lock("sync_entry_timeo_lock"),
@@ -510,10 +513,14 @@ FileStore::FileStore(const std::string &base, const std::string &jdev, osflagbit
   stop(false), sync_thread(this),
   fdcache(g_ceph_context),
   wbthrottle(g_ceph_context),
+  fsync_tp(g_ceph_context, "FileStore::fsync_tp",
+	   MAX(g_conf->filestore_fsync_commit_threads, 1)),
+  fsync_wq(g_conf->filestore_commit_timeout, &fsync_tp),
   default_osr("default"),
   op_queue_len(0), op_queue_bytes(0),
   op_throttle_lock("FileStore::op_throttle_lock"),
-  op_finisher(g_ceph_context),
+  op_finisher(g_ceph_context, "filestore-apply",
+	      g_conf->filestore_finisher_threads),
   op_tp(g_ceph_context, "FileStore::op_tp", g_conf->filestore_op_threads, "filestore_op_threads"),
   op_wq(this, g_conf->filestore_op_thread_timeout,
 	g_conf->filestore_op_thread_suicide_timeout, &op_tp),
@@ -542,6 +549,7 @@ FileStore::FileStore(const std::string &base, const std::string &jdev, osflagbit
   m_filestore_dump_fmt(true),
   m_filestore_sloppy_crc(g_conf->filestore_sloppy_crc),
   m_filestore_sloppy_crc_block_size(g_conf->filestore_sloppy_crc_block_size),
+  m_filestore_fsync_commit(g_conf->filestore_fsync_commit),
   m_filestore_max_alloc_hint_size(g_conf->filestore_max_alloc_hint_size),
   m_fs_type(0),
   m_filestore_max_inline_xattr_size(0),
@@ -549,6 +557,12 @@ FileStore::FileStore(const std::string &base, const std::string &jdev, osflagbit
 {
   m_filestore_kill_at.set(g_conf->filestore_kill_at);
 
+  int num_dirty_shards = g_conf->filestore_fsync_commit_shards;
+  if (num_dirty_shards < 1)
+    num_dirty_shards = 1;
+  for (int i = 0; i < num_dirty_shards; ++i)
+    dirty_shards.push_back(new DirtyShard);
+
   ostringstream oss;
   oss << basedir << "/current";
   current_fn = oss.str();
@@ -608,6 +622,9 @@ FileStore::~FileStore()
   if (m_filestore_do_dump) {
     dump_stop();
   }
+
+  for (unsigned i = 0; i < dirty_shards.size(); ++i)
+    delete dirty_shards[i];
 }
 
 static void get_attrname(const char *name, char *buf, int len)
@@ -995,6 +1012,12 @@ int FileStore::_detect_fs()
     return r;
   }
 
+  if (m_filestore_fsync_commit && backend->can_checkpoint()) {
+    dout(0) << "_detect_fs: " << backend->get_name() << " commits via checkpoints, "
+	    << "ignoring 'filestore fsync commit'" << dendl;
+    m_filestore_fsync_commit = false;
+  }
+
   // test xattrs
   char fn[PATH_MAX];
   int x = rand();
@@ -1540,6 +1563,8 @@ int FileStore::mount()
   }
 
   wbthrottle.start();
+  if (m_filestore_fsync_commit)
+    fsync_tp.start();
   sync_thread.create();
 
   if (!(generic_flags & SKIP_JOURNAL_REPLAY)) {
@@ -1619,6 +1644,8 @@ int FileStore::umount()
   sync_cond.Signal();
   lock.Unlock();
   sync_thread.join();
+  if (m_filestore_fsync_commit)
+    fsync_tp.stop();
   wbthrottle.stop();
   op_tp.stop();
 
@@ -1780,11 +1807,14 @@ void FileStore::_do_op(OpSequencer *osr, ThreadPool::TPHandle &handle)
   osr->apply_lock.Lock();
   Op *o = osr->peek_queue();
   apply_manager.op_apply_start(o->op);
+  if (o->osd_op)
+    o->osd_op->mark_event("filestore_apply_started");
   dout(5) << "_do_op " << o << " seq " << o->op << " " << *osr << "/" << osr->parent << " start" << dendl;
   int r = _do_transactions(o->tls, o->op, &handle);
   apply_manager.op_apply_finish(o->op);
-  dout(10) << "_do_op " << o << " seq " << o->op << " r = " << r
-	   << ", finisher " << o->onreadable << " " << o->onreadable_sync << dendl;
+  doutf(10, "filestore(%s) _do_op %p seq %llu r = %d, finisher %p %p",
+	basedir.c_str(), o, (unsigned long long)o->op, r,
+	o->onreadable, o->onreadable_sync);
 }
 
 void FileStore::_finish_op(OpSequencer *osr)
@@ -1801,14 +1831,16 @@ void FileStore::_finish_op(OpSequencer *osr)
   utime_t lat = ceph_clock_now(g_ceph_context);
   lat -= o->start;
   logger->tinc(l_os_apply_lat, lat);
+  if (o->osd_op)
+    o->osd_op->mark_event("filestore_applied");
 
   if (o->onreadable_sync) {
     o->onreadable_sync->complete(0);
   }
   if (o->onreadable) {
-    op_finisher.queue(o->onreadable);
+    op_finisher.queue((uintptr_t)osr, o->onreadable);
   }
-  op_finisher.queue(to_queue);
+  op_finisher.queue((uintptr_t)osr, to_queue);
   delete o;
 }
 
@@ -1934,7 +1966,7 @@ int FileStore::queue_transactions(Sequencer *posr, list<Transaction*> &tls,
   if (onreadable_sync) {
     onreadable_sync->complete(r);
   }
-  op_finisher.queue(onreadable, r);
+  op_finisher.queue((uintptr_t)osr, onreadable, r);
 
   submit_manager.op_submit_finish(op);
   apply_manager.op_apply_finish(op);
@@ -1956,9 +1988,9 @@ void FileStore::_journaled_ahead(OpSequencer *osr, Op *o, Context *ondisk)
   // getting blocked behind an ondisk completion.
   if (ondisk) {
     dout(10) << " queueing ondisk " << ondisk << dendl;
-    ondisk_finisher.queue(ondisk);
+    ondisk_finisher.queue((uintptr_t)osr, ondisk);
   }
-  ondisk_finisher.queue(to_queue);
+  ondisk_finisher.queue((uintptr_t)osr, to_queue);
 }
 
 int FileStore::_do_transactions(
@@ -2238,7 +2270,7 @@ unsigned FileStore::_do_transaction(
   Transaction& t, uint64_t op_seq, int trans_num,
   ThreadPool::TPHandle *handle)
 {
-  dout(10) << "_do_transaction on " << &t << dendl;
+  doutf(10, "filestore(%s) _do_transaction on %p", basedir.c_str(), &t);
 
 #ifdef WITH_LTTNG
   const char *osr_name = t.get_osr() ? static_cast<OpSequencer*>(t.get_osr())->get_name().c_str() : "<NULL>";
@@ -2251,18 +2283,18 @@ unsigned FileStore::_do_transaction(
     if (handle)
       handle->reset_tp_timeout();
 
-    int op = i.decode_op();
+    Transaction::Op *op = i.decode_op();
     int r = 0;
 
     _inject_failure();
 
-    switch (op) {
+    switch (op->op) {
     case Transaction::OP_NOP:
       break;
     case Transaction::OP_TOUCH:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
         tracepoint(objectstore, touch_enter, osr_name);
 	if (_check_replay_guard(cid, oid, spos) > 0)
 	  r = _touch(cid, oid);
@@ -2272,10 +2304,10 @@ unsigned FileStore::_do_transaction(
       
     case Transaction::OP_WRITE:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
-	uint64_t off = i.decode_length();
-	uint64_t len = i.decode_length();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
+	uint64_t off = op->off;
+	uint64_t len = op->len;
 	bool replica = i.get_replica();
 	bufferlist bl;
 	i.decode_bl(bl);
@@ -2288,10 +2320,10 @@ unsigned FileStore::_do_transaction(
       
     case Transaction::OP_ZERO:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
-	uint64_t off = i.decode_length();
-	uint64_t len = i.decode_length();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
+	uint64_t off = op->off;
+	uint64_t len = op->len;
         tracepoint(objectstore, zero_enter, osr_name, off, len);
 	if (_check_replay_guard(cid, oid, spos) > 0)
 	  r = _zero(cid, oid, off, len);
@@ -2301,19 +2333,15 @@ unsigned FileStore::_do_transaction(
       
     case Transaction::OP_TRIMCACHE:
       {
-	i.decode_cid();
-	i.decode_oid();
-	i.decode_length();
-	i.decode_length();
 	// deprecated, no-op
       }
       break;
       
     case Transaction::OP_TRUNCATE:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
-	uint64_t off = i.decode_length();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
+	uint64_t off = op->off;
         tracepoint(objectstore, truncate_enter, osr_name, off);
 	if (_check_replay_guard(cid, oid, spos) > 0)
 	  r = _truncate(cid, oid, off);
@@ -2323,8 +2351,8 @@ unsigned FileStore::_do_transaction(
       
     case Transaction::OP_REMOVE:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
         tracepoint(objectstore, remove_enter, osr_name);
 	if (_check_replay_guard(cid, oid, spos) > 0)
 	  r = _remove(cid, oid, spos);
@@ -2334,9 +2362,9 @@ unsigned FileStore::_do_transaction(
       
     case Transaction::OP_SETATTR:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
-	string name = i.decode_attrname();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
+	string name = i.decode_string();
 	bufferlist bl;
 	i.decode_bl(bl);
         tracepoint(objectstore, setattr_enter, osr_name);
@@ -2354,8 +2382,8 @@ unsigned FileStore::_do_transaction(
       
     case Transaction::OP_SETATTRS:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
 	map<string, bufferptr> aset;
 	i.decode_attrset(aset);
         tracepoint(objectstore, setattrs_enter, osr_name);
@@ -2369,9 +2397,9 @@ unsigned FileStore::_do_transaction(
 
     case Transaction::OP_RMATTR:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
-	string name = i.decode_attrname();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
+	string name = i.decode_string();
         tracepoint(objectstore, rmattr_enter, osr_name);
 	if (_check_replay_guard(cid, oid, spos) > 0)
 	  r = _rmattr(cid, oid, name.c_str(), spos);
@@ -2381,8 +2409,8 @@ unsigned FileStore::_do_transaction(
 
     case Transaction::OP_RMATTRS:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
         tracepoint(objectstore, rmattrs_enter, osr_name);
 	if (_check_replay_guard(cid, oid, spos) > 0)
 	  r = _rmattrs(cid, oid, spos);
@@ -2392,9 +2420,9 @@ unsigned FileStore::_do_transaction(
       
     case Transaction::OP_CLONE:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
-	ghobject_t noid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
+	const ghobject_t &noid = i.get_oid(op->dest_oid);
         tracepoint(objectstore, clone_enter, osr_name);
 	r = _clone(cid, oid, noid, spos);
         tracepoint(objectstore, clone_exit, r);
@@ -2403,11 +2431,11 @@ unsigned FileStore::_do_transaction(
 
     case Transaction::OP_CLONERANGE:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
-	ghobject_t noid = i.decode_oid();
-	uint64_t off = i.decode_length();
-	uint64_t len = i.decode_length();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
+	const ghobject_t &noid = i.get_oid(op->dest_oid);
+	uint64_t off = op->off;
+	uint64_t len = op->len;
         tracepoint(objectstore, clone_range_enter, osr_name, len);
 	r = _clone_range(cid, oid, noid, off, len, off, spos);
         tracepoint(objectstore, clone_range_exit, r);
@@ -2416,12 +2444,12 @@ unsigned FileStore::_do_transaction(
 
     case Transaction::OP_CLONERANGE2:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
-	ghobject_t noid = i.decode_oid();
-	uint64_t srcoff = i.decode_length();
-	uint64_t len = i.decode_length();
-	uint64_t dstoff = i.decode_length();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
+	const ghobject_t &noid = i.get_oid(op->dest_oid);
+	uint64_t srcoff = op->off;
+	uint64_t len = op->len;
+	uint64_t dstoff = op->dest_off;
         tracepoint(objectstore, clone_range2_enter, osr_name, len);
 	r = _clone_range(cid, oid, noid, srcoff, len, dstoff, spos);
         tracepoint(objectstore, clone_range2_exit, r);
@@ -2430,7 +2458,7 @@ unsigned FileStore::_do_transaction(
 
     case Transaction::OP_MKCOLL:
       {
-	coll_t cid = i.decode_cid();
+	const coll_t &cid = i.get_cid(op->cid);
         tracepoint(objectstore, mkcoll_enter, osr_name);
 	if (_check_replay_guard(cid, spos) > 0)
 	  r = _create_collection(cid, spos);
@@ -2440,8 +2468,8 @@ unsigned FileStore::_do_transaction(
 
     case Transaction::OP_COLL_HINT:
       {
-        coll_t cid = i.decode_cid();
-        uint32_t type = i.decode_u32();
+        const coll_t &cid = i.get_cid(op->cid);
+        uint32_t type = op->hint_type;
         bufferlist hint;
         i.decode_bl(hint);
         bufferlist::iterator hiter = hint.begin();
@@ -2462,7 +2490,7 @@ unsigned FileStore::_do_transaction(
 
     case Transaction::OP_RMCOLL:
       {
-	coll_t cid = i.decode_cid();
+	const coll_t &cid = i.get_cid(op->cid);
         tracepoint(objectstore, rmcoll_enter, osr_name);
 	if (_check_replay_guard(cid, spos) > 0)
 	  r = _destroy_collection(cid);
@@ -2472,15 +2500,15 @@ unsigned FileStore::_do_transaction(
 
     case Transaction::OP_COLL_ADD:
       {
-	coll_t ncid = i.decode_cid();
-	coll_t ocid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
+	const coll_t &ncid = i.get_cid(op->cid);
+	const coll_t &ocid = i.get_cid(op->dest_cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
 
 	// always followed by OP_COLL_REMOVE
-	int op = i.decode_op();
-	coll_t ocid2 = i.decode_cid();
-	ghobject_t oid2 = i.decode_oid();
-	assert(op == Transaction::OP_COLL_REMOVE);
+	Transaction::Op *op2 = i.decode_op();
+	const coll_t &ocid2 = i.get_cid(op2->cid);
+	const ghobject_t &oid2 = i.get_oid(op2->oid);
+	assert(op2->op == Transaction::OP_COLL_REMOVE);
 	assert(ocid2 == ocid);
 	assert(oid2 == oid);
 
@@ -2500,9 +2528,9 @@ unsigned FileStore::_do_transaction(
     case Transaction::OP_COLL_MOVE:
       {
 	// WARNING: this is deprecated and buggy; only here to replay old journals.
-	coll_t ocid = i.decode_cid();
-	coll_t ncid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
+	const coll_t &ocid = i.get_cid(op->cid);
+	const coll_t &ncid = i.get_cid(op->dest_cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
         tracepoint(objectstore, coll_move_enter);
 	r = _collection_add(ocid, ncid, oid, spos);
 	if (r == 0 &&
@@ -2514,10 +2542,10 @@ unsigned FileStore::_do_transaction(
 
     case Transaction::OP_COLL_MOVE_RENAME:
       {
-	coll_t oldcid = i.decode_cid();
-	ghobject_t oldoid = i.decode_oid();
-	coll_t newcid = i.decode_cid();
-	ghobject_t newoid = i.decode_oid();
+	const coll_t &oldcid = i.get_cid(op->cid);
+	const ghobject_t &oldoid = i.get_oid(op->oid);
+	const coll_t &newcid = i.get_cid(op->dest_cid);
+	const ghobject_t &newoid = i.get_oid(op->dest_oid);
         tracepoint(objectstore, coll_move_rename_enter);
 	r = _collection_move_rename(oldcid, oldoid, newcid, newoid, spos);
         tracepoint(objectstore, coll_move_rename_exit, r);
@@ -2526,8 +2554,8 @@ unsigned FileStore::_do_transaction(
 
     case Transaction::OP_COLL_SETATTR:
       {
-	coll_t cid = i.decode_cid();
-	string name = i.decode_attrname();
+	const coll_t &cid = i.get_cid(op->cid);
+	string name = i.decode_string();
 	bufferlist bl;
 	i.decode_bl(bl);
         tracepoint(objectstore, coll_setattr_enter, osr_name);
@@ -2539,8 +2567,8 @@ unsigned FileStore::_do_transaction(
 
     case Transaction::OP_COLL_RMATTR:
       {
-	coll_t cid = i.decode_cid();
-	string name = i.decode_attrname();
+	const coll_t &cid = i.get_cid(op->cid);
+	string name = i.decode_string();
         tracepoint(objectstore, coll_rmattr_enter, osr_name);
 	if (_check_replay_guard(cid, spos) > 0)
 	  r = _collection_rmattr(cid, name.c_str());
@@ -2555,17 +2583,13 @@ unsigned FileStore::_do_transaction(
       break;
 
     case Transaction::OP_COLL_RENAME:
-      {
-	coll_t cid(i.decode_cid());
-	coll_t ncid(i.decode_cid());
-	r = -EOPNOTSUPP;
-      }
+      r = -EOPNOTSUPP;
       break;
 
     case Transaction::OP_OMAP_CLEAR:
       {
-	coll_t cid(i.decode_cid());
-	ghobject_t oid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
         tracepoint(objectstore, omap_clear_enter, osr_name);
 	r = _omap_clear(cid, oid, spos);
         tracepoint(objectstore, omap_clear_exit, r);
@@ -2573,8 +2597,8 @@ unsigned FileStore::_do_transaction(
       break;
     case Transaction::OP_OMAP_SETKEYS:
       {
-	coll_t cid(i.decode_cid());
-	ghobject_t oid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
 	map<string, bufferlist> aset;
 	i.decode_attrset(aset);
         tracepoint(objectstore, omap_setkeys_enter, osr_name);
@@ -2584,8 +2608,8 @@ unsigned FileStore::_do_transaction(
       break;
     case Transaction::OP_OMAP_RMKEYS:
       {
-	coll_t cid(i.decode_cid());
-	ghobject_t oid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
 	set<string> keys;
 	i.decode_keyset(keys);
         tracepoint(objectstore, omap_rmkeys_enter, osr_name);
@@ -2595,11 +2619,11 @@ unsigned FileStore::_do_transaction(
       break;
     case Transaction::OP_OMAP_RMKEYRANGE:
       {
-	coll_t cid(i.decode_cid());
-	ghobject_t oid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
 	string first, last;
-	first = i.decode_key();
-	last = i.decode_key();
+	first = i.decode_string();
+	last = i.decode_string();
         tracepoint(objectstore, omap_rmkeyrange_enter, osr_name);
 	r = _omap_rmkeyrange(cid, oid, first, last, spos);
         tracepoint(objectstore, omap_rmkeyrange_exit, r);
@@ -2607,8 +2631,8 @@ unsigned FileStore::_do_transaction(
       break;
     case Transaction::OP_OMAP_SETHEADER:
       {
-	coll_t cid(i.decode_cid());
-	ghobject_t oid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
 	bufferlist bl;
 	i.decode_bl(bl);
         tracepoint(objectstore, omap_setheader_enter, osr_name);
@@ -2618,10 +2642,10 @@ unsigned FileStore::_do_transaction(
       break;
     case Transaction::OP_SPLIT_COLLECTION:
       {
-	coll_t cid(i.decode_cid());
-	uint32_t bits(i.decode_u32());
-	uint32_t rem(i.decode_u32());
-	coll_t dest(i.decode_cid());
+	const coll_t &cid = i.get_cid(op->cid);
+	uint32_t bits(op->split_bits);
+	uint32_t rem(op->split_rem);
+	const coll_t &dest = i.get_cid(op->dest_cid);
         tracepoint(objectstore, split_coll_enter, osr_name);
 	r = _split_collection_create(cid, bits, rem, dest, spos);
         tracepoint(objectstore, split_coll_exit, r);
@@ -2629,10 +2653,10 @@ unsigned FileStore::_do_transaction(
       break;
     case Transaction::OP_SPLIT_COLLECTION2:
       {
-	coll_t cid(i.decode_cid());
-	uint32_t bits(i.decode_u32());
-	uint32_t rem(i.decode_u32());
-	coll_t dest(i.decode_cid());
+	const coll_t &cid = i.get_cid(op->cid);
+	uint32_t bits(op->split_bits);
+	uint32_t rem(op->split_rem);
+	const coll_t &dest = i.get_cid(op->dest_cid);
         tracepoint(objectstore, split_coll2_enter, osr_name);
 	r = _split_collection(cid, bits, rem, dest, spos);
         tracepoint(objectstore, split_coll2_exit, r);
@@ -2641,10 +2665,10 @@ unsigned FileStore::_do_transaction(
 
     case Transaction::OP_SETALLOCHINT:
       {
-        coll_t cid = i.decode_cid();
-        ghobject_t oid = i.decode_oid();
-        uint64_t expected_object_size = i.decode_length();
-        uint64_t expected_write_size = i.decode_length();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
+        uint64_t expected_object_size = op->expected_object_size;
+        uint64_t expected_write_size = op->expected_write_size;
         tracepoint(objectstore, setallochint_enter, osr_name);
         if (_check_replay_guard(cid, oid, spos) > 0)
           r = _set_alloc_hint(cid, oid, expected_object_size,
@@ -2654,24 +2678,24 @@ unsigned FileStore::_do_transaction(
       break;
 
     default:
-      derr << "bad op " << op << dendl;
+      derr << "bad op " << op->op << dendl;
       assert(0);
     }
 
     if (r < 0) {
       bool ok = false;
 
-      if (r == -ENOENT && !(op == Transaction::OP_CLONERANGE ||
-			    op == Transaction::OP_CLONE ||
-			    op == Transaction::OP_CLONERANGE2 ||
-			    op == Transaction::OP_COLL_ADD))
+      if (r == -ENOENT && !(op->op == Transaction::OP_CLONERANGE ||
+			    op->op == Transaction::OP_CLONE ||
+			    op->op == Transaction::OP_CLONERANGE2 ||
+			    op->op == Transaction::OP_COLL_ADD))
 	// -ENOENT is normally okay
 	// ...including on a replayed OP_RMCOLL with checkpoint mode
 	ok = true;
       if (r == -ENODATA)
 	ok = true;
 
-      if (op == Transaction::OP_SETALLOCHINT)
+      if (op->op == Transaction::OP_SETALLOCHINT)
         // Either EOPNOTSUPP or EINVAL most probably.  EINVAL in most
         // cases means invalid hint size (e.g. too big, not a multiple
         // of block size, etc) or, at least on xfs, an attempt to set
@@ -2680,15 +2704,15 @@ unsigned FileStore::_do_transaction(
         ok = true;
 
       if (replaying && !backend->can_checkpoint()) {
-	if (r == -EEXIST && op == Transaction::OP_MKCOLL) {
+	if (r == -EEXIST && op->op == Transaction::OP_MKCOLL) {
 	  dout(10) << "tolerating EEXIST during journal replay since checkpoint is not enabled" << dendl;
 	  ok = true;
 	}
-	if (r == -EEXIST && op == Transaction::OP_COLL_ADD) {
+	if (r == -EEXIST && op->op == Transaction::OP_COLL_ADD) {
 	  dout(10) << "tolerating EEXIST during journal replay since checkpoint is not enabled" << dendl;
 	  ok = true;
 	}
-	if (r == -EEXIST && op == Transaction::OP_COLL_MOVE) {
+	if (r == -EEXIST && op->op == Transaction::OP_COLL_MOVE) {
 	  dout(10) << "tolerating EEXIST during journal replay since checkpoint is not enabled" << dendl;
 	  ok = true;
 	}
@@ -2705,9 +2729,9 @@ unsigned FileStore::_do_transaction(
       if (!ok) {
 	const char *msg = "unexpected error code";
 
-	if (r == -ENOENT && (op == Transaction::OP_CLONERANGE ||
-			     op == Transaction::OP_CLONE ||
-			     op == Transaction::OP_CLONERANGE2))
+	if (r == -ENOENT && (op->op == Transaction::OP_CLONERANGE ||
+			     op->op == Transaction::OP_CLONE ||
+			     op->op == Transaction::OP_CLONERANGE2))
 	  msg = "ENOENT on clone suggests osd bug";
 
 	if (r == -ENOSPC)
@@ -2719,7 +2743,7 @@ unsigned FileStore::_do_transaction(
 	  msg = "ENOTEMPTY suggests garbage data in osd data dir";
 	}
 
-	dout(0) << " error " << cpp_strerror(r) << " not handled on operation " << op
+	dout(0) << " error " << cpp_strerror(r) << " not handled on operation " << op->op
 		<< " (" << spos << ", or op " << spos.op << ", counting from 0)" << dendl;
 	dout(0) << msg << dendl;
 	dout(0) << " transaction dump:\n";
@@ -2848,21 +2872,75 @@ int FileStore::read(
   }
 }
 
+int FileStore::_get_extents(int fd, uint64_t offset, uint64_t len,
+			    map<uint64_t, uint64_t> *m)
+{
+  if (backend->has_seek_data_hole()) {
+    dout(15) << "_get_extents seek_data_hole " << offset << "~" << len << dendl;
+    return backend->do_seek_data_hole(fd, offset, len, m);
+  }
+
+  dout(15) << "_get_extents fiemap " << offset << "~" << len << dendl;
+  struct fiemap *fiemap = NULL;
+  int r = backend->do_fiemap(fd, offset, len, &fiemap);
+  if (r < 0)
+    return r;
+
+  if (fiemap->fm_mapped_extents == 0) {
+    free(fiemap);
+    return 0;
+  }
+
+  struct fiemap_extent *extent = &fiemap->fm_extents[0];
+
+  /* start where we were asked to start */
+  if (extent->fe_logical < offset) {
+    extent->fe_length -= offset - extent->fe_logical;
+    extent->fe_logical = offset;
+  }
+
+  uint64_t i = 0;
+
+  while (i < fiemap->fm_mapped_extents) {
+    struct fiemap_extent *next = extent + 1;
+
+    dout(10) << "_get_extents fm_mapped_extents=" << fiemap->fm_mapped_extents
+	     << " fe_logical=" << extent->fe_logical << " fe_length=" << extent->fe_length << dendl;
+
+    /* try to merge extents */
+    while ((i < fiemap->fm_mapped_extents - 1) &&
+	   (extent->fe_logical + extent->fe_length == next->fe_logical)) {
+	next->fe_length += extent->fe_length;
+	next->fe_logical = extent->fe_logical;
+	extent = next;
+	next = extent + 1;
+	i++;
+    }
+
+    if (extent->fe_logical + extent->fe_length > offset + len)
+      extent->fe_length = offset + len - extent->fe_logical;
+    (*m)[extent->fe_logical] = extent->fe_length;
+    i++;
+    extent++;
+  }
+  free(fiemap);
+  return 0;
+}
+
 int FileStore::fiemap(coll_t cid, const ghobject_t& oid,
                     uint64_t offset, size_t len,
                     bufferlist& bl)
 {
   tracepoint(objectstore, fiemap_enter, cid.c_str(), offset, len);
 
-  if (!backend->has_fiemap() || len <= (size_t)m_filestore_fiemap_threshold) {
+  if ((!backend->has_seek_data_hole() && !backend->has_fiemap()) ||
+      len <= (size_t)m_filestore_fiemap_threshold) {
     map<uint64_t, uint64_t> m;
     m[offset] = len;
     ::encode(m, bl);
     return 0;
   }
 
-
-  struct fiemap *fiemap = NULL;
   map<uint64_t, uint64_t> exomap;
 
   dout(15) << "fiemap " << cid << "/" << oid << " " << offset << "~" << len << dendl;
@@ -2872,56 +2950,10 @@ int FileStore::fiemap(coll_t cid, const ghobject_t& oid,
   if (r < 0) {
     dout(10) << "read couldn't open " << cid << "/" << oid << ": " << cpp_strerror(r) << dendl;
   } else {
-    uint64_t i;
-
-    r = backend->do_fiemap(**fd, offset, len, &fiemap);
-    if (r < 0)
-      goto done;
-
-    if (fiemap->fm_mapped_extents == 0) {
-      free(fiemap);
-      goto done;
-    }
-
-    struct fiemap_extent *extent = &fiemap->fm_extents[0];
-
-    /* start where we were asked to start */
-    if (extent->fe_logical < offset) {
-      extent->fe_length -= offset - extent->fe_logical;
-      extent->fe_logical = offset;
-    }
-
-    i = 0;
-
-    while (i < fiemap->fm_mapped_extents) {
-      struct fiemap_extent *next = extent + 1;
-
-      dout(10) << "FileStore::fiemap() fm_mapped_extents=" << fiemap->fm_mapped_extents
-	       << " fe_logical=" << extent->fe_logical << " fe_length=" << extent->fe_length << dendl;
-
-      /* try to merge extents */
-      while ((i < fiemap->fm_mapped_extents - 1) &&
-             (extent->fe_logical + extent->fe_length == next->fe_logical)) {
-          next->fe_length += extent->fe_length;
-          next->fe_logical = extent->fe_logical;
-          extent = next;
-          next = extent + 1;
-          i++;
-      }
-
-      if (extent->fe_logical + extent->fe_length > offset + len)
-        extent->fe_length = offset + len - extent->fe_logical;
-      exomap[extent->fe_logical] = extent->fe_length;
-      i++;
-      extent++;
-    }
-    free(fiemap);
-  }
-
-done:
-  if (r >= 0) {
+    r = _get_extents(**fd, offset, len, &exomap);
     lfn_close(fd);
-    ::encode(exomap, bl);
+    if (r >= 0)
+      ::encode(exomap, bl);
   }
 
   dout(10) << "fiemap " << cid << "/" << oid << " " << offset << "~" << len << " = " << r << " num_extents=" << exomap.size() << " " << exomap << dendl;
@@ -3006,6 +3038,8 @@ int FileStore::_write(coll_t cid, const ghobject_t& oid,
     int rc = backend->_crc_update_write(**fd, offset, len, bl);
     assert(rc >= 0);
   }
+  if (r >= 0)
+    _mark_dirty(oid, fd);
 
   // flush?
   if (!replaying &&
@@ -3036,6 +3070,8 @@ int FileStore::_zero(coll_t cid, const ghobject_t& oid, uint64_t offset, size_t
   ret = fallocate(**fd, FALLOC_FL_PUNCH_HOLE, offset, len);
   if (ret < 0)
     ret = -errno;
+  if (ret >= 0)
+    _mark_dirty(oid, fd);
   lfn_close(fd);
 
   if (ret >= 0 && m_filestore_sloppy_crc) {
@@ -3104,6 +3140,7 @@ int FileStore::_clone(coll_t cid, const ghobject_t& oldoid, const ghobject_t& ne
     if (r < 0) {
       goto out3;
     }
+    _mark_dirty(newoid, n);
 
     dout(20) << "objectmap clone" << dendl;
     r = object_map->clone(oldoid, newoid, &spos);
@@ -3157,110 +3194,50 @@ int FileStore::_do_sparse_copy_range(int from, int to, uint64_t srcoff, uint64_t
 {
   dout(20) << __func__ << " " << srcoff << "~" << len << " to " << dstoff << dendl;
   int r = 0;
-  struct fiemap *fiemap = NULL;
+  map<uint64_t, uint64_t> exomap;
 
   // fiemap doesn't allow zero length
   if (len == 0)
     return 0;
 
-  r = backend->do_fiemap(from, srcoff, len, &fiemap);
+  r = _get_extents(from, srcoff, len, &exomap);
   if (r < 0) {
-    derr << "do_fiemap failed:" << srcoff << "~" << len << " = " << r << dendl;
+    derr << __func__ << " _get_extents failed:" << srcoff << "~" << len << " = " << r << dendl;
     return r;
   }
 
-  // No need to copy
-  if (fiemap->fm_mapped_extents == 0)
-    return r;
-
-  int buflen = 4096*32;
-  char buf[buflen];
-  struct fiemap_extent *extent = &fiemap->fm_extents[0];
-
-  /* start where we were asked to start */
-  if (extent->fe_logical < srcoff) {
-    extent->fe_length -= srcoff - extent->fe_logical;
-    extent->fe_logical = srcoff;
+  for (map<uint64_t, uint64_t>::iterator miter = exomap.begin();
+       miter != exomap.end();
+       ++miter) {
+    r = _do_copy_range(from, to, miter->first, miter->second,
+		       miter->first - srcoff + dstoff, true);
+    if (r < 0)
+      break;
   }
 
-  uint64_t i = 0;
-
-  while (i < fiemap->fm_mapped_extents) {
-    struct fiemap_extent *next = extent + 1;
-
-    dout(10) << __func__ << " fm_mapped_extents=" << fiemap->fm_mapped_extents
-             << " fe_logical=" << extent->fe_logical << " fe_length="
-             << extent->fe_length << dendl;
-
-    /* try to merge extents */
-    while ((i < fiemap->fm_mapped_extents - 1) &&
-           (extent->fe_logical + extent->fe_length == next->fe_logical)) {
-        next->fe_length += extent->fe_length;
-        next->fe_logical = extent->fe_logical;
-        extent = next;
-        next = extent + 1;
-        i++;
-    }
-
-    if (extent->fe_logical + extent->fe_length > srcoff + len)
-      extent->fe_length = srcoff + len - extent->fe_logical;
-
-    int64_t actual;
-
-    actual = ::lseek64(from, extent->fe_logical, SEEK_SET);
-    if (actual != (int64_t)extent->fe_logical) {
-      r = errno;
-      derr << "lseek64 to " << srcoff << " got " << cpp_strerror(r) << dendl;
-      return r;
-    }
-    actual = ::lseek64(to, extent->fe_logical - srcoff + dstoff, SEEK_SET);
-    if (actual != (int64_t)(extent->fe_logical - srcoff + dstoff)) {
-      r = errno;
-      derr << "lseek64 to " << dstoff << " got " << cpp_strerror(r) << dendl;
-      return r;
-    }
-
-    loff_t pos = 0;
-    loff_t end = extent->fe_length;
-    while (pos < end) {
-      int l = MIN(end-pos, buflen);
-      r = ::read(from, buf, l);
-      dout(25) << "  read from " << pos << "~" << l << " got " << r << dendl;
+  // the copied extents may stop short of a trailing hole; extend the
+  // destination as a plain copy of the source would have.
+  if (r >= 0) {
+    struct stat st;
+    r = ::fstat(from, &st);
+    if (r < 0) {
+      r = -errno;
+      derr << __func__ << ": fstat error " << cpp_strerror(r) << dendl;
+    } else if ((uint64_t)st.st_size > srcoff) {
+      uint64_t dstend = MIN((uint64_t)st.st_size, srcoff + len) - srcoff + dstoff;
+      r = ::fstat(to, &st);
       if (r < 0) {
-        if (errno == EINTR) {
-          continue;
-        } else {
-          r = -errno;
-          derr << __func__ << ": read error at " << pos << "~" << len
-              << ", " << cpp_strerror(r) << dendl;
-          break;
-        }
-      }
-      if (r == 0) {
-        r = -ERANGE;
-        derr << __func__ << " got short read result at " << pos
-             << " of fd " << from << " len " << len << dendl;
-        break;
-      }
-      int op = 0;
-      while (op < r) {
-        int r2 = safe_write(to, buf+op, r-op);
-        dout(25) << " write to " << to << " len " << (r-op)
-                 << " got " << r2 << dendl;
-        if (r2 < 0) {
-          r = r2;
-          derr << __func__ << ": write error at " << pos << "~"
-               << r-op << ", " << cpp_strerror(r) << dendl;
-          break;
-        }
-        op += (r-op);
+	r = -errno;
+	derr << __func__ << ": fstat error " << cpp_strerror(r) << dendl;
+      } else if ((uint64_t)st.st_size < dstend) {
+	r = ::ftruncate(to, dstend);
+	if (r < 0) {
+	  r = -errno;
+	  derr << __func__ << ": ftruncate to " << dstend << " error "
+	       << cpp_strerror(r) << dendl;
+	}
       }
-      if (r < 0)
-        break;
-      pos += r;
     }
-    i++;
-    extent++;
   }
 
   if (r >= 0 && m_filestore_sloppy_crc) {
@@ -3272,7 +3249,8 @@ int FileStore::_do_sparse_copy_range(int from, int to, uint64_t srcoff, uint64_t
   return r;
 }
 
-int FileStore::_do_copy_range(int from, int to, uint64_t srcoff, uint64_t len, uint64_t dstoff)
+int FileStore::_do_copy_range(int from, int to, uint64_t srcoff, uint64_t len, uint64_t dstoff,
+			      bool skip_sloppycrc)
 {
   dout(20) << "_do_copy_range " << srcoff << "~" << len << " to " << dstoff << dendl;
   int r = 0;
@@ -3334,7 +3312,7 @@ int FileStore::_do_copy_range(int from, int to, uint64_t srcoff, uint64_t len, u
       break;
     pos += r;
   }
-  if (r >= 0 && m_filestore_sloppy_crc) {
+  if (r >= 0 && m_filestore_sloppy_crc && !skip_sloppycrc) {
     int rc = backend->_crc_update_clone_range(from, to, srcoff, len, dstoff);
     assert(rc >= 0);
   }
@@ -3362,6 +3340,8 @@ int FileStore::_clone_range(coll_t cid, const ghobject_t& oldoid, const ghobject
     goto out;
   }
   r = _do_clone_range(**o, **n, srcoff, len, dstoff);
+  if (r >= 0)
+    _mark_dirty(newoid, n);
 
   // clone is non-idempotent; record our work.
   _set_replay_guard(**n, spos, &newoid);
@@ -3375,6 +3355,51 @@ int FileStore::_clone_range(coll_t cid, const ghobject_t& oldoid, const ghobject
   return r;
 }
 
+void FileStore::_mark_dirty(const ghobject_t &oid, FDRef fd)
+{
+  if (!m_filestore_fsync_commit || dirty_overflow.read())
+    return;
+  DirtyShard *shard = get_dirty_shard(oid);
+  Mutex::Locker l(shard->lock);
+  if (!shard->fds.insert(fd).second)
+    return;
+  if (dirty_count.inc() > (unsigned)g_conf->filestore_fsync_commit_max_files) {
+    // too many fds pinned; this commit will syncfs instead.  drop what
+    // we hold here, the other shards let go at the commit.
+    dout(10) << "_mark_dirty more than "
+	     << g_conf->filestore_fsync_commit_max_files
+	     << " dirty files, next commit will syncfs" << dendl;
+    dirty_overflow.set(1);
+    dirty_count.sub(shard->fds.size());
+    shard->fds.clear();
+  }
+}
+
+bool FileStore::_take_dirty(vector<FDRef> *dirty)
+{
+  bool overflow = dirty_overflow.read();
+  for (unsigned i = 0; i < dirty_shards.size(); ++i) {
+    Mutex::Locker l(dirty_shards[i]->lock);
+    if (!overflow)
+      dirty->insert(dirty->end(),
+		    dirty_shards[i]->fds.begin(), dirty_shards[i]->fds.end());
+    dirty_shards[i]->fds.clear();
+  }
+  dirty_count.set(0);
+  dirty_overflow.set(0);
+  return !overflow;
+}
+
+int FileStore::_fsync_fds(vector<FDRef> &fds)
+{
+  dout(15) << "_fsync_fds " << fds.size() << " files" << dendl;
+  fsync_wq.r = 0;
+  for (vector<FDRef>::iterator p = fds.begin(); p != fds.end(); ++p)
+    fsync_wq.queue(*p);
+  fsync_wq.drain();
+  return fsync_wq.r;
+}
+
 class SyncEntryTimeout : public Context {
 public:
   SyncEntryTimeout(int commit_timeo) 
@@ -3489,13 +3514,32 @@ void FileStore::sync_entry()
 	}
       } else
       {
+	// everything applied up to cp is marked dirty by now; later ops
+	// dirty a fresh set once op_tp is unpaused.
+	vector<FDRef> dirty;
+	bool fsync_commit = m_filestore_fsync_commit && _take_dirty(&dirty);
+
 	apply_manager.commit_started();
 	op_tp.unpause();
 
-	int err = backend->syncfs();
-	if (err < 0) {
-	  derr << "syncfs got " << cpp_strerror(err) << dendl;
-	  assert(0 == "syncfs returned error");
+	int err;
+	if (fsync_commit) {
+	  err = _fsync_fds(dirty);
+	  if (err < 0) {
+	    derr << "fdatasync of dirty files got " << cpp_strerror(err) << dendl;
+	    assert(0 == "fdatasync of dirty files returned error");
+	  }
+	  err = object_map->sync();
+	  if (err < 0) {
+	    derr << "object_map sync got " << cpp_strerror(err) << dendl;
+	    assert(0 == "object_map sync returned error");
+	  }
+	} else {
+	  err = backend->syncfs();
+	  if (err < 0) {
+	    derr << "syncfs got " << cpp_strerror(err) << dendl;
+	    assert(0 == "syncfs returned error");
+	  }
 	}
 
 	err = write_op_seq(op_fd, cp);
@@ -4981,17 +5025,21 @@ int FileStore::_omap_rmkeyrange(coll_t cid, const ghobject_t &hoid,
 				const string& first, const string& last,
 				const SequencerPosition &spos) {
   dout(15) << __func__ << " " << cid << "/" << hoid << " [" << first << "," << last << "]" << dendl;
-  set<string> keys;
+  Index index;
+  int r = get_index(cid, &index);
+  if (r < 0)
+    return r;
   {
-    ObjectMap::ObjectMapIterator iter = get_omap_iterator(cid, hoid);
-    if (!iter)
-      return -ENOENT;
-    for (iter->lower_bound(first); iter->valid() && iter->key() < last;
-	 iter->next()) {
-      keys.insert(iter->key());
-    }
+    assert(NULL != index.index);
+    RWLock::RLocker l((index.index)->access_lock);
+    r = lfn_find(hoid, index);
+    if (r < 0)
+      return r;
   }
-  return _omap_rmkeys(cid, hoid, keys, spos);
+  r = object_map->rm_key_range(hoid, first, last, &spos);
+  if (r < 0 && r != -ENOENT)
+    return r;
+  return 0;
 }
 
 int FileStore::_omap_setheader(coll_t cid, const ghobject_t &hoid,
@@ -144,7 +144,7 @@ private:
   // ObjectMap
   boost::scoped_ptr<ObjectMap> object_map;
   
-  Finisher ondisk_finisher;
+  ShardedFinisher ondisk_finisher;  ///< keyed by OpSequencer
 
   // helper fns
   int get_cdir(coll_t cid, char *s, int len);
@@ -326,12 +326,70 @@ private:
   FDCache fdcache;
   WBThrottle wbthrottle;
 
+  // -- fsync commit --
+  /**
+   * With filestore_fsync_commit, a commit fdatasyncs the files dirtied
+   * since the previous commit instead of syncfs'ing the whole fs.  The
+   * dirty set is sharded by object so op threads rarely contend on it.
+   * It holds an open fd per file, so once it grows past
+   * filestore_fsync_commit_max_files it is dropped and that commit
+   * falls back to syncfs.
+   */
+  struct DirtyShard {
+    Mutex lock;
+    set<FDRef> fds;
+    DirtyShard() : lock("FileStore::DirtyShard::lock") {}
+  };
+  vector<DirtyShard*> dirty_shards;
+  atomic_t dirty_count;     ///< fds held by all shards
+  atomic_t dirty_overflow;  ///< nonzero if this commit must syncfs
+  DirtyShard *get_dirty_shard(const ghobject_t &oid) {
+    return dirty_shards[oid.hobj.hash % dirty_shards.size()];
+  }
+  void _mark_dirty(const ghobject_t &oid, FDRef fd);
+  /// move the dirty set of every shard into *dirty; @returns false on overflow
+  bool _take_dirty(vector<FDRef> *dirty);
+  /// fdatasync fds in parallel; @returns the first -errno seen, or 0
+  int _fsync_fds(vector<FDRef> &fds);
+
+  ThreadPool fsync_tp;
+  struct FsyncWQ : public ThreadPool::WorkQueueVal<FDRef> {
+    list<FDRef> fds;
+    Mutex lock;
+    int r;  ///< first error of this batch
+    FsyncWQ(time_t timeout, ThreadPool *tp)
+      : ThreadPool::WorkQueueVal<FDRef>("FileStore::FsyncWQ", timeout, 0, tp),
+	lock("FileStore::FsyncWQ::lock"), r(0) {}
+    void _enqueue(FDRef fd) {
+      fds.push_back(fd);
+    }
+    void _enqueue_front(FDRef fd) {
+      fds.push_front(fd);
+    }
+    bool _empty() {
+      return fds.empty();
+    }
+    FDRef _dequeue() {
+      FDRef fd = fds.front();
+      fds.pop_front();
+      return fd;
+    }
+    void _process(FDRef fd) {
+      if (::fdatasync(**fd) < 0) {
+	int err = -errno;
+	Mutex::Locker l(lock);
+	if (r == 0)
+	  r = err;
+      }
+    }
+  } fsync_wq;
+
   Sequencer default_osr;
   deque<OpSequencer*> op_queue;
   uint64_t op_queue_len, op_queue_bytes;
   Cond op_throttle_cond;
   Mutex op_throttle_lock;
-  Finisher op_finisher;
+  ShardedFinisher op_finisher;      ///< keyed by OpSequencer
 
   ThreadPool op_tp;
   struct OpWQ : public ThreadPool::WorkQueue<OpSequencer> {
@@ -540,7 +598,9 @@ public:
 		   const SequencerPosition& spos);
   int _do_clone_range(int from, int to, uint64_t srcoff, uint64_t len, uint64_t dstoff);
   int _do_sparse_copy_range(int from, int to, uint64_t srcoff, uint64_t len, uint64_t dstoff);
-  int _do_copy_range(int from, int to, uint64_t srcoff, uint64_t len, uint64_t dstoff);
+  int _do_copy_range(int from, int to, uint64_t srcoff, uint64_t len, uint64_t dstoff,
+		     bool skip_sloppycrc=false);
+  int _get_extents(int fd, uint64_t offset, uint64_t len, map<uint64_t, uint64_t> *m);
   int _remove(coll_t cid, const ghobject_t& oid, const SequencerPosition &spos);
 
   int _fgetattr(int fd, const char *name, bufferptr& bp);
@@ -702,6 +762,7 @@ private:
   atomic_t m_filestore_kill_at;
   bool m_filestore_sloppy_crc;
   int m_filestore_sloppy_crc_block_size;
+  bool m_filestore_fsync_commit;
   uint64_t m_filestore_max_alloc_hint_size;
   long m_fs_type;
 
@@ -761,7 +822,7 @@ protected:
     return filestore->current_fn;
   }
   int _copy_range(int from, int to, uint64_t srcoff, uint64_t len, uint64_t dstoff) {
-    if (has_fiemap()) {
+    if (has_seek_data_hole() || has_fiemap()) {
       return filestore->_do_sparse_copy_range(from, to, srcoff, len, dstoff);
     } else {
       return filestore->_do_copy_range(from, to, srcoff, len, dstoff);
@@ -789,6 +850,10 @@ public:
   virtual int syncfs() = 0;
   virtual bool has_fiemap() = 0;
   virtual int do_fiemap(int fd, off_t start, size_t len, struct fiemap **pfiemap) = 0;
+  virtual bool has_seek_data_hole() = 0;
+  /// fill *m with the data extents of fd within [start, start+len)
+  virtual int do_seek_data_hole(int fd, uint64_t start, uint64_t len,
+				map<uint64_t, uint64_t> *m) = 0;
   virtual int clone_range(int from, int to, uint64_t srcoff, uint64_t len, uint64_t dstoff) = 0;
   virtual int set_alloc_hint(int fd, uint64_t hint) = 0;
 
@@ -57,7 +57,9 @@
 GenericFileStoreBackend::GenericFileStoreBackend(FileStore *fs):
   FileStoreBackend(fs),
   ioctl_fiemap(false),
+  seek_data_hole(false),
   m_filestore_fiemap(g_conf->filestore_fiemap),
+  m_filestore_seek_data_hole(g_conf->filestore_seek_data_hole),
   m_filestore_fsync_flushes_journal_data(g_conf->filestore_fsync_flushes_journal_data) {}
 
 int GenericFileStoreBackend::detect_features()
@@ -130,6 +132,33 @@ int GenericFileStoreBackend::detect_features()
     ioctl_fiemap = false;
   }
 
+  // SEEK_DATA/SEEK_HOLE; the first extent written above starts past a hole
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+  {
+    int64_t pos = ::lseek64(fd, 0, SEEK_DATA);
+    if (pos < 0) {
+      r = -errno;
+      dout(0) << "detect_features: SEEK_DATA/SEEK_HOLE is NOT supported: "
+	      << cpp_strerror(r) << dendl;
+      seek_data_hole = false;
+    } else if (pos > v[0]) {
+      dout(0) << "detect_features: SEEK_DATA/SEEK_HOLE is supported, but "
+	      << "SEEK_DATA skipped data at " << v[0] << dendl;
+      seek_data_hole = false;
+    } else {
+      dout(0) << "detect_features: SEEK_DATA/SEEK_HOLE is supported"
+	      << (pos == 0 ? " (no holes reported)" : "") << dendl;
+      seek_data_hole = true;
+    }
+  }
+#else
+  dout(0) << "detect_features: SEEK_DATA/SEEK_HOLE is NOT supported" << dendl;
+#endif
+  if (!m_filestore_seek_data_hole) {
+    dout(0) << "detect_features: SEEK_DATA/SEEK_HOLE is disabled via 'filestore seek data hole' config option" << dendl;
+    seek_data_hole = false;
+  }
+
   ::unlink(fn);
   VOID_TEMP_FAILURE_RETRY(::close(fd));
 
@@ -262,6 +291,38 @@ done_err:
   return ret;
 }
 
+int GenericFileStoreBackend::do_seek_data_hole(int fd, uint64_t start, uint64_t len,
+					       map<uint64_t, uint64_t> *m)
+{
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+  uint64_t end = start + len;
+  uint64_t pos = start;
+  while (pos < end) {
+    int64_t data = ::lseek64(fd, pos, SEEK_DATA);
+    if (data < 0) {
+      int r = -errno;
+      if (r == -ENXIO)  // no data past pos
+	break;
+      return r;
+    }
+    if ((uint64_t)data >= end)
+      break;
+    int64_t hole = ::lseek64(fd, data, SEEK_HOLE);
+    if (hole < 0) {
+      int r = -errno;
+      if (r == -ENXIO)  // truncated underneath us
+	break;
+      return r;
+    }
+    uint64_t next = MIN((uint64_t)hole, end);
+    (*m)[data] = next - data;
+    pos = next;
+  }
+  return 0;
+#else
+  return -EOPNOTSUPP;
+#endif
+}
 
 int GenericFileStoreBackend::_crc_load_or_init(int fd, SloppyCRCMap *cm)
 {
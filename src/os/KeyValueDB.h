@@ -4,6 +4,7 @@
 #define KEY_VALUE_DB_H
 
 #include "include/buffer.h"
+#include <errno.h>
 #include <set>
 #include <map>
 #include <string>
@@ -60,6 +61,13 @@ public:
       const string &prefix ///< [in] Prefix by which to remove keys
       ) = 0;
 
+    /// Removes keys beginning with prefix in the range [start, end)
+    virtual void rm_range_keys(
+      const string &prefix,   ///< [in] Prefix by which to remove keys
+      const string &start,    ///< [in] First key to remove
+      const string &end       ///< [in] First key past the range
+      ) = 0;
+
     virtual ~TransactionImpl() {}
   };
   typedef ceph::shared_ptr< TransactionImpl > Transaction;
@@ -71,6 +79,32 @@ public:
   /// test whether we can successfully initialize; may have side effects (e.g., create)
   static int test_init(const string& type, const string& dir);
   virtual int init() = 0;
+
+  /**
+   * A column family groups the keys of one or more prefixes so that the
+   * backend can store and compact them apart from the rest of the
+   * store, with its own tuning.
+   */
+  struct ColumnFamily {
+    string name;    ///< column family name
+    string option;  ///< backend specific options, "key=value[,key=value]"
+    ColumnFamily(const string &name, const string &option)
+      : name(name), option(option) {}
+  };
+
+  /**
+   * Place keys beginning with prefix in column family cf
+   *
+   * Must be called before open() or create_and_open().  Backends without
+   * column families return -EOPNOTSUPP and keep a single key space.
+   */
+  virtual int add_column_family(
+    const string &prefix,   ///< [in] Prefix to place
+    const ColumnFamily &cf  ///< [in] Column family to place it in
+    ) {
+    return -EOPNOTSUPP;
+  }
+
   virtual int open(ostream &out) = 0;
   virtual int create_and_open(ostream &out) = 0;
 
@@ -161,7 +195,7 @@ public:
 
   Iterator get_iterator(const string &prefix) {
     return ceph::shared_ptr<IteratorImpl>(
-      new IteratorImpl(prefix, get_iterator())
+      new IteratorImpl(prefix, _get_prefix_iterator(prefix))
     );
   }
 
@@ -171,7 +205,7 @@ public:
 
   Iterator get_snapshot_iterator(const string &prefix) {
     return ceph::shared_ptr<IteratorImpl>(
-      new IteratorImpl(prefix, get_snapshot_iterator())
+      new IteratorImpl(prefix, _get_prefix_snapshot_iterator(prefix))
     );
   }
 
@@ -194,6 +228,15 @@ public:
 protected:
   virtual WholeSpaceIterator _get_iterator() = 0;
   virtual WholeSpaceIterator _get_snapshot_iterator() = 0;
+
+  /// iterator that need only be valid for keys beginning with prefix
+  virtual WholeSpaceIterator _get_prefix_iterator(const string &prefix) {
+    return _get_iterator();
+  }
+  virtual WholeSpaceIterator _get_prefix_snapshot_iterator(
+    const string &prefix) {
+    return _get_snapshot_iterator();
+  }
 };
 
 #endif
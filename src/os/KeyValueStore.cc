@@ -1203,27 +1203,27 @@ unsigned KeyValueStore::_do_transaction(Transaction& transaction,
     if (handle)
       handle->reset_tp_timeout();
 
-    int op = i.decode_op();
+    Transaction::Op *op = i.decode_op();
     int r = 0;
 
-    switch (op) {
+    switch (op->op) {
     case Transaction::OP_NOP:
       break;
 
     case Transaction::OP_TOUCH:
       {
-        coll_t cid = i.decode_cid();
-        ghobject_t oid = i.decode_oid();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
         r = _touch(cid, oid, t);
       }
       break;
 
     case Transaction::OP_WRITE:
       {
-        coll_t cid = i.decode_cid();
-        ghobject_t oid = i.decode_oid();
-        uint64_t off = i.decode_length();
-        uint64_t len = i.decode_length();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
+        uint64_t off = op->off;
+        uint64_t len = op->len;
         bool replica = i.get_replica();
         bufferlist bl;
         i.decode_bl(bl);
@@ -1233,46 +1233,42 @@ unsigned KeyValueStore::_do_transaction(Transaction& transaction,
 
     case Transaction::OP_ZERO:
       {
-        coll_t cid = i.decode_cid();
-        ghobject_t oid = i.decode_oid();
-        uint64_t off = i.decode_length();
-        uint64_t len = i.decode_length();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
+        uint64_t off = op->off;
+        uint64_t len = op->len;
         r = _zero(cid, oid, off, len, t);
       }
       break;
 
     case Transaction::OP_TRIMCACHE:
       {
-        i.decode_cid();
-        i.decode_oid();
-        i.decode_length();
-        i.decode_length();
         // deprecated, no-op
       }
       break;
 
     case Transaction::OP_TRUNCATE:
       {
-        coll_t cid = i.decode_cid();
-        ghobject_t oid = i.decode_oid();
-        uint64_t off = i.decode_length();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
+        uint64_t off = op->off;
         r = _truncate(cid, oid, off, t);
       }
       break;
 
     case Transaction::OP_REMOVE:
       {
-        coll_t cid = i.decode_cid();
-        ghobject_t oid = i.decode_oid();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
         r = _remove(cid, oid, t);
       }
       break;
 
     case Transaction::OP_SETATTR:
       {
-        coll_t cid = i.decode_cid();
-        ghobject_t oid = i.decode_oid();
-        string name = i.decode_attrname();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
+        string name = i.decode_string();
         bufferlist bl;
         i.decode_bl(bl);
         map<string, bufferptr> to_set;
@@ -1286,8 +1282,8 @@ unsigned KeyValueStore::_do_transaction(Transaction& transaction,
 
     case Transaction::OP_SETATTRS:
       {
-        coll_t cid = i.decode_cid();
-        ghobject_t oid = i.decode_oid();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
         map<string, bufferptr> aset;
         i.decode_attrset(aset);
         r = _setattrs(cid, oid, aset, t);
@@ -1298,26 +1294,26 @@ unsigned KeyValueStore::_do_transaction(Transaction& transaction,
 
     case Transaction::OP_RMATTR:
       {
-        coll_t cid = i.decode_cid();
-        ghobject_t oid = i.decode_oid();
-        string name = i.decode_attrname();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
+        string name = i.decode_string();
         r = _rmattr(cid, oid, name.c_str(), t);
       }
       break;
 
     case Transaction::OP_RMATTRS:
       {
-        coll_t cid = i.decode_cid();
-        ghobject_t oid = i.decode_oid();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
         r = _rmattrs(cid, oid, t);
       }
       break;
 
     case Transaction::OP_CLONE:
       {
-        coll_t cid = i.decode_cid();
-        ghobject_t oid = i.decode_oid();
-        ghobject_t noid = i.decode_oid();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
+        const ghobject_t &noid = i.get_oid(op->dest_oid);
         exist_clone = true;
         r = _clone(cid, oid, noid, t);
       }
@@ -1325,11 +1321,11 @@ unsigned KeyValueStore::_do_transaction(Transaction& transaction,
 
     case Transaction::OP_CLONERANGE:
       {
-        coll_t cid = i.decode_cid();
-        ghobject_t oid = i.decode_oid();
-        ghobject_t noid = i.decode_oid();
-        uint64_t off = i.decode_length();
-        uint64_t len = i.decode_length();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
+        const ghobject_t &noid = i.get_oid(op->dest_oid);
+        uint64_t off = op->off;
+        uint64_t len = op->len;
         exist_clone = true;
         r = _clone_range(cid, oid, noid, off, len, off, t);
       }
@@ -1337,12 +1333,12 @@ unsigned KeyValueStore::_do_transaction(Transaction& transaction,
 
     case Transaction::OP_CLONERANGE2:
       {
-        coll_t cid = i.decode_cid();
-        ghobject_t oid = i.decode_oid();
-        ghobject_t noid = i.decode_oid();
-        uint64_t srcoff = i.decode_length();
-        uint64_t len = i.decode_length();
-        uint64_t dstoff = i.decode_length();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
+        const ghobject_t &noid = i.get_oid(op->dest_oid);
+        uint64_t srcoff = op->off;
+        uint64_t len = op->len;
+        uint64_t dstoff = op->dest_off;
         exist_clone = true;
         r = _clone_range(cid, oid, noid, srcoff, len, dstoff, t);
       }
@@ -1350,15 +1346,15 @@ unsigned KeyValueStore::_do_transaction(Transaction& transaction,
 
     case Transaction::OP_MKCOLL:
       {
-        coll_t cid = i.decode_cid();
+        const coll_t &cid = i.get_cid(op->cid);
         r = _create_collection(cid, t);
       }
       break;
 
     case Transaction::OP_COLL_HINT:
       {
-        coll_t cid = i.decode_cid();
-        uint32_t type = i.decode_u32();
+        const coll_t &cid = i.get_cid(op->cid);
+        uint32_t type = op->hint_type;
         bufferlist hint;
         i.decode_bl(hint);
         bufferlist::iterator hiter = hint.begin();
@@ -1377,24 +1373,24 @@ unsigned KeyValueStore::_do_transaction(Transaction& transaction,
 
     case Transaction::OP_RMCOLL:
       {
-        coll_t cid = i.decode_cid();
+        const coll_t &cid = i.get_cid(op->cid);
         r = _destroy_collection(cid, t);
       }
       break;
 
     case Transaction::OP_COLL_ADD:
       {
-        coll_t ncid = i.decode_cid();
-        coll_t ocid = i.decode_cid();
-        ghobject_t oid = i.decode_oid();
+        const coll_t &ncid = i.get_cid(op->cid);
+        const coll_t &ocid = i.get_cid(op->dest_cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
         r = _collection_add(ncid, ocid, oid, t);
       }
       break;
 
     case Transaction::OP_COLL_REMOVE:
        {
-        coll_t cid = i.decode_cid();
-        ghobject_t oid = i.decode_oid();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
         r = _remove(cid, oid, t);
        }
       break;
@@ -1402,27 +1398,27 @@ unsigned KeyValueStore::_do_transaction(Transaction& transaction,
     case Transaction::OP_COLL_MOVE:
       {
         // WARNING: this is deprecated and buggy; only here to replay old journals.
-        coll_t ocid = i.decode_cid();
-        coll_t ncid = i.decode_cid();
-        ghobject_t oid = i.decode_oid();
+        const coll_t &ocid = i.get_cid(op->cid);
+        const coll_t &ncid = i.get_cid(op->dest_cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
         r = _collection_move_rename(ocid, oid, ncid, oid, t);
       }
       break;
 
     case Transaction::OP_COLL_MOVE_RENAME:
       {
-        coll_t oldcid = i.decode_cid();
-        ghobject_t oldoid = i.decode_oid();
-        coll_t newcid = i.decode_cid();
-        ghobject_t newoid = i.decode_oid();
+        const coll_t &oldcid = i.get_cid(op->cid);
+        const ghobject_t &oldoid = i.get_oid(op->oid);
+        const coll_t &newcid = i.get_cid(op->dest_cid);
+        const ghobject_t &newoid = i.get_oid(op->dest_oid);
         r = _collection_move_rename(oldcid, oldoid, newcid, newoid, t);
       }
       break;
 
     case Transaction::OP_COLL_SETATTR:
       {
-        coll_t cid = i.decode_cid();
-        string name = i.decode_attrname();
+        const coll_t &cid = i.get_cid(op->cid);
+        string name = i.decode_string();
         bufferlist bl;
         i.decode_bl(bl);
         r = _collection_setattr(cid, name.c_str(), bl.c_str(), bl.length(), t);
@@ -1431,8 +1427,8 @@ unsigned KeyValueStore::_do_transaction(Transaction& transaction,
 
     case Transaction::OP_COLL_RMATTR:
       {
-        coll_t cid = i.decode_cid();
-        string name = i.decode_attrname();
+        const coll_t &cid = i.get_cid(op->cid);
+        string name = i.decode_string();
         r = _collection_rmattr(cid, name.c_str(), t);
       }
       break;
@@ -1444,24 +1440,20 @@ unsigned KeyValueStore::_do_transaction(Transaction& transaction,
       }
 
     case Transaction::OP_COLL_RENAME:
-      {
-        coll_t cid(i.decode_cid());
-        coll_t ncid(i.decode_cid());
-        r = -EOPNOTSUPP;
-      }
+      r = -EOPNOTSUPP;
       break;
 
     case Transaction::OP_OMAP_CLEAR:
       {
-        coll_t cid(i.decode_cid());
-        ghobject_t oid = i.decode_oid();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
         r = _omap_clear(cid, oid, t);
       }
       break;
     case Transaction::OP_OMAP_SETKEYS:
       {
-        coll_t cid(i.decode_cid());
-        ghobject_t oid = i.decode_oid();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
         map<string, bufferlist> aset;
         i.decode_attrset(aset);
         r = _omap_setkeys(cid, oid, aset, t);
@@ -1469,8 +1461,8 @@ unsigned KeyValueStore::_do_transaction(Transaction& transaction,
       break;
     case Transaction::OP_OMAP_RMKEYS:
       {
-        coll_t cid(i.decode_cid());
-        ghobject_t oid = i.decode_oid();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
         set<string> keys;
         i.decode_keyset(keys);
         r = _omap_rmkeys(cid, oid, keys, t);
@@ -1478,18 +1470,18 @@ unsigned KeyValueStore::_do_transaction(Transaction& transaction,
       break;
     case Transaction::OP_OMAP_RMKEYRANGE:
       {
-        coll_t cid(i.decode_cid());
-        ghobject_t oid = i.decode_oid();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
         string first, last;
-        first = i.decode_key();
-        last = i.decode_key();
+        first = i.decode_string();
+        last = i.decode_string();
         r = _omap_rmkeyrange(cid, oid, first, last, t);
       }
       break;
     case Transaction::OP_OMAP_SETHEADER:
       {
-        coll_t cid(i.decode_cid());
-        ghobject_t oid = i.decode_oid();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
         bufferlist bl;
         i.decode_bl(bl);
         r = _omap_setheader(cid, oid, bl, t);
@@ -1497,45 +1489,45 @@ unsigned KeyValueStore::_do_transaction(Transaction& transaction,
       break;
     case Transaction::OP_SPLIT_COLLECTION:
       {
-        coll_t cid(i.decode_cid());
-        uint32_t bits(i.decode_u32());
-        uint32_t rem(i.decode_u32());
-        coll_t dest(i.decode_cid());
+        const coll_t &cid = i.get_cid(op->cid);
+        uint32_t bits(op->split_bits);
+        uint32_t rem(op->split_rem);
+        const coll_t &dest = i.get_cid(op->dest_cid);
         r = _split_collection_create(cid, bits, rem, dest, t);
       }
       break;
     case Transaction::OP_SPLIT_COLLECTION2:
       {
-        coll_t cid(i.decode_cid());
-        uint32_t bits(i.decode_u32());
-        uint32_t rem(i.decode_u32());
-        coll_t dest(i.decode_cid());
+        const coll_t &cid = i.get_cid(op->cid);
+        uint32_t bits(op->split_bits);
+        uint32_t rem(op->split_rem);
+        const coll_t &dest = i.get_cid(op->dest_cid);
         r = _split_collection(cid, bits, rem, dest, t);
       }
       break;
 
     case Transaction::OP_SETALLOCHINT:
       {
-        coll_t cid(i.decode_cid());
-        ghobject_t oid = i.decode_oid();
-        uint64_t expected_object_size = i.decode_length();
-        uint64_t expected_write_size = i.decode_length();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
+        uint64_t expected_object_size = op->expected_object_size;
+        uint64_t expected_write_size = op->expected_write_size;
         r = _set_alloc_hint(cid, oid, expected_object_size,
                             expected_write_size, t);
       }
       break;
 
     default:
-      derr << "bad op " << op << dendl;
+      derr << "bad op " << op->op << dendl;
       assert(0);
     }
 
     if (r < 0) {
       bool ok = false;
 
-      if (r == -ENOENT && !(op == Transaction::OP_CLONERANGE ||
-                            op == Transaction::OP_CLONE ||
-                            op == Transaction::OP_CLONERANGE2))
+      if (r == -ENOENT && !(op->op == Transaction::OP_CLONERANGE ||
+                            op->op == Transaction::OP_CLONE ||
+                            op->op == Transaction::OP_CLONERANGE2))
         // -ENOENT is normally okay
         // ...including on a replayed OP_RMCOLL with checkpoint mode
         ok = true;
@@ -1559,7 +1551,7 @@ unsigned KeyValueStore::_do_transaction(Transaction& transaction,
         }
 
         dout(0) << " error " << cpp_strerror(r) << " not handled on operation "
-                << op << " op " << op_num << ", counting from 0)" << dendl;
+                << op->op << " op " << op_num << ", counting from 0)" << dendl;
         dout(0) << msg << dendl;
         dout(0) << " transaction dump:\n";
         JSONFormatter f(true);
@@ -16,6 +16,7 @@
 
 #include "include/Context.h"
 #include "include/buffer.h"
+#include "include/ceph_features.h"
 #include "include/types.h"
 #include "osd/osd_types.h"
 #include "common/TrackedOp.h"
@@ -302,6 +303,13 @@ public:
    *   implementation of ObjectStore, neither of these fields is
    *   relevant.
    *
+   * Since v8 a Transaction is kept (and encoded) as an array of
+   * fixed-size Ops plus a table of the collections and objects they
+   * reference and a data_bl holding the variable-length arguments.
+   * Older encodings are converted to that form when decoded, and
+   * encode(bl, features) produces the legacy (v7) form for peers
+   * that lack CEPH_FEATURE_OSD_TRANSACTION_OP_STRUCT.
+   *
    *
    * TRANSACTION ISOLATION
    *
@@ -383,12 +391,49 @@ public:
       COLL_HINT_EXPECTED_NUM_OBJECTS = 1,
     };
 
+    /**
+     * Op
+     *
+     * Fixed-size, pre-encoded description of a single mutation.  The
+     * collections and objects an op refers to are stored once per
+     * Transaction in coll_index/object_index and referenced here by
+     * id; any variable-length arguments (attr names, data buffers,
+     * key sets, ...) are appended to data_bl in op order.  Decoding a
+     * Transaction therefore never re-parses an object name per op.
+     *
+     * The layout is part of the on-disk and on-wire format; only ever
+     * add fields at the end and bump the Transaction encoding version.
+     */
+    struct Op {
+      __le32 op;
+      __le32 cid;
+      __le32 oid;
+      __le64 off;
+      __le64 len;
+      __le32 dest_cid;                  ///< OP_COLL_ADD, OP_COLL_MOVE*, OP_SPLIT_COLLECTION*
+      __le32 dest_oid;                  ///< OP_CLONE*, OP_COLL_MOVE_RENAME
+      __le64 dest_off;                  ///< OP_CLONERANGE2
+      __le32 hint_type;                 ///< OP_COLL_HINT
+      __le64 expected_object_size;      ///< OP_SETALLOCHINT
+      __le64 expected_write_size;       ///< OP_SETALLOCHINT
+      __le32 split_bits;                ///< OP_SPLIT_COLLECTION*
+      __le32 split_rem;                 ///< OP_SPLIT_COLLECTION*
+    } __attribute__ ((packed)) ;
+
   private:
+    /// number of Ops preallocated each time op_ptr runs out of room
+    static const unsigned OPS_PER_PTR = 32u;
+
     uint64_t ops;
     uint64_t pad_unused_bytes;
-    uint32_t largest_data_len, largest_data_off, largest_data_off_in_tbl;
-    bufferlist tbl;
-    bool sobject_encoding;
+    uint32_t largest_data_len, largest_data_off, largest_data_off_in_data_bl;
+    map<coll_t, __le32> coll_index;
+    map<ghobject_t, __le32> object_index;
+    __u32 coll_id;
+    __u32 object_id;
+    bufferlist data_bl;
+    bufferlist op_bl;
+    bufferptr op_ptr;
     int64_t pool_override;
     bool use_pool_override;
     bool replica;
@@ -398,6 +443,52 @@ public:
     list<Context *> on_commit;
     list<Context *> on_applied_sync;
 
+    __le32 _get_coll_id(const coll_t& coll) {
+      map<coll_t, __le32>::iterator c = coll_index.find(coll);
+      if (c != coll_index.end())
+	return c->second;
+
+      __le32 index_id;
+      index_id = coll_id++;
+      coll_index[coll] = index_id;
+      return index_id;
+    }
+    __le32 _get_object_id(const ghobject_t& oid) {
+      map<ghobject_t, __le32>::iterator o = object_index.find(oid);
+      if (o != object_index.end())
+	return o->second;
+
+      __le32 index_id;
+      index_id = object_id++;
+      object_index[oid] = index_id;
+      return index_id;
+    }
+    /// carve the next zeroed Op out of op_ptr and append it to op_bl
+    Op* _get_next_op() {
+      if (op_ptr.length() == 0 || op_ptr.offset() >= op_ptr.length()) {
+	op_ptr = bufferptr(sizeof(Op) * OPS_PER_PTR);
+      }
+      bufferptr ptr(op_ptr, 0, sizeof(Op));
+      op_bl.append(ptr);
+
+      op_ptr.set_offset(op_ptr.offset() + sizeof(Op));
+
+      char* p = ptr.c_str();
+      memset(p, 0, sizeof(Op));
+      return reinterpret_cast<Op*>(p);
+    }
+
+    /// legacy (pre-v6) oids may need their pool filled in by the caller
+    void _apply_pool_override(ghobject_t& oid) const {
+      if (pool_override != -1 && !oid.hobj.is_max() && oid.hobj.pool == -1)
+	oid.hobj.pool = pool_override;
+    }
+    void _remap_op(Op* op, const vector<__le32> &cm,
+		   const vector<__le32> &om) const;
+    void _encode_legacy_tbl(bufferlist& tbl, uint32_t *largest_off_in_tbl) const;
+    void _decode_legacy_tbl(bufferlist::iterator& p, bool sobject_encoding);
+    void _validate_ids() const;
+
   public:
     /* Operations on callback contexts */
     void register_on_applied(Context *c) {
@@ -461,26 +552,81 @@ public:
 
     void swap(Transaction& other) {
       std::swap(ops, other.ops);
+      std::swap(pad_unused_bytes, other.pad_unused_bytes);
       std::swap(largest_data_len, other.largest_data_len);
       std::swap(largest_data_off, other.largest_data_off);
-      std::swap(largest_data_off_in_tbl, other.largest_data_off_in_tbl);
+      std::swap(largest_data_off_in_data_bl, other.largest_data_off_in_data_bl);
       std::swap(on_applied, other.on_applied);
       std::swap(on_commit, other.on_commit);
       std::swap(on_applied_sync, other.on_applied_sync);
-      tbl.swap(other.tbl);
+
+      std::swap(coll_index, other.coll_index);
+      std::swap(object_index, other.object_index);
+      std::swap(coll_id, other.coll_id);
+      std::swap(object_id, other.object_id);
+      std::swap(pool_override, other.pool_override);
+      std::swap(use_pool_override, other.use_pool_override);
+      op_bl.swap(other.op_bl);
+      data_bl.swap(other.data_bl);
+      op_ptr.swap(other.op_ptr);
     }
 
-    /// Append the operations of the parameter to this Transaction. Those operations are removed from the parameter Transaction
+    /**
+     * Append the operations of the parameter to this Transaction.
+     *
+     * Data buffers are shared, not copied.  The parameter's ops are
+     * shared as well when their collection/object ids line up with
+     * ours (e.g., when appending to an empty Transaction); otherwise
+     * the fixed-size Ops are copied and their ids remapped.  The
+     * callback contexts are moved from the parameter.
+     */
     void append(Transaction& other) {
-      ops += other.ops;
       assert(pad_unused_bytes == 0);
       assert(other.pad_unused_bytes == 0);
       if (other.largest_data_len > largest_data_len) {
 	largest_data_len = other.largest_data_len;
 	largest_data_off = other.largest_data_off;
-	largest_data_off_in_tbl = tbl.length() + other.largest_data_off_in_tbl;
+	largest_data_off_in_data_bl = data_bl.length() + other.largest_data_off_in_data_bl;
       }
-      tbl.append(other.tbl);
+
+      bool identity = true;
+      vector<__le32> cm(other.coll_index.size());
+      for (map<coll_t, __le32>::iterator c = other.coll_index.begin();
+	   c != other.coll_index.end();
+	   ++c) {
+	cm[c->second] = _get_coll_id(c->first);
+	if ((__u32)cm[c->second] != (__u32)c->second)
+	  identity = false;
+      }
+      vector<__le32> om(other.object_index.size());
+      for (map<ghobject_t, __le32>::iterator o = other.object_index.begin();
+	   o != other.object_index.end();
+	   ++o) {
+	if (other.use_pool_override) {
+	  ghobject_t oid = o->first;
+	  other._apply_pool_override(oid);
+	  om[o->second] = _get_object_id(oid);
+	} else {
+	  om[o->second] = _get_object_id(o->first);
+	}
+	if ((__u32)om[o->second] != (__u32)o->second)
+	  identity = false;
+      }
+
+      if (identity) {
+	op_bl.append(other.op_bl);
+      } else {
+	bufferlist other_op_bl = other.op_bl;
+	const char *p = other_op_bl.c_str();
+	for (uint64_t n = 0; n < other.ops; ++n, p += sizeof(Op)) {
+	  Op* op = _get_next_op();
+	  memcpy(op, p, sizeof(Op));
+	  _remap_op(op, cm, om);
+	}
+      }
+      ops += other.ops;
+      data_bl.append(other.data_bl);
+
       on_applied.splice(on_applied.end(), other.on_applied);
       on_commit.splice(on_commit.end(), other.on_commit);
       on_applied_sync.splice(on_applied_sync.end(), other.on_applied_sync);
@@ -488,9 +634,24 @@ public:
 
     /** Inquires about the Transaction as a whole. */
 
-    /// How big is the encoded Transaction buffer?
+    /// How big is the encoded Transaction buffer? (approximately)
     uint64_t get_encoded_bytes() {
-      return 1 + 8 + 8 + 4 + 4 + 4 + 4 + tbl.length();
+      // header and the data_bl/op_bl length prefixes
+      uint64_t bytes = 1 + 1 + 4 + 8 + 8 + 4 + 4 + 4 + 4 + 4 +
+	data_bl.length() + op_bl.length();
+      // coll_index and object_index: count, then (key, id) pairs
+      bytes += 4 + 4;
+      for (map<coll_t, __le32>::iterator c = coll_index.begin();
+	   c != coll_index.end();
+	   ++c)
+	bytes += 4 + c->first.to_str().length() + sizeof(__le32);
+      for (map<ghobject_t, __le32>::iterator o = object_index.begin();
+	   o != object_index.end();
+	   ++o)
+	bytes += 48 + o->first.hobj.oid.name.length() +
+	  o->first.hobj.get_key().length() + o->first.hobj.nspace.length() +
+	  sizeof(__le32);
+      return bytes;
     }
 
     uint64_t get_num_bytes() {
@@ -502,8 +663,8 @@ public:
     }
     /// offset within the encoded buffer to the start of the largest data buffer that's encoded
     uint32_t get_data_offset() {
-      if (largest_data_off_in_tbl) {
-	return largest_data_off_in_tbl +
+      if (largest_data_off_in_data_bl) {
+	return largest_data_off_in_data_bl +
 	  sizeof(__u8) +  // encode struct_v
 	  sizeof(__u8) +  // encode compat_v
 	  sizeof(__u32) + // encode len
@@ -511,8 +672,8 @@ public:
 	  sizeof(pad_unused_bytes) +
 	  sizeof(largest_data_len) +
 	  sizeof(largest_data_off) +
-	  sizeof(largest_data_off_in_tbl) +
-	  sizeof(__u32);  // tbl length
+	  sizeof(largest_data_off_in_data_bl) +
+	  sizeof(__u32);  // data_bl length
       }
       return 0;  // none
     }
@@ -544,98 +705,93 @@ public:
      *
      * Helper object to parse Transactions.
      *
-     * ObjectStore instances use this object to step down the encoded
-     * buffer decoding operation codes and parameters as we go.
+     * ObjectStore instances use this object to step through the
+     * fixed-size Ops; collections and objects are looked up by the ids
+     * stored in each Op, and variable-length arguments are decoded
+     * from data_bl in op order.
      *
      */
     class iterator {
-      bufferlist::iterator p;
-      bool sobject_encoding;
-      int64_t pool_override;
-      bool use_pool_override;
-      bool replica;
+      Transaction *t;
+
+      const char *op_buffer_p;
+      const char *op_buffer_end;
+
+      bufferlist::iterator data_bl_p;
+
+      vector<coll_t> colls;
+      vector<ghobject_t> objects;
 
       iterator(Transaction *t)
-	: p(t->tbl.begin()),
-	  sobject_encoding(t->sobject_encoding),
-	  pool_override(t->pool_override),
-	  use_pool_override(t->use_pool_override),
-	  replica(t->replica) {}
+	: t(t),
+	  data_bl_p(t->data_bl.begin()),
+	  colls(t->coll_index.size()),
+	  objects(t->object_index.size()) {
+
+	op_buffer_p = t->op_bl.c_str();
+	op_buffer_end = op_buffer_p + t->op_bl.length();
+
+	for (map<coll_t, __le32>::iterator c = t->coll_index.begin();
+	     c != t->coll_index.end();
+	     ++c) {
+	  colls[c->second] = c->first;
+	}
+
+	for (map<ghobject_t, __le32>::iterator o = t->object_index.begin();
+	     o != t->object_index.end();
+	     ++o) {
+	  objects[o->second] = o->first;
+	  if (t->use_pool_override)
+	    t->_apply_pool_override(objects[o->second]);
+	}
+      }
 
       friend class Transaction;
 
     public:
       /// true if there are more operations left to be enumerated
       bool have_op() {
-	return !p.end();
+	return op_buffer_p < op_buffer_end;
       }
 
       /* Decode the specified type of object from the input
        * stream. There is no checking that the encoded data is of the
        * correct type.
        */
-      int decode_op() {
-	__u32 op;
-	::decode(op, p);
+      Op* decode_op() {
+	if ((size_t)(op_buffer_end - op_buffer_p) < sizeof(Op))
+	  throw buffer::malformed_input("truncated transaction op");
+	Op* op = reinterpret_cast<Op*>(const_cast<char*>(op_buffer_p));
+	op_buffer_p += sizeof(Op);
 	return op;
       }
-      void decode_bl(bufferlist& bl) {
-	::decode(bl, p);
-      }
-      /// Get an oid, recognize various legacy forms and update them.
-      ghobject_t decode_oid() {
-	ghobject_t oid;
-	if (sobject_encoding) {
-	  sobject_t soid;
-	  ::decode(soid, p);
-	  oid.hobj.snap = soid.snap;
-	  oid.hobj.oid = soid.oid;
-	  oid.generation = ghobject_t::NO_GEN;
-	  oid.shard_id = shard_id_t::NO_SHARD;
-	} else {
-	  ::decode(oid, p);
-	  if (use_pool_override && pool_override != -1 &&
-	      !oid.hobj.is_max() && oid.hobj.pool == -1) {
-	    oid.hobj.pool = pool_override;
-	  }
-	}
-	return oid;
-      }
-      coll_t decode_cid() {
-	coll_t c;
-	::decode(c, p);
-	return c;
-      }
-      uint64_t decode_length() {
-	uint64_t len;
-	::decode(len, p);
-	return len;
-      }
-      string decode_attrname() {
+      string decode_string() {
 	string s;
-	::decode(s, p);
+	::decode(s, data_bl_p);
 	return s;
       }
-      string decode_key() {
-	string s;
-	::decode(s, p);
-	return s;
+      void decode_bl(bufferlist& bl) {
+	::decode(bl, data_bl_p);
       }
       void decode_attrset(map<string,bufferptr>& aset) {
-	::decode(aset, p);
+	::decode(aset, data_bl_p);
       }
       void decode_attrset(map<string,bufferlist>& aset) {
-	::decode(aset, p);
+	::decode(aset, data_bl_p);
       }
       void decode_keyset(set<string> &keys) {
-	::decode(keys, p);
+	::decode(keys, data_bl_p);
       }
-      uint32_t decode_u32() {
-	uint32_t bits;
-	::decode(bits, p);
-	return bits;
+
+      const ghobject_t &get_oid(__le32 oid_id) {
+	assert(oid_id < objects.size());
+	return objects[oid_id];
       }
-      bool get_replica() { return replica; }
+      const coll_t &get_cid(__le32 cid_id) {
+	assert(cid_id < colls.size());
+	return colls[cid_id];
+      }
+      bool get_replica() { return t->replica; }
     };
 
     iterator begin() {
@@ -653,14 +809,14 @@ public:
 
     /// Commence a global file system sync operation.
     void start_sync() {
-      __u32 op = OP_STARTSYNC;
-      ::encode(op, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_STARTSYNC;
       ops++;
     }
     /// noop. 'nuf said
     void nop() {
-      __u32 op = OP_NOP;
-      ::encode(op, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_NOP;
       ops++;
     }
     /**
@@ -670,10 +826,10 @@ public:
      * empty object if necessary
      */
     void touch(coll_t cid, const ghobject_t& oid) {
-      __u32 op = OP_TOUCH;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_TOUCH;
+      _op->cid = _get_coll_id(cid);
+      _op->oid = _get_object_id(oid);
       ops++;
     }
     /**
@@ -688,19 +844,19 @@ public:
      */
     void write(coll_t cid, const ghobject_t& oid, uint64_t off, uint64_t len,
 	       const bufferlist& data) {
-      __u32 op = OP_WRITE;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(off, tbl);
-      ::encode(len, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_WRITE;
+      _op->cid = _get_coll_id(cid);
+      _op->oid = _get_object_id(oid);
+      _op->off = off;
+      _op->len = len;
       assert(len == data.length());
       if (data.length() > largest_data_len) {
 	largest_data_len = data.length();
 	largest_data_off = off;
-	largest_data_off_in_tbl = tbl.length() + sizeof(__u32);  // we are about to
+	largest_data_off_in_data_bl = data_bl.length() + sizeof(__u32);  // we are about to
       }
-      ::encode(data, tbl);
+      ::encode(data, data_bl);
       ops++;
     }
     /**
@@ -709,29 +865,29 @@ public:
      * underlying storage space.
      */
     void zero(coll_t cid, const ghobject_t& oid, uint64_t off, uint64_t len) {
-      __u32 op = OP_ZERO;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(off, tbl);
-      ::encode(len, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_ZERO;
+      _op->cid = _get_coll_id(cid);
+      _op->oid = _get_object_id(oid);
+      _op->off = off;
+      _op->len = len;
       ops++;
     }
     /// Discard all data in the object beyond the specified size.
     void truncate(coll_t cid, const ghobject_t& oid, uint64_t off) {
-      __u32 op = OP_TRUNCATE;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(off, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_TRUNCATE;
+      _op->cid = _get_coll_id(cid);
+      _op->oid = _get_object_id(oid);
+      _op->off = off;
       ops++;
     }
     /// Remove an object. All four parts of the object are removed.
     void remove(coll_t cid, const ghobject_t& oid) {
-      __u32 op = OP_REMOVE;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_REMOVE;
+      _op->cid = _get_coll_id(cid);
+      _op->oid = _get_object_id(oid);
       ops++;
     }
     /// Set an xattr of an object
@@ -741,30 +897,30 @@ public:
     }
     /// Set an xattr of an object
     void setattr(coll_t cid, const ghobject_t& oid, const string& s, bufferlist& val) {
-      __u32 op = OP_SETATTR;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(s, tbl);
-      ::encode(val, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_SETATTR;
+      _op->cid = _get_coll_id(cid);
+      _op->oid = _get_object_id(oid);
+      ::encode(s, data_bl);
+      ::encode(val, data_bl);
       ops++;
     }
     /// Set multiple xattrs of an object
     void setattrs(coll_t cid, const ghobject_t& oid, map<string,bufferptr>& attrset) {
-      __u32 op = OP_SETATTRS;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(attrset, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_SETATTRS;
+      _op->cid = _get_coll_id(cid);
+      _op->oid = _get_object_id(oid);
+      ::encode(attrset, data_bl);
       ops++;
     }
     /// Set multiple xattrs of an object
     void setattrs(coll_t cid, const ghobject_t& oid, map<string,bufferlist>& attrset) {
-      __u32 op = OP_SETATTRS;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(attrset, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_SETATTRS;
+      _op->cid = _get_coll_id(cid);
+      _op->oid = _get_object_id(oid);
+      ::encode(attrset, data_bl);
       ops++;
     }
     /// remove an xattr from an object
@@ -774,19 +930,19 @@ public:
     }
     /// remove an xattr from an object
     void rmattr(coll_t cid, const ghobject_t& oid, const string& s) {
-      __u32 op = OP_RMATTR;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(s, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_RMATTR;
+      _op->cid = _get_coll_id(cid);
+      _op->oid = _get_object_id(oid);
+      ::encode(s, data_bl);
       ops++;
     }
     /// remove all xattrs from an object
     void rmattrs(coll_t cid, const ghobject_t& oid) {
-      __u32 op = OP_RMATTRS;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_RMATTRS;
+      _op->cid = _get_coll_id(cid);
+      _op->oid = _get_object_id(oid);
       ops++;
     }
     /**
@@ -801,11 +957,11 @@ public:
      * which case its previous contents are discarded.
      */
     void clone(coll_t cid, const ghobject_t& oid, ghobject_t noid) {
-      __u32 op = OP_CLONE;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(noid, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_CLONE;
+      _op->cid = _get_coll_id(cid);
+      _op->oid = _get_object_id(oid);
+      _op->dest_oid = _get_object_id(noid);
       ops++;
     }
     /**
@@ -817,21 +973,21 @@ public:
      */
     void clone_range(coll_t cid, const ghobject_t& oid, ghobject_t noid,
 		     uint64_t srcoff, uint64_t srclen, uint64_t dstoff) {
-      __u32 op = OP_CLONERANGE2;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(noid, tbl);
-      ::encode(srcoff, tbl);
-      ::encode(srclen, tbl);
-      ::encode(dstoff, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_CLONERANGE2;
+      _op->cid = _get_coll_id(cid);
+      _op->oid = _get_object_id(oid);
+      _op->dest_oid = _get_object_id(noid);
+      _op->off = srcoff;
+      _op->len = srclen;
+      _op->dest_off = dstoff;
       ops++;
     }
     /// Create the collection
     void create_collection(coll_t cid) {
-      __u32 op = OP_MKCOLL;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_MKCOLL;
+      _op->cid = _get_coll_id(cid);
       ops++;
     }
 
@@ -844,45 +1000,46 @@ public:
      *               data along with the hint type.
      */
      void collection_hint(coll_t cid, uint32_t type, const bufferlist& hint) {
-       __u32 op = OP_COLL_HINT;
-       ::encode(op, tbl);
-       ::encode(cid, tbl);
-       ::encode(type, tbl);
-       ::encode(hint, tbl);
+       Op* _op = _get_next_op();
+       _op->op = OP_COLL_HINT;
+       _op->cid = _get_coll_id(cid);
+       _op->hint_type = type;
+       ::encode(hint, data_bl);
        ops++;
      }
 
     /// remove the collection, the collection must be empty
     void remove_collection(coll_t cid) {
-      __u32 op = OP_RMCOLL;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_RMCOLL;
+      _op->cid = _get_coll_id(cid);
       ops++;
     }
     void collection_move(coll_t cid, coll_t oldcid, const ghobject_t& oid) {
       // NOTE: we encode this as a fixed combo of ADD + REMOVE.  they
       // always appear together, so this is effectively a single MOVE.
-      __u32 op = OP_COLL_ADD;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oldcid, tbl);
-      ::encode(oid, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_COLL_ADD;
+      _op->cid = _get_coll_id(cid);
+      _op->dest_cid = _get_coll_id(oldcid);
+      _op->oid = _get_object_id(oid);
       ops++;
-      op = OP_COLL_REMOVE;
-      ::encode(op, tbl);
-      ::encode(oldcid, tbl);
-      ::encode(oid, tbl);
+
+      _op = _get_next_op();
+      _op->op = OP_COLL_REMOVE;
+      _op->cid = _get_coll_id(oldcid);
+      _op->oid = _get_object_id(oid);
       ops++;
       return;
     }
     void collection_move_rename(coll_t oldcid, const ghobject_t& oldoid,
 				coll_t cid, const ghobject_t& oid) {
-      __u32 op = OP_COLL_MOVE_RENAME;
-      ::encode(op, tbl);
-      ::encode(oldcid, tbl);
-      ::encode(oldoid, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_COLL_MOVE_RENAME;
+      _op->cid = _get_coll_id(oldcid);
+      _op->oid = _get_object_id(oldoid);
+      _op->dest_cid = _get_coll_id(cid);
+      _op->dest_oid = _get_object_id(oid);
       ops++;
     }
 
@@ -893,11 +1050,11 @@ public:
     }
     /// Set an xattr on a collection
     void collection_setattr(coll_t cid, const string& name, bufferlist& val) {
-      __u32 op = OP_COLL_SETATTR;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(name, tbl);
-      ::encode(val, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_COLL_SETATTR;
+      _op->cid = _get_coll_id(cid);
+      ::encode(name, data_bl);
+      ::encode(val, data_bl);
       ops++;
     }
 
@@ -908,26 +1065,26 @@ public:
     }
     /// Remove an xattr from a collection
     void collection_rmattr(coll_t cid, const string& name) {
-      __u32 op = OP_COLL_RMATTR;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(name, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_COLL_RMATTR;
+      _op->cid = _get_coll_id(cid);
+      ::encode(name, data_bl);
       ops++;
     }
     /// Set multiple xattrs on a collection
     void collection_setattrs(coll_t cid, map<string,bufferptr>& aset) {
-      __u32 op = OP_COLL_SETATTRS;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(aset, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_COLL_SETATTRS;
+      _op->cid = _get_coll_id(cid);
+      ::encode(aset, data_bl);
       ops++;
     }
     /// Set multiple xattrs on a collection
     void collection_setattrs(coll_t cid, map<string,bufferlist>& aset) {
-      __u32 op = OP_COLL_SETATTRS;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(aset, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_COLL_SETATTRS;
+      _op->cid = _get_coll_id(cid);
+      ::encode(aset, data_bl);
       ops++;
     }
 
@@ -936,10 +1093,10 @@ public:
       coll_t cid,           ///< [in] Collection containing oid
       const ghobject_t &oid  ///< [in] Object from which to remove omap
       ) {
-      __u32 op = OP_OMAP_CLEAR;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_OMAP_CLEAR;
+      _op->cid = _get_coll_id(cid);
+      _op->oid = _get_object_id(oid);
       ops++;
     }
     /// Set keys on oid omap.  Replaces duplicate keys.
@@ -948,11 +1105,11 @@ public:
       const ghobject_t &oid,                ///< [in] Object to update
       const map<string, bufferlist> &attrset ///< [in] Replacement keys and values
       ) {
-      __u32 op = OP_OMAP_SETKEYS;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(attrset, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_OMAP_SETKEYS;
+      _op->cid = _get_coll_id(cid);
+      _op->oid = _get_object_id(oid);
+      ::encode(attrset, data_bl);
       ops++;
     }
     /// Remove keys from oid omap
@@ -961,11 +1118,11 @@ public:
       const ghobject_t &oid,  ///< [in] Object from which to remove the omap
       const set<string> &keys ///< [in] Keys to clear
       ) {
-      __u32 op = OP_OMAP_RMKEYS;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(keys, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_OMAP_RMKEYS;
+      _op->cid = _get_coll_id(cid);
+      _op->oid = _get_object_id(oid);
+      ::encode(keys, data_bl);
       ops++;
     }
 
@@ -976,12 +1133,12 @@ public:
       const string& first,    ///< [in] first key in range
       const string& last      ///< [in] first key past range, range is [first,last)
       ) {
-      __u32 op = OP_OMAP_RMKEYRANGE;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(first, tbl);
-      ::encode(last, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_OMAP_RMKEYRANGE;
+      _op->cid = _get_coll_id(cid);
+      _op->oid = _get_object_id(oid);
+      ::encode(first, data_bl);
+      ::encode(last, data_bl);
       ops++;
     }
 
@@ -991,11 +1148,11 @@ public:
       const ghobject_t &oid,  ///< [in] Object
       const bufferlist &bl    ///< [in] Header value
       ) {
-      __u32 op = OP_OMAP_SETHEADER;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(bl, tbl);
+      Op* _op = _get_next_op();
+      _op->op = OP_OMAP_SETHEADER;
+      _op->cid = _get_coll_id(cid);
+      _op->oid = _get_object_id(oid);
+      ::encode(bl, data_bl);
       ops++;
     }
 
@@ -1006,13 +1163,13 @@ public:
       uint32_t bits,
       uint32_t rem,
       coll_t destination) {
-      __u32 op = OP_SPLIT_COLLECTION2;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(bits, tbl);
-      ::encode(rem, tbl);
-      ::encode(destination, tbl);
-      ++ops;
+      Op* _op = _get_next_op();
+      _op->op = OP_SPLIT_COLLECTION2;
+      _op->cid = _get_coll_id(cid);
+      _op->dest_cid = _get_coll_id(destination);
+      _op->split_bits = bits;
+      _op->split_rem = rem;
+      ops++;
     }
 
     void set_alloc_hint(
@@ -1021,40 +1178,87 @@ public:
       uint64_t expected_object_size,
       uint64_t expected_write_size
     ) {
-      __u32 op = OP_SETALLOCHINT;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(expected_object_size, tbl);
-      ::encode(expected_write_size, tbl);
-      ++ops;
+      Op* _op = _get_next_op();
+      _op->op = OP_SETALLOCHINT;
+      _op->cid = _get_coll_id(cid);
+      _op->oid = _get_object_id(oid);
+      _op->expected_object_size = expected_object_size;
+      _op->expected_write_size = expected_write_size;
+      ops++;
     }
 
     // etc.
     Transaction() :
-      ops(0), pad_unused_bytes(0), largest_data_len(0), largest_data_off(0), largest_data_off_in_tbl(0),
-      sobject_encoding(false), pool_override(-1), use_pool_override(false),
+      ops(0), pad_unused_bytes(0), largest_data_len(0), largest_data_off(0),
+      largest_data_off_in_data_bl(0), coll_id(0), object_id(0),
+      pool_override(-1), use_pool_override(false),
       replica(false),
       osr(NULL) {}
 
+    /**
+     * Copies share the encoded ops and data, but never the preallocated
+     * op space: both sides would otherwise carve their next Op out of
+     * the same raw buffer.
+     */
+    Transaction(const Transaction& other) :
+      ops(other.ops), pad_unused_bytes(other.pad_unused_bytes),
+      largest_data_len(other.largest_data_len),
+      largest_data_off(other.largest_data_off),
+      largest_data_off_in_data_bl(other.largest_data_off_in_data_bl),
+      coll_index(other.coll_index), object_index(other.object_index),
+      coll_id(other.coll_id), object_id(other.object_id),
+      data_bl(other.data_bl), op_bl(other.op_bl),
+      pool_override(other.pool_override),
+      use_pool_override(other.use_pool_override),
+      replica(other.replica),
+      osr(other.osr),
+      on_applied(other.on_applied), on_commit(other.on_commit),
+      on_applied_sync(other.on_applied_sync) {}
+
+    Transaction& operator=(const Transaction& other) {
+      if (this != &other) {
+	Transaction t(other);
+	swap(t);
+	replica = other.replica;
+	osr = other.osr;
+      }
+      return *this;
+    }
+
     Transaction(bufferlist::iterator &dp) :
-      ops(0), pad_unused_bytes(0), largest_data_len(0), largest_data_off(0), largest_data_off_in_tbl(0),
-      sobject_encoding(false), pool_override(-1), use_pool_override(false),
+      ops(0), pad_unused_bytes(0), largest_data_len(0), largest_data_off(0),
+      largest_data_off_in_data_bl(0), coll_id(0), object_id(0),
+      pool_override(-1), use_pool_override(false),
       replica(false),
       osr(NULL) {
       decode(dp);
     }
 
     Transaction(bufferlist &nbl) :
-      ops(0), pad_unused_bytes(0), largest_data_len(0), largest_data_off(0), largest_data_off_in_tbl(0),
-      sobject_encoding(false), pool_override(-1), use_pool_override(false),
+      ops(0), pad_unused_bytes(0), largest_data_len(0), largest_data_off(0),
+      largest_data_off_in_data_bl(0), coll_id(0), object_id(0),
+      pool_override(-1), use_pool_override(false),
       replica(false),
       osr(NULL) {
       bufferlist::iterator dp = nbl.begin();
       decode(dp);
     }
 
-    void encode(bufferlist& bl) const {
+    /**
+     * Encode for a peer with the given features.
+     *
+     * Peers without CEPH_FEATURE_OSD_TRANSACTION_OP_STRUCT only
+     * understand the legacy (v7) per-field encoding, so the Ops are
+     * re-serialized into that form for them.
+     */
+    void encode(bufferlist& bl, uint64_t features) const {
+      if (features & CEPH_FEATURE_OSD_TRANSACTION_OP_STRUCT) {
+	encode(bl);
+	return;
+      }
+      bufferlist tbl;
+      uint32_t largest_data_off_in_tbl = 0;
+      _encode_legacy_tbl(tbl, &largest_data_off_in_tbl);
       ENCODE_START(7, 5, bl);
       ::encode(ops, bl);
       ::encode(pad_unused_bytes, bl);
@@ -1068,27 +1272,72 @@ public:
       }
       ENCODE_FINISH(bl);
     }
+    void encode(bufferlist& bl) const {
+      // data_bl goes first so that get_data_offset() is independent
+      // of the size of the op and index tables
+      ENCODE_START(8, 8, bl);
+      ::encode(ops, bl);
+      ::encode(pad_unused_bytes, bl);
+      ::encode(largest_data_len, bl);
+      ::encode(largest_data_off, bl);
+      ::encode(largest_data_off_in_data_bl, bl);
+      ::encode(data_bl, bl);
+      ::encode(op_bl, bl);
+      ::encode(coll_index, bl);
+      ::encode(object_index, bl);
+      ENCODE_FINISH(bl);
+    }
     void decode(bufferlist::iterator &bl) {
-      DECODE_START_LEGACY_COMPAT_LEN(7, 5, 5, bl);
+      DECODE_START_LEGACY_COMPAT_LEN(8, 5, 5, bl);
       DECODE_OLDEST(2);
-      if (struct_v < 4)
-	sobject_encoding = true;
-      else
-	sobject_encoding = false;
-      ::decode(ops, bl);
-      ::decode(pad_unused_bytes, bl);
-      if (struct_v >= 3) {
+      if (struct_v >= 8) {
+	::decode(ops, bl);
+	::decode(pad_unused_bytes, bl);
 	::decode(largest_data_len, bl);
 	::decode(largest_data_off, bl);
-	::decode(largest_data_off_in_tbl, bl);
-      }
-      ::decode(tbl, bl);
-      if (struct_v < 6) {
-	use_pool_override = true;
-      }
-      if (struct_v >= 7) {
-	bool tolerate_collection_add_enoent;
-	::decode(tolerate_collection_add_enoent, bl);
+	::decode(largest_data_off_in_data_bl, bl);
+	::decode(data_bl, bl);
+	::decode(op_bl, bl);
+	::decode(coll_index, bl);
+	::decode(object_index, bl);
+	coll_id = coll_index.size();
+	object_id = object_index.size();
+	op_ptr = bufferptr();
+	if (op_bl.length() != ops * sizeof(Op))
+	  throw buffer::malformed_input("transaction op table length mismatch");
+	_validate_ids();
+      } else {
+	// legacy per-field encoding: convert to Ops as we go
+	uint64_t legacy_ops;
+	::decode(legacy_ops, bl);
+	::decode(pad_unused_bytes, bl);
+	if (struct_v >= 3) {
+	  uint32_t legacy_data_len, legacy_data_off, legacy_data_off_in_tbl;
+	  ::decode(legacy_data_len, bl);
+	  ::decode(legacy_data_off, bl);
+	  ::decode(legacy_data_off_in_tbl, bl);
+	}
+	bufferlist tbl;
+	::decode(tbl, bl);
+	ops = 0;
+	largest_data_len = largest_data_off = largest_data_off_in_data_bl = 0;
+	coll_index.clear();
+	object_index.clear();
+	coll_id = object_id = 0;
+	op_bl.clear();
+	data_bl.clear();
+	op_ptr = bufferptr();
+	bufferlist::iterator p = tbl.begin();
+	_decode_legacy_tbl(p, struct_v < 4);
+	if (ops != legacy_ops)
+	  throw buffer::malformed_input("transaction op count mismatch");
+	if (struct_v < 6) {
+	  use_pool_override = true;
+	}
+	if (struct_v >= 7) {
+	  bool tolerate_collection_add_enoent;
+	  ::decode(tolerate_collection_add_enoent, bl);
+	}
       }
       DECODE_FINISH(bl);
     }
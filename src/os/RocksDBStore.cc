@@ -16,6 +16,9 @@
 
 using std::string;
 #include "common/perf_counters.h"
+#include "common/strtol.h"
+#include "include/str_map.h"
+#include "include/str_list.h"
 #include "KeyValueDB.h"
 #include "RocksDBStore.h"
 
@@ -42,6 +45,202 @@ int RocksDBStore::init()
   options.disableWAL = g_conf->rocksdb_disableWAL;
   options.wal_dir = g_conf->rocksdb_wal_dir;
   options.info_log_level = g_conf->rocksdb_info_log_level;
+
+  // "<prefix>=<column family> ..." and
+  // "<column family>:<key>=<value>,...;<column family>:..."
+  map<string,string> cf_options;
+  list<string> cf_option_list;
+  get_str_list(g_conf->rocksdb_column_family_options, ";", cf_option_list);
+  for (list<string>::iterator p = cf_option_list.begin();
+       p != cf_option_list.end();
+       ++p) {
+    size_t colon = p->find(':');
+    if (colon == string::npos) {
+      derr << __func__ << " malformed rocksdb_column_family_options entry '"
+	   << *p << "'" << dendl;
+      return -EINVAL;
+    }
+    cf_options[p->substr(0, colon)] = p->substr(colon + 1);
+  }
+  map<string,string> prefixes;
+  get_str_map(g_conf->rocksdb_column_families, " \t,;", &prefixes);
+  for (map<string,string>::iterator p = prefixes.begin();
+       p != prefixes.end();
+       ++p) {
+    if (p->second.empty()) {
+      derr << __func__ << " no column family given for prefix '"
+	   << p->first << "'" << dendl;
+      return -EINVAL;
+    }
+    int r = add_column_family(p->first,
+			      ColumnFamily(p->second, cf_options[p->second]));
+    if (r < 0)
+      return r;
+  }
+  return 0;
+}
+
+int RocksDBStore::add_column_family(const string &prefix,
+				    const ColumnFamily &cf)
+{
+  assert(!db);
+  if (cf.name == rocksdb::kDefaultColumnFamilyName)
+    return -EINVAL;
+  // all prefixes placed in one column family share its options
+  for (map<string, ColumnFamily>::iterator p = column_families.begin();
+       p != column_families.end();
+       ++p) {
+    if (p->second.name == cf.name && p->second.option != cf.option)
+      return -EINVAL;
+  }
+  column_families.insert(make_pair(prefix, cf));
+  return 0;
+}
+
+int RocksDBStore::parse_cf_options(const string &name,
+				   rocksdb::ColumnFamilyOptions *cf_opt,
+				   ostream &out)
+{
+  string option;
+  for (map<string, ColumnFamily>::iterator p = column_families.begin();
+       p != column_families.end();
+       ++p) {
+    if (p->second.name == name) {
+      option = p->second.option;
+      break;
+    }
+  }
+
+  map<string,string> kv;
+  get_str_map(option, ",", &kv);
+  for (map<string,string>::iterator p = kv.begin(); p != kv.end(); ++p) {
+    if (p->first == "compression") {
+      if (p->second == "snappy")
+	cf_opt->compression = rocksdb::kSnappyCompression;
+      else if (p->second == "zlib")
+	cf_opt->compression = rocksdb::kZlibCompression;
+      else if (p->second == "bzip2")
+	cf_opt->compression = rocksdb::kBZip2Compression;
+      else
+	cf_opt->compression = rocksdb::kNoCompression;
+      continue;
+    }
+
+    string err;
+    long long val = strict_strtoll(p->second.c_str(), 10, &err);
+    if (!err.empty() || val < 0) {
+      out << "column family " << name << ": bad value for " << p->first
+	  << ": '" << p->second << "'" << std::endl;
+      return -EINVAL;
+    }
+    if (p->first == "write_buffer_size")
+      cf_opt->write_buffer_size = val;
+    else if (p->first == "max_write_buffer_number")
+      cf_opt->max_write_buffer_number = val;
+    else if (p->first == "target_file_size_base")
+      cf_opt->target_file_size_base = val;
+    else if (p->first == "block_size")
+      cf_opt->block_size = val;
+    else if (p->first == "num_levels")
+      cf_opt->num_levels = val;
+    else if (p->first == "level0_file_num_compaction_trigger")
+      cf_opt->level0_file_num_compaction_trigger = val;
+    else if (p->first == "level0_slowdown_writes_trigger")
+      cf_opt->level0_slowdown_writes_trigger = val;
+    else if (p->first == "level0_stop_writes_trigger")
+      cf_opt->level0_stop_writes_trigger = val;
+    else if (p->first == "disable_auto_compactions")
+      cf_opt->disable_auto_compactions = val;
+    else {
+      out << "column family " << name << ": unknown option "
+	  << p->first << std::endl;
+      return -EINVAL;
+    }
+  }
+  return 0;
+}
+
+int RocksDBStore::open_column_families(const rocksdb::Options &opt,
+				       ostream &out)
+{
+  // every column family already in the store must be opened, and must
+  // still be wanted: keys in one we no longer map would silently vanish.
+  vector<string> existing;
+  rocksdb::Status status =
+    rocksdb::DB::ListColumnFamilies(opt, path, &existing);
+  if (!status.ok())
+    existing.clear();  // nothing there yet
+
+  set<string> wanted;
+  for (map<string, ColumnFamily>::iterator p = column_families.begin();
+       p != column_families.end();
+       ++p)
+    wanted.insert(p->second.name);
+
+  vector<rocksdb::ColumnFamilyDescriptor> cfds;
+  cfds.push_back(rocksdb::ColumnFamilyDescriptor(
+		   rocksdb::kDefaultColumnFamilyName,
+		   rocksdb::ColumnFamilyOptions(opt)));
+  for (vector<string>::iterator p = existing.begin();
+       p != existing.end();
+       ++p) {
+    if (*p == rocksdb::kDefaultColumnFamilyName)
+      continue;
+    if (!wanted.count(*p)) {
+      out << "column family " << *p << " exists but no prefix maps to it"
+	  << std::endl;
+      return -EINVAL;
+    }
+    rocksdb::ColumnFamilyOptions cf_opt(opt);
+    int r = parse_cf_options(*p, &cf_opt, out);
+    if (r < 0)
+      return r;
+    cfds.push_back(rocksdb::ColumnFamilyDescriptor(*p, cf_opt));
+  }
+
+  vector<rocksdb::ColumnFamilyHandle*> handles;
+  status = rocksdb::DB::Open(opt, path, cfds, &handles, &db);
+  if (!status.ok()) {
+    out << status.ToString() << std::endl;
+    return -EINVAL;
+  }
+  for (unsigned i = 0; i < cfds.size(); ++i)
+    cf_handles[cfds[i].name] = handles[i];
+  default_cf = cf_handles[rocksdb::kDefaultColumnFamilyName];
+
+  for (map<string, ColumnFamily>::iterator p = column_families.begin();
+       p != column_families.end();
+       ++p) {
+    const string &name = p->second.name;
+    if (!cf_handles.count(name)) {
+      // a prefix moving out of the default column family would lose
+      // whatever it already stored there
+      string start = combine_strings(p->first, string());
+      rocksdb::Iterator *it = db->NewIterator(rocksdb::ReadOptions(),
+					      default_cf);
+      it->Seek(start);
+      bool in_use = it->Valid() && it->key().starts_with(start);
+      delete it;
+      if (in_use) {
+	out << "prefix " << p->first << " already has keys in the default "
+	    << "column family; cannot move it to " << name << std::endl;
+	return -EINVAL;
+      }
+
+      rocksdb::ColumnFamilyOptions cf_opt(opt);
+      int r = parse_cf_options(name, &cf_opt, out);
+      if (r < 0)
+	return r;
+      rocksdb::ColumnFamilyHandle *h;
+      status = db->CreateColumnFamily(cf_opt, name, &h);
+      if (!status.ok()) {
+	out << status.ToString() << std::endl;
+	return -EINVAL;
+      }
+      cf_handles[name] = h;
+    }
+    prefix_handles[p->first] = cf_handles[name];
+  }
   return 0;
 }
 
@@ -109,13 +308,18 @@ int RocksDBStore::do_open(ostream &out, bool create_if_missing)
     ldoptions.wal_dir = options.wal_dir;
 
 
-  //rocksdb::DB *_db;
-  rocksdb::Status status = rocksdb::DB::Open(ldoptions, path, &db);
-  if (!status.ok()) {
-    out << status.ToString() << std::endl;
-    return -EINVAL;
+  if (column_families.empty()) {
+    rocksdb::Status status = rocksdb::DB::Open(ldoptions, path, &db);
+    if (!status.ok()) {
+      out << status.ToString() << std::endl;
+      return -EINVAL;
+    }
+    default_cf = db->DefaultColumnFamily();
+  } else {
+    int r = open_column_families(ldoptions, out);
+    if (r < 0)
+      return r;
   }
-  //db.reset(_db);
 
   if (g_conf->rocksdb_compact_on_mount) {
     derr << "Compacting rocksdb store..." << dendl;
@@ -151,6 +355,13 @@ RocksDBStore::~RocksDBStore()
   close();
   delete logger;
 
+  // column family handles must go before the db itself
+  for (map<string, rocksdb::ColumnFamilyHandle*>::iterator p =
+	 cf_handles.begin();
+       p != cf_handles.end();
+       ++p)
+    delete p->second;
+
   // Ensure db is destroyed before dependent db_cache and filterpolicy
   delete db;
 }
@@ -229,8 +440,9 @@ void RocksDBStore::RocksDBTransactionImpl::set(
   bufferlist &bl = *(buffers.rbegin());
   string key = combine_strings(prefix, k);
   keys.push_back(key);
-  bat->Delete(rocksdb::Slice(*(keys.rbegin())));
-  bat->Put(rocksdb::Slice(*(keys.rbegin())),
+  rocksdb::ColumnFamilyHandle *cf = db->get_cf_handle(prefix);
+  bat->Delete(cf, rocksdb::Slice(*(keys.rbegin())));
+  bat->Put(cf, rocksdb::Slice(*(keys.rbegin())),
 	  rocksdb::Slice(bl.c_str(), bl.length()));
 }
 
@@ -239,18 +451,35 @@ void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 {
   string key = combine_strings(prefix, k);
   keys.push_back(key);
-  bat->Delete(rocksdb::Slice(*(keys.rbegin())));
+  bat->Delete(db->get_cf_handle(prefix), rocksdb::Slice(*(keys.rbegin())));
 }
 
 void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix)
 {
+  rocksdb::ColumnFamilyHandle *cf = db->get_cf_handle(prefix);
   KeyValueDB::Iterator it = db->get_iterator(prefix);
   for (it->seek_to_first();
        it->valid();
        it->next()) {
     string key = combine_strings(prefix, it->key());
     keys.push_back(key);
-    bat->Delete(*(keys.rbegin()));
+    bat->Delete(cf, *(keys.rbegin()));
+  }
+}
+
+void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
+							 const string &start,
+							 const string &end)
+{
+  // only walks the column family holding prefix, not the whole store
+  rocksdb::ColumnFamilyHandle *cf = db->get_cf_handle(prefix);
+  KeyValueDB::Iterator it = db->get_iterator(prefix);
+  for (it->lower_bound(start);
+       it->valid() && it->key() < end;
+       it->next()) {
+    string key = combine_strings(prefix, it->key());
+    keys.push_back(key);
+    bat->Delete(cf, *(keys.rbegin()));
   }
 }
 
@@ -305,7 +534,15 @@ int RocksDBStore::split_key(rocksdb::Slice in, string *prefix, string *key)
 void RocksDBStore::compact()
 {
   logger->inc(l_rocksdb_compact);
-  db->CompactRange(NULL, NULL);
+  if (cf_handles.empty()) {
+    db->CompactRange(NULL, NULL);
+    return;
+  }
+  for (map<string, rocksdb::ColumnFamilyHandle*>::iterator p =
+	 cf_handles.begin();
+       p != cf_handles.end();
+       ++p)
+    db->CompactRange(p->second, NULL, NULL);
 }
 
 
@@ -380,40 +617,98 @@ void RocksDBStore::compact_range(const string& start, const string& end)
 {
     rocksdb::Slice cstart(start);
     rocksdb::Slice cend(end);
-    db->CompactRange(&cstart, &cend);
+    if (cf_handles.empty()) {
+      db->CompactRange(&cstart, &cend);
+      return;
+    }
+    // column families without keys in the range have nothing to do
+    for (map<string, rocksdb::ColumnFamilyHandle*>::iterator p =
+	   cf_handles.begin();
+	 p != cf_handles.end();
+	 ++p)
+      db->CompactRange(p->second, &cstart, &cend);
 }
 RocksDBStore::RocksDBWholeSpaceIteratorImpl::~RocksDBWholeSpaceIteratorImpl()
 {
-  delete dbiter;
+  for (vector<rocksdb::Iterator*>::iterator p = iters.begin();
+       p != iters.end();
+       ++p)
+    delete *p;
+}
+void RocksDBStore::RocksDBWholeSpaceIteratorImpl::pick_smallest()
+{
+  if (iters.size() == 1)
+    return;
+  dbiter = iters[0];
+  for (vector<rocksdb::Iterator*>::iterator p = iters.begin() + 1;
+       p != iters.end();
+       ++p) {
+    if (!(*p)->Valid())
+      continue;
+    if (!dbiter->Valid() || (*p)->key().compare(dbiter->key()) < 0)
+      dbiter = *p;
+  }
+}
+void RocksDBStore::RocksDBWholeSpaceIteratorImpl::pick_largest()
+{
+  if (iters.size() == 1)
+    return;
+  dbiter = iters[0];
+  for (vector<rocksdb::Iterator*>::iterator p = iters.begin() + 1;
+       p != iters.end();
+       ++p) {
+    if (!(*p)->Valid())
+      continue;
+    if (!dbiter->Valid() || (*p)->key().compare(dbiter->key()) > 0)
+      dbiter = *p;
+  }
+}
+void RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek(const string &k)
+{
+  rocksdb::Slice slice(k);
+  for (vector<rocksdb::Iterator*>::iterator p = iters.begin();
+       p != iters.end();
+       ++p)
+    (*p)->Seek(slice);
+  forward = true;
+  pick_smallest();
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_first()
 {
-  dbiter->SeekToFirst();
-  return dbiter->status().ok() ? 0 : -1;
+  for (vector<rocksdb::Iterator*>::iterator p = iters.begin();
+       p != iters.end();
+       ++p)
+    (*p)->SeekToFirst();
+  forward = true;
+  pick_smallest();
+  return status();
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_first(const string &prefix)
 {
-  rocksdb::Slice slice_prefix(prefix);
-  dbiter->Seek(slice_prefix);
-  return dbiter->status().ok() ? 0 : -1;
+  seek(prefix);
+  return status();
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_last()
 {
-  dbiter->SeekToLast();
-  return dbiter->status().ok() ? 0 : -1;
+  for (vector<rocksdb::Iterator*>::iterator p = iters.begin();
+       p != iters.end();
+       ++p)
+    (*p)->SeekToLast();
+  forward = false;
+  pick_largest();
+  return status();
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_last(const string &prefix)
 {
   string limit = past_prefix(prefix);
-  rocksdb::Slice slice_limit(limit);
-  dbiter->Seek(slice_limit);
+  seek(limit);
 
-  if (!dbiter->Valid()) {
-    dbiter->SeekToLast();
+  if (!valid()) {
+    seek_to_last();
   } else {
-    dbiter->Prev();
+    prev();
   }
-  return dbiter->status().ok() ? 0 : -1;
+  return status();
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::upper_bound(const string &prefix, const string &after)
 {
@@ -423,14 +718,13 @@ int RocksDBStore::RocksDBWholeSpaceIteratorImpl::upper_bound(const string &prefi
     if (key.first == prefix && key.second == after)
       next();
   }
-  return dbiter->status().ok() ? 0 : -1;
+  return status();
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::lower_bound(const string &prefix, const string &to)
 {
   string bound = combine_strings(prefix, to);
-  rocksdb::Slice slice_bound(bound);
-  dbiter->Seek(slice_bound);
-  return dbiter->status().ok() ? 0 : -1;
+  seek(bound);
+  return status();
 }
 bool RocksDBStore::RocksDBWholeSpaceIteratorImpl::valid()
 {
@@ -438,15 +732,46 @@ bool RocksDBStore::RocksDBWholeSpaceIteratorImpl::valid()
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::next()
 {
-  if (valid())
+  if (!valid())
+    return status();
+  if (!forward && iters.size() > 1) {
+    // the others sit before the current key; move them past it
+    string k = dbiter->key().ToString();
+    for (vector<rocksdb::Iterator*>::iterator p = iters.begin();
+	 p != iters.end();
+	 ++p) {
+      if (*p != dbiter)
+	(*p)->Seek(k);
+    }
+  }
+  forward = true;
   dbiter->Next();
-  return dbiter->status().ok() ? 0 : -1;
+  pick_smallest();
+  return status();
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::prev()
 {
-  if (valid())
-    dbiter->Prev();
-    return dbiter->status().ok() ? 0 : -1;
+  if (!valid())
+    return status();
+  if (forward && iters.size() > 1) {
+    // the others sit after the current key; move them before it
+    string k = dbiter->key().ToString();
+    for (vector<rocksdb::Iterator*>::iterator p = iters.begin();
+	 p != iters.end();
+	 ++p) {
+      if (*p == dbiter)
+	continue;
+      (*p)->Seek(k);
+      if ((*p)->Valid())
+	(*p)->Prev();
+      else
+	(*p)->SeekToLast();
+    }
+  }
+  forward = false;
+  dbiter->Prev();
+  pick_largest();
+  return status();
 }
 string RocksDBStore::RocksDBWholeSpaceIteratorImpl::key()
 {
@@ -466,7 +791,13 @@ bufferlist RocksDBStore::RocksDBWholeSpaceIteratorImpl::value()
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::status()
 {
-  return dbiter->status().ok() ? 0 : -1;
+  for (vector<rocksdb::Iterator*>::iterator p = iters.begin();
+       p != iters.end();
+       ++p) {
+    if (!(*p)->status().ok())
+      return -1;
+  }
+  return 0;
 }
 
 bool RocksDBStore::in_prefix(const string &prefix, rocksdb::Slice key)
@@ -483,15 +814,71 @@ string RocksDBStore::past_prefix(const string &prefix)
 
 
 RocksDBStore::WholeSpaceIterator RocksDBStore::_get_iterator()
+{
+  if (cf_handles.empty()) {
+    return std::tr1::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
+      new RocksDBWholeSpaceIteratorImpl(
+	db->NewIterator(rocksdb::ReadOptions())
+      )
+    );
+  }
+
+  vector<rocksdb::ColumnFamilyHandle*> handles;
+  for (map<string, rocksdb::ColumnFamilyHandle*>::iterator p =
+	 cf_handles.begin();
+       p != cf_handles.end();
+       ++p)
+    handles.push_back(p->second);
+  vector<rocksdb::Iterator*> iters;
+  rocksdb::Status status = db->NewIterators(rocksdb::ReadOptions(),
+					    handles, &iters);
+  assert(status.ok());
+  return std::tr1::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
+    new RocksDBWholeSpaceIteratorImpl(iters)
+  );
+}
+
+RocksDBStore::WholeSpaceIterator RocksDBStore::_get_snapshot_iterator()
+{
+  const rocksdb::Snapshot *snapshot;
+  rocksdb::ReadOptions options;
+
+  snapshot = db->GetSnapshot();
+  options.snapshot = snapshot;
+
+  if (cf_handles.empty()) {
+    return std::tr1::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
+      new RocksDBSnapshotIteratorImpl(db, snapshot,
+	db->NewIterator(options))
+    );
+  }
+
+  vector<rocksdb::ColumnFamilyHandle*> handles;
+  for (map<string, rocksdb::ColumnFamilyHandle*>::iterator p =
+	 cf_handles.begin();
+       p != cf_handles.end();
+       ++p)
+    handles.push_back(p->second);
+  vector<rocksdb::Iterator*> iters;
+  rocksdb::Status status = db->NewIterators(options, handles, &iters);
+  assert(status.ok());
+  return std::tr1::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
+    new RocksDBSnapshotIteratorImpl(db, snapshot, iters)
+  );
+}
+
+RocksDBStore::WholeSpaceIterator RocksDBStore::_get_prefix_iterator(
+  const string &prefix)
 {
   return std::tr1::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
     new RocksDBWholeSpaceIteratorImpl(
-      db->NewIterator(rocksdb::ReadOptions())
+      db->NewIterator(rocksdb::ReadOptions(), get_cf_handle(prefix))
     )
   );
 }
 
-RocksDBStore::WholeSpaceIterator RocksDBStore::_get_snapshot_iterator()
+RocksDBStore::WholeSpaceIterator RocksDBStore::_get_prefix_snapshot_iterator(
+  const string &prefix)
 {
   const rocksdb::Snapshot *snapshot;
   rocksdb::ReadOptions options;
@@ -501,7 +888,7 @@ RocksDBStore::WholeSpaceIterator RocksDBStore::_get_snapshot_iterator()
 
   return std::tr1::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
     new RocksDBSnapshotIteratorImpl(db, snapshot,
-      db->NewIterator(options))
+      db->NewIterator(options, get_cf_handle(prefix)))
   );
 }
 
@@ -35,6 +35,9 @@ enum {
 
 namespace rocksdb{
   class DB;
+  class ColumnFamilyHandle;
+  struct ColumnFamilyOptions;
+  struct Options;
   class Cache;
   class FilterPolicy;
   class Snapshot;
@@ -53,7 +56,29 @@ class RocksDBStore : public KeyValueDB {
   const rocksdb::FilterPolicy *filterpolicy;
   rocksdb::DB *db;
 
+  /// prefix -> column family, as requested through add_column_family()
+  map<string, ColumnFamily> column_families;
+  /// column family name -> handle, for every column family we opened
+  map<string, rocksdb::ColumnFamilyHandle*> cf_handles;
+  /// prefix -> handle, for prefixes not kept in the default column family
+  map<string, rocksdb::ColumnFamilyHandle*> prefix_handles;
+  rocksdb::ColumnFamilyHandle *default_cf;
+
   int do_open(ostream &out, bool create_if_missing);
+  int parse_cf_options(const string &name,
+		       rocksdb::ColumnFamilyOptions *cf_opt,
+		       ostream &out);
+  int open_column_families(const rocksdb::Options &opt, ostream &out);
+
+  rocksdb::ColumnFamilyHandle *get_cf_handle(const string &prefix) {
+    if (prefix_handles.empty())
+      return default_cf;
+    map<string, rocksdb::ColumnFamilyHandle*>::iterator p =
+      prefix_handles.find(prefix);
+    if (p == prefix_handles.end())
+      return default_cf;
+    return p->second;
+  }
 
   // manage async compactions
   Mutex compact_queue_lock;
@@ -82,6 +107,7 @@ public:
 
   static int _test_init(const string& dir);
   int init();
+  int add_column_family(const string &prefix, const ColumnFamily &cf);
   /// compact rocksdb for all keys with a given prefix
   void compact_prefix(const string& prefix) {
     compact_range(prefix, past_prefix(prefix));
@@ -159,6 +185,9 @@ public:
     cct(c),
     logger(NULL),
     path(path),
+    filterpolicy(NULL),
+    db(NULL),
+    default_cf(NULL),
     compact_queue_lock("RocksDBStore::compact_thread_lock"),
     compact_queue_stop(false),
     compact_thread(this),
@@ -198,6 +227,10 @@ public:
     void rmkeys_by_prefix(
       const string &prefix
       );
+    void rm_range_keys(
+      const string &prefix,
+      const string &start,
+      const string &end);
   };
 
   KeyValueDB::Transaction get_transaction() {
@@ -213,14 +246,27 @@ public:
     std::map<string, bufferlist> *out
     );
 
+  /**
+   * Iterates over one or more column families as a single ordered key
+   * space.  Each key lives in exactly one column family, so the merged
+   * view simply follows whichever child holds the next key; dbiter is
+   * the child positioned on the current one.
+   */
   class RocksDBWholeSpaceIteratorImpl :
     public KeyValueDB::WholeSpaceIteratorImpl {
   protected:
+    vector<rocksdb::Iterator*> iters;
     rocksdb::Iterator *dbiter;
+    bool forward;
+
+    void seek(const string &k);
+    void pick_smallest();
+    void pick_largest();
   public:
     RocksDBWholeSpaceIteratorImpl(rocksdb::Iterator *iter) :
-      dbiter(iter) { }
-    //virtual ~RocksDBWholeSpaceIteratorImpl() { }
+      iters(1, iter), dbiter(iter), forward(true) { }
+    RocksDBWholeSpaceIteratorImpl(const vector<rocksdb::Iterator*> &i) :
+      iters(i), dbiter(i[0]), forward(true) { }
     ~RocksDBWholeSpaceIteratorImpl();
 
     int seek_to_first();
@@ -245,6 +291,9 @@ public:
     RocksDBSnapshotIteratorImpl(rocksdb::DB *db, const rocksdb::Snapshot *s,
 				rocksdb::Iterator *iter) :
       RocksDBWholeSpaceIteratorImpl(iter), db(db), snapshot(s) { }
+    RocksDBSnapshotIteratorImpl(rocksdb::DB *db, const rocksdb::Snapshot *s,
+				const vector<rocksdb::Iterator*> &iters) :
+      RocksDBWholeSpaceIteratorImpl(iters), db(db), snapshot(s) { }
 
     ~RocksDBSnapshotIteratorImpl();
   };
@@ -328,6 +377,9 @@ protected:
 
   WholeSpaceIterator _get_snapshot_iterator();
 
+  WholeSpaceIterator _get_prefix_iterator(const string &prefix);
+
+  WholeSpaceIterator _get_prefix_snapshot_iterator(const string &prefix);
 };
 
 #endif
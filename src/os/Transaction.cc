@@ -11,18 +11,18 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
   int op_num = 0;
   bool stop_looping = false;
   while (i.have_op() && !stop_looping) {
-    int op = i.decode_op();
+    Transaction::Op *op = i.decode_op();
     f->open_object_section("op");
     f->dump_int("op_num", op_num);
 
-    switch (op) {
+    switch (op->op) {
     case Transaction::OP_NOP:
       f->dump_string("op_name", "nop");
       break;
     case Transaction::OP_TOUCH:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
 	f->dump_string("op_name", "touch");
 	f->dump_stream("collection") << cid;
 	f->dump_stream("oid") << oid;
@@ -31,10 +31,10 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
       
     case Transaction::OP_WRITE:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
-	uint64_t off = i.decode_length();
-	uint64_t len = i.decode_length();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
+	uint64_t off = op->off;
+	uint64_t len = op->len;
 	bufferlist bl;
 	i.decode_bl(bl);
 	f->dump_string("op_name", "write");
@@ -48,10 +48,10 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
       
     case Transaction::OP_ZERO:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
-	uint64_t off = i.decode_length();
-	uint64_t len = i.decode_length();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
+	uint64_t off = op->off;
+	uint64_t len = op->len;
 	f->dump_string("op_name", "zero");
 	f->dump_stream("collection") << cid;
 	f->dump_stream("oid") << oid;
@@ -62,10 +62,10 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
       
     case Transaction::OP_TRIMCACHE:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
-	uint64_t off = i.decode_length();
-	uint64_t len = i.decode_length();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
+	uint64_t off = op->off;
+	uint64_t len = op->len;
 	f->dump_string("op_name", "trim_cache");
 	f->dump_stream("collection") << cid;
 	f->dump_stream("oid") << oid;
@@ -76,9 +76,9 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
       
     case Transaction::OP_TRUNCATE:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
-	uint64_t off = i.decode_length();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
+	uint64_t off = op->off;
 	f->dump_string("op_name", "truncate");
 	f->dump_stream("collection") << cid;
 	f->dump_stream("oid") << oid;
@@ -88,8 +88,8 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
       
     case Transaction::OP_REMOVE:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
 	f->dump_string("op_name", "remove");
 	f->dump_stream("collection") << cid;
 	f->dump_stream("oid") << oid;
@@ -98,9 +98,9 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
       
     case Transaction::OP_SETATTR:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
-	string name = i.decode_attrname();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
+	string name = i.decode_string();
 	bufferlist bl;
 	i.decode_bl(bl);
 	f->dump_string("op_name", "setattr");
@@ -113,8 +113,8 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
       
     case Transaction::OP_SETATTRS:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
 	map<string, bufferptr> aset;
 	i.decode_attrset(aset);
 	f->dump_string("op_name", "setattrs");
@@ -131,9 +131,9 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_RMATTR:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
-	string name = i.decode_attrname();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
+	string name = i.decode_string();
 	f->dump_string("op_name", "rmattr");
 	f->dump_stream("collection") << cid;
 	f->dump_stream("oid") << oid;
@@ -143,8 +143,8 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_RMATTRS:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
 	f->dump_string("op_name", "rmattrs");
 	f->dump_stream("collection") << cid;
 	f->dump_stream("oid") << oid;
@@ -153,9 +153,9 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
       
     case Transaction::OP_CLONE:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
-	ghobject_t noid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
+	const ghobject_t &noid = i.get_oid(op->dest_oid);
 	f->dump_string("op_name", "clone");
 	f->dump_stream("collection") << cid;
 	f->dump_stream("src_oid") << oid;
@@ -165,11 +165,11 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_CLONERANGE:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
-	ghobject_t noid = i.decode_oid();
-	uint64_t off = i.decode_length();
-	uint64_t len = i.decode_length();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
+	const ghobject_t &noid = i.get_oid(op->dest_oid);
+	uint64_t off = op->off;
+	uint64_t len = op->len;
 	f->dump_string("op_name", "clonerange");
 	f->dump_stream("collection") << cid;
 	f->dump_stream("src_oid") << oid;
@@ -181,12 +181,12 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_CLONERANGE2:
       {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
-	ghobject_t noid = i.decode_oid();
-	uint64_t srcoff = i.decode_length();
-	uint64_t len = i.decode_length();
-	uint64_t dstoff = i.decode_length();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
+	const ghobject_t &noid = i.get_oid(op->dest_oid);
+	uint64_t srcoff = op->off;
+	uint64_t len = op->len;
+	uint64_t dstoff = op->dest_off;
 	f->dump_string("op_name", "clonerange2");
 	f->dump_stream("collection") << cid;
 	f->dump_stream("src_oid") << oid;
@@ -199,7 +199,7 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_MKCOLL:
       {
-	coll_t cid = i.decode_cid();
+	const coll_t &cid = i.get_cid(op->cid);
 	f->dump_string("op_name", "mkcoll");
 	f->dump_stream("collection") << cid;
       }
@@ -207,8 +207,8 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_COLL_HINT:
       {
-        coll_t cid = i.decode_cid();
-        uint32_t type = i.decode_u32();
+        const coll_t &cid = i.get_cid(op->cid);
+        uint32_t type = op->hint_type;
         f->dump_string("op_name", "coll_hint");
         f->dump_stream("collection") << cid;
         f->dump_unsigned("type", type);
@@ -228,7 +228,7 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_RMCOLL:
       {
-	coll_t cid = i.decode_cid();
+	const coll_t &cid = i.get_cid(op->cid);
 	f->dump_string("op_name", "rmcoll");
 	f->dump_stream("collection") << cid;
       }
@@ -236,9 +236,9 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_COLL_ADD:
       {
-	coll_t ncid = i.decode_cid();
-	coll_t ocid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
+	const coll_t &ncid = i.get_cid(op->cid);
+	const coll_t &ocid = i.get_cid(op->dest_cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
 	f->dump_string("op_name", "collection_add");
 	f->dump_stream("src_collection") << ocid;
 	f->dump_stream("dst_collection") << ncid;
@@ -248,8 +248,8 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_COLL_REMOVE:
        {
-	coll_t cid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
 	f->dump_string("op_name", "collection_remove");
 	f->dump_stream("collection") << cid;
 	f->dump_stream("oid") << oid;
@@ -258,9 +258,9 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_COLL_MOVE:
        {
-	coll_t ocid = i.decode_cid();
-	coll_t ncid = i.decode_cid();
-	ghobject_t oid = i.decode_oid();
+	const coll_t &ocid = i.get_cid(op->cid);
+	const coll_t &ncid = i.get_cid(op->dest_cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
 	f->open_object_section("collection_move");
 	f->dump_stream("src_collection") << ocid;
 	f->dump_stream("dst_collection") << ncid;
@@ -272,8 +272,8 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_COLL_SETATTR:
       {
-	coll_t cid = i.decode_cid();
-	string name = i.decode_attrname();
+	const coll_t &cid = i.get_cid(op->cid);
+	string name = i.decode_string();
 	bufferlist bl;
 	i.decode_bl(bl);
 	f->dump_string("op_name", "collection_setattr");
@@ -285,8 +285,8 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_COLL_RMATTR:
       {
-	coll_t cid = i.decode_cid();
-	string name = i.decode_attrname();
+	const coll_t &cid = i.get_cid(op->cid);
+	string name = i.decode_string();
 	f->dump_string("op_name", "collection_rmattr");
 	f->dump_stream("collection") << cid;
 	f->dump_string("name", name);
@@ -299,8 +299,8 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_COLL_RENAME:
       {
-	coll_t cid(i.decode_cid());
-	coll_t ncid(i.decode_cid());
+	const coll_t &cid = i.get_cid(op->cid);
+	const coll_t &ncid = i.get_cid(op->dest_cid);
 	f->dump_string("op_name", "collection_rename");
 	f->dump_stream("src_collection") << cid;
 	f->dump_stream("dst_collection") << ncid;
@@ -309,8 +309,8 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_OMAP_CLEAR:
       {
-	coll_t cid(i.decode_cid());
-	ghobject_t oid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
 	f->dump_string("op_name", "omap_clear");
 	f->dump_stream("collection") << cid;
 	f->dump_stream("oid") << oid;
@@ -319,8 +319,8 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_OMAP_SETKEYS:
       {
-	coll_t cid(i.decode_cid());
-	ghobject_t oid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
 	map<string, bufferlist> aset;
 	i.decode_attrset(aset);
 	f->dump_string("op_name", "omap_setkeys");
@@ -337,8 +337,8 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_OMAP_RMKEYS:
       {
-	coll_t cid(i.decode_cid());
-	ghobject_t oid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
 	set<string> keys;
 	i.decode_keyset(keys);
 	f->dump_string("op_name", "omap_rmkeys");
@@ -349,8 +349,8 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_OMAP_SETHEADER:
       {
-	coll_t cid(i.decode_cid());
-	ghobject_t oid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
 	bufferlist bl;
 	i.decode_bl(bl);
 	f->dump_string("op_name", "omap_setheader");
@@ -362,10 +362,10 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_SPLIT_COLLECTION:
       {
-	coll_t cid(i.decode_cid());
-	uint32_t bits(i.decode_u32());
-	uint32_t rem(i.decode_u32());
-	coll_t dest(i.decode_cid());
+	const coll_t &cid = i.get_cid(op->cid);
+	uint32_t bits(op->split_bits);
+	uint32_t rem(op->split_rem);
+	const coll_t &dest = i.get_cid(op->dest_cid);
 	f->dump_string("op_name", "op_split_collection_create");
 	f->dump_stream("collection") << cid;
 	f->dump_stream("bits") << bits;
@@ -376,10 +376,10 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_SPLIT_COLLECTION2:
       {
-	coll_t cid(i.decode_cid());
-	uint32_t bits(i.decode_u32());
-	uint32_t rem(i.decode_u32());
-	coll_t dest(i.decode_cid());
+	const coll_t &cid = i.get_cid(op->cid);
+	uint32_t bits(op->split_bits);
+	uint32_t rem(op->split_rem);
+	const coll_t &dest = i.get_cid(op->dest_cid);
 	f->dump_string("op_name", "op_split_collection");
 	f->dump_stream("collection") << cid;
 	f->dump_stream("bits") << bits;
@@ -390,11 +390,11 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_OMAP_RMKEYRANGE:
       {
-	coll_t cid(i.decode_cid());
-	ghobject_t oid = i.decode_oid();
+	const coll_t &cid = i.get_cid(op->cid);
+	const ghobject_t &oid = i.get_oid(op->oid);
 	string first, last;
-	first = i.decode_key();
-	last = i.decode_key();
+	first = i.decode_string();
+	last = i.decode_string();
 	f->dump_string("op_name", "op_omap_rmkeyrange");
 	f->dump_stream("collection") << cid;
 	f->dump_stream("oid") << oid;
@@ -405,10 +405,10 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_COLL_MOVE_RENAME:
       {
-	coll_t old_cid(i.decode_cid());
-	ghobject_t old_oid = i.decode_oid();
-	coll_t new_cid(i.decode_cid());
-	ghobject_t new_oid = i.decode_oid();
+	const coll_t &old_cid = i.get_cid(op->cid);
+	const ghobject_t &old_oid = i.get_oid(op->oid);
+	const coll_t &new_cid = i.get_cid(op->dest_cid);
+	const ghobject_t &new_oid = i.get_oid(op->dest_oid);
 	f->dump_string("op_name", "op_coll_move_rename");
 	f->dump_stream("old_collection") << old_cid;
 	f->dump_stream("old_oid") << old_oid;
@@ -419,10 +419,10 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     case Transaction::OP_SETALLOCHINT:
       {
-        coll_t cid = i.decode_cid();
-        ghobject_t oid = i.decode_oid();
-        uint64_t expected_object_size = i.decode_length();
-        uint64_t expected_write_size = i.decode_length();
+        const coll_t &cid = i.get_cid(op->cid);
+        const ghobject_t &oid = i.get_oid(op->oid);
+        uint64_t expected_object_size = op->expected_object_size;
+        uint64_t expected_write_size = op->expected_write_size;
         f->dump_string("op_name", "op_setallochint");
         f->dump_stream("collection") << cid;
         f->dump_stream("oid") << oid;
@@ -433,7 +433,7 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
 
     default:
       f->dump_string("op_name", "unknown");
-      f->dump_unsigned("op_code", op);
+      f->dump_unsigned("op_code", op->op);
       stop_looping = true;
       break;
     }
@@ -443,6 +443,599 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
   f->close_section();
 }
 
+/*
+ * Which of the index-valued Op fields each op code uses.  Ops that are
+ * only ever produced by decoding a legacy (pre-v8) transaction are
+ * included so that such transactions can still be appended and
+ * re-encoded.
+ */
+enum {
+  OP_USES_CID = 1,
+  OP_USES_OID = 2,
+  OP_USES_DEST_CID = 4,
+  OP_USES_DEST_OID = 8,
+};
+
+static int op_index_fields(__u32 op)
+{
+  switch (op) {
+  case ObjectStore::Transaction::OP_NOP:
+  case ObjectStore::Transaction::OP_STARTSYNC:
+    return 0;
+
+  case ObjectStore::Transaction::OP_TOUCH:
+  case ObjectStore::Transaction::OP_WRITE:
+  case ObjectStore::Transaction::OP_ZERO:
+  case ObjectStore::Transaction::OP_TRUNCATE:
+  case ObjectStore::Transaction::OP_REMOVE:
+  case ObjectStore::Transaction::OP_SETATTR:
+  case ObjectStore::Transaction::OP_SETATTRS:
+  case ObjectStore::Transaction::OP_RMATTR:
+  case ObjectStore::Transaction::OP_RMATTRS:
+  case ObjectStore::Transaction::OP_TRIMCACHE:
+  case ObjectStore::Transaction::OP_COLL_REMOVE:
+  case ObjectStore::Transaction::OP_OMAP_CLEAR:
+  case ObjectStore::Transaction::OP_OMAP_SETKEYS:
+  case ObjectStore::Transaction::OP_OMAP_RMKEYS:
+  case ObjectStore::Transaction::OP_OMAP_SETHEADER:
+  case ObjectStore::Transaction::OP_OMAP_RMKEYRANGE:
+  case ObjectStore::Transaction::OP_SETALLOCHINT:
+    return OP_USES_CID | OP_USES_OID;
+
+  case ObjectStore::Transaction::OP_CLONE:
+  case ObjectStore::Transaction::OP_CLONERANGE:
+  case ObjectStore::Transaction::OP_CLONERANGE2:
+    return OP_USES_CID | OP_USES_OID | OP_USES_DEST_OID;
+
+  case ObjectStore::Transaction::OP_MKCOLL:
+  case ObjectStore::Transaction::OP_RMCOLL:
+  case ObjectStore::Transaction::OP_COLL_SETATTR:
+  case ObjectStore::Transaction::OP_COLL_RMATTR:
+  case ObjectStore::Transaction::OP_COLL_SETATTRS:
+  case ObjectStore::Transaction::OP_COLL_HINT:
+    return OP_USES_CID;
+
+  case ObjectStore::Transaction::OP_COLL_ADD:
+  case ObjectStore::Transaction::OP_COLL_MOVE:
+    return OP_USES_CID | OP_USES_OID | OP_USES_DEST_CID;
+
+  case ObjectStore::Transaction::OP_COLL_MOVE_RENAME:
+    return OP_USES_CID | OP_USES_OID | OP_USES_DEST_CID | OP_USES_DEST_OID;
+
+  case ObjectStore::Transaction::OP_COLL_RENAME:
+  case ObjectStore::Transaction::OP_SPLIT_COLLECTION:
+  case ObjectStore::Transaction::OP_SPLIT_COLLECTION2:
+    return OP_USES_CID | OP_USES_DEST_CID;
+
+  default:
+    return -1;
+  }
+}
+
+void ObjectStore::Transaction::_remap_op(Op* op, const vector<__le32> &cm,
+					 const vector<__le32> &om) const
+{
+  int fields = op_index_fields(op->op);
+  assert(fields >= 0);
+  if (fields & OP_USES_CID) {
+    assert(op->cid < cm.size());
+    op->cid = cm[op->cid];
+  }
+  if (fields & OP_USES_OID) {
+    assert(op->oid < om.size());
+    op->oid = om[op->oid];
+  }
+  if (fields & OP_USES_DEST_CID) {
+    assert(op->dest_cid < cm.size());
+    op->dest_cid = cm[op->dest_cid];
+  }
+  if (fields & OP_USES_DEST_OID) {
+    assert(op->dest_oid < om.size());
+    op->dest_oid = om[op->dest_oid];
+  }
+}
+
+/*
+ * The indices and the ids in each Op come off the wire; check them
+ * before the iterator or append() index anything with them.
+ */
+void ObjectStore::Transaction::_validate_ids() const
+{
+  vector<bool> seen(coll_index.size());
+  for (map<coll_t, __le32>::const_iterator c = coll_index.begin();
+       c != coll_index.end();
+       ++c) {
+    if (c->second >= seen.size() || seen[c->second])
+      throw buffer::malformed_input("bad transaction collection index");
+    seen[c->second] = true;
+  }
+  seen.assign(object_index.size(), false);
+  for (map<ghobject_t, __le32>::const_iterator o = object_index.begin();
+       o != object_index.end();
+       ++o) {
+    if (o->second >= seen.size() || seen[o->second])
+      throw buffer::malformed_input("bad transaction object index");
+    seen[o->second] = true;
+  }
+
+  bufferlist obl = op_bl;
+  bufferlist::iterator p = obl.begin();
+  for (uint64_t n = 0; n < ops; ++n) {
+    Op op;
+    p.copy(sizeof(Op), reinterpret_cast<char*>(&op));
+    int fields = op_index_fields(op.op);
+    if (fields < 0)
+      throw buffer::malformed_input("unknown transaction op");
+    if (((fields & OP_USES_CID) && op.cid >= coll_index.size()) ||
+	((fields & OP_USES_DEST_CID) && op.dest_cid >= coll_index.size()) ||
+	((fields & OP_USES_OID) && op.oid >= object_index.size()) ||
+	((fields & OP_USES_DEST_OID) && op.dest_oid >= object_index.size()))
+      throw buffer::malformed_input("transaction op id out of range");
+  }
+}
+
+/// move one variable-length argument between a data_bl and a legacy tbl
+template<typename T>
+static void copy_field(bufferlist::iterator& p, bufferlist& out)
+{
+  T v;
+  ::decode(v, p);
+  ::encode(v, out);
+}
+
+void ObjectStore::Transaction::_encode_legacy_tbl(
+  bufferlist& tbl, uint32_t *largest_off_in_tbl) const
+{
+  vector<coll_t> colls(coll_index.size());
+  for (map<coll_t, __le32>::const_iterator c = coll_index.begin();
+       c != coll_index.end();
+       ++c)
+    colls[c->second] = c->first;
+  vector<ghobject_t> objects(object_index.size());
+  for (map<ghobject_t, __le32>::const_iterator o = object_index.begin();
+       o != object_index.end();
+       ++o) {
+    objects[o->second] = o->first;
+    if (use_pool_override)
+      _apply_pool_override(objects[o->second]);
+  }
+
+  // work on copies so that c_str() never rebuilds our own buffers
+  bufferlist obl = op_bl;
+  const char *p = obl.c_str();
+  bufferlist dbl = data_bl;
+  bufferlist::iterator dp = dbl.begin();
+
+  uint32_t largest_len = 0;
+  *largest_off_in_tbl = 0;
+  for (uint64_t n = 0; n < ops; ++n, p += sizeof(Op)) {
+    const Op *op = reinterpret_cast<const Op*>(p);
+    __u32 opcode = op->op;
+    uint64_t off = op->off, len = op->len;
+    ::encode(opcode, tbl);
+
+    switch (opcode) {
+    case OP_NOP:
+    case OP_STARTSYNC:
+      break;
+
+    case OP_TOUCH:
+    case OP_REMOVE:
+    case OP_RMATTRS:
+    case OP_COLL_REMOVE:
+    case OP_OMAP_CLEAR:
+      ::encode(colls[op->cid], tbl);
+      ::encode(objects[op->oid], tbl);
+      break;
+
+    case OP_WRITE:
+      {
+	::encode(colls[op->cid], tbl);
+	::encode(objects[op->oid], tbl);
+	::encode(off, tbl);
+	::encode(len, tbl);
+	bufferlist bl;
+	::decode(bl, dp);
+	if (bl.length() > largest_len) {
+	  largest_len = bl.length();
+	  *largest_off_in_tbl = tbl.length() + sizeof(__u32);
+	}
+	::encode(bl, tbl);
+      }
+      break;
+
+    case OP_ZERO:
+    case OP_TRIMCACHE:
+      ::encode(colls[op->cid], tbl);
+      ::encode(objects[op->oid], tbl);
+      ::encode(off, tbl);
+      ::encode(len, tbl);
+      break;
+
+    case OP_TRUNCATE:
+      ::encode(colls[op->cid], tbl);
+      ::encode(objects[op->oid], tbl);
+      ::encode(off, tbl);
+      break;
+
+    case OP_SETATTR:
+      ::encode(colls[op->cid], tbl);
+      ::encode(objects[op->oid], tbl);
+      copy_field<string>(dp, tbl);
+      copy_field<bufferlist>(dp, tbl);
+      break;
+
+    case OP_SETATTRS:
+    case OP_OMAP_SETKEYS:
+      ::encode(colls[op->cid], tbl);
+      ::encode(objects[op->oid], tbl);
+      copy_field<map<string, bufferlist> >(dp, tbl);
+      break;
+
+    case OP_RMATTR:
+      ::encode(colls[op->cid], tbl);
+      ::encode(objects[op->oid], tbl);
+      copy_field<string>(dp, tbl);
+      break;
+
+    case OP_CLONE:
+      ::encode(colls[op->cid], tbl);
+      ::encode(objects[op->oid], tbl);
+      ::encode(objects[op->dest_oid], tbl);
+      break;
+
+    case OP_CLONERANGE:
+      ::encode(colls[op->cid], tbl);
+      ::encode(objects[op->oid], tbl);
+      ::encode(objects[op->dest_oid], tbl);
+      ::encode(off, tbl);
+      ::encode(len, tbl);
+      break;
+
+    case OP_CLONERANGE2:
+      {
+	uint64_t dest_off = op->dest_off;
+	::encode(colls[op->cid], tbl);
+	::encode(objects[op->oid], tbl);
+	::encode(objects[op->dest_oid], tbl);
+	::encode(off, tbl);
+	::encode(len, tbl);
+	::encode(dest_off, tbl);
+      }
+      break;
+
+    case OP_MKCOLL:
+    case OP_RMCOLL:
+      ::encode(colls[op->cid], tbl);
+      break;
+
+    case OP_COLL_HINT:
+      {
+	uint32_t type = op->hint_type;
+	::encode(colls[op->cid], tbl);
+	::encode(type, tbl);
+	copy_field<bufferlist>(dp, tbl);
+      }
+      break;
+
+    case OP_COLL_ADD:
+    case OP_COLL_MOVE:
+      ::encode(colls[op->cid], tbl);
+      ::encode(colls[op->dest_cid], tbl);
+      ::encode(objects[op->oid], tbl);
+      break;
+
+    case OP_COLL_MOVE_RENAME:
+      ::encode(colls[op->cid], tbl);
+      ::encode(objects[op->oid], tbl);
+      ::encode(colls[op->dest_cid], tbl);
+      ::encode(objects[op->dest_oid], tbl);
+      break;
+
+    case OP_COLL_SETATTR:
+      ::encode(colls[op->cid], tbl);
+      copy_field<string>(dp, tbl);
+      copy_field<bufferlist>(dp, tbl);
+      break;
+
+    case OP_COLL_RMATTR:
+      ::encode(colls[op->cid], tbl);
+      copy_field<string>(dp, tbl);
+      break;
+
+    case OP_COLL_SETATTRS:
+      ::encode(colls[op->cid], tbl);
+      copy_field<map<string, bufferlist> >(dp, tbl);
+      break;
+
+    case OP_COLL_RENAME:
+      ::encode(colls[op->cid], tbl);
+      ::encode(colls[op->dest_cid], tbl);
+      break;
+
+    case OP_OMAP_RMKEYS:
+      ::encode(colls[op->cid], tbl);
+      ::encode(objects[op->oid], tbl);
+      copy_field<set<string> >(dp, tbl);
+      break;
+
+    case OP_OMAP_RMKEYRANGE:
+      ::encode(colls[op->cid], tbl);
+      ::encode(objects[op->oid], tbl);
+      copy_field<string>(dp, tbl);
+      copy_field<string>(dp, tbl);
+      break;
+
+    case OP_OMAP_SETHEADER:
+      ::encode(colls[op->cid], tbl);
+      ::encode(objects[op->oid], tbl);
+      copy_field<bufferlist>(dp, tbl);
+      break;
+
+    case OP_SPLIT_COLLECTION:
+    case OP_SPLIT_COLLECTION2:
+      {
+	uint32_t bits = op->split_bits;
+	uint32_t rem = op->split_rem;
+	::encode(colls[op->cid], tbl);
+	::encode(bits, tbl);
+	::encode(rem, tbl);
+	::encode(colls[op->dest_cid], tbl);
+      }
+      break;
+
+    case OP_SETALLOCHINT:
+      {
+	uint64_t expected_object_size = op->expected_object_size;
+	uint64_t expected_write_size = op->expected_write_size;
+	::encode(colls[op->cid], tbl);
+	::encode(objects[op->oid], tbl);
+	::encode(expected_object_size, tbl);
+	::encode(expected_write_size, tbl);
+      }
+      break;
+
+    default:
+      assert(0 == "unknown transaction op");
+    }
+  }
+}
+
+static ghobject_t decode_legacy_oid(bufferlist::iterator& p,
+				    bool sobject_encoding)
+{
+  ghobject_t oid;
+  if (sobject_encoding) {
+    sobject_t soid;
+    ::decode(soid, p);
+    oid.hobj.snap = soid.snap;
+    oid.hobj.oid = soid.oid;
+    oid.generation = ghobject_t::NO_GEN;
+    oid.shard_id = shard_id_t::NO_SHARD;
+  } else {
+    ::decode(oid, p);
+  }
+  return oid;
+}
+
+static coll_t decode_legacy_cid(bufferlist::iterator& p)
+{
+  coll_t c;
+  ::decode(c, p);
+  return c;
+}
+
+void ObjectStore::Transaction::_decode_legacy_tbl(bufferlist::iterator& p,
+						  bool sobject_encoding)
+{
+  while (!p.end()) {
+    __u32 opcode;
+    ::decode(opcode, p);
+    Op *op = _get_next_op();
+    op->op = opcode;
+    ops++;
+
+    switch (opcode) {
+    case OP_NOP:
+    case OP_STARTSYNC:
+      break;
+
+    case OP_TOUCH:
+    case OP_REMOVE:
+    case OP_RMATTRS:
+    case OP_COLL_REMOVE:
+    case OP_OMAP_CLEAR:
+      op->cid = _get_coll_id(decode_legacy_cid(p));
+      op->oid = _get_object_id(decode_legacy_oid(p, sobject_encoding));
+      break;
+
+    case OP_WRITE:
+      {
+	uint64_t off, len;
+	op->cid = _get_coll_id(decode_legacy_cid(p));
+	op->oid = _get_object_id(decode_legacy_oid(p, sobject_encoding));
+	::decode(off, p);
+	::decode(len, p);
+	op->off = off;
+	op->len = len;
+	bufferlist bl;
+	::decode(bl, p);
+	if (bl.length() > largest_data_len) {
+	  largest_data_len = bl.length();
+	  largest_data_off = off;
+	  largest_data_off_in_data_bl = data_bl.length() + sizeof(__u32);
+	}
+	::encode(bl, data_bl);
+      }
+      break;
+
+    case OP_ZERO:
+    case OP_TRIMCACHE:
+      {
+	uint64_t off, len;
+	op->cid = _get_coll_id(decode_legacy_cid(p));
+	op->oid = _get_object_id(decode_legacy_oid(p, sobject_encoding));
+	::decode(off, p);
+	::decode(len, p);
+	op->off = off;
+	op->len = len;
+      }
+      break;
+
+    case OP_TRUNCATE:
+      {
+	uint64_t off;
+	op->cid = _get_coll_id(decode_legacy_cid(p));
+	op->oid = _get_object_id(decode_legacy_oid(p, sobject_encoding));
+	::decode(off, p);
+	op->off = off;
+      }
+      break;
+
+    case OP_SETATTR:
+      op->cid = _get_coll_id(decode_legacy_cid(p));
+      op->oid = _get_object_id(decode_legacy_oid(p, sobject_encoding));
+      copy_field<string>(p, data_bl);
+      copy_field<bufferlist>(p, data_bl);
+      break;
+
+    case OP_SETATTRS:
+    case OP_OMAP_SETKEYS:
+      op->cid = _get_coll_id(decode_legacy_cid(p));
+      op->oid = _get_object_id(decode_legacy_oid(p, sobject_encoding));
+      copy_field<map<string, bufferlist> >(p, data_bl);
+      break;
+
+    case OP_RMATTR:
+      op->cid = _get_coll_id(decode_legacy_cid(p));
+      op->oid = _get_object_id(decode_legacy_oid(p, sobject_encoding));
+      copy_field<string>(p, data_bl);
+      break;
+
+    case OP_CLONE:
+      op->cid = _get_coll_id(decode_legacy_cid(p));
+      op->oid = _get_object_id(decode_legacy_oid(p, sobject_encoding));
+      op->dest_oid = _get_object_id(decode_legacy_oid(p, sobject_encoding));
+      break;
+
+    case OP_CLONERANGE:
+    case OP_CLONERANGE2:
+      {
+	uint64_t off, len, dest_off;
+	op->cid = _get_coll_id(decode_legacy_cid(p));
+	op->oid = _get_object_id(decode_legacy_oid(p, sobject_encoding));
+	op->dest_oid = _get_object_id(decode_legacy_oid(p, sobject_encoding));
+	::decode(off, p);
+	::decode(len, p);
+	op->off = off;
+	op->len = len;
+	if (opcode == OP_CLONERANGE2) {
+	  ::decode(dest_off, p);
+	  op->dest_off = dest_off;
+	}
+      }
+      break;
+
+    case OP_MKCOLL:
+    case OP_RMCOLL:
+      op->cid = _get_coll_id(decode_legacy_cid(p));
+      break;
+
+    case OP_COLL_HINT:
+      {
+	uint32_t type;
+	op->cid = _get_coll_id(decode_legacy_cid(p));
+	::decode(type, p);
+	op->hint_type = type;
+	copy_field<bufferlist>(p, data_bl);
+      }
+      break;
+
+    case OP_COLL_ADD:
+    case OP_COLL_MOVE:
+      op->cid = _get_coll_id(decode_legacy_cid(p));
+      op->dest_cid = _get_coll_id(decode_legacy_cid(p));
+      op->oid = _get_object_id(decode_legacy_oid(p, sobject_encoding));
+      break;
+
+    case OP_COLL_MOVE_RENAME:
+      op->cid = _get_coll_id(decode_legacy_cid(p));
+      op->oid = _get_object_id(decode_legacy_oid(p, sobject_encoding));
+      op->dest_cid = _get_coll_id(decode_legacy_cid(p));
+      op->dest_oid = _get_object_id(decode_legacy_oid(p, sobject_encoding));
+      break;
+
+    case OP_COLL_SETATTR:
+      op->cid = _get_coll_id(decode_legacy_cid(p));
+      copy_field<string>(p, data_bl);
+      copy_field<bufferlist>(p, data_bl);
+      break;
+
+    case OP_COLL_RMATTR:
+      op->cid = _get_coll_id(decode_legacy_cid(p));
+      copy_field<string>(p, data_bl);
+      break;
+
+    case OP_COLL_SETATTRS:
+      op->cid = _get_coll_id(decode_legacy_cid(p));
+      copy_field<map<string, bufferlist> >(p, data_bl);
+      break;
+
+    case OP_COLL_RENAME:
+      op->cid = _get_coll_id(decode_legacy_cid(p));
+      op->dest_cid = _get_coll_id(decode_legacy_cid(p));
+      break;
+
+    case OP_OMAP_RMKEYS:
+      op->cid = _get_coll_id(decode_legacy_cid(p));
+      op->oid = _get_object_id(decode_legacy_oid(p, sobject_encoding));
+      copy_field<set<string> >(p, data_bl);
+      break;
+
+    case OP_OMAP_RMKEYRANGE:
+      op->cid = _get_coll_id(decode_legacy_cid(p));
+      op->oid = _get_object_id(decode_legacy_oid(p, sobject_encoding));
+      copy_field<string>(p, data_bl);
+      copy_field<string>(p, data_bl);
+      break;
+
+    case OP_OMAP_SETHEADER:
+      op->cid = _get_coll_id(decode_legacy_cid(p));
+      op->oid = _get_object_id(decode_legacy_oid(p, sobject_encoding));
+      copy_field<bufferlist>(p, data_bl);
+      break;
+
+    case OP_SPLIT_COLLECTION:
+    case OP_SPLIT_COLLECTION2:
+      {
+	uint32_t bits, rem;
+	op->cid = _get_coll_id(decode_legacy_cid(p));
+	::decode(bits, p);
+	::decode(rem, p);
+	op->split_bits = bits;
+	op->split_rem = rem;
+	op->dest_cid = _get_coll_id(decode_legacy_cid(p));
+      }
+      break;
+
+    case OP_SETALLOCHINT:
+      {
+	uint64_t expected_object_size, expected_write_size;
+	op->cid = _get_coll_id(decode_legacy_cid(p));
+	op->oid = _get_object_id(decode_legacy_oid(p, sobject_encoding));
+	::decode(expected_object_size, p);
+	::decode(expected_write_size, p);
+	op->expected_object_size = expected_object_size;
+	op->expected_write_size = expected_write_size;
+      }
+      break;
+
+    default:
+      throw buffer::malformed_input("unknown transaction op");
+    }
+  }
+}
+
 void ObjectStore::Transaction::generate_test_instances(list<ObjectStore::Transaction*>& o)
 {
   o.push_back(new Transaction);
@@ -14,7 +14,7 @@
 
 #include "ECMsgTypes.h"
 
-void ECSubWrite::encode(bufferlist &bl) const
+void ECSubWrite::encode(bufferlist &bl, uint64_t features) const
 {
   ENCODE_START(3, 1, bl);
   ::encode(from, bl);
@@ -22,7 +22,7 @@ void ECSubWrite::encode(bufferlist &bl) const
   ::encode(reqid, bl);
   ::encode(soid, bl);
   ::encode(stats, bl);
-  ::encode(t, bl);
+  t.encode(bl, features);
   ::encode(at_version, bl);
   ::encode(trim_to, bl);
   ::encode(log_entries, bl);
@@ -56,12 +56,12 @@ struct ECSubWrite {
       temp_added(temp_added),
       temp_removed(temp_removed),
       updated_hit_set_history(updated_hit_set_history) {}
-  void encode(bufferlist &bl) const;
+  void encode(bufferlist &bl, uint64_t features) const;
   void decode(bufferlist::iterator &bl);
   void dump(Formatter *f) const;
   static void generate_test_instances(list<ECSubWrite*>& o);
 };
-WRITE_CLASS_ENCODER(ECSubWrite)
+WRITE_CLASS_ENCODER_FEATURES(ECSubWrite)
 
 struct ECSubWriteReply {
   pg_shard_t from;
@@ -64,6 +64,7 @@
 #include "messages/MOSDFailure.h"
 #include "messages/MOSDMarkMeDown.h"
 #include "messages/MOSDOp.h"
+#include "messages/MOSDOpBatch.h"
 #include "messages/MOSDOpReply.h"
 #include "messages/MOSDSubOp.h"
 #include "messages/MOSDSubOpReply.h"
@@ -800,9 +801,8 @@ bool OSDService::should_share_map(entity_name_t name, Connection *con,
   if (name.is_client()) {
     bool message_sendmap = epoch < osdmap->get_epoch();
     if (message_sendmap && sent_epoch_p) {
-      dout(20) << "client session last_sent_epoch: "
-               << *sent_epoch_p
-               << " versus osdmap epoch " << osdmap->get_epoch() << dendl;
+      doutf(20, "osd.%d %u client session last_sent_epoch: %u versus osdmap epoch %u",
+            whoami, get_osdmap_epoch(), *sent_epoch_p, osdmap->get_epoch());
       if (*sent_epoch_p < osdmap->get_epoch()) {
         should_send = true;
       } // else we don't need to send it out again
@@ -883,9 +883,11 @@ void OSDService::share_map_peer(int peer, Connection *con, OSDMapRef map)
       send_incremental_map(pe, con, map);
       note_peer_epoch(peer, map->get_epoch());
     } else
-      dout(20) << "share_map_peer " << con << " already has epoch " << pe << dendl;
+      doutf(20, "osd.%d %u share_map_peer %p already has epoch %u",
+            whoami, get_osdmap_epoch(), con, pe);
   } else {
-    dout(20) << "share_map_peer " << con << " don't know epoch, doing nothing" << dendl;
+    doutf(20, "osd.%d %u share_map_peer %p don't know epoch, doing nothing",
+          whoami, get_osdmap_epoch(), con);
     // no idea about peer's epoch.
     // ??? send recent ???
     // do nothing.
@@ -1163,7 +1165,7 @@ OSDMapRef OSDService::try_get_map(epoch_t epoch)
   Mutex::Locker l(map_cache_lock);
   OSDMapRef retval = map_cache.lookup(epoch);
   if (retval) {
-    dout(30) << "get_map " << epoch << " -cached" << dendl;
+    doutf(30, "osd.%d %u get_map %u -cached", whoami, get_osdmap_epoch(), epoch);
     return retval;
   }
 
@@ -5398,6 +5400,10 @@ void OSD::ms_fast_dispatch(Message *m)
     m->put();
     return;
   }
+  if (m->get_type() == MSG_OSD_OP_BATCH) {
+    handle_op_batch(static_cast<MOSDOpBatch*>(m));
+    return;
+  }
   OpRequestRef op = op_tracker.create_request<OpRequest>(m);
   {
 #ifdef WITH_LTTNG
@@ -5420,6 +5426,47 @@ void OSD::ms_fast_dispatch(Message *m)
   service.release_map(nextmap);
 }
 
+/*
+ * A client's batch of ops for us.  Each op goes through the normal
+ * path as if it had arrived on its own, in the order they were packed.
+ *
+ * The batch was counted once against the client byte and message
+ * throttles.  Each op takes its own share before the batch lets go of
+ * that, so ops still in flight keep holding back the client.
+ */
+void OSD::handle_op_batch(MOSDOpBatch *m)
+{
+  dout(20) << __func__ << " " << *m << dendl;
+  Throttle *byte_throttler = m->get_byte_throttler();
+  Throttle *msg_throttler = m->get_message_throttler();
+  while (!m->ops.empty()) {
+    Message *op = m->ops.front();
+    m->ops.pop_front();
+    if (op->get_type() != CEPH_MSG_OSD_OP) {
+      derr << __func__ << " unexpected " << *op << " in " << *m << dendl;
+      op->put();
+      continue;
+    }
+    op->get_header().src = m->get_header().src;
+    op->set_connection(m->get_connection());
+    op->set_recv_stamp(m->get_recv_stamp());
+    op->set_throttle_stamp(m->get_throttle_stamp());
+    op->set_recv_complete_stamp(m->get_recv_complete_stamp());
+    if (byte_throttler) {
+      byte_throttler->take(op->get_payload().length() +
+			   op->get_middle().length() +
+			   op->get_data().length());
+      op->set_byte_throttler(byte_throttler);
+    }
+    if (msg_throttler) {
+      msg_throttler->take();
+      op->set_message_throttler(msg_throttler);
+    }
+    ms_fast_dispatch(op);
+  }
+  m->put();
+}
+
 void OSD::ms_fast_preprocess(Message *m)
 {
   if (m->get_connection()->get_peer_type() == CEPH_ENTITY_TYPE_OSD) {
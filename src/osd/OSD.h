@@ -2288,12 +2288,14 @@ protected:
     case MSG_OSD_EC_WRITE_REPLY:
     case MSG_OSD_EC_READ:
     case MSG_OSD_EC_READ_REPLY:
+    case MSG_OSD_OP_BATCH:
       return true;
     default:
       return false;
     }
   }
   void ms_fast_dispatch(Message *m);
+  void handle_op_batch(class MOSDOpBatch *m);
   void ms_fast_preprocess(Message *m);
   bool ms_dispatch(Message *m);
   bool ms_get_authorizer(int dest_type, AuthAuthorizer **authorizer, bool force_new);
@@ -35,6 +35,17 @@ OpRequest::OpRequest(Message *req, OpTracker *tracker) :
   tracker->mark_event(this, "throttled", request->get_throttle_stamp());
   tracker->mark_event(this, "all_read", request->get_recv_complete_stamp());
   tracker->mark_event(this, "dispatched", request->get_dispatch_stamp());
+
+  if (req->get_trace().sampled()) {
+    trace.init_child(tracker->cct, req->get_type_name(), req->get_trace());
+    trace.event("header_read", request->get_recv_stamp());
+    trace.event("throttled", request->get_throttle_stamp());
+    trace.event("all_read", request->get_recv_complete_stamp());
+    trace.event("dispatched", request->get_dispatch_stamp());
+    stringstream ss;
+    ss << reqid;
+    trace.tag("reqid", ss.str());
+  }
 }
 
 void OpRequest::_dump(utime_t now, Formatter *f) const
@@ -72,6 +83,8 @@ void OpRequest::_dump_op_descriptor_unlocked(ostream& stream) const
 void OpRequest::_unregistered() {
   request->clear_data();
   request->clear_payload();
+  Mutex::Locker l(lock);
+  trace.finish();
 }
 
 bool OpRequest::check_rmw(int flag) {
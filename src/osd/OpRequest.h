@@ -41,10 +41,13 @@ struct osd_reqid_t {
 
   void encode(bufferlist &bl) const;
   void decode(bufferlist::iterator &bl);
+  void bound_encode(size_t &s) const;
+  void encode_bounded(char *&p) const;
+  void decode_bounded(const char *&p, const char *end);
   void dump(Formatter *f) const;
   static void generate_test_instances(list<osd_reqid_t*>& o);
 };
-WRITE_CLASS_ENCODER(osd_reqid_t)
+WRITE_CLASS_ENCODER_BOUNDED(osd_reqid_t)
 
 /**
  * The OpRequest takes in a Message* and takes over a single reference
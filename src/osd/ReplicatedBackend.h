@@ -263,6 +263,9 @@ private:
 		    ObjectRecoveryProgress *out_progress,
 		    PushOp *out_op,
 		    object_stat_sum_t *stat = 0);
+  /// drop the holes the store reports from the extents about to be pushed
+  void trim_push_holes(const ObjectRecoveryInfo &recovery_info,
+		       interval_set<uint64_t> *data_included);
   void submit_push_data(ObjectRecoveryInfo &recovery_info,
 			bool first,
 			bool complete,
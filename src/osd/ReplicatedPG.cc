@@ -1402,6 +1402,11 @@ void ReplicatedPG::do_op(OpRequestRef& op)
 		 CEPH_NOSNAP, m->get_pg().ps(),
 		 info.pgid.pool(), m->get_object_locator().nspace);
 
+  // a hedged read is a second copy of a read the primary also has; if
+  // we are a replica that cannot answer it now, say so rather than wait
+  // for recovery, and let the client take the primary's answer
+  bool hedged_read = !is_primary() &&
+    (m->get_flags() & CEPH_OSD_FLAG_HEDGED_READ);
 
   if (write_ordered && scrubber.write_blocked_by_scrub(head)) {
     dout(20) << __func__ << ": waiting for scrub" << dendl;
@@ -1412,6 +1417,10 @@ void ReplicatedPG::do_op(OpRequestRef& op)
 
   // missing object?
   if (is_unreadable_object(head)) {
+    if (hedged_read) {
+      osd->reply_op_error(op, -EAGAIN);
+      return;
+    }
     wait_for_unreadable_object(head, op);
     return;
   }
@@ -1427,6 +1436,10 @@ void ReplicatedPG::do_op(OpRequestRef& op)
 		    CEPH_SNAPDIR, m->get_pg().ps(), info.pgid.pool(),
 		    m->get_object_locator().nspace);
   if (is_unreadable_object(snapdir)) {
+    if (hedged_read) {
+      osd->reply_op_error(op, -EAGAIN);
+      return;
+    }
     wait_for_unreadable_object(snapdir, op);
     return;
   }
@@ -1507,6 +1520,10 @@ void ReplicatedPG::do_op(OpRequestRef& op)
     }
   } else if (r == 0) {
     if (is_unreadable_object(obc->obs.oi.soid)) {
+      if (hedged_read) {
+	osd->reply_op_error(op, -EAGAIN);
+	return;
+      }
       dout(10) << __func__ << ": clone " << obc->obs.oi.soid
 	       << " is unreadable, waiting" << dendl;
       wait_for_unreadable_object(obc->obs.oi.soid, op);
@@ -7190,6 +7207,8 @@ void ReplicatedBackend::issue_op(
       acks_wanted,
       get_osdmap()->get_epoch(),
       tid, at_version);
+    if (op->op)
+      wr->set_trace(op->op->get_trace_ctx());
 
     // ship resulting transaction, log entries, and pg_stats
     if (!parent->should_send_op(peer, soid)) {
@@ -7199,9 +7218,9 @@ void ReplicatedBackend::issue_op(
 	       << ", pinfo.last_backfill "
 	       << pinfo.last_backfill << ")" << dendl;
       ObjectStore::Transaction t;
-      ::encode(t, wr->get_data());
+      t.encode(wr->get_data(), parent->min_peer_features());
     } else {
-      ::encode(*op_t, wr->get_data());
+      op_t->encode(wr->get_data(), parent->min_peer_features());
     }
 
     ::encode(log_entries, wr->logbl);
@@ -8933,10 +8952,15 @@ int ReplicatedBackend::build_push_op(const ObjectRecoveryInfo &recovery_info,
       new_progress.omap_recovered_to = iter->key();
   }
 
+  uint64_t recovered_to = progress.data_recovered_to;
   if (available > 0) {
     out_op->data_included.span_of(recovery_info.copy_subset,
 				 progress.data_recovered_to,
 				 available);
+    if (!out_op->data_included.empty()) {
+      recovered_to = out_op->data_included.range_end();
+      trim_push_holes(recovery_info, &out_op->data_included);
+    }
   } else {
     out_op->data_included.clear();
   }
@@ -8957,8 +8981,10 @@ int ReplicatedBackend::build_push_op(const ObjectRecoveryInfo &recovery_info,
     out_op->data.claim_append(bit);
   }
 
-  if (!out_op->data_included.empty())
+  if (!out_op->data_included.empty() && new_progress.data_complete)
     new_progress.data_recovered_to = out_op->data_included.range_end();
+  else
+    new_progress.data_recovered_to = recovered_to;
 
   if (new_progress.is_complete(recovery_info)) {
     new_progress.data_complete = true;
@@ -8983,6 +9009,39 @@ int ReplicatedBackend::build_push_op(const ObjectRecoveryInfo &recovery_info,
   return 0;
 }
 
+void ReplicatedBackend::trim_push_holes(const ObjectRecoveryInfo &recovery_info,
+					interval_set<uint64_t> *data_included)
+{
+  uint64_t start = data_included->range_start();
+  uint64_t end = data_included->range_end();
+  bufferlist bl;
+  int r = store->fiemap(coll, recovery_info.soid, start, end - start, bl);
+  if (r < 0)
+    return;
+  map<uint64_t, uint64_t> m;
+  bufferlist::iterator p = bl.begin();
+  ::decode(m, p);
+
+  interval_set<uint64_t> extents;
+  for (map<uint64_t, uint64_t>::iterator i = m.begin(); i != m.end(); ++i) {
+    if (i->second)
+      extents.insert(i->first, i->second);
+  }
+  interval_set<uint64_t> sparse;
+  sparse.intersection_of(*data_included, extents);
+
+  // always push the last byte of the object so that the replica ends
+  // up with the right size even if the object ends in a hole.
+  if (end == recovery_info.size && !sparse.contains(end - 1, 1))
+    sparse.insert(end - 1, 1);
+
+  if (sparse.size() < data_included->size()) {
+    dout(20) << __func__ << " " << recovery_info.soid << " " << *data_included
+	     << " -> " << sparse << dendl;
+    data_included->swap(sparse);
+  }
+}
+
 int ReplicatedBackend::send_push_op_legacy(int prio, pg_shard_t peer, PushOp &pop)
 {
   ceph_tid_t tid = get_parent()->get_tid();
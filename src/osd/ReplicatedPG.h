@@ -400,6 +400,9 @@ public:
   pg_shard_t primary_shard() const {
     return primary;
   }
+  uint64_t min_peer_features() const {
+    return get_min_peer_features();
+  }
 
   void send_message_osd_cluster(
     int peer, Message *m, epoch_t from_epoch);
@@ -50,6 +50,7 @@ const char *ceph_osd_flag_name(unsigned flag)
   case CEPH_OSD_FLAG_ENFORCE_SNAPC: return "enforce_snapc";
   case CEPH_OSD_FLAG_REDIRECTED: return "redirected";
   case CEPH_OSD_FLAG_KNOWN_REDIR: return "known_if_redirected";
+  case CEPH_OSD_FLAG_HEDGED_READ: return "hedged_read";
   default: return "???";
   }
 }
@@ -96,11 +97,7 @@ ostream &operator<<(ostream &lhs, const pg_shard_t &rhs)
 // -- osd_reqid_t --
 void osd_reqid_t::encode(bufferlist &bl) const
 {
-  ENCODE_START(2, 2, bl);
-  ::encode(name, bl);
-  ::encode(tid, bl);
-  ::encode(inc, bl);
-  ENCODE_FINISH(bl);
+  ::encode_via_bounded(*this, bl);
 }
 
 void osd_reqid_t::decode(bufferlist::iterator &bl)
@@ -112,6 +109,32 @@ void osd_reqid_t::decode(bufferlist::iterator &bl)
   DECODE_FINISH(bl);
 }
 
+void osd_reqid_t::bound_encode(size_t &s) const
+{
+  s += BOUNDED_ENCODE_START_SIZE;
+  ::bound_encode(name, s);
+  ::bound_encode(tid, s);
+  ::bound_encode(inc, s);
+}
+
+void osd_reqid_t::encode_bounded(char *&p) const
+{
+  BOUNDED_ENCODE_START(2, 2, p);
+  ::encode_bounded(name, p);
+  ::encode_bounded(tid, p);
+  ::encode_bounded(inc, p);
+  BOUNDED_ENCODE_FINISH(p);
+}
+
+void osd_reqid_t::decode_bounded(const char *&p, const char *end)
+{
+  BOUNDED_DECODE_START(2, 2, p, end);
+  ::decode_bounded(name, p, end);
+  ::decode_bounded(tid, p, end);
+  ::decode_bounded(inc, p, end);
+  BOUNDED_DECODE_FINISH(p);
+}
+
 void osd_reqid_t::dump(Formatter *f) const
 {
   f->dump_stream("name") << name;
@@ -128,20 +151,49 @@ void osd_reqid_t::generate_test_instances(list<osd_reqid_t*>& o)
 // -- object_locator_t --
 
 void object_locator_t::encode(bufferlist& bl) const
+{
+  ::encode_via_bounded(*this, bl);
+}
+
+void object_locator_t::bound_encode(size_t &s) const
+{
+  s += BOUNDED_ENCODE_START_SIZE;
+  ::bound_encode(pool, s);
+  s += sizeof(ceph_le32);  // preferred
+  ::bound_encode(key, s);
+  ::bound_encode(nspace, s);
+  ::bound_encode(hash, s);
+}
+
+void object_locator_t::encode_bounded(char *&p) const
 {
   // verify that nobody's corrupted the locator
   assert(hash == -1 || key.empty());
   __u8 encode_compat = 3;
-  ENCODE_START(6, encode_compat, bl);
-  ::encode(pool, bl);
+  BOUNDED_ENCODE_START(6, encode_compat, p);
+  ::encode_bounded(pool, p);
   int32_t preferred = -1;  // tell old code there is no preferred osd (-1).
-  ::encode(preferred, bl);
-  ::encode(key, bl);
-  ::encode(nspace, bl);
-  ::encode(hash, bl);
+  ::encode_bounded(preferred, p);
+  ::encode_bounded(key, p);
+  ::encode_bounded(nspace, p);
+  ::encode_bounded(hash, p);
   if (hash != -1)
     encode_compat = MAX(encode_compat, 6); // need to interpret the hash
-  ENCODE_FINISH_NEW_COMPAT(bl, encode_compat);
+  BOUNDED_ENCODE_FINISH_NEW_COMPAT(p, encode_compat);
+}
+
+void object_locator_t::decode_bounded(const char *&p, const char *end)
+{
+  BOUNDED_DECODE_START(6, 6, p, end);
+  ::decode_bounded(pool, p, end);
+  int32_t preferred;
+  ::decode_bounded(preferred, p, end);
+  ::decode_bounded(key, p, end);
+  ::decode_bounded(nspace, p, end);
+  ::decode_bounded(hash, p, end);
+  BOUNDED_DECODE_FINISH(p);
+  // verify that nobody's corrupted the locator
+  assert(hash == -1 || key.empty());
 }
 
 void object_locator_t::decode(bufferlist::iterator& p)
@@ -2684,11 +2736,7 @@ void ObjectModDesc::generate_test_instances(list<ObjectModDesc*>& o)
 
 void ObjectModDesc::encode(bufferlist &_bl) const
 {
-  ENCODE_START(1, 1, _bl);
-  ::encode(can_local_rollback, _bl);
-  ::encode(rollback_info_completed, _bl);
-  ::encode(bl, _bl);
-  ENCODE_FINISH(_bl);
+  ::encode_via_bounded(*this, _bl);
 }
 void ObjectModDesc::decode(bufferlist::iterator &_bl)
 {
@@ -2698,6 +2746,29 @@ void ObjectModDesc::decode(bufferlist::iterator &_bl)
   ::decode(bl, _bl);
   DECODE_FINISH(_bl);
 }
+void ObjectModDesc::bound_encode(size_t &s) const
+{
+  s += BOUNDED_ENCODE_START_SIZE;
+  ::bound_encode(can_local_rollback, s);
+  ::bound_encode(rollback_info_completed, s);
+  ::bound_encode(bl, s);
+}
+void ObjectModDesc::encode_bounded(char *&p) const
+{
+  BOUNDED_ENCODE_START(1, 1, p);
+  ::encode_bounded(can_local_rollback, p);
+  ::encode_bounded(rollback_info_completed, p);
+  ::encode_bounded(bl, p);
+  BOUNDED_ENCODE_FINISH(p);
+}
+void ObjectModDesc::decode_bounded(const char *&p, const char *end)
+{
+  BOUNDED_DECODE_START(1, 1, p, end);
+  ::decode_bounded(can_local_rollback, p, end);
+  ::decode_bounded(rollback_info_completed, p, end);
+  ::decode_bounded(bl, p, end);
+  BOUNDED_DECODE_FINISH(p);
+}
 
 // -- pg_log_entry_t --
 
@@ -2724,36 +2795,12 @@ void pg_log_entry_t::decode_with_checksum(bufferlist::iterator& p)
   if (crc != bl.crc32c(0))
     throw buffer::malformed_input("bad checksum on pg_log_entry_t");
   bufferlist::iterator q = bl.begin();
-  decode(q);
+  ::decode(*this, q);
 }
 
 void pg_log_entry_t::encode(bufferlist &bl) const
 {
-  ENCODE_START(9, 4, bl);
-  ::encode(op, bl);
-  ::encode(soid, bl);
-  ::encode(version, bl);
-
-  /**
-   * Added with reverting_to:
-   * Previous code used prior_version to encode
-   * what we now call reverting_to.  This will
-   * allow older code to decode reverting_to
-   * into prior_version as expected.
-   */
-  if (op == LOST_REVERT)
-    ::encode(reverting_to, bl);
-  else
-    ::encode(prior_version, bl);
-
-  ::encode(reqid, bl);
-  ::encode(mtime, bl);
-  if (op == LOST_REVERT)
-    ::encode(prior_version, bl);
-  ::encode(snaps, bl);
-  ::encode(user_version, bl);
-  ::encode(mod_desc, bl);
-  ENCODE_FINISH(bl);
+  ::encode_via_bounded(*this, bl);
 }
 
 void pg_log_entry_t::decode(bufferlist::iterator &bl)
@@ -2808,6 +2855,71 @@ void pg_log_entry_t::decode(bufferlist::iterator &bl)
   DECODE_FINISH(bl);
 }
 
+void pg_log_entry_t::bound_encode(size_t &s) const
+{
+  s += BOUNDED_ENCODE_START_SIZE;
+  ::bound_encode(op, s);
+  ::bound_encode(soid, s);
+  ::bound_encode(version, s);
+  ::bound_encode(prior_version, s);
+  ::bound_encode(reqid, s);
+  ::bound_encode(mtime, s);
+  if (op == LOST_REVERT)
+    ::bound_encode(prior_version, s);
+  ::bound_encode(snaps, s);
+  ::bound_encode(user_version, s);
+  ::bound_encode(mod_desc, s);
+}
+
+void pg_log_entry_t::encode_bounded(char *&p) const
+{
+  BOUNDED_ENCODE_START(9, 4, p);
+  ::encode_bounded(op, p);
+  ::encode_bounded(soid, p);
+  ::encode_bounded(version, p);
+
+  /**
+   * Added with reverting_to:
+   * Previous code used prior_version to encode
+   * what we now call reverting_to.  This will
+   * allow older code to decode reverting_to
+   * into prior_version as expected.
+   */
+  if (op == LOST_REVERT)
+    ::encode_bounded(reverting_to, p);
+  else
+    ::encode_bounded(prior_version, p);
+
+  ::encode_bounded(reqid, p);
+  ::encode_bounded(mtime, p);
+  if (op == LOST_REVERT)
+    ::encode_bounded(prior_version, p);
+  ::encode_bounded(snaps, p);
+  ::encode_bounded(user_version, p);
+  ::encode_bounded(mod_desc, p);
+  BOUNDED_ENCODE_FINISH(p);
+}
+
+void pg_log_entry_t::decode_bounded(const char *&p, const char *end)
+{
+  BOUNDED_DECODE_START(8, 9, p, end);
+  ::decode_bounded(op, p, end);
+  ::decode_bounded(soid, p, end);
+  ::decode_bounded(version, p, end);
+  if (op == LOST_REVERT)
+    ::decode_bounded(reverting_to, p, end);
+  else
+    ::decode_bounded(prior_version, p, end);
+  ::decode_bounded(reqid, p, end);
+  ::decode_bounded(mtime, p, end);
+  if (op == LOST_REVERT)
+    ::decode_bounded(prior_version, p, end);
+  ::decode_bounded(snaps, p, end);
+  ::decode_bounded(user_version, p, end);
+  ::decode_bounded(mod_desc, p, end);
+  BOUNDED_DECODE_FINISH(p);
+}
+
 void pg_log_entry_t::dump(Formatter *f) const
 {
   f->dump_string("op", get_op_name());
@@ -164,10 +164,13 @@ struct object_locator_t {
 
   void encode(bufferlist& bl) const;
   void decode(bufferlist::iterator& p);
+  void bound_encode(size_t &s) const;
+  void encode_bounded(char *&p) const;
+  void decode_bounded(const char *&p, const char *end);
   void dump(Formatter *f) const;
   static void generate_test_instances(list<object_locator_t*>& o);
 };
-WRITE_CLASS_ENCODER(object_locator_t)
+WRITE_CLASS_ENCODER_BOUNDED(object_locator_t)
 
 inline bool operator==(const object_locator_t& l, const object_locator_t& r) {
   return l.pool == r.pool && l.key == r.key && l.nspace == r.nspace && l.hash == r.hash;
@@ -337,6 +340,26 @@ struct pg_t {
     ::decode(m_seed, bl);
     ::decode(m_preferred, bl);
   }
+  void bound_encode(size_t &s) const {
+    s += 1;
+    ::bound_encode(m_pool, s);
+    ::bound_encode(m_seed, s);
+    ::bound_encode(m_preferred, s);
+  }
+  void encode_bounded(char *&p) const {
+    __u8 v = 1;
+    ::encode_bounded(v, p);
+    ::encode_bounded(m_pool, p);
+    ::encode_bounded(m_seed, p);
+    ::encode_bounded(m_preferred, p);
+  }
+  void decode_bounded(const char *&p, const char *end) {
+    __u8 v;
+    ::decode_bounded(v, p, end);
+    ::decode_bounded(m_pool, p, end);
+    ::decode_bounded(m_seed, p, end);
+    ::decode_bounded(m_preferred, p, end);
+  }
   void decode_old(bufferlist::iterator& bl) {
     old_pg_t opg;
     ::decode(opg, bl);
@@ -346,6 +369,7 @@ struct pg_t {
   static void generate_test_instances(list<pg_t*>& o);
 };
 WRITE_CLASS_ENCODER(pg_t)
+WRITE_CLASS_BOUNDED(pg_t)
 
 inline bool operator<(const pg_t& l, const pg_t& r) {
   return l.pool() < r.pool() ||
@@ -613,8 +637,21 @@ public:
     bufferlist::iterator p = bl.begin();
     decode(p);
   }
+  void bound_encode(size_t &s) const {
+    ::bound_encode(version, s);
+    ::bound_encode(epoch, s);
+  }
+  void encode_bounded(char *&p) const {
+    ::encode_bounded(version, p);
+    ::encode_bounded(epoch, p);
+  }
+  void decode_bounded(const char *&p, const char *end) {
+    ::decode_bounded(version, p, end);
+    ::decode_bounded(epoch, p, end);
+  }
 };
 WRITE_CLASS_ENCODER(eversion_t)
+WRITE_CLASS_BOUNDED(eversion_t)
 
 inline bool operator==(const eversion_t& l, const eversion_t& r) {
   return (l.epoch == r.epoch) && (l.version == r.version);
@@ -2018,10 +2055,13 @@ public:
   }
   void encode(bufferlist &bl) const;
   void decode(bufferlist::iterator &bl);
+  void bound_encode(size_t &s) const;
+  void encode_bounded(char *&p) const;
+  void decode_bounded(const char *&p, const char *end);
   void dump(Formatter *f) const;
   static void generate_test_instances(list<ObjectModDesc*>& o);
 };
-WRITE_CLASS_ENCODER(ObjectModDesc)
+WRITE_CLASS_ENCODER_BOUNDED(ObjectModDesc)
 
 
 /**
@@ -2123,11 +2163,14 @@ struct pg_log_entry_t {
 
   void encode(bufferlist &bl) const;
   void decode(bufferlist::iterator &bl);
+  void bound_encode(size_t &s) const;
+  void encode_bounded(char *&p) const;
+  void decode_bounded(const char *&p, const char *end);
   void dump(Formatter *f) const;
   static void generate_test_instances(list<pg_log_entry_t*>& o);
 
 };
-WRITE_CLASS_ENCODER(pg_log_entry_t)
+WRITE_CLASS_ENCODER_BOUNDED(pg_log_entry_t)
 
 ostream& operator<<(ostream& out, const pg_log_entry_t& e);
 
@@ -35,6 +35,7 @@ ObjectCacher::BufferHead *ObjectCacher::Object::split(BufferHead *left, loff_t o
   right->last_read_tid = left->last_read_tid;
   right->set_state(left->get_state());
   right->snapc = left->snapc;
+  right->hot = left->hot;
 
   loff_t newleftlen = off - left->start();
   right->set_start(off);
@@ -89,6 +90,8 @@ void ObjectCacher::Object::merge_left(BufferHead *left, BufferHead *right)
   oc->bh_stat_sub(left);
   left->set_length(left->length() + right->length());
   oc->bh_stat_add(left);
+  if (right->hot)
+    oc->bh_set_hot(left);
 
   // data
   left->bl.claim_append(right->bl);
@@ -528,6 +531,7 @@ ObjectCacher::~ObjectCacher()
       ++i)
     assert(i->empty());
   assert(bh_lru_rest.lru_get_size() == 0);
+  assert(bh_lru_probation.lru_get_size() == 0);
   assert(bh_lru_dirty.lru_get_size() == 0);
   assert(ob_lru.lru_get_size() == 0);
   assert(dirty_or_tx_bh.empty());
@@ -549,6 +553,7 @@ void ObjectCacher::perf_start()
                       "data_overwritten_while_flushing");
   plb.add_u64_counter(l_objectcacher_write_ops_blocked, "write_ops_blocked");
   plb.add_u64_counter(l_objectcacher_write_bytes_blocked, "write_bytes_blocked");
+  plb.add_u64_counter(l_objectcacher_promoted, "promoted");
   plb.add_time(l_objectcacher_write_time_blocked, "write_time_blocked");
 
   perfcounter = plb.create_perf_counters();
@@ -957,7 +962,20 @@ void ObjectCacher::trim()
 		 << dendl;
 
   while (get_stat_clean() > 0 && (uint64_t) get_stat_clean() > max_size) {
-    BufferHead *bh = static_cast<BufferHead*>(bh_lru_rest.lru_expire());
+    // probation gets a quarter of the buffers; beyond that it goes first
+    BufferHead *bh = NULL;
+    bool probation = bh_lru_probation.lru_get_size() * 4 >
+      bh_lru_probation.lru_get_size() + bh_lru_rest.lru_get_size();
+    if (probation)
+      bh = static_cast<BufferHead*>(bh_lru_probation.lru_expire());
+    if (!bh) {
+      bh = static_cast<BufferHead*>(bh_lru_rest.lru_expire());
+      probation = false;
+    }
+    if (!bh) {
+      bh = static_cast<BufferHead*>(bh_lru_probation.lru_expire());
+      probation = true;
+    }
     if (!bh)
       break;
 
@@ -965,6 +983,8 @@ void ObjectCacher::trim()
     assert(bh->is_clean() || bh->is_zero());
 
     Object *ob = bh->ob;
+    if (probation)
+      ghost_add(ob);
     bh_remove(ob, bh);
     delete bh;
 
@@ -2039,13 +2059,9 @@ void ObjectCacher::bh_set_state(BufferHead *bh, int s)
   assert(lock.is_locked());
   int state = bh->get_state();
   // move between lru lists?
-  if (s == BufferHead::STATE_DIRTY && state != BufferHead::STATE_DIRTY) {
-    bh_lru_rest.lru_remove(bh);
-    bh_lru_dirty.lru_insert_top(bh);
-  } else if (s != BufferHead::STATE_DIRTY && state == BufferHead::STATE_DIRTY) {
-    bh_lru_dirty.lru_remove(bh);
-    bh_lru_rest.lru_insert_top(bh);
-  }
+  bool relist = (s == BufferHead::STATE_DIRTY) != (state == BufferHead::STATE_DIRTY);
+  if (relist)
+    bh_lru_remove(bh);
 
   if ((s == BufferHead::STATE_TX ||
        s == BufferHead::STATE_DIRTY) &&
@@ -2067,6 +2083,9 @@ void ObjectCacher::bh_set_state(BufferHead *bh, int s)
   bh_stat_sub(bh);
   bh->set_state(s);
   bh_stat_add(bh);
+
+  if (relist)
+    bh_lru_insert(bh);
 }
 
 void ObjectCacher::bh_add(Object *ob, BufferHead *bh)
@@ -2074,12 +2093,16 @@ void ObjectCacher::bh_add(Object *ob, BufferHead *bh)
   assert(lock.is_locked());
   ldout(cct, 30) << "bh_add " << *ob << " " << *bh << dendl;
   ob->add_bh(bh);
-  if (bh->is_dirty()) {
-    bh_lru_dirty.lru_insert_top(bh);
-    dirty_or_tx_bh.insert(bh);
-  } else {
-    bh_lru_rest.lru_insert_top(bh);
+  if (bh->is_missing() && !bh->hot && ghost_hit(ob)) {
+    ldout(cct, 20) << "bh_add " << *bh << " was trimmed recently, promoting"
+		   << dendl;
+    bh->hot = true;
+    if (perfcounter)
+      perfcounter->inc(l_objectcacher_promoted);
   }
+  bh_lru_insert(bh);
+  if (bh->is_dirty())
+    dirty_or_tx_bh.insert(bh);
 
   if (bh->is_tx()) {
     dirty_or_tx_bh.insert(bh);
@@ -2092,12 +2115,9 @@ void ObjectCacher::bh_remove(Object *ob, BufferHead *bh)
   assert(lock.is_locked());
   ldout(cct, 30) << "bh_remove " << *ob << " " << *bh << dendl;
   ob->remove_bh(bh);
-  if (bh->is_dirty()) {
-    bh_lru_dirty.lru_remove(bh);
+  bh_lru_remove(bh);
+  if (bh->is_dirty())
     dirty_or_tx_bh.erase(bh);
-  } else {
-    bh_lru_rest.lru_remove(bh);
-  }
 
   if (bh->is_tx()) {
     dirty_or_tx_bh.erase(bh);
@@ -2105,3 +2125,52 @@ void ObjectCacher::bh_remove(Object *ob, BufferHead *bh)
   bh_stat_sub(bh);
 }
 
+void ObjectCacher::bh_lru_insert(BufferHead *bh)
+{
+  if (bh->is_dirty())
+    bh_lru_dirty.lru_insert_top(bh);
+  else if (bh->hot)
+    bh_lru_rest.lru_insert_top(bh);
+  else
+    bh_lru_probation.lru_insert_top(bh);
+}
+
+void ObjectCacher::bh_lru_remove(BufferHead *bh)
+{
+  if (bh->is_dirty())
+    bh_lru_dirty.lru_remove(bh);
+  else if (bh->hot)
+    bh_lru_rest.lru_remove(bh);
+  else
+    bh_lru_probation.lru_remove(bh);
+}
+
+void ObjectCacher::bh_set_hot(BufferHead *bh)
+{
+  if (bh->hot)
+    return;
+  bh_lru_remove(bh);
+  bh->hot = true;
+  bh_lru_insert(bh);
+}
+
+void ObjectCacher::ghost_add(Object *ob)
+{
+  pair<int64_t, sobject_t> key(ob->oloc.pool, ob->get_soid());
+  map<pair<int64_t, sobject_t>, list<pair<int64_t, sobject_t> >::iterator>::iterator p =
+    ghosts.find(key);
+  if (p != ghosts.end()) {
+    ghost_lru.splice(ghost_lru.begin(), ghost_lru, p->second);
+    return;
+  }
+  ghosts[key] = ghost_lru.insert(ghost_lru.begin(), key);
+  while (ghost_lru.size() > max_objects) {
+    ghosts.erase(ghost_lru.back());
+    ghost_lru.pop_back();
+  }
+}
+
+bool ObjectCacher::ghost_hit(Object *ob)
+{
+  return ghosts.count(make_pair(ob->oloc.pool, ob->get_soid()));
+}
@@ -37,6 +37,8 @@ enum {
   l_objectcacher_write_bytes_blocked, // total number of write bytes we delayed due to dirty limits
   l_objectcacher_write_time_blocked, // total time in seconds spent blocking a write due to dirty limits
 
+  l_objectcacher_promoted, // buffers read again after being trimmed from probation
+
   l_objectcacher_last,
 };
 
@@ -108,6 +110,7 @@ class ObjectCacher {
     utime_t last_write;
     SnapContext snapc;
     int error; // holds return value for failed reads
+    bool hot;  // in bh_lru_rest rather than bh_lru_probation when clean
     
     map< loff_t, list<Context*> > waitfor_read;
     
@@ -118,7 +121,8 @@ class ObjectCacher {
       ob(o),
       last_write_tid(0),
       last_read_tid(0),
-      error(0) {
+      error(0),
+      hot(false) {
       ex.start = ex.length = 0;
     }
   
@@ -346,8 +350,24 @@ class ObjectCacher {
   ceph_tid_t last_read_tid;
 
   set<BufferHead*>    dirty_or_tx_bh;
-  LRU   bh_lru_dirty, bh_lru_rest;
+
+  /*
+   * Clean buffers are kept 2Q style, so that one pass over a large
+   * file or image doesn't push out everything else.  New buffers go on
+   * bh_lru_probation and leave it in FIFO order; only data that is read
+   * again after being trimmed from there (we remember the last
+   * max_objects objects that were) goes on bh_lru_rest, which is LRU.
+   */
+  LRU   bh_lru_dirty, bh_lru_rest, bh_lru_probation;
   LRU   ob_lru;
+  list<pair<int64_t, sobject_t> > ghost_lru;
+  map<pair<int64_t, sobject_t>, list<pair<int64_t, sobject_t> >::iterator> ghosts;
+
+  void bh_lru_insert(BufferHead *bh);
+  void bh_lru_remove(BufferHead *bh);
+  void bh_set_hot(BufferHead *bh);
+  void ghost_add(Object *ob);
+  bool ghost_hit(Object *ob);
 
   Cond flusher_cond;
   bool flusher_stop;
@@ -403,8 +423,9 @@ class ObjectCacher {
   void touch_bh(BufferHead *bh) {
     if (bh->is_dirty())
       bh_lru_dirty.lru_touch(bh);
-    else
+    else if (bh->hot)
       bh_lru_rest.lru_touch(bh);
+    // else probation is FIFO; repeated hits while there don't count
     touch_ob(bh->ob);
   }
   void touch_ob(Object *ob) {
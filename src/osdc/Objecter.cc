@@ -23,6 +23,7 @@
 
 #include "messages/MPing.h"
 #include "messages/MOSDOp.h"
+#include "messages/MOSDOpBatch.h"
 #include "messages/MOSDOpReply.h"
 #include "messages/MOSDMap.h"
 
@@ -60,6 +61,9 @@ enum {
   l_osdc_op_send,
   l_osdc_op_send_bytes,
   l_osdc_op_resend,
+  l_osdc_op_batch,
+  l_osdc_op_hedge,
+  l_osdc_op_hedge_won,
   l_osdc_op_ack,
   l_osdc_op_commit,
 
@@ -183,6 +187,9 @@ void Objecter::init()
     pcb.add_u64_counter(l_osdc_op_send, "op_send");
     pcb.add_u64_counter(l_osdc_op_send_bytes, "op_send_bytes");
     pcb.add_u64_counter(l_osdc_op_resend, "op_resend");
+    pcb.add_u64_counter(l_osdc_op_batch, "op_batch");
+    pcb.add_u64_counter(l_osdc_op_hedge, "op_hedge");
+    pcb.add_u64_counter(l_osdc_op_hedge_won, "op_hedge_won");
     pcb.add_u64_counter(l_osdc_op_ack, "op_ack");
     pcb.add_u64_counter(l_osdc_op_commit, "op_commit");
 
@@ -270,6 +277,9 @@ void Objecter::init()
   timer_lock.Lock();
   timer.init();
   timer_lock.Unlock();
+  // hedged reads can be turned on at any time, so run it even without
+  // an osd_timeout
+  op_timer.init();
 
   initialized.set(1);
 }
@@ -401,11 +411,12 @@ void Objecter::shutdown()
     Mutex::Locker l(timer_lock);
     timer.shutdown();
   }
+  op_timer.shutdown();
 
   assert(tick_event == NULL);
 }
 
-void Objecter::_send_linger(LingerOp *info)
+void Objecter::_send_linger(LingerOp *info, OpBatch *batch)
 {
   assert(rwlock.is_wlocked());
 
@@ -440,7 +451,7 @@ void Objecter::_send_linger(LingerOp *info)
     }
     info->session->lock.unlock();
 
-    info->register_tid = _op_submit(o, lc);
+    info->register_tid = _op_submit(o, lc, batch);
   } else {
     // first send
     info->register_tid = _op_submit_with_budget(o, lc);
@@ -851,7 +862,8 @@ void Objecter::handle_osd_map(MOSDMap *m)
 
   RWLock::Context lc(rwlock, RWLock::Context::TakenForWrite);
 
-  // resend requests
+  // resend requests, in one message per osd
+  OpBatch batch;
   for (map<ceph_tid_t, Op*>::iterator p = need_resend.begin();
        p != need_resend.end(); ++p) {
     Op *op = p->second;
@@ -871,7 +883,7 @@ void Objecter::handle_osd_map(MOSDMap *m)
     if (op->should_resend) {
       if (!op->session->is_homeless() && !op->target.paused) {
 	logger->inc(l_osdc_op_resend);
-	_send_op(op);
+	_send_op(op, NULL, &batch);
       }
     } else {
       _cancel_linger_op(op);
@@ -893,9 +905,10 @@ void Objecter::handle_osd_map(MOSDMap *m)
     }
     if (!op->session->is_homeless()) {
       logger->inc(l_osdc_linger_resend);
-      _send_linger(op);
+      _send_linger(op, &batch);
     }
   }
+  _flush_op_batch(batch);
   for (map<ceph_tid_t,CommandOp*>::iterator p = need_resend_command.begin();
        p != need_resend_command.end(); ++p) {
     CommandOp *c = p->second;
@@ -1499,10 +1512,12 @@ void Objecter::_kick_requests(OSDSession *session, map<uint64_t, LingerOp *>& lr
     }
   }
 
+  OpBatch batch;
   while (!resend.empty()) {
-    _send_op(resend.begin()->second);
+    _send_op(resend.begin()->second, NULL, &batch);
     resend.erase(resend.begin());
   }
+  _flush_op_batch(batch);
 
   // resend lingers
   for (map<ceph_tid_t, LingerOp*>::iterator j = session->linger_ops.begin(); j != session->linger_ops.end(); ++j) {
@@ -1529,14 +1544,17 @@ void Objecter::_linger_ops_resend(map<uint64_t, LingerOp *>& lresend)
 {
   assert(rwlock.is_locked());
 
+  // re-register them all in one message
+  OpBatch batch;
   while (!lresend.empty()) {
     LingerOp *op = lresend.begin()->second;
     if (!op->canceled) {
-      _send_linger(op);
+      _send_linger(op, &batch);
     }
     op->put();
     lresend.erase(lresend.begin());
   }
+  _flush_op_batch(batch);
 }
 
 void Objecter::schedule_tick()
@@ -1689,6 +1707,17 @@ public:
   }
 };
 
+class C_HedgeRead : public Context
+{
+  ceph_tid_t tid;
+  Objecter *objecter;
+public:
+  C_HedgeRead(ceph_tid_t t, Objecter *objecter) : tid(t), objecter(objecter) {}
+  void finish(int r) {
+    objecter->hedge_read(tid);
+  }
+};
+
 ceph_tid_t Objecter::op_submit(Op *op, int *ctx_budget)
 {
   RWLock::RLocker rl(rwlock);
@@ -1714,19 +1743,135 @@ ceph_tid_t Objecter::_op_submit_with_budget(Op *op, RWLock::Context& lc, int *ct
       *ctx_budget = op_budget;
     }
   }
+  _wait_for_osd_budget(op);
 
   ceph_tid_t tid = _op_submit(op, lc);
 
   if (osd_timeout > 0) {
-    Mutex::Locker l(timer_lock);
     op->ontimeout = new C_CancelOp(tid, this);
-    timer.add_event_after(osd_timeout, op->ontimeout);
+    op_timer.add_event_after(osd_timeout, op->ontimeout);
   }
 
   return tid;
 }
 
-ceph_tid_t Objecter::_op_submit(Op *op, RWLock::Context& lc)
+void Objecter::op_submit_batch(vector<Op*>& ops, vector<ceph_tid_t> *tids)
+{
+  RWLock::RLocker rl(rwlock);
+  RWLock::Context lc(rwlock, RWLock::Context::TakenForRead);
+  assert(initialized.read());
+
+  OpBatch batch;
+  for (vector<Op*>::iterator p = ops.begin(); p != ops.end(); ++p) {
+    Op *op = *p;
+    assert(op->ops.size() == op->out_bl.size());
+    assert(op->ops.size() == op->out_rval.size());
+    assert(op->ops.size() == op->out_handler.size());
+
+    // the ops held back in the batch may be what we would wait for,
+    // so send them before blocking on the throttle
+    if (!op->ctx_budgeted && !_try_take_op_budget(op)) {
+      _flush_op_batch(batch);
+      _take_op_budget(op);
+    }
+    _wait_for_osd_budget(op, &batch);
+
+    ceph_tid_t tid = _op_submit(op, lc, &batch);
+
+    if (osd_timeout > 0) {
+      op->ontimeout = new C_CancelOp(tid, this);
+      op_timer.add_event_after(osd_timeout, op->ontimeout);
+    }
+    if (tids)
+      tids->push_back(tid);
+  }
+  _flush_op_batch(batch);
+}
+
+void Objecter::_flush_op_batch(OpBatch& batch)
+{
+  assert(rwlock.is_locked());
+
+  for (OpBatch::iterator p = batch.begin(); p != batch.end(); ++p) {
+    // a connection that was reset meanwhile drops these; the ops are
+    // resent when the session is reopened
+    ConnectionRef con = p->first;
+    if (p->second.size() == 1 ||
+	!con->has_feature(CEPH_FEATURE_OSD_OP_BATCH)) {
+      for (list<Message*>::iterator q = p->second.begin();
+	   q != p->second.end();
+	   ++q)
+	con->send_message(*q);
+    } else {
+      ldout(cct, 15) << __func__ << " " << p->second.size() << " ops to "
+		     << con->get_peer_addr() << dendl;
+      logger->inc(l_osdc_op_batch);
+      con->send_message(new MOSDOpBatch(p->second));
+    }
+  }
+  batch.clear();
+}
+
+/*
+ * Wait until the osd the op maps to has room in its window.  Only
+ * called from the submitting thread: ops resubmitted from the reply
+ * path go out regardless, or we could wait on ourselves.
+ */
+void Objecter::_wait_for_osd_budget(Op *op, OpBatch *batch)
+{
+  assert(rwlock.is_locked());
+
+  while (true) {
+    // don't touch op->target; _op_submit wants to see the change itself
+    op_target_t t = op->target;
+    _calc_target(&t);
+    if (t.osd < 0)
+      return;
+    map<int,OSDSession*>::iterator p = osd_sessions.find(t.osd);
+    if (p == osd_sessions.end())
+      return;
+    OSDSession *s = p->second;
+    if (!s->budget || s->budget->get_current() < s->budget->get_max())
+      return;
+
+    ldout(cct, 10) << __func__ << " osd." << s->osd << " has "
+		   << s->budget->get_current() << " of " << s->budget->get_max()
+		   << " in flight, waiting" << dendl;
+    if (batch)
+      _flush_op_batch(*batch);
+    s->get();
+    bool locked_for_write = rwlock.is_wlocked();
+    rwlock.unlock();
+    s->budget_waiters.inc();
+    s->budget->get(1);
+    s->budget->put(1);
+    s->budget_waiters.dec();
+    s->put();
+    rwlock.get(locked_for_write);
+  }
+}
+
+void Objecter::_osd_budget_update(OSDSession *s, double latency)
+{
+  assert(s->lock.is_wlocked());
+
+  if (s->avg_latency == 0)
+    s->avg_latency = latency;
+  if (s->budget) {
+    double max_window = cct->_conf->objecter_osd_inflight_ops;
+    double min_window = MIN((double)MAX(cct->_conf->objecter_osd_inflight_ops_min, 1),
+			    max_window);
+    if (s->update_window(latency, ceph_clock_now(cct), min_window, max_window,
+			 cct->_conf->objecter_osd_latency_factor))
+      ldout(cct, 10) << __func__ << " osd." << s->osd << " latency " << latency
+		     << " avg " << s->avg_latency << ", window now "
+		     << s->window << dendl;
+    s->budget->reset_max((int64_t)s->window);
+  }
+  s->avg_latency += (latency - s->avg_latency) / 32;
+}
+
+ceph_tid_t Objecter::_op_submit(Op *op, RWLock::Context& lc, OpBatch *batch)
 {
   assert(rwlock.is_locked());
 
@@ -1755,6 +1900,11 @@ ceph_tid_t Objecter::_op_submit(Op *op, RWLock::Context& lc)
 
   inflight_ops.inc();
 
+  if (!op->trace.valid()) {
+    op->trace.init_root(tracer, "objecter_op");
+    op->trace.tag("oid", op->target.base_oid.name);
+  }
+
   // add to gather set(s)
   if (op->onack) {
     num_unacked.inc();
@@ -1854,7 +2004,14 @@ ceph_tid_t Objecter::_op_submit(Op *op, RWLock::Context& lc)
   _session_op_assign(s, op);
 
   if (need_send) {
-    _send_op(op, m);
+    _send_op(op, m, batch);
+    if (_hedge_eligible(op)) {
+      double delay = MAX(cct->_conf->objecter_hedged_read_min_delay,
+			 cct->_conf->objecter_hedged_read_latency_factor *
+			 s->avg_latency);
+      op->onhedge = new C_HedgeRead(op->tid, this);
+      op_timer.add_event_after(delay, op->onhedge);
+    }
   }
 
   // Last chance to touch Op here, after giving up session lock it can be
@@ -2177,6 +2334,8 @@ void Objecter::_session_op_assign(OSDSession *to, Op *op)
   get_session(to);
   op->session = to;
   to->ops[op->tid] = op;
+  if (to->budget)
+    to->budget->take(1);
 
   if (to->is_homeless()) {
     num_homeless_ops.inc();
@@ -2195,6 +2354,8 @@ void Objecter::_session_op_remove(OSDSession *from, Op *op)
   }
 
   from->ops.erase(op->tid);
+  if (from->budget)
+    from->budget->put(1);
   put_session(from);
   op->session = NULL;
 
@@ -2350,10 +2511,12 @@ void Objecter::_finish_op(Op *op)
   if (!op->ctx_budgeted && op->budgeted)
     put_op_budget(op);
 
-  if (op->ontimeout) {
-    Mutex::Locker l(timer_lock);
-    timer.cancel_event(op->ontimeout);
-  }
+  if (op->ontimeout)
+    op_timer.cancel_event(op->ontimeout);
+  if (op->onhedge)
+    op_timer.cancel_event(op->onhedge);
+
+  op->trace.finish();
 
   _session_op_remove(op->session, op);
 
@@ -2409,6 +2572,7 @@ MOSDOp *Objecter::_prepare_osd_op(Op *op)
   m->ops = op->ops;
   m->set_mtime(op->mtime);
   m->set_retry_attempt(op->attempts++);
+  m->set_trace(op->trace.get_ctx());
 
   if (op->replay_version != eversion_t())
     m->set_version(op->replay_version);  // we're replaying this op!
@@ -2424,7 +2588,7 @@ MOSDOp *Objecter::_prepare_osd_op(Op *op)
   return m;
 }
 
-void Objecter::_send_op(Op *op, MOSDOp *m)
+void Objecter::_send_op(Op *op, MOSDOp *m, OpBatch *batch)
 {
   assert(rwlock.is_locked());
   assert(op->session->lock.is_locked());
@@ -2456,7 +2620,16 @@ void Objecter::_send_op(Op *op, MOSDOp *m)
 
   m->set_tid(op->tid);
 
-  op->session->con->send_message(m);
+  if (op->trace.valid()) {
+    stringstream ss;
+    ss << "sent to osd." << op->session->osd;
+    op->trace.event(ss.str());
+  }
+
+  if (batch)
+    (*batch)[con].push_back(m);
+  else
+    op->session->con->send_message(m);
 }
 
 int Objecter::calc_op_budget(Op *op)
@@ -2503,6 +2676,8 @@ void Objecter::unregister_op(Op *op)
 {
   op->session->lock.get_write();
   op->session->ops.erase(op->tid);
+  if (op->session->budget)
+    op->session->budget->put(1);
   op->session->lock.unlock();
   put_session(op->session);
   op->session = NULL;
@@ -2579,6 +2754,17 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
     // have, but that is better than doing callbacks out of order.
   }
 
+  if (op->hedge_of) {
+    // a replica answered our hedge; finish the read it stands in for
+    op = _hedge_reply(s, op, m);
+    if (!op) {
+      m->put();
+      return;
+    }
+    s = op->session;
+    tid = op->tid;
+  }
+
   Context *onack = 0;
   Context *oncommit = 0;
 
@@ -2668,6 +2854,7 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
     op->onack = 0;  // only do callback once
     num_unacked.dec();
     logger->inc(l_osdc_op_ack);
+    op->trace.event("ack");
   }
   if (op->oncommit && (m->is_ondisk() || rc)) {
     ldout(cct, 15) << "handle_osd_op_reply safe" << dendl;
@@ -2675,6 +2862,7 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
     op->oncommit = 0;
     num_uncommitted.dec();
     logger->inc(l_osdc_op_commit);
+    op->trace.event("commit");
   }
 
   // got data?
@@ -2689,8 +2877,11 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
   Mutex *completion_lock = (op->target.base_oid.name.size() ? s->get_lock(op->target.base_oid) : NULL);
 
   // done with this tid?
+  ceph_tid_t hedge_tid = 0;
   if (!op->onack && !op->oncommit) {
     ldout(cct, 15) << "handle_osd_op_reply completed tid " << tid << dendl;
+    _osd_budget_update(s, (double)(ceph_clock_now(cct) - op->stamp));
+    hedge_tid = op->hedge_tid;
     _finish_op(op);
   }
 
@@ -2713,10 +2904,203 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
     completion_lock->Unlock();
   }
 
+  // the other copy lost
+  if (hedge_tid)
+    op_cancel(hedge_tid, -ECANCELED);
+
   m->put();
   put_session(s);
 }
 
+/*
+ * Find a sent op by tid.  Returns it with its session write locked
+ * and referenced, or NULL.
+ */
+Objecter::Op *Objecter::_op_find(ceph_tid_t tid, OSDSession **ps)
+{
+  assert(rwlock.is_locked());
+
+  for (map<int, OSDSession *>::iterator siter = osd_sessions.begin();
+       siter != osd_sessions.end();
+       ++siter) {
+    OSDSession *s = siter->second;
+    s->lock.get_write();
+    map<ceph_tid_t, Op*>::iterator p = s->ops.find(tid);
+    if (p != s->ops.end()) {
+      get_session(s);
+      *ps = s;
+      return p->second;
+    }
+    s->lock.unlock();
+  }
+  return NULL;
+}
+
+/*
+ * Hedged reads.  A read that cannot race a write (a snapshot read, or
+ * one the caller already lets a replica answer) and that takes much
+ * longer than its osd usually does is sent again to the replica that
+ * has been answering fastest.  Whichever copy answers first completes
+ * the read and the other is cancelled.  The copy carries
+ * CEPH_OSD_FLAG_HEDGED_READ, so a replica that would have to wait for
+ * recovery answers -EAGAIN instead, and we just keep waiting for the
+ * primary.
+ */
+bool Objecter::_hedge_eligible(Op *op)
+{
+  assert(rwlock.is_locked());
+
+  if (!cct->_conf->objecter_hedged_reads ||
+      op->onhedge || op->hedge_tid || op->hedge_of)
+    return false;
+  const op_target_t& t = op->target;
+  if ((t.flags & (CEPH_OSD_FLAG_READ | CEPH_OSD_FLAG_WRITE |
+		  CEPH_OSD_FLAG_PGOP)) != CEPH_OSD_FLAG_READ)
+    return false;
+  if (op->snapid == CEPH_NOSNAP &&
+      !(t.flags & (CEPH_OSD_FLAG_BALANCE_READS |
+		   CEPH_OSD_FLAG_LOCALIZE_READS)))
+    return false;
+  if (t.acting.size() < 2)
+    return false;
+  // erasure coded shards cannot serve reads on their own
+  const pg_pool_t *pi = osdmap->get_pg_pool(t.target_oloc.pool);
+  return pi && pi->is_replicated();
+}
+
+int Objecter::_pick_hedge_osd(const op_target_t& t, int exclude)
+{
+  assert(rwlock.is_locked());
+
+  int best = -1;
+  double best_latency = 0;
+  for (vector<int>::const_iterator p = t.acting.begin();
+       p != t.acting.end();
+       ++p) {
+    if (*p == exclude || *p < 0 || !osdmap->is_up(*p))
+      continue;
+    // an osd we have not heard from yet is as good as any
+    double latency = 0;
+    map<int, OSDSession *>::iterator q = osd_sessions.find(*p);
+    if (q != osd_sessions.end()) {
+      q->second->lock.get_read();
+      latency = q->second->avg_latency;
+      q->second->lock.unlock();
+    }
+    if (best < 0 || latency < best_latency) {
+      best = *p;
+      best_latency = latency;
+    }
+  }
+  return best;
+}
+
+void Objecter::hedge_read(ceph_tid_t tid)
+{
+  RWLock::RLocker rl(rwlock);
+  RWLock::Context lc(rwlock, RWLock::Context::TakenForRead);
+  if (!initialized.read())
+    return;
+
+  OSDSession *s = NULL;
+  Op *op = _op_find(tid, &s);
+  if (!op)
+    return;
+  op->onhedge = NULL;
+  if (op->hedge_tid || op->target.paused) {
+    s->lock.unlock();
+    put_session(s);
+    return;
+  }
+
+  vector<OSDOp> ops(op->ops);
+  Op *hedge = new Op(op->target.base_oid, op->target.base_oloc, ops,
+		     op->target.flags, NULL, NULL, NULL);
+  hedge->target = op->target;
+  hedge->target.flags |= CEPH_OSD_FLAG_BALANCE_READS |
+    CEPH_OSD_FLAG_HEDGED_READ;
+  hedge->snapid = op->snapid;
+  hedge->snapc = op->snapc;
+  hedge->mtime = op->mtime;
+  hedge->priority = op->priority;
+  hedge->hedge_of = tid;
+  hedge->tid = last_tid.inc();
+  op->hedge_tid = hedge->tid;
+  int primary = s->osd;
+  s->lock.unlock();
+  put_session(s);
+
+  int osd = _pick_hedge_osd(hedge->target, primary);
+  if (osd < 0) {
+    ldout(cct, 10) << __func__ << " tid " << tid << " no replica to hedge to"
+		   << dendl;
+    hedge->put();
+    return;
+  }
+  // _calc_target keeps this unless the pg has changed meanwhile
+  hedge->target.osd = osd;
+  hedge->target.used_replica = true;
+
+  ldout(cct, 10) << __func__ << " tid " << tid << " slow on osd." << primary
+		 << ", hedging to osd." << osd << " as tid " << hedge->tid
+		 << dendl;
+  logger->inc(l_osdc_op_hedge);
+  if (osd_timeout > 0) {
+    hedge->ontimeout = new C_CancelOp(hedge->tid, this);
+    op_timer.add_event_after(osd_timeout, hedge->ontimeout);
+  }
+  _op_submit(hedge, lc);
+}
+
+/*
+ * Takes the hedge's session locked and drops it.  Returns the read the
+ * hedge stands in for, with its session write locked and referenced,
+ * if the reply is an answer and the read is still waiting for one.
+ */
+Objecter::Op *Objecter::_hedge_reply(OSDSession *s, Op *hedge,
+				     MOSDOpReply *m)
+{
+  assert(rwlock.is_locked());
+  assert(s->lock.is_wlocked());
+
+  ceph_tid_t hedge_tid = hedge->tid;
+  ceph_tid_t tid = hedge->hedge_of;
+  int rc = m->get_result();
+  bool answered = rc != -EAGAIN && !m->is_redirect_reply();
+  if (answered)
+    _osd_budget_update(s, (double)(ceph_clock_now(cct) - hedge->stamp));
+  _finish_op(hedge);
+  s->lock.unlock();
+  put_session(s);
+
+  if (!answered) {
+    ldout(cct, 10) << __func__ << " hedge " << hedge_tid << " for tid " << tid
+		   << " got " << rc << ", waiting for the primary" << dendl;
+    return NULL;
+  }
+
+  Op *op = _op_find(tid, &s);
+  if (!op)
+    return NULL;
+  if (op->hedge_tid != hedge_tid) {
+    s->lock.unlock();
+    put_session(s);
+    return NULL;
+  }
+  ldout(cct, 10) << __func__ << " hedge " << hedge_tid << " answered tid "
+		 << tid << " first" << dendl;
+  // the primary may still answer into the caller's buffer; see #9582
+  if (op->con) {
+    ldout(cct, 20) << " revoking rx buffer for " << tid << " on " << op->con
+		   << dendl;
+    op->con->revoke_rx_buffer(tid);
+    op->con = NULL;
+  }
+  op->hedge_tid = 0;
+  logger->inc(l_osdc_op_hedge_won);
+  return op;
+}
+
 
 uint32_t Objecter::list_nobjects_seek(NListContext *list_context,
 				     uint32_t pos)
@@ -3696,9 +4080,33 @@ void Objecter::dump_requests(Formatter *fmt)
   dump_pool_stat_ops(fmt);
   dump_statfs_ops(fmt);
   dump_command_ops(fmt);
+  dump_osd_budgets(fmt);
   fmt->close_section(); // requests object
 }
 
+void Objecter::dump_osd_budgets(Formatter *fmt)
+{
+  fmt->open_array_section("osd_budgets");
+  rwlock.get_read();
+  for (map<int, OSDSession *>::const_iterator siter = osd_sessions.begin(); siter != osd_sessions.end(); ++siter) {
+    OSDSession *s = siter->second;
+    if (!s->budget)
+      continue;
+    s->lock.get_read();
+    fmt->open_object_section("osd_budget");
+    fmt->dump_int("osd", s->osd);
+    fmt->dump_int("in_flight", s->budget->get_current());
+    fmt->dump_int("window", s->budget->get_max());
+    fmt->dump_float("avg_latency", s->avg_latency);
+    fmt->dump_unsigned("waiting", s->budget_waiters.read());
+    fmt->dump_bool("blocked", s->budget->get_current() >= s->budget->get_max());
+    fmt->close_section(); // osd_budget object
+    s->lock.unlock();
+  }
+  rwlock.unlock();
+  fmt->close_section(); // osd_budgets array
+}
+
 void Objecter::_dump_ops(const OSDSession *s, Formatter *fmt)
 {
   for (map<ceph_tid_t,Op*>::const_iterator p = s->ops.begin();
@@ -3985,9 +4393,8 @@ int Objecter::submit_command(CommandOp *c, ceph_tid_t *ptid)
   (void)_calc_command_target(c);
   _assign_command_session(c);
   if (osd_timeout > 0) {
-    Mutex::Locker l(timer_lock);
     c->ontimeout = new C_CancelCommandOp(c->session, tid, this);
-    timer.add_event_after(osd_timeout, c->ontimeout);
+    op_timer.add_event_after(osd_timeout, c->ontimeout);
   }
 
   if (!c->session->is_homeless()) {
@@ -4119,10 +4526,8 @@ void Objecter::_finish_command(CommandOp *c, int r, string rs)
   if (c->onfinish)
     c->onfinish->complete(r);
 
-  if (c->ontimeout) {
-    Mutex::Locker l(timer_lock);
-    timer.cancel_event(c->ontimeout);
-  }
+  if (c->ontimeout)
+    op_timer.cancel_event(c->ontimeout);
 
   OSDSession *s = c->session;
   s->lock.get_write();
@@ -4134,6 +4539,23 @@ void Objecter::_finish_command(CommandOp *c, int r, string rs)
   logger->dec(l_osdc_command_active);
 }
 
+bool Objecter::OSDSession::update_window(double latency, utime_t now,
+					 double min_window, double max_window,
+					 double latency_factor)
+{
+  if (latency > latency_factor * avg_latency) {
+    // at most once per round trip, or one bad burst empties the window
+    if ((double)(now - last_decrease) > avg_latency) {
+      window = MAX(min_window, window / 2);
+      last_decrease = now;
+      return true;
+    }
+  } else {
+    window = MIN(max_window, window + 1.0 / window);
+  }
+  return false;
+}
+
 Objecter::OSDSession::~OSDSession()
 {
   // Caller is responsible for re-assigning or
@@ -4146,6 +4568,7 @@ Objecter::OSDSession::~OSDSession()
     delete completion_locks[i];
   }
   delete[] completion_locks;
+  delete budget;
 }
 
 Objecter::~Objecter()
@@ -1034,8 +1034,10 @@ private:
   RWLock rwlock;
   Mutex timer_lock;
   SafeTimer timer;
+  ShardedTimer op_timer;  ///< per-op osd_timeout and hedged read events
 
   PerfCounters *logger;
+  Tracer *tracer;  ///< cached, so starting a span skips the singleton lock
   
   class C_Tick : public Context {
     Objecter *ob;
@@ -1147,6 +1149,14 @@ public:
     /// the very first OP of the series and released upon receiving the last OP reply.
     bool ctx_budgeted;
 
+    /// root span if this op was sampled for tracing
+    TraceSpan trace;
+
+    // hedged reads; see objecter_hedged_reads
+    Context *onhedge;      ///< timer event that sends our hedge
+    ceph_tid_t hedge_tid;  ///< our copy sent to a replica, if any
+    ceph_tid_t hedge_of;   ///< if we are a hedge, the read we stand in for
+
     Op(const object_t& o, const object_locator_t& ol, vector<OSDOp>& op,
        int f, Context *ac, Context *co, version_t *ov) :
       session(NULL), incarnation(0),
@@ -1161,7 +1171,10 @@ public:
       map_dne_bound(0),
       budgeted(false),
       should_resend(true),
-      ctx_budgeted(false) {
+      ctx_budgeted(false),
+      onhedge(NULL),
+      hedge_tid(0),
+      hedge_of(0) {
       ops.swap(op);
       
       /* initialize out_* to match op vector */
@@ -1539,12 +1552,28 @@ public:
     int num_locks;
     ConnectionRef con;
 
+    // per-osd in-flight limit, adjusted from reply latency: +1/window
+    // for a normal reply, halved for a slow one.  NULL if not enabled.
+    Throttle *budget;         ///< ops assigned to us, max is the window
+    double window;
+    double avg_latency;       ///< slow moving average, in seconds; kept
+                              ///< even without a budget, for hedged reads
+    utime_t last_decrease;
+    atomic_t budget_waiters;  ///< submitters waiting for room
+
     OSDSession(CephContext *cct, int o) :
       lock("OSDSession"),
       osd(o),
       incarnation(0),
-      con(NULL)
+      con(NULL),
+      budget(NULL),
+      window(0),
+      avg_latency(0)
     {
+      if (o >= 0 && cct->_conf->objecter_osd_inflight_ops > 0) {
+	window = cct->_conf->objecter_osd_inflight_ops;
+	budget = new Throttle(cct, "objecter_osd_ops", window, false);
+      }
       num_locks = cct->_conf->objecter_completion_locks_per_session;
       completion_locks = new Mutex *[num_locks];
       for (int i = 0; i < num_locks; i++) {
@@ -1556,6 +1585,14 @@ public:
 
     bool is_homeless() { return (osd == -1); }
 
+    /**
+     * one AIMD step of the window for an op that took latency
+     *
+     * @return true if the window was halved
+     */
+    bool update_window(double latency, utime_t now, double min_window,
+		       double max_window, double latency_factor);
+
     Mutex *get_lock(object_t& oid);
   };
   map<int,OSDSession*> osd_sessions;
@@ -1581,8 +1618,12 @@ public:
 
   double mon_timeout, osd_timeout;
 
+  /// messages held back by op_submit_batch(), per connection
+  typedef map<ConnectionRef, list<Message*> > OpBatch;
+
   MOSDOp *_prepare_osd_op(Op *op);
-  void _send_op(Op *op, MOSDOp *m = NULL);
+  void _send_op(Op *op, MOSDOp *m = NULL, OpBatch *batch = NULL);
+  void _flush_op_batch(OpBatch& batch);
   void _cancel_linger_op(Op *op);
   void finish_op(OSDSession *session, ceph_tid_t tid);
   void _finish_op(Op *op);
@@ -1619,7 +1660,7 @@ public:
   int _recalc_linger_op_target(LingerOp *op, RWLock::Context& lc);
 
   void _linger_submit(LingerOp *info);
-  void _send_linger(LingerOp *info);
+  void _send_linger(LingerOp *info, OpBatch *batch = NULL);
   void _linger_ack(LingerOp *info, int r);
   void _linger_commit(LingerOp *info, int r);
 
@@ -1658,6 +1699,32 @@ public:
    */
   int calc_op_budget(Op *op);
   void _throttle_op(Op *op, int op_size=0);
+  /// take the budget for op if that does not mean waiting
+  bool _try_take_op_budget(Op *op) {
+    int op_budget = calc_op_budget(op);
+    if (keep_balanced_budget) {
+      if (!op_throttle_bytes.get_or_fail(op_budget))
+	return false;
+      if (!op_throttle_ops.get_or_fail(1)) {
+	op_throttle_bytes.put(op_budget);
+	return false;
+      }
+    } else {
+      op_throttle_bytes.take(op_budget);
+      op_throttle_ops.take(1);
+    }
+    op->budgeted = true;
+    return true;
+  }
+  void _wait_for_osd_budget(Op *op, OpBatch *batch = NULL);
+  void _osd_budget_update(OSDSession *s, double latency);
+
+  Op *_op_find(ceph_tid_t tid, OSDSession **ps);
+  bool _hedge_eligible(Op *op);
+  int _pick_hedge_osd(const op_target_t& t, int exclude);
+  Op *_hedge_reply(OSDSession *s, Op *hedge, class MOSDOpReply *m);
+  void hedge_read(ceph_tid_t tid);
+  friend class C_HedgeRead;
   int _take_op_budget(Op *op) {
     assert(rwlock.is_locked());
     int op_budget = calc_op_budget(op);
@@ -1702,7 +1769,8 @@ public:
     rwlock("Objecter::rwlock"),
     timer_lock("Objecter::timer_lock"),
     timer(cct, timer_lock, false),
-    logger(NULL), tick_event(NULL),
+    op_timer(cct, cct->_conf->objecter_timeout_shards, "Objecter::op_timer_lock"),
+    logger(NULL), tracer(Tracer::get(cct_)), tick_event(NULL),
     m_request_state_hook(NULL),
     num_homeless_ops(0),
     homeless_session(new OSDSession(cct, -1)),
@@ -1777,13 +1845,22 @@ private:
   bool _promote_lock_check_race(RWLock::Context& lc);
 
   // low-level
-  ceph_tid_t _op_submit(Op *op, RWLock::Context& lc);
+  ceph_tid_t _op_submit(Op *op, RWLock::Context& lc, OpBatch *batch = NULL);
   ceph_tid_t _op_submit_with_budget(Op *op, RWLock::Context& lc, int *ctx_budget = NULL);
   inline void unregister_op(Op *op);
 
   // public interface
 public:
   ceph_tid_t op_submit(Op *op, int *ctx_budget = NULL);
+  /**
+   * Submit several ops at once.  Ops that map to the same OSD go out
+   * in one MOSDOpBatch if it supports that; each still completes on its
+   * own, as if it had been submitted with op_submit().
+   *
+   * @param ops the ops to submit, in order
+   * @param tids where to put the tid of each op, if not NULL
+   */
+  void op_submit_batch(vector<Op*>& ops, vector<ceph_tid_t> *tids = NULL);
   bool is_active() {
     return !((!inflight_ops.read()) && linger_ops.empty() && poolstat_ops.empty() && statfs_ops.empty());
   }
@@ -1795,6 +1872,7 @@ public:
   void _dump_active();
   void dump_active();
   void dump_requests(Formatter *fmt);
+  void dump_osd_budgets(Formatter *fmt);
   void _dump_ops(const OSDSession *s, Formatter *fmt);
   void dump_ops(Formatter *fmt);
   void _dump_linger_ops(const OSDSession *s, Formatter *fmt);
@@ -1004,37 +1004,43 @@ struct ExportContext {
   int fd;
   uint64_t totalsize;
   MyProgressContext pc;
+  OrderedThrottle throttle;
 
-  ExportContext(librbd::Image *i, int f, uint64_t t) :
+  ExportContext(librbd::Image *i, int f, uint64_t t, int max_ops) :
     image(i),
     fd(f),
     totalsize(t),
-    pc("Exporting image")
+    pc("Exporting image"),
+    throttle(max_ops, false)
   {}
 };
 
-class AioExportContext : public Context
+/**
+ * Reads one chunk of the image.  Up to rbd_concurrent_management_ops
+ * reads are in flight; the throttle hands them back in order, so the
+ * output is written sequentially even when it is a pipe.
+ */
+class C_Export : public Context
 {
 public:
-  AioExportContext(SimpleThrottle &simple_throttle, librbd::Image &image,
-                   uint64_t offset, uint64_t length, int fd)
-    : m_aio_completion(
-        new librbd::RBD::AioCompletion(this, &AioExportContext::aio_callback)),
-      m_throttle(simple_throttle),
-      m_offset(offset),
-      m_fd(fd)
+  C_Export(OrderedThrottle &ordered_throttle, librbd::Image &image,
+           uint64_t offset, uint64_t length, int fd)
+    : m_throttle(ordered_throttle), m_image(image), m_offset(offset),
+      m_length(length), m_fd(fd)
   {
-    m_throttle.start_op();
-    int r = image.aio_read(offset, length, m_bufferlist, m_aio_completion);
-    if (r < 0) {
-      cerr << "rbd: error requesting read from source image" << std::endl;
-      m_throttle.end_op(r);
-    }
   }
 
-  virtual ~AioExportContext()
+  void send()
   {
-    m_aio_completion->release();
+    C_OrderedThrottle *ctx = m_throttle.start_op(this);
+    librbd::RBD::AioCompletion *aio_completion =
+      new librbd::RBD::AioCompletion(ctx, &C_Export::aio_callback);
+    int r = m_image.aio_read(m_offset, m_length, m_bufferlist, aio_completion);
+    if (r < 0) {
+      cerr << "rbd: error requesting read from source image" << std::endl;
+      aio_completion->release();
+      ctx->complete(r);
+    }
   }
 
   virtual void finish(int r)
@@ -1052,6 +1058,7 @@ public:
 
     assert(m_bufferlist.length() == static_cast<size_t>(r));
     if (m_fd != STDOUT_FILENO) {
+      // leave a hole; the file is truncated to the image size at the end
       if (m_bufferlist.is_zero()) {
         return;
       }
@@ -1076,15 +1083,17 @@ public:
   {
     librbd::RBD::AioCompletion *aio_completion =
       reinterpret_cast<librbd::RBD::AioCompletion*>(completion);
-    AioExportContext *export_context = reinterpret_cast<AioExportContext*>(arg);
-    export_context->complete(aio_completion->get_return_value());
+    Context *ctx = reinterpret_cast<Context *>(arg);
+    ctx->complete(aio_completion->get_return_value());
+    aio_completion->release();
   }
 
 private:
-  librbd::RBD::AioCompletion *m_aio_completion;
-  SimpleThrottle &m_throttle;
+  OrderedThrottle &m_throttle;
+  librbd::Image &m_image;
   bufferlist m_bufferlist;
   uint64_t m_offset;
+  uint64_t m_length;
   int m_fd;
 };
 
@@ -1096,13 +1105,11 @@ static int do_export(librbd::Image& image, const char *path)
     return r;
 
   int fd;
-  int max_concurrent_ops;
+  int max_concurrent_ops = max(g_conf->rbd_concurrent_management_ops, 1);
   bool to_stdout = (strcmp(path, "-") == 0);
   if (to_stdout) {
     fd = STDOUT_FILENO;
-    max_concurrent_ops = 1;
   } else {
-    max_concurrent_ops = max(g_conf->rbd_concurrent_management_ops, 1);
     fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
     if (fd < 0) {
       return -errno;
@@ -1111,11 +1118,17 @@ static int do_export(librbd::Image& image, const char *path)
 
   MyProgressContext pc("Exporting image");
 
-  SimpleThrottle throttle(max_concurrent_ops, false);
+  OrderedThrottle throttle(max_concurrent_ops, false);
   uint64_t period = image.get_stripe_count() * (1ull << info.order);
   for (uint64_t offset = 0; offset < info.size; offset += period) {
+    if (throttle.pending_error()) {
+      break;
+    }
+
     uint64_t length = min(period, info.size - offset);
-    new AioExportContext(throttle, image, offset, length, fd);
+    C_Export *ctx = new C_Export(throttle, image, offset, length, fd);
+    ctx->send();
+
     pc.update_progress(offset, info.size);
   }
 
@@ -1135,35 +1148,84 @@ static int do_export(librbd::Image& image, const char *path)
   return r;
 }
 
-static int export_diff_cb(uint64_t ofs, size_t _len, int exists, void *arg)
+/**
+ * One extent of an export-diff.  Extents that exist are read with
+ * the same window as export; the records are written in the order
+ * diff_iterate reported them.
+ */
+class C_ExportDiff : public Context
 {
-  ExportContext *ec = static_cast<ExportContext *>(arg);
-  int r;
+public:
+  C_ExportDiff(ExportContext *export_context, uint64_t offset,
+               uint64_t length, bool exists)
+    : m_export_context(export_context), m_offset(offset), m_length(length),
+      m_exists(exists)
+  {
+  }
 
-  // extent
-  bufferlist bl;
-  __u8 tag = exists ? 'w' : 'z';
-  ::encode(tag, bl);
-  ::encode(ofs, bl);
-  uint64_t len = _len;
-  ::encode(len, bl);
-  r = bl.write_fd(ec->fd);
-  if (r < 0)
-    return r;
+  void send()
+  {
+    C_OrderedThrottle *ctx = m_export_context->throttle.start_op(this);
+    if (!m_exists) {
+      ctx->complete(0);
+      return;
+    }
 
-  if (exists) {
-    // read block
-    bl.clear();
-    r = ec->image->read(ofs, len, bl);
-    if (r < 0)
-      return r;
-    r = bl.write_fd(ec->fd);
-    if (r < 0)
-      return r;
+    librbd::RBD::AioCompletion *aio_completion =
+      new librbd::RBD::AioCompletion(ctx, &C_Export::aio_callback);
+    int r = m_export_context->image->aio_read(m_offset, m_length,
+                                              m_read_data, aio_completion);
+    if (r < 0) {
+      aio_completion->release();
+      ctx->complete(r);
+    }
+  }
+
+  virtual void finish(int r)
+  {
+    if (r >= 0) {
+      r = send_extent();
+    }
+
+    if (r < 0) {
+      cerr << "rbd: error exporting extent " << m_offset << "~" << m_length
+           << ": " << cpp_strerror(r) << std::endl;
+    }
+    m_export_context->pc.update_progress(m_offset,
+                                         m_export_context->totalsize);
+    m_export_context->throttle.end_op(r);
   }
 
-  ec->pc.update_progress(ofs, ec->totalsize);
+private:
+  ExportContext *m_export_context;
+  uint64_t m_offset;
+  uint64_t m_length;
+  bool m_exists;
+  bufferlist m_read_data;
+
+  int send_extent()
+  {
+    bufferlist bl;
+    __u8 tag = m_exists ? 'w' : 'z';
+    ::encode(tag, bl);
+    ::encode(m_offset, bl);
+    ::encode(m_length, bl);
+    if (m_exists) {
+      bl.claim_append(m_read_data);
+    }
+    return bl.write_fd(m_export_context->fd);
+  }
+};
+
+static int export_diff_cb(uint64_t ofs, size_t _len, int exists, void *arg)
+{
+  ExportContext *ec = static_cast<ExportContext *>(arg);
+  if (ec->throttle.pending_error()) {
+    return -EIO;
+  }
 
+  C_ExportDiff *context = new C_ExportDiff(ec, ofs, _len, exists);
+  context->send();
   return 0;
 }
 
@@ -1218,8 +1280,12 @@ static int do_export_diff(librbd::Image& image, const char *fromsnapname,
     }
   }
 
-  ExportContext ec(&image, fd, info.size);
+  ExportContext ec(&image, fd, info.size,
+		   max(g_conf->rbd_concurrent_management_ops, 1));
   r = image.diff_iterate(fromsnapname, 0, info.size, export_diff_cb, (void *)&ec);
+  int ret = ec.throttle.wait_for_ret();
+  if (r >= 0)
+    r = ret;
   if (r < 0)
     goto out;
 
@@ -1422,15 +1488,13 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
   size_t blklen = 0;		// amount accumulated from reads to fill blk
   librbd::Image image;
 
-  boost::scoped_ptr<SimpleThrottle> throttle;
+  boost::scoped_ptr<SimpleThrottle> throttle(new SimpleThrottle(
+    max(g_conf->rbd_concurrent_management_ops, 1), false));
   bool from_stdin = !strcmp(path, "-");
   if (from_stdin) {
-    throttle.reset(new SimpleThrottle(1, false));
     fd = 0;
     size = 1ULL << *order;
   } else {
-    throttle.reset(new SimpleThrottle(
-      max(g_conf->rbd_concurrent_management_ops, 1), false));
     if ((fd = open(path, O_RDONLY)) < 0) {
       r = -errno;
       cerr << "rbd: error opening " << path << std::endl;
@@ -1491,6 +1555,7 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
       r = image.resize(size);
       if (r < 0) {
 	cerr << "rbd: can't resize image during import" << std::endl;
+	throttle->wait_for_ret();
 	goto done;
       }
     }
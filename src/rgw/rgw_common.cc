@@ -137,6 +137,7 @@ req_state::req_state(CephContext *_cct, class RGWEnv *e) : cct(_cct), cio(NULL),
   content_started = false;
   format = 0;
   formatter = NULL;
+  formatter_sink = NULL;
   bucket_acl = NULL;
   object_acl = NULL;
   expect_cont = false;
@@ -166,6 +167,7 @@ req_state::req_state(CephContext *_cct, class RGWEnv *e) : cct(_cct), cio(NULL),
 
 req_state::~req_state() {
   delete formatter;
+  delete formatter_sink;
   delete bucket_acl;
   delete object_acl;
   free((void *)object);
@@ -862,6 +862,7 @@ struct req_state {
    bool content_started;
    int format;
    ceph::Formatter *formatter;
+   ceph::Formatter::Sink *formatter_sink; /* streams the body once headers are out */
    string decoded_uri;
    string relative_uri;
    const char *length;
@@ -178,6 +178,27 @@ static void dump_status(struct req_state *s, const char *status, const char *sta
   }
 }
 
+/*
+ * Once the headers are out, the formatter hands its output straight to
+ * the client as it goes, so a big listing is neither held in memory nor
+ * sent only at the end.
+ */
+class RGWClientIOSink : public Formatter::Sink {
+  struct req_state *s;
+public:
+  RGWClientIOSink(struct req_state *_s) : s(_s) {}
+  void write(bufferlist &bl) {
+    for (bufferlist::buffers_t::const_iterator p = bl.buffers().begin();
+	 p != bl.buffers().end(); ++p) {
+      int r = s->cio->write(p->c_str(), p->length());
+      if (r < 0) {
+	ldout(s->cct, 0) << "ERROR: s->cio->write() returned err=" << r << dendl;
+	break;
+      }
+    }
+  }
+};
+
 void rgw_flush_formatter_and_reset(struct req_state *s, Formatter *formatter)
 {
   std::ostringstream oss;
@@ -459,6 +480,11 @@ void end_header(struct req_state *s, RGWOp *op, const char *content_type)
 
   s->cio->set_account(true);
   rgw_flush_formatter_and_reset(s, s->formatter);
+
+  if (s->op != OP_HEAD && !s->formatter_sink) {
+    s->formatter_sink = new RGWClientIOSink(s);
+    s->formatter->set_sink(s->formatter_sink);
+  }
 }
 
 void abort_early(struct req_state *s, RGWOp *op, int err_no)
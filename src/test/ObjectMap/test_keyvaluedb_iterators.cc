@@ -10,6 +10,7 @@
 * License version 2.1, as published by the Free Software
 * Foundation. See file COPYING.
 */
+#include "acconfig.h"
 #include "include/memory.h"
 #include <map>
 #include <set>
@@ -382,6 +383,43 @@ public:
     ASSERT_FALSE(iter->valid());
   }
 
+  /**
+   * Test the transaction's rm_range_keys behavior: only keys of the given
+   * prefix within [start, end) go away.
+   */
+  void RmRangeKeys(KeyValueDB *store) {
+    KeyValueDB::Transaction tx = store->get_transaction();
+    tx->rm_range_keys(prefix2, "22", "23");
+    tx->rm_range_keys(prefix3, "3", "32");
+    store->submit_transaction_sync(tx);
+
+    deque<string> key_deque;
+    KeyValueDB::WholeSpaceIterator iter = store->get_iterator();
+    iter->seek_to_first();
+
+    key_deque.push_back("11");
+    key_deque.push_back("12");
+    key_deque.push_back("13");
+    validate_prefix(iter, prefix1, key_deque);
+    ASSERT_FALSE(HasFatalFailure());
+
+    ASSERT_TRUE(iter->valid());
+    key_deque.clear();
+    key_deque.push_back("21");
+    key_deque.push_back("23");
+    validate_prefix(iter, prefix2, key_deque);
+    ASSERT_FALSE(HasFatalFailure());
+
+    ASSERT_TRUE(iter->valid());
+    key_deque.clear();
+    key_deque.push_back("32");
+    key_deque.push_back("33");
+    validate_prefix(iter, prefix3, key_deque);
+    ASSERT_FALSE(HasFatalFailure());
+
+    ASSERT_FALSE(iter->valid());
+  }
+
   /**
    * Test how the leveldb's whole-space iterator behaves when we remove
    * keys from the store while iterating over them.
@@ -471,6 +509,20 @@ TEST_F(RmKeysTest, RmKeysByPrefixMockDB)
   ASSERT_FALSE(HasFatalFailure());
 }
 
+TEST_F(RmKeysTest, RmRangeKeysLevelDB)
+{
+  SCOPED_TRACE("LevelDB");
+  RmRangeKeys(db.get());
+  ASSERT_FALSE(HasFatalFailure());
+}
+
+TEST_F(RmKeysTest, RmRangeKeysMockDB)
+{
+  SCOPED_TRACE("Mock DB");
+  RmRangeKeys(mock.get());
+  ASSERT_FALSE(HasFatalFailure());
+}
+
 /**
  * If you refer to function RmKeysTest::RmKeysWhileIteratingSnapshot(),
  * you will notice that we seek the iterator to the first key, and then
@@ -523,6 +575,240 @@ TEST_F(RmKeysTest, RmKeysWhileIteratingSnapshotMockDB)
   ASSERT_FALSE(HasFatalFailure());
 }
 
+#ifdef HAVE_LIBROCKSDB
+// ------- Column Families -------
+/**
+ * Same key layout as RmKeysTest, but on a rocksdb store with prefix1 and
+ * prefix3 in column families of their own and prefix2 left in the default
+ * one, so each whole-space walk has to merge three underlying iterators.
+ */
+class ColumnFamilyTest : public RmKeysTest
+{
+public:
+  boost::scoped_ptr<KeyValueDB> cfdb;
+
+  virtual void SetUp() {
+    RmKeysTest::SetUp();
+
+    KeyValueDB *db_ptr =
+      KeyValueDB::create(g_ceph_context, "rocksdb", store_path + "-cf");
+    assert(db_ptr);
+    assert(!db_ptr->init());
+    assert(!db_ptr->add_column_family(prefix1,
+				      KeyValueDB::ColumnFamily("cf1", "")));
+    assert(!db_ptr->add_column_family(prefix3,
+				      KeyValueDB::ColumnFamily("cf3", "")));
+    assert(!db_ptr->create_and_open(std::cerr));
+    cfdb.reset(db_ptr);
+
+    clear(cfdb.get());
+    ASSERT_TRUE(validate_db_clear(cfdb.get()));
+    init(cfdb.get());
+  }
+
+  virtual void TearDown() {
+    cfdb.reset();
+    RmKeysTest::TearDown();
+  }
+
+  void BackwardIteration(KeyValueDB::WholeSpaceIterator iter) {
+    deque<string> key_deque;
+    iter->seek_to_last();
+
+    key_deque.push_back("33");
+    key_deque.push_back("32");
+    key_deque.push_back("31");
+    validate_prefix_backwards(iter, prefix3, key_deque);
+    ASSERT_FALSE(HasFatalFailure());
+
+    key_deque.push_back("23");
+    key_deque.push_back("22");
+    key_deque.push_back("21");
+    validate_prefix_backwards(iter, prefix2, key_deque);
+    ASSERT_FALSE(HasFatalFailure());
+
+    key_deque.push_back("13");
+    key_deque.push_back("12");
+    key_deque.push_back("11");
+    validate_prefix_backwards(iter, prefix1, key_deque);
+    ASSERT_FALSE(HasFatalFailure());
+
+    ASSERT_FALSE(iter->valid());
+  }
+
+  /**
+   * Bounds and seeks that land in one column family and have to step into
+   * the next one.
+   */
+  void Bounds(KeyValueDB::WholeSpaceIterator iter) {
+    iter->lower_bound(prefix1, "13");
+    ASSERT_TRUE(validate_iterator(iter, prefix1, "13", _gen_val_str("13")));
+    iter->next();
+    ASSERT_TRUE(validate_iterator(iter, prefix2, "21", _gen_val_str("21")));
+
+    iter->upper_bound(prefix2, "23");
+    ASSERT_TRUE(validate_iterator(iter, prefix3, "31", _gen_val_str("31")));
+    iter->prev();
+    ASSERT_TRUE(validate_iterator(iter, prefix2, "23", _gen_val_str("23")));
+
+    iter->lower_bound(prefix2, "");
+    ASSERT_TRUE(validate_iterator(iter, prefix2, "21", _gen_val_str("21")));
+    iter->prev();
+    ASSERT_TRUE(validate_iterator(iter, prefix1, "13", _gen_val_str("13")));
+
+    iter->seek_to_first(prefix3);
+    ASSERT_TRUE(validate_iterator(iter, prefix3, "31", _gen_val_str("31")));
+    iter->seek_to_last(prefix1);
+    ASSERT_TRUE(validate_iterator(iter, prefix1, "13", _gen_val_str("13")));
+
+    iter->upper_bound(prefix3, "33");
+    ASSERT_FALSE(iter->valid());
+  }
+
+  /// Prefix iterators only walk the column family their prefix lives in
+  void PrefixIteration(KeyValueDB *store, const string &prefix,
+		       const string &first) {
+    KeyValueDB::Iterator iter = store->get_iterator(prefix);
+    iter->seek_to_first();
+    for (int i = 1; i <= 3; ++i) {
+      ostringstream ss;
+      ss << first << i;
+      ASSERT_TRUE(iter->valid());
+      ASSERT_EQ(ss.str(), iter->key());
+      ASSERT_EQ(_gen_val_str(ss.str()), _bl_to_str(iter->value()));
+      iter->next();
+    }
+    ASSERT_FALSE(iter->valid());
+  }
+
+  /**
+   * One transaction touching every column family: each op has to be routed
+   * by its prefix and the whole batch still commits as one.
+   */
+  void Transaction(KeyValueDB *store) {
+    KeyValueDB::Transaction tx = store->get_transaction();
+    tx->rmkey(prefix1, "11");
+    tx->set(prefix1, "14", _gen_val("14"));
+    tx->rm_range_keys(prefix2, "21", "23");
+    tx->rmkeys_by_prefix(prefix3);
+    tx->set(prefix3, "34", _gen_val("34"));
+    store->submit_transaction_sync(tx);
+
+    set<string> keys;
+    keys.insert("11");
+    keys.insert("14");
+    map<string, bufferlist> got;
+    ASSERT_EQ(0, store->get(prefix1, keys, &got));
+    ASSERT_EQ(1u, got.size());
+    ASSERT_EQ(_gen_val_str("14"), _bl_to_str(got["14"]));
+
+    deque<string> key_deque;
+    KeyValueDB::WholeSpaceIterator iter = store->get_iterator();
+    iter->seek_to_first();
+
+    key_deque.push_back("12");
+    key_deque.push_back("13");
+    key_deque.push_back("14");
+    validate_prefix(iter, prefix1, key_deque);
+    ASSERT_FALSE(HasFatalFailure());
+
+    key_deque.push_back("23");
+    validate_prefix(iter, prefix2, key_deque);
+    ASSERT_FALSE(HasFatalFailure());
+
+    key_deque.push_back("34");
+    validate_prefix(iter, prefix3, key_deque);
+    ASSERT_FALSE(HasFatalFailure());
+
+    ASSERT_FALSE(iter->valid());
+  }
+};
+
+TEST_F(ColumnFamilyTest, ForwardIterationRocksDB)
+{
+  SCOPED_TRACE("RocksDB -- column families, WholeSpaceIterator");
+  deque<string> key_deque;
+  KeyValueDB::WholeSpaceIterator iter = cfdb->get_iterator();
+  iter->seek_to_first();
+  key_deque.push_back("11");
+  key_deque.push_back("12");
+  key_deque.push_back("13");
+  validate_prefix(iter, prefix1, key_deque);
+  ASSERT_FALSE(HasFatalFailure());
+  key_deque.push_back("21");
+  key_deque.push_back("22");
+  key_deque.push_back("23");
+  validate_prefix(iter, prefix2, key_deque);
+  ASSERT_FALSE(HasFatalFailure());
+  key_deque.push_back("31");
+  key_deque.push_back("32");
+  key_deque.push_back("33");
+  validate_prefix(iter, prefix3, key_deque);
+  ASSERT_FALSE(HasFatalFailure());
+  ASSERT_FALSE(iter->valid());
+}
+
+TEST_F(ColumnFamilyTest, BackwardIterationRocksDB)
+{
+  SCOPED_TRACE("RocksDB -- column families, WholeSpaceIterator");
+  BackwardIteration(cfdb->get_iterator());
+  ASSERT_FALSE(HasFatalFailure());
+}
+
+TEST_F(ColumnFamilyTest, BackwardIterationSnapshotRocksDB)
+{
+  SCOPED_TRACE("RocksDB -- column families, WholeSpaceSnapshotIterator");
+  BackwardIteration(cfdb->get_snapshot_iterator());
+  ASSERT_FALSE(HasFatalFailure());
+}
+
+TEST_F(ColumnFamilyTest, BoundsRocksDB)
+{
+  SCOPED_TRACE("RocksDB -- column families, WholeSpaceIterator");
+  Bounds(cfdb->get_iterator());
+  ASSERT_FALSE(HasFatalFailure());
+}
+
+TEST_F(ColumnFamilyTest, PrefixIterationRocksDB)
+{
+  SCOPED_TRACE("RocksDB -- column families, Iterator");
+  PrefixIteration(cfdb.get(), prefix1, "1");
+  ASSERT_FALSE(HasFatalFailure());
+  PrefixIteration(cfdb.get(), prefix2, "2");
+  ASSERT_FALSE(HasFatalFailure());
+  PrefixIteration(cfdb.get(), prefix3, "3");
+  ASSERT_FALSE(HasFatalFailure());
+}
+
+TEST_F(ColumnFamilyTest, TransactionRocksDB)
+{
+  SCOPED_TRACE("RocksDB -- column families");
+  Transaction(cfdb.get());
+  ASSERT_FALSE(HasFatalFailure());
+}
+
+TEST_F(ColumnFamilyTest, RmKeysByPrefixRocksDB)
+{
+  SCOPED_TRACE("RocksDB -- column families");
+  RmKeysByPrefix(cfdb.get());
+  ASSERT_FALSE(HasFatalFailure());
+}
+
+TEST_F(ColumnFamilyTest, RmRangeKeysRocksDB)
+{
+  SCOPED_TRACE("RocksDB -- column families");
+  RmRangeKeys(cfdb.get());
+  ASSERT_FALSE(HasFatalFailure());
+}
+
+TEST_F(ColumnFamilyTest, RmKeysWhileIteratingSnapshotRocksDB)
+{
+  SCOPED_TRACE("RocksDB -- column families, WholeSpaceSnapshotIterator");
+  RmKeysWhileIteratingSnapshot(cfdb.get(), cfdb->get_snapshot_iterator());
+  ASSERT_FALSE(HasFatalFailure());
+}
+#endif
+
 // ------- Set Keys / Update Values -------
 class SetKeysTest : public IteratorTest
 {
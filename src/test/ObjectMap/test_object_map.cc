@@ -745,6 +745,60 @@ TEST_F(ObjectMapTest, OddEvenClone) {
   db->clear(hoid2);
 }
 
+TEST_F(ObjectMapTest, RmKeyRange) {
+  ghobject_t hoid(hobject_t(sobject_t("foo", CEPH_NOSNAP)));
+  ghobject_t hoid2(hobject_t(sobject_t("foo2", CEPH_NOSNAP)));
+
+  for (unsigned i = 0; i < 100; ++i) {
+    tester.set_key(hoid, "foo" + num_str(i), "bar" + num_str(i));
+  }
+
+  // no parent: the range goes away in a single range delete
+  ASSERT_EQ(0, db->rm_key_range(hoid, "foo" + num_str(10),
+				"foo" + num_str(20)));
+  for (unsigned i = 0; i < 100; ++i) {
+    string result;
+    int r = tester.get_key(hoid, "foo" + num_str(i), &result);
+    if (i >= 10 && i < 20) {
+      ASSERT_EQ(0, r);
+    } else {
+      ASSERT_EQ(1, r);
+      ASSERT_EQ("bar" + num_str(i), result);
+    }
+  }
+
+  // with a parent: keys coming from it must be hidden, not lost for the clone
+  db->clone(hoid, hoid2);
+  ASSERT_EQ(0, db->rm_key_range(hoid, "foo" + num_str(30),
+				"foo" + num_str(40)));
+  ASSERT_EQ(0, db->rm_key_range(hoid2, "foo" + num_str(35),
+				"foo" + num_str(50)));
+  for (unsigned i = 0; i < 100; ++i) {
+    string result;
+    string result2;
+    int r = tester.get_key(hoid, "foo" + num_str(i), &result);
+    int r2 = tester.get_key(hoid2, "foo" + num_str(i), &result2);
+    if ((i >= 10 && i < 20) || (i >= 30 && i < 40)) {
+      ASSERT_EQ(0, r);
+    } else {
+      ASSERT_EQ(1, r);
+      ASSERT_EQ("bar" + num_str(i), result);
+    }
+    if ((i >= 10 && i < 20) || (i >= 35 && i < 50)) {
+      ASSERT_EQ(0, r2);
+    } else {
+      ASSERT_EQ(1, r2);
+      ASSERT_EQ("bar" + num_str(i), result2);
+    }
+  }
+
+  ghobject_t missing(hobject_t(sobject_t("missing", CEPH_NOSNAP)));
+  ASSERT_EQ(-ENOENT, db->rm_key_range(missing, "a", "z"));
+
+  db->clear(hoid);
+  db->clear(hoid2);
+}
+
 TEST_F(ObjectMapTest, RandomTest) {
   tester.def_init();
   for (unsigned i = 0; i < 5000; ++i) {
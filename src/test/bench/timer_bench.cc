@@ -0,0 +1,197 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Measure the cost of scheduling and cancelling timer events, the
+ * pattern of per-op timeouts: every event is cancelled before it fires.
+ *
+ *  - the bare TimingWheel against the multimap + lookup map SafeTimer
+ *    used to keep;
+ *  - one SafeTimer shared by all threads against a ShardedTimer.
+ */
+
+#include <boost/program_options/option.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <stdlib.h>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "common/ceph_argparse.h"
+#include "common/Clock.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
+#include "common/Timer.h"
+#include "common/TimingWheel.h"
+#include "global/global_init.h"
+#include "include/Context.h"
+
+namespace po = boost::program_options;
+using namespace std;
+
+class C_Nop : public Context {
+  void finish(int r) {}
+};
+
+static void report(const char *what, uint64_t ops, utime_t start)
+{
+  double secs = (double)(ceph_clock_now(g_ceph_context) - start);
+  cout << what << ": " << ops << " add+cancel in " << secs << "s, "
+       << (uint64_t)(ops / secs) << "/s" << std::endl;
+}
+
+// keep `depth` events outstanding, replacing the oldest each round
+static void bench_structures(uint64_t ops, unsigned depth)
+{
+  vector<Context*> ctx(depth);
+  for (unsigned i = 0; i < depth; ++i)
+    ctx[i] = new C_Nop;
+  utime_t now = ceph_clock_now(g_ceph_context);
+
+  {
+    typedef multimap<utime_t, Context*> schedule_t;
+    schedule_t schedule;
+    map<Context*, schedule_t::iterator> events;
+    utime_t start = ceph_clock_now(g_ceph_context);
+    for (uint64_t i = 0; i < ops; ++i) {
+      Context *c = ctx[i % depth];
+      if (i >= depth) {
+	map<Context*, schedule_t::iterator>::iterator p = events.find(c);
+	schedule.erase(p->second);
+	events.erase(p);
+      }
+      utime_t when = now;
+      when += 30.0 + (double)(rand() % 1000) / 1000;
+      events[c] = schedule.insert(make_pair(when, c));
+    }
+    report("multimap", ops, start);
+  }
+
+  {
+    TimingWheel wheel(now);
+    utime_t start = ceph_clock_now(g_ceph_context);
+    for (uint64_t i = 0; i < ops; ++i) {
+      Context *c = ctx[i % depth];
+      if (i >= depth)
+	wheel.remove(c);
+      utime_t when = now;
+      when += 30.0 + (double)(rand() % 1000) / 1000;
+      wheel.add(when, c);
+    }
+    report("timing wheel", ops, start);
+  }
+
+  for (unsigned i = 0; i < depth; ++i)
+    delete ctx[i];
+}
+
+struct TimerClient : public Thread {
+  SafeTimer *timer;
+  Mutex *lock;
+  ShardedTimer *sharded;
+  uint64_t ops;
+
+  TimerClient(SafeTimer *t, Mutex *l, ShardedTimer *s, uint64_t o)
+    : timer(t), lock(l), sharded(s), ops(o) {}
+
+  void *entry() {
+    for (uint64_t i = 0; i < ops; ++i) {
+      Context *c = new C_Nop;
+      if (sharded) {
+	sharded->add_event_after(30.0, c);
+	sharded->cancel_event(c);
+      } else {
+	Mutex::Locker l(*lock);
+	timer->add_event_after(30.0, c);
+	timer->cancel_event(c);
+      }
+    }
+    return NULL;
+  }
+};
+
+static void run_clients(const char *what, unsigned threads, uint64_t ops,
+			SafeTimer *timer, Mutex *lock, ShardedTimer *sharded)
+{
+  vector<TimerClient*> clients;
+  utime_t start = ceph_clock_now(g_ceph_context);
+  for (unsigned i = 0; i < threads; ++i) {
+    clients.push_back(new TimerClient(timer, lock, sharded, ops / threads));
+    clients.back()->create();
+  }
+  for (unsigned i = 0; i < threads; ++i) {
+    clients[i]->join();
+    delete clients[i];
+  }
+  report(what, ops / threads * threads, start);
+}
+
+int main(int argc, char **argv)
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help", "produce help message")
+    ("num-ops", po::value<uint64_t>()->default_value(1000000),
+     "add+cancel pairs per test")
+    ("depth", po::value<unsigned>()->default_value(10000),
+     "outstanding events for the data structure test")
+    ("num-threads", po::value<unsigned>()->default_value(8),
+     "client threads for the timer test")
+    ("num-shards", po::value<int>()->default_value(4),
+     "ShardedTimer shards")
+    ;
+
+  vector<string> ceph_option_strings;
+  po::variables_map vm;
+  try {
+    po::parsed_options parsed =
+      po::command_line_parser(argc, argv).options(desc).allow_unregistered().run();
+    po::store(parsed, vm);
+    po::notify(vm);
+    ceph_option_strings = po::collect_unrecognized(parsed.options,
+						   po::include_positional);
+  } catch(po::error &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  vector<const char *> ceph_options, def_args;
+  for (vector<string>::iterator i = ceph_option_strings.begin();
+       i != ceph_option_strings.end();
+       ++i)
+    ceph_options.push_back(i->c_str());
+
+  global_init(
+    &def_args, ceph_options, CEPH_ENTITY_TYPE_CLIENT,
+    CODE_ENVIRONMENT_UTILITY,
+    CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+
+  if (vm.count("help")) {
+    cout << desc << std::endl;
+    return 1;
+  }
+
+  uint64_t ops = vm["num-ops"].as<uint64_t>();
+  unsigned threads = vm["num-threads"].as<unsigned>();
+  bench_structures(ops, vm["depth"].as<unsigned>());
+
+  Mutex lock("timer_bench::lock");
+  SafeTimer timer(g_ceph_context, lock, false);
+  lock.Lock();
+  timer.init();
+  lock.Unlock();
+  run_clients("SafeTimer", threads, ops, &timer, &lock, NULL);
+  lock.Lock();
+  timer.shutdown();
+  lock.Unlock();
+
+  ShardedTimer sharded(g_ceph_context, vm["num-shards"].as<int>(),
+		       "timer_bench::shard_lock");
+  sharded.init();
+  run_clients("ShardedTimer", threads, ops, NULL, NULL, &sharded);
+  sharded.shutdown();
+  return 0;
+}
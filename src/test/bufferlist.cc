@@ -30,6 +30,7 @@
 #include "common/environment.h"
 #include "common/Clock.h"
 #include "common/safe_io.h"
+#include "common/Formatter.h"
 
 #include "gtest/gtest.h"
 #include "stdlib.h"
@@ -2303,6 +2304,61 @@ TEST(BufferHash, all) {
   }
 }
 
+TEST(BufferPool, Reuse) {
+  if (getenv("CEPH_BUFFER_NOPOOL"))
+    return;
+  // a freed chunk comes straight back from the thread cache
+  char *c;
+  {
+    bufferptr p = buffer::create(100);
+    c = p.c_str();
+    memset(c, 1, 100);
+  }
+  {
+    bufferptr p = buffer::create(100);
+    EXPECT_EQ(c, p.c_str());
+  }
+  {
+    bufferptr p = buffer::create_page_aligned(CEPH_PAGE_SIZE);
+    c = p.c_str();
+    EXPECT_EQ(0u, (unsigned long)c & ~CEPH_PAGE_MASK);
+  }
+  {
+    bufferptr p = buffer::create_page_aligned(CEPH_PAGE_SIZE);
+    EXPECT_EQ(c, p.c_str());
+  }
+  // big buffers bypass the pools but still work
+  {
+    bufferptr p = buffer::create(1 << 20);
+    memset(p.c_str(), 2, p.length());
+  }
+}
+
+TEST(BufferPool, SmallAppends) {
+  bufferlist bl;
+  for (int i = 0; i < 10000; ++i)
+    bl.append((char)(i & 0x7f));
+  EXPECT_EQ(10000u, bl.length());
+  // appends pack into a handful of pooled, page aligned buffers
+  EXPECT_GT(10u, bl.buffers().size());
+  EXPECT_TRUE(bl.is_page_aligned());
+  for (int i = 0; i < 10000; ++i)
+    EXPECT_EQ((char)(i & 0x7f), bl[i]);
+}
+
+TEST(BufferPool, Dump) {
+  bufferlist bl;
+  bl.append("abc");
+  JSONFormatter f(false);
+  f.open_object_section("pools");
+  buffer::dump_pools(&f);
+  f.close_section();
+  ostringstream ss;
+  f.flush(ss);
+  EXPECT_NE(string::npos, ss.str().find("\"buffer_data\""));
+  EXPECT_NE(string::npos, ss.str().find("\"buffer_aligned\""));
+}
+
 /*
  * Local Variables:
  * compile-command: "cd .. ; make unittest_bufferlist && 
@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <signal.h>
+#include <vector>
 #include "common/Mutex.h"
 #include "common/Thread.h"
 #include "common/Throttle.h"
@@ -238,6 +239,53 @@ TEST_F(ThrottleTest, destructor) {
   }
 }
 
+class C_Record : public Context {
+public:
+  OrderedThrottle &throttle;
+  std::vector<int> &order;
+  int id;
+
+  C_Record(OrderedThrottle &_throttle, std::vector<int> &_order, int _id) :
+    throttle(_throttle),
+    order(_order),
+    id(_id)
+  {
+  }
+
+  virtual void finish(int r) {
+    order.push_back(id);
+    throttle.end_op(r);
+  }
+};
+
+TEST_F(ThrottleTest, OrderedThrottle) {
+  OrderedThrottle throttle(3, false);
+  std::vector<int> order;
+
+  C_OrderedThrottle *ctx0 = throttle.start_op(new C_Record(throttle, order, 0));
+  C_OrderedThrottle *ctx1 = throttle.start_op(new C_Record(throttle, order, 1));
+  C_OrderedThrottle *ctx2 = throttle.start_op(new C_Record(throttle, order, 2));
+
+  // finished out of order, nothing is handed back until the first one is
+  ctx2->complete(0);
+  ctx1->complete(0);
+  ASSERT_TRUE(order.empty());
+
+  ctx0->complete(0);
+  C_OrderedThrottle *ctx3 = throttle.start_op(new C_Record(throttle, order, 3));
+  ASSERT_EQ(3U, order.size());
+  ASSERT_EQ(0, order[0]);
+  ASSERT_EQ(1, order[1]);
+  ASSERT_EQ(2, order[2]);
+
+  ASSERT_FALSE(throttle.pending_error());
+  ctx3->complete(-EIO);
+  ASSERT_EQ(-EIO, throttle.wait_for_ret());
+  ASSERT_TRUE(throttle.pending_error());
+  ASSERT_EQ(4U, order.size());
+  ASSERT_EQ(3, order[3]);
+}
+
 int main(int argc, char **argv) {
   vector<const char*> args;
   argv_to_vec(argc, (const char **)argv, args);
@@ -0,0 +1,124 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <sstream>
+#include <unistd.h>
+
+#include "common/Formatter.h"
+#include "common/Mutex.h"
+#include "common/RWLock.h"
+#include "common/Thread.h"
+#include "common/lockstat.h"
+#include "test/unit.h"
+
+// the json for one lock, or "" if it has no stats
+static std::string dump(const char *name)
+{
+  JSONFormatter f;
+  f.open_object_section("lock_stats");
+  lockstat_dump(&f);
+  f.close_section();
+  std::ostringstream ss;
+  f.flush(ss);
+  std::string s = ss.str();
+  size_t p = s.find(std::string("{\"name\":\"") + name + "\"");
+  if (p == std::string::npos)
+    return "";
+  return s.substr(p, s.find('}', p) + 1 - p);
+}
+
+class Holder : public Thread {
+  Mutex &lock;
+public:
+  Holder(Mutex &l) : lock(l) {}
+  void *entry() {
+    lock.Lock();
+    usleep(100000);
+    lock.Unlock();
+    return NULL;
+  }
+};
+
+class LockStatTest : public ::testing::Test {
+public:
+  virtual void SetUp() {
+    g_lockstat = 1;
+    lockstat_countdown = 0;
+    lockstat_reset();
+  }
+  virtual void TearDown() {
+    g_lockstat = 0;
+  }
+};
+
+TEST_F(LockStatTest, MutexSampled)
+{
+  Mutex m("LockStatTest::m");
+  for (int i = 0; i < 10; ++i) {
+    m.Lock();
+    m.Unlock();
+  }
+  std::string s = dump("LockStatTest::m");
+  ASSERT_NE(std::string::npos, s.find("\"sampled\":10,\"contended\":0,"));
+  ASSERT_NE(std::string::npos, s.find("\"held\":10,"));
+}
+
+TEST_F(LockStatTest, SampleRate)
+{
+  g_lockstat = 4;
+  Mutex m("LockStatTest::rate");
+  for (int i = 0; i < 20; ++i) {
+    m.Lock();
+    m.Unlock();
+  }
+  ASSERT_NE(std::string::npos, dump("LockStatTest::rate").find("\"sampled\":5,"));
+}
+
+TEST_F(LockStatTest, MutexContended)
+{
+  Mutex m("LockStatTest::contended");
+  Holder h(m);
+  h.create();
+  while (!m.is_locked())
+    usleep(1000);
+  m.Lock();
+  m.Unlock();
+  h.join();
+  std::string s = dump("LockStatTest::contended");
+  ASSERT_NE(std::string::npos, s.find("\"contended\":1,"));
+  // both the holder and we sampled our first acquisition
+  ASSERT_NE(std::string::npos, s.find("\"held\":2,"));
+}
+
+TEST_F(LockStatTest, RWLock)
+{
+  RWLock l("LockStatTest::rwlock");
+  l.get_read();
+  l.get_read();
+  l.unlock();
+  l.unlock();
+  l.get_write();
+  l.unlock();
+  std::string s = dump("LockStatTest::rwlock");
+  ASSERT_NE(std::string::npos, s.find("\"sampled\":3,\"contended\":0,"));
+  // only the write lock counts toward hold times
+  ASSERT_NE(std::string::npos, s.find("\"held\":1,"));
+}
+
+TEST_F(LockStatTest, Off)
+{
+  g_lockstat = 0;
+  Mutex m("LockStatTest::off");
+  m.Lock();
+  m.Unlock();
+  ASSERT_EQ("", dump("LockStatTest::off"));
+}
@@ -0,0 +1,111 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <vector>
+
+#include "common/Finisher.h"
+#include "include/Context.h"
+#include "test/unit.h"
+
+// record (key, seq) and check seq grows per key
+struct Record {
+  Mutex lock;
+  std::vector<int> last;
+  int done, out_of_order;
+  Record(int keys)
+    : lock("Record::lock"), last(keys, -1), done(0), out_of_order(0) {}
+};
+
+class C_Record : public Context {
+  Record *rec;
+  int key, seq;
+public:
+  C_Record(Record *r, int k, int s) : rec(r), key(k), seq(s) {}
+  void finish(int r) {
+    Mutex::Locker l(rec->lock);
+    if (rec->last[key] >= seq)
+      rec->out_of_order++;
+    rec->last[key] = seq;
+    rec->done++;
+  }
+};
+
+class C_Rval : public Context {
+  int *out;
+public:
+  C_Rval(int *o) : out(o) {}
+  void finish(int r) { *out = r; }
+};
+
+TEST(ShardedFinisher, PerKeyOrder)
+{
+  const int keys = 37, per_key = 2000;
+  ShardedFinisher fin(g_ceph_context, "test-order", 4);
+  fin.start();
+  Record rec(keys);
+  for (int i = 0; i < per_key; ++i)
+    for (int k = 0; k < keys; ++k)
+      fin.queue(k, new C_Record(&rec, k, i));
+  fin.wait_for_empty();
+  ASSERT_EQ(keys * per_key, rec.done);
+  ASSERT_EQ(0, rec.out_of_order);
+  fin.stop();
+}
+
+TEST(ShardedFinisher, QueueList)
+{
+  ShardedFinisher fin(g_ceph_context, "test-list", 2);
+  fin.start();
+  Record rec(1);
+  list<Context*> ls;
+  for (int i = 0; i < 100; ++i)
+    ls.push_back(new C_Record(&rec, 0, i));
+  fin.queue(0, ls);
+  ASSERT_TRUE(ls.empty());
+  fin.queue(0, new C_Record(&rec, 0, 100));
+  fin.wait_for_empty();
+  ASSERT_EQ(101, rec.done);
+  ASSERT_EQ(0, rec.out_of_order);
+  fin.stop();
+}
+
+TEST(ShardedFinisher, Rval)
+{
+  ShardedFinisher fin(g_ceph_context, "test-rval", 1);
+  fin.start();
+  int a = 0, b = 0;
+  fin.queue(1, new C_Rval(&a), -5);
+  fin.queue(2, new C_Rval(&b));
+  fin.wait_for_empty();
+  ASSERT_EQ(-5, a);
+  ASSERT_EQ(0, b);
+  fin.stop();
+}
+
+TEST(ShardedFinisher, StopDrains)
+{
+  ShardedFinisher fin(g_ceph_context, "test-stop", 3);
+  Record rec(8);
+  for (int i = 0; i < 500; ++i)
+    fin.queue(i % 8, new C_Record(&rec, i % 8, i));
+  fin.start();
+  fin.stop();
+  ASSERT_EQ(500, rec.done);
+  ASSERT_EQ(0, rec.out_of_order);
+}
+
+/*
+ * Local Variables:
+ * compile-command: "cd ../.. ; make -j4 unittest_sharded_finisher &&
+ *   ./unittest_sharded_finisher"
+ * End:
+ */
@@ -0,0 +1,170 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <stdlib.h>
+#include <list>
+#include <map>
+#include <set>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "common/TimingWheel.h"
+#include "include/Context.h"
+
+class C_Id : public Context {
+public:
+  int id;
+  C_Id(int i) : id(i) {}
+  void finish(int r) {}
+};
+
+static utime_t ms(uint64_t m)
+{
+  return utime_t(m / 1000, (m % 1000) * 1000000);
+}
+
+// advance to t, and return the ids that fired
+static std::vector<int> run(TimingWheel &w, utime_t t)
+{
+  std::list<Context*> out;
+  w.advance(t, &out);
+  std::vector<int> ids;
+  for (std::list<Context*>::iterator p = out.begin(); p != out.end(); ++p) {
+    ids.push_back(static_cast<C_Id*>(*p)->id);
+    delete *p;
+  }
+  return ids;
+}
+
+TEST(TimingWheel, Order)
+{
+  TimingWheel w(ms(1000000));
+  w.add(ms(1000300), new C_Id(3));
+  w.add(ms(1000100), new C_Id(1));
+  w.add(ms(1000200), new C_Id(2));
+  w.add(ms(1000100), new C_Id(4));
+  ASSERT_EQ(4u, w.size());
+
+  utime_t next;
+  ASSERT_TRUE(w.get_next(&next));
+  ASSERT_GE(ms(1000100), next);
+
+  ASSERT_TRUE(run(w, ms(1000099)).empty());
+  std::vector<int> ids = run(w, ms(1000150));
+  ASSERT_EQ(2u, ids.size());
+  ASSERT_EQ(1, ids[0]);
+  ASSERT_EQ(4, ids[1]);
+  ids = run(w, ms(1000400));
+  ASSERT_EQ(2u, ids.size());
+  ASSERT_EQ(2, ids[0]);
+  ASSERT_EQ(3, ids[1]);
+  ASSERT_TRUE(w.empty());
+  ASSERT_FALSE(w.get_next(&next));
+}
+
+TEST(TimingWheel, NeverEarly)
+{
+  TimingWheel w(ms(5000));
+  // 1.5ms rounds up to the 2ms tick
+  w.add(utime_t(5, 1500000), new C_Id(1));
+  ASSERT_TRUE(run(w, utime_t(5, 1499000)).empty());
+  ASSERT_EQ(1u, run(w, utime_t(5, 2000000)).size());
+
+  // in the past: fires on the next advance
+  w.add(ms(4000), new C_Id(2));
+  ASSERT_EQ(1u, run(w, ms(5002)).size());
+}
+
+TEST(TimingWheel, Remove)
+{
+  TimingWheel w(ms(0));
+  C_Id *a = new C_Id(1), *b = new C_Id(2);
+  w.add(ms(100), a);
+  w.add(ms(100000000), b);
+  ASSERT_TRUE(w.contains(a));
+  ASSERT_TRUE(w.remove(a));
+  ASSERT_FALSE(w.remove(a));
+  delete a;
+  ASSERT_TRUE(run(w, ms(200)).empty());
+
+  std::list<Context*> ls;
+  w.clear(&ls);
+  ASSERT_EQ(1u, ls.size());
+  ASSERT_EQ(b, ls.front());
+  delete b;
+  ASSERT_TRUE(w.empty());
+}
+
+TEST(TimingWheel, FarFuture)
+{
+  TimingWheel w(ms(1000));
+  // past the top level (64^6 ms)
+  uint64_t far = 1000 + (1ull << 37);
+  w.add(ms(far), new C_Id(1));
+  w.add(ms(far + 1), new C_Id(2));
+  ASSERT_TRUE(run(w, ms(far - 1)).empty());
+  std::vector<int> ids = run(w, ms(far + 1));
+  ASSERT_EQ(2u, ids.size());
+  ASSERT_EQ(1, ids[0]);
+  ASSERT_EQ(2, ids[1]);
+}
+
+TEST(TimingWheel, Random)
+{
+  // compare against a multimap, stepping time unevenly
+  srand(42);
+  uint64_t now = 123456789;
+  TimingWheel w(ms(now));
+  std::multimap<uint64_t, int> expect;
+  std::map<int, C_Id*> live;
+  int next_id = 0;
+  for (int round = 0; round < 2000; ++round) {
+    for (int i = rand() % 20; i > 0; --i) {
+      uint64_t delay = rand() % 4 == 0 ? rand() % 10000000 : rand() % 5000;
+      C_Id *c = new C_Id(next_id);
+      live[next_id] = c;
+      expect.insert(std::make_pair(now + delay, next_id++));
+      w.add(ms(now + delay), c);
+    }
+    if (!live.empty() && rand() % 3 == 0) {
+      std::map<int, C_Id*>::iterator p = live.lower_bound(rand() % next_id);
+      if (p == live.end())
+	p = live.begin();
+      ASSERT_TRUE(w.remove(p->second));
+      for (std::multimap<uint64_t, int>::iterator q = expect.begin();
+	   q != expect.end(); ++q) {
+	if (q->second == p->first) {
+	  expect.erase(q);
+	  break;
+	}
+      }
+      delete p->second;
+      live.erase(p);
+    }
+
+    now += rand() % 3 == 0 ? rand() % 100000 : rand() % 100;
+    std::vector<int> ids = run(w, ms(now));
+    std::multiset<int> want, got(ids.begin(), ids.end());
+    while (!expect.empty() && expect.begin()->first <= now) {
+      want.insert(expect.begin()->second);
+      expect.erase(expect.begin());
+    }
+    ASSERT_TRUE(want == got);
+    for (std::vector<int>::iterator p = ids.begin(); p != ids.end(); ++p)
+      live.erase(*p);
+    ASSERT_EQ(expect.size(), w.size());
+  }
+  std::list<Context*> ls;
+  w.clear(&ls);
+  for (std::list<Context*>::iterator p = ls.begin(); p != ls.end(); ++p)
+    delete *p;
+}
@@ -0,0 +1,122 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "common/Trace.h"
+#include "common/config.h"
+#include "json_spirit/json_spirit.h"
+#include "test/unit.h"
+
+static std::vector<json_spirit::mObject> read_spans(const std::string &path)
+{
+  std::vector<json_spirit::mObject> ret;
+  std::ifstream in(path.c_str());
+  std::string line;
+  while (std::getline(in, line)) {
+    json_spirit::mValue v;
+    if (!json_spirit::read(line, v))
+      return std::vector<json_spirit::mObject>();
+    ret.push_back(v.get_obj());
+  }
+  return ret;
+}
+
+class TraceTest : public ::testing::Test {
+ public:
+  std::string path;
+  virtual void SetUp() {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "/tmp/test_trace.%d", getpid());
+    path = buf;
+    ::unlink(path.c_str());
+    g_ceph_context->_conf->set_val("trace_file", path);
+    g_ceph_context->_conf->set_val("trace_sample_rate", "1");
+  }
+  virtual void TearDown() {
+    g_ceph_context->_conf->set_val("trace_sample_rate", "0");
+    ::unlink(path.c_str());
+  }
+};
+
+TEST_F(TraceTest, NotSampled)
+{
+  g_ceph_context->_conf->set_val("trace_sample_rate", "0");
+  TraceSpan s;
+  s.init_root(g_ceph_context, "root");
+  ASSERT_FALSE(s.valid());
+  ASSERT_FALSE(s.get_ctx().sampled());
+  TraceSpan c;
+  c.init_child(g_ceph_context, "child", s.get_ctx());
+  ASSERT_FALSE(c.valid());
+  s.finish();
+  c.finish();
+  ASSERT_EQ(0u, read_spans(path).size());
+}
+
+TEST_F(TraceTest, CachedTracer)
+{
+  // the sample rate is still read on every span
+  Tracer *t = Tracer::get(g_ceph_context);
+  TraceSpan s;
+  s.init_root(t, "cached");
+  ASSERT_TRUE(s.valid());
+  s.finish();
+  g_ceph_context->_conf->set_val("trace_sample_rate", "0");
+  TraceSpan n;
+  n.init_root(t, "cached");
+  ASSERT_FALSE(n.valid());
+  ASSERT_EQ(1u, read_spans(path).size());
+}
+
+TEST_F(TraceTest, Propagate)
+{
+  TraceSpan root;
+  root.init_root(g_ceph_context, "root");
+  ASSERT_TRUE(root.valid());
+
+  // across the wire
+  bufferlist bl;
+  ::encode(root.get_ctx(), bl);
+  trace_ctx_t ctx;
+  bufferlist::iterator p = bl.begin();
+  ::decode(ctx, p);
+  ASSERT_EQ(root.get_ctx().trace_id, ctx.trace_id);
+  ASSERT_TRUE(ctx.sampled());
+
+  {
+    TraceSpan child;
+    child.init_child(g_ceph_context, "child", ctx);
+    ASSERT_TRUE(child.valid());
+    child.event("working");
+    child.tag("who", "me \"quoted\"");
+  } // finishes when destroyed
+  root.event("done");
+  root.finish();
+  ASSERT_FALSE(root.valid());
+
+  std::vector<json_spirit::mObject> spans = read_spans(path);
+  ASSERT_EQ(2u, spans.size());
+  json_spirit::mObject &c = spans[0], &r = spans[1];
+  ASSERT_EQ("child", c["name"].get_str());
+  ASSERT_EQ("root", r["name"].get_str());
+  ASSERT_EQ(r["traceId"].get_str(), c["traceId"].get_str());
+  ASSERT_EQ(r["id"].get_str(), c["parentId"].get_str());
+  ASSERT_EQ(0u, r.count("parentId"));
+  ASSERT_EQ("working", c["annotations"].get_array()[0].get_obj()["value"].get_str());
+  ASSERT_EQ("me \"quoted\"", c["tags"].get_obj()["who"].get_str());
+  ASSERT_LE(r["timestamp"].get_uint64(), c["timestamp"].get_uint64());
+}
@@ -1,6 +1,8 @@
 #include "common/config.h"
 #include "include/buffer.h"
 #include "include/encoding.h"
+#include "common/hobject.h"
+#include "osd/osd_types.h"
 
 #include "gtest/gtest.h"
 
@@ -196,3 +198,118 @@ TEST(EncodingRoundTrip, MultimapConstructorCounter) {
   EXPECT_EQ(my_val_t::get_copy_ctor(), 10);
   EXPECT_EQ(my_val_t::get_assigns(), 0);
 }
+
+// bounded encoding
+
+// the same bytes, one byte per segment
+static void fragment(const bufferlist& in, bufferlist& out)
+{
+  for (unsigned i = 0; i < in.length(); ++i)
+    out.append(buffer::copy(&in[i], 1));
+}
+
+TEST(BoundedEncoding, WireFormat) {
+  hobject_t h(object_t("oname"), "okey", 123, 456, 7, "ns");
+  bufferlist expected;
+  {
+    bufferlist &bl = expected;
+    ENCODE_START(4, 3, bl);
+    ::encode(h.get_key(), bl);
+    ::encode(h.oid, bl);
+    ::encode(h.snap, bl);
+    ::encode(h.hash, bl);
+    ::encode(h.is_max(), bl);
+    ::encode(h.nspace, bl);
+    ::encode(h.pool, bl);
+    ENCODE_FINISH(bl);
+  }
+  bufferlist bl;
+  ::encode(h, bl);
+  ASSERT_TRUE(bl.contents_equal(expected));
+  ASSERT_EQ(1u, bl.buffers().size());
+
+  object_locator_t oloc(5, "ns", 17);
+  expected.clear();
+  {
+    bufferlist &bl = expected;
+    ENCODE_START(6, 3, bl);
+    ::encode(oloc.pool, bl);
+    int32_t preferred = -1;
+    ::encode(preferred, bl);
+    ::encode(oloc.key, bl);
+    ::encode(oloc.nspace, bl);
+    ::encode(oloc.hash, bl);
+    ENCODE_FINISH_NEW_COMPAT(bl, 6);
+  }
+  bl.clear();
+  ::encode(oloc, bl);
+  ASSERT_TRUE(bl.contents_equal(expected));
+}
+
+TEST(BoundedEncoding, ContiguousAndFragmented) {
+  list<pg_log_entry_t*> ls;
+  pg_log_entry_t::generate_test_instances(ls);
+  ls.back()->snaps.append("snapsnap");
+  ls.back()->mod_desc.mark_unrollbackable();
+  for (list<pg_log_entry_t*>::iterator i = ls.begin(); i != ls.end(); ++i) {
+    bufferlist bl;
+    ::encode(**i, bl);
+
+    pg_log_entry_t a, b;
+    bufferlist::iterator p = bl.begin();
+    ::decode(a, p);
+    ASSERT_TRUE(p.end());
+
+    bufferlist frag;
+    fragment(bl, frag);
+    p = frag.begin();
+    ::decode(b, p);
+    ASSERT_TRUE(p.end());
+
+    bufferlist abl, bbl;
+    ::encode(a, abl);
+    ::encode(b, bbl);
+    ASSERT_TRUE(abl.contents_equal(bl));
+    ASSERT_TRUE(bbl.contents_equal(bl));
+    delete *i;
+  }
+}
+
+TEST(BoundedEncoding, LegacyVersion) {
+  // a v3 hobject_t has no namespace or pool; it goes through decode()
+  bufferlist bl;
+  {
+    ENCODE_START(3, 3, bl);
+    ::encode(string("okey"), bl);
+    ::encode(object_t("oname"), bl);
+    ::encode(snapid_t(12), bl);
+    ::encode((uint32_t)34, bl);
+    ::encode(false, bl);
+    ENCODE_FINISH(bl);
+  }
+  uint32_t trailer = 0xdeadbeef;
+  ::encode(trailer, bl);
+  bl.rebuild();
+
+  hobject_t h;
+  bufferlist::iterator p = bl.begin();
+  ::decode(h, p);
+  ASSERT_EQ("oname", h.oid.name);
+  ASSERT_EQ("okey", h.get_key());
+  ASSERT_EQ(snapid_t(12), h.snap);
+  ASSERT_EQ(34u, h.hash);
+  ::decode(trailer, p);
+  ASSERT_EQ(0xdeadbeef, trailer);
+}
+
+TEST(BoundedEncoding, Truncated) {
+  hobject_t h(object_t("oname"), "okey", 123, 456, 7, "ns");
+  bufferlist bl;
+  ::encode(h, bl);
+  bufferlist shorter;
+  shorter.substr_of(bl, 0, bl.length() - 1);
+  shorter.rebuild();
+  hobject_t d;
+  bufferlist::iterator p = shorter.begin();
+  ASSERT_THROW(::decode(d, p), buffer::error);
+}
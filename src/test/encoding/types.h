@@ -23,6 +23,9 @@ TYPE(LogSummary)
 #include "common/SloppyCRCMap.h"
 TYPE(SloppyCRCMap)
 
+#include "common/Trace.h"
+TYPE(trace_ctx_t)
+
 #include "msg/msg_types.h"
 TYPE(entity_name_t)
 TYPE(entity_addr_t)
@@ -87,7 +90,7 @@ TYPE(PushReplyOp)
 TYPE(ECUtil::HashInfo)
 
 #include "osd/ECMsgTypes.h"
-TYPE(ECSubWrite)
+TYPE_FEATUREFUL(ECSubWrite)
 TYPE(ECSubWriteReply)
 TYPE(ECSubRead)
 TYPE(ECSubReadReply)
@@ -473,6 +476,8 @@ MESSAGE(MOSDFailure)
 MESSAGE(MOSDMap)
 #include "messages/MOSDOp.h"
 MESSAGE(MOSDOp)
+#include "messages/MOSDOpBatch.h"
+MESSAGE(MOSDOpBatch)
 #include "messages/MOSDOpReply.h"
 MESSAGE(MOSDOpReply)
 #include "messages/MOSDPGBackfill.h"
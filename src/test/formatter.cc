@@ -197,3 +197,68 @@ TEST(XmlFormatter, DumpFormatNameSpaceTest) {
   fmt.flush(oss2);
   ASSERT_EQ(oss2.str(),"<foo>bar</foo>");
 }
+
+// remembers how the output was chunked
+class CountingSink : public Formatter::Sink {
+public:
+  bufferlist out;
+  int writes;
+  CountingSink() : writes(0) {}
+  void write(bufferlist &bl) {
+    out.claim_append(bl);
+    ++writes;
+  }
+};
+
+TEST(JsonFormatter, SinkStreams) {
+  ostringstream whole;
+  JSONFormatter ref(true);
+  JSONFormatter fmt(true);
+  CountingSink sink;
+  fmt.set_sink(&sink, 100);
+
+  Formatter *both[] = { &ref, &fmt };
+  for (int k = 0; k < 2; ++k) {
+    Formatter *f = both[k];
+    f->open_object_section("top");
+    f->open_array_section("items");
+    for (int i = 0; i < 1000; ++i) {
+      f->open_object_section("item");
+      f->dump_int("i", i);
+      f->dump_stream("s") << "item " << i;
+      f->dump_string("name", "a \"quoted\" name");
+      f->close_section();
+    }
+    f->close_section();
+    f->close_section();
+  }
+  ref.flush(whole);
+
+  // most of the document went out early, in bounded pieces
+  ASSERT_GT(sink.writes, 100);
+  ASSERT_LT(fmt.get_len(), 200);
+  both[1]->flush(sink.out);
+  ASSERT_EQ(whole.str(), std::string(sink.out.c_str(), sink.out.length()));
+}
+
+TEST(XmlFormatter, SinkStreams) {
+  ostringstream whole;
+  XMLFormatter ref(false);
+  XMLFormatter fmt(false);
+  bufferlist out;
+  BufferlistSink sink(&out);
+  fmt.set_sink(&sink, 64);
+
+  Formatter *both[] = { &ref, &fmt };
+  for (int k = 0; k < 2; ++k) {
+    Formatter *f = both[k];
+    f->open_array_section("list");
+    for (int i = 0; i < 500; ++i)
+      f->dump_unsigned("n", i);
+    f->close_section();
+  }
+  ref.flush(whole);
+  ASSERT_GT(out.length(), 0u);
+  both[1]->flush(out);
+  ASSERT_EQ(whole.str(), std::string(out.c_str(), out.length()));
+}
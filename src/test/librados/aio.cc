@@ -1410,6 +1410,71 @@ TEST(LibRadosAio, OmapPP) {
   destroy_one_pool_pp(pool_name, cluster);
 }
 
+TEST(LibRadosAio, OperateBatchPP) {
+  Rados cluster;
+  std::string pool_name = get_temp_pool_name();
+  ASSERT_EQ("", create_one_pool_pp(pool_name, cluster));
+  IoCtx ioctx;
+  cluster.ioctx_create(pool_name.c_str(), ioctx);
+
+  const int num = 50;
+  std::vector<std::string> oids;
+  std::vector<AioCompletion*> cs;
+  std::vector<ObjectWriteOperation*> wops;
+  for (int i = 0; i < num; ++i) {
+    ostringstream oss;
+    oss << "batch_" << i;
+    oids.push_back(oss.str());
+    cs.push_back(cluster.aio_create_completion(0, 0, 0));
+    ObjectWriteOperation *op = new ObjectWriteOperation;
+    bufferlist bl;
+    bl.append(oss.str());
+    op->write_full(bl);
+    wops.push_back(op);
+  }
+  ASSERT_EQ(0, ioctx.aio_operate_batch(oids, cs, wops));
+  for (int i = 0; i < num; ++i) {
+    {
+      TestAlarm alarm;
+      ASSERT_EQ(0, cs[i]->wait_for_safe());
+    }
+    ASSERT_EQ(0, cs[i]->get_return_value());
+    cs[i]->release();
+    delete wops[i];
+  }
+
+  // each op gets its own result
+  cs.clear();
+  std::vector<ObjectReadOperation*> rops;
+  std::vector<bufferlist> bls(num + 1);
+  std::vector<int> rvals(num + 1);
+  oids.push_back("batch_missing");
+  for (int i = 0; i <= num; ++i) {
+    cs.push_back(cluster.aio_create_completion(0, 0, 0));
+    ObjectReadOperation *op = new ObjectReadOperation;
+    op->read(0, 0, &bls[i], &rvals[i]);
+    rops.push_back(op);
+  }
+  ASSERT_EQ(0, ioctx.aio_operate_batch(oids, cs, rops));
+  for (int i = 0; i <= num; ++i) {
+    {
+      TestAlarm alarm;
+      ASSERT_EQ(0, cs[i]->wait_for_complete());
+    }
+    if (i < num) {
+      ASSERT_EQ(0, cs[i]->get_return_value());
+      ASSERT_EQ(oids[i], std::string(bls[i].c_str(), bls[i].length()));
+    } else {
+      ASSERT_EQ(-ENOENT, cs[i]->get_return_value());
+    }
+    cs[i]->release();
+    delete rops[i];
+  }
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, cluster));
+}
+
 TEST(LibRadosAio, MultiWrite) {
   AioTestData test_data;
   rados_completion_t my_completion, my_completion2, my_completion3;
@@ -1,10 +1,15 @@
 #include "include/rados/librados.hpp"
+#include "common/ceph_context.h"
+#include "common/ceph_json.h"
+#include "common/perf_counters.h"
 #include "test/librados/test.h"
 #include "test/librados/TestCase.h"
 
 #include <algorithm>
 #include <errno.h>
+#include <stdlib.h>
 #include "gtest/gtest.h"
+#include <sstream>
 #include <string>
 
 using namespace librados;
@@ -145,6 +150,94 @@ TEST_F(LibRadosSnapshotsPP, SnapGetNamePP) {
   EXPECT_EQ(0, ioctx.snap_remove("snapfoo"));
 }
 
+static uint64_t get_objecter_counter(Rados& cluster, const char *name)
+{
+  CephContext *cct = (CephContext *)cluster.cct();
+  JSONFormatter f;
+  cct->get_perfcounters_collection()->dump_formatted(&f, false);
+  std::stringstream ss;
+  f.flush(ss);
+  JSONParser parser;
+  if (!parser.parse(ss.str().c_str(), ss.str().length()))
+    return 0;
+  JSONObj *objecter = parser.find_obj("objecter");
+  if (!objecter)
+    return 0;
+  JSONObj *o = objecter->find_obj(name);
+  return o ? strtoull(o->get_data().c_str(), NULL, 10) : 0;
+}
+
+static int get_pool_size(Rados& cluster, const std::string& pool_name)
+{
+  bufferlist inbl, outbl;
+  std::string cmd = "{\"prefix\": \"osd pool get\", \"pool\": \"" +
+    pool_name + "\", \"var\": \"size\", \"format\": \"json\"}";
+  if (cluster.mon_command(cmd, inbl, &outbl, NULL) < 0)
+    return -1;
+  JSONParser parser;
+  if (!parser.parse(outbl.c_str(), outbl.length()))
+    return -1;
+  JSONObj *o = parser.find_obj("size");
+  return o ? atoi(o->get_data().c_str()) : -1;
+}
+
+TEST_F(LibRadosSnapshotsPP, HedgedReadPP) {
+  char buf[bufsize];
+  memset(buf, 0xcc, sizeof(buf));
+  bufferlist bl1;
+  bl1.append(buf, sizeof(buf));
+  ASSERT_EQ(0, ioctx.write("foo", bl1, sizeof(buf), 0));
+  ASSERT_EQ(0, ioctx.snap_create("snap1"));
+  char buf2[sizeof(buf)];
+  memset(buf2, 0xdd, sizeof(buf2));
+  bufferlist bl2;
+  bl2.append(buf2, sizeof(buf2));
+  ASSERT_EQ(0, ioctx.write_full("foo", bl2));
+  bool replicated = get_pool_size(cluster, pool_name) > 1;
+
+  // hedge every snapshot read at once, so both copies race; read into
+  // a caller buffer, which the losing copy must not write to later
+  ASSERT_EQ(0, cluster.conf_set("objecter_hedged_read_min_delay", "0"));
+  ASSERT_EQ(0, cluster.conf_set("objecter_hedged_read_latency_factor", "0"));
+  ASSERT_EQ(0, cluster.conf_set("objecter_hedged_reads", "true"));
+  rados_snap_t snap;
+  ASSERT_EQ(0, ioctx.snap_lookup("snap1", &snap));
+  ioctx.snap_set_read(snap);
+  uint64_t hedged = get_objecter_counter(cluster, "op_hedge");
+  uint64_t won = get_objecter_counter(cluster, "op_hedge_won");
+  uint64_t nhedged = 0, nwon = 0;
+  for (int i = 0; i < 1000; ++i) {
+    char buf3[sizeof(buf)];
+    memset(buf3, 0, sizeof(buf3));
+    bufferlist bl3;
+    bl3.push_back(buffer::create_static(sizeof(buf3), buf3));
+    ASSERT_EQ((int)sizeof(buf), ioctx.read("foo", bl3, sizeof(buf), 0));
+    ASSERT_EQ(0, memcmp(buf, bl3.c_str(), sizeof(buf)));
+    nhedged = get_objecter_counter(cluster, "op_hedge") - hedged;
+    nwon = get_objecter_counter(cluster, "op_hedge_won") - won;
+    // until the hedge has both won and lost at least once
+    if (i >= 99 && nwon > 0 && nwon < nhedged)
+      break;
+  }
+  ioctx.snap_set_read(LIBRADOS_SNAP_HEAD);
+  ASSERT_EQ(0, cluster.conf_set("objecter_hedged_reads", "false"));
+  ASSERT_EQ(0, cluster.conf_set("objecter_hedged_read_min_delay", ".01"));
+  ASSERT_EQ(0, cluster.conf_set("objecter_hedged_read_latency_factor", "3"));
+  if (replicated) {
+    EXPECT_GT(nhedged, 0u);
+    EXPECT_GT(nwon, 0u);
+    EXPECT_LT(nwon, nhedged);
+  } else {
+    // no replica to hedge to
+    EXPECT_EQ(0u, nhedged);
+  }
+
+  bufferlist bl3;
+  ASSERT_EQ((int)sizeof(buf2), ioctx.read("foo", bl3, sizeof(buf2), 0));
+  ASSERT_EQ(0, memcmp(buf2, bl3.c_str(), sizeof(buf2)));
+  EXPECT_EQ(0, ioctx.snap_remove("snap1"));
+}
+
 TEST_F(LibRadosSnapshotsSelfManaged, Snap) {
   std::vector<uint64_t> my_snaps;
   my_snaps.push_back(-2);
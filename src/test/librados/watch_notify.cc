@@ -5,7 +5,10 @@
 #include "test/librados/TestCase.h"
 
 #include <errno.h>
+#include <pthread.h>
 #include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
 #include "gtest/gtest.h"
 
 using namespace librados;
@@ -68,6 +71,129 @@ TEST_P(LibRadosWatchNotifyPP, WatchNotifyTestPP) {
   ioctx.unwatch("foo", handle);
   sem_destroy(&sem);
 }
+TEST_P(LibRadosWatchNotifyPP, MultiWatchNotifyTestPP) {
+  ASSERT_EQ(0, sem_init(&sem, 0, 0));
+  char buf[128];
+  memset(buf, 0xcc, sizeof(buf));
+  bufferlist bl1;
+  bl1.append(buf, sizeof(buf));
+  ASSERT_EQ(0, ioctx.write("foo", bl1, sizeof(buf), 0));
+  // the notifies to these watches arrive together and are acked together
+  const int num_watches = 8;
+  uint64_t handles[num_watches];
+  WatchNotifyTestCtx ctx;
+  for (int i = 0; i < num_watches; ++i)
+    ASSERT_EQ(0, ioctx.watch("foo", 0, &handles[i], &ctx));
+  std::list<obj_watch_t> watches;
+  ASSERT_EQ(0, ioctx.list_watchers("foo", &watches));
+  ASSERT_EQ(watches.size(), (unsigned)num_watches);
+  bufferlist bl2;
+  ASSERT_EQ(0, ioctx.notify("foo", 0, bl2));
+  TestAlarm alarm;
+  for (int i = 0; i < num_watches; ++i)
+    sem_wait(&sem);
+  for (int i = 0; i < num_watches; ++i)
+    ioctx.unwatch("foo", handles[i]);
+  sem_destroy(&sem);
+}
+
+class SleepWatchCtx : public WatchCtx
+{
+public:
+  void notify(uint8_t opcode, uint64_t ver, bufferlist& bl)
+  {
+    sleep(2);
+    sem_post(&sem);
+  }
+};
+
+class WaitWatchCtx : public WatchCtx
+{
+  sem_t *wait_for;
+public:
+  bool timed_out;
+  WaitWatchCtx(sem_t *w) : wait_for(w), timed_out(false) {}
+  void notify(uint8_t opcode, uint64_t ver, bufferlist& bl)
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += 10;
+    if (sem_timedwait(wait_for, &ts) < 0)
+      timed_out = true;
+    sem_post(&sem);
+  }
+};
+
+struct notify_arg_t {
+  IoCtx *ioctx;
+  const char *oid;
+  useconds_t delay;
+  sem_t *done;
+};
+
+static void *notify_thread(void *arg)
+{
+  notify_arg_t *a = (notify_arg_t *)arg;
+  usleep(a->delay);
+  bufferlist bl;
+  a->ioctx->notify(a->oid, 0, bl);
+  if (a->done)
+    sem_post(a->done);
+  return NULL;
+}
+
+TEST_P(LibRadosWatchNotifyPP, AckBeforeNextCallbackPP) {
+  ASSERT_EQ(0, sem_init(&sem, 0, 0));
+  sem_t foo_acked;
+  ASSERT_EQ(0, sem_init(&foo_acked, 0, 0));
+  bufferlist bl1;
+  bl1.append("x");
+  ASSERT_EQ(0, ioctx.write_full("baz", bl1));
+  ASSERT_EQ(0, ioctx.write_full("foo", bl1));
+  ASSERT_EQ(0, ioctx.write_full("bar", bl1));
+
+  // notify from another client, so the notifies do not complete through
+  // the finisher the callbacks below hold up
+  Rados cluster2;
+  ASSERT_EQ("", connect_cluster_pp(cluster2));
+  IoCtx ioctx2;
+  ASSERT_EQ(0, cluster2.ioctx_create(pool_name.c_str(), ioctx2));
+  ioctx2.set_namespace(nspace);
+
+  SleepWatchCtx baz_ctx;
+  WatchNotifyTestCtx foo_ctx;
+  WaitWatchCtx bar_ctx(&foo_acked);
+  uint64_t handles[3];
+  ASSERT_EQ(0, ioctx.watch("baz", 0, &handles[0], &baz_ctx));
+  ASSERT_EQ(0, ioctx.watch("foo", 0, &handles[1], &foo_ctx));
+  ASSERT_EQ(0, ioctx.watch("bar", 0, &handles[2], &bar_ctx));
+
+  // the notifies to foo and bar queue up behind the slow one to baz and
+  // are delivered together; bar's callback waits for foo's notify to be
+  // acked, which it must be before bar's callback runs
+  notify_arg_t args[3] = {
+    { &ioctx2, "baz", 0, NULL },
+    { &ioctx2, "foo", 500000, &foo_acked },
+    { &ioctx2, "bar", 1000000, NULL },
+  };
+  pthread_t threads[3];
+  for (int i = 0; i < 3; ++i)
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, notify_thread, &args[i]));
+  for (int i = 0; i < 3; ++i)
+    pthread_join(threads[i], NULL);
+  for (int i = 0; i < 3; ++i)
+    sem_wait(&sem);
+  ASSERT_FALSE(bar_ctx.timed_out);
+
+  ioctx.unwatch("baz", handles[0]);
+  ioctx.unwatch("foo", handles[1]);
+  ioctx.unwatch("bar", handles[2]);
+  ioctx2.close();
+  cluster2.shutdown();
+  sem_destroy(&foo_acked);
+  sem_destroy(&sem);
+}
+
 TEST_P(LibRadosWatchNotifyPP, WatchNotifyTimeoutTestPP) {
   ASSERT_EQ(0, sem_init(&sem, 0, 0));
   ioctx.set_notify_timeout(1);
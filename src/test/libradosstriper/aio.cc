@@ -442,6 +442,38 @@ TEST_F(StriperTestPP, RoundTripAppendPP) {
   my_completion3->release();
 }
 
+TEST_F(StriperTestPP, BufferedAppendSafePP) {
+  ASSERT_EQ(0, cluster.conf_set("rados_striper_buffer_appends", "true"));
+  RadosStriper bstriper;
+  ASSERT_EQ(0, RadosStriper::striper_create(ioctx, &bstriper));
+  ASSERT_EQ(0, cluster.conf_set("rados_striper_buffer_appends", "false"));
+  AioCompletion *my_completion = librados::Rados::aio_create_completion();
+  char buf[128];
+  memset(buf, 0xcc, sizeof(buf));
+  bufferlist bl1;
+  bl1.append(buf, sizeof(buf));
+  ASSERT_EQ(0, bstriper.aio_append("BufferedAppendSafePP", my_completion, bl1, sizeof(buf)));
+  {
+    TestAlarm alarm;
+    my_completion->wait_for_complete();
+  }
+  // the append is only in memory, so it is not safe yet
+  ASSERT_FALSE(my_completion->is_safe());
+  uint64_t size;
+  time_t mtime;
+  ASSERT_EQ(-ENOENT, striper.stat("BufferedAppendSafePP", &size, &mtime));
+  // until it is written
+  ASSERT_EQ(0, bstriper.aio_flush());
+  {
+    TestAlarm alarm;
+    my_completion->wait_for_safe();
+  }
+  ASSERT_EQ(0, my_completion->get_return_value());
+  ASSERT_EQ(0, striper.stat("BufferedAppendSafePP", &size, &mtime));
+  ASSERT_EQ(sizeof(buf), size);
+  my_completion->release();
+}
+
 TEST_F(StriperTest, Flush) {
   AioTestData test_data;
   rados_completion_t my_completion;
@@ -197,6 +197,85 @@ TEST_F(StriperTestPP, AppendRoundTripPP) {
   ASSERT_EQ(0, memcmp(bl3_str + sizeof(buf), buf2, sizeof(buf2)));
 }
 
+TEST_F(StriperTestPP, BufferedAppendRoundTripPP) {
+  ASSERT_EQ(0, cluster.conf_set("rados_striper_buffer_appends", "true"));
+  RadosStriper bstriper;
+  ASSERT_EQ(0, RadosStriper::striper_create(ioctx, &bstriper));
+  ASSERT_EQ(0, cluster.conf_set("rados_striper_buffer_appends", "false"));
+  char buf[64];
+  bufferlist expected;
+  for (int i = 0; i < 16; i++) {
+    memset(buf, 'a' + i, sizeof(buf));
+    bufferlist bl;
+    bl.append(buf, sizeof(buf));
+    expected.append(buf, sizeof(buf));
+    ASSERT_EQ(0, bstriper.append("BufferedAppendRoundTripPP", bl, sizeof(buf)));
+  }
+  // nothing reached the cluster yet
+  uint64_t size;
+  time_t mtime;
+  ASSERT_EQ(-ENOENT, striper.stat("BufferedAppendRoundTripPP", &size, &mtime));
+  // reading through the buffering striper sees its own appends
+  bufferlist bl2;
+  ASSERT_EQ((int)expected.length(),
+	    bstriper.read("BufferedAppendRoundTripPP", &bl2, expected.length(), 0));
+  ASSERT_TRUE(bl2.contents_equal(expected));
+  // and the rest is written on flush
+  bufferlist bl3;
+  bl3.append(buf, sizeof(buf));
+  expected.append(buf, sizeof(buf));
+  ASSERT_EQ(0, bstriper.append("BufferedAppendRoundTripPP", bl3, sizeof(buf)));
+  ASSERT_EQ(0, bstriper.aio_flush());
+  ASSERT_EQ(0, striper.stat("BufferedAppendRoundTripPP", &size, &mtime));
+  ASSERT_EQ(expected.length(), size);
+  bufferlist bl4;
+  ASSERT_EQ((int)expected.length(),
+	    striper.read("BufferedAppendRoundTripPP", &bl4, expected.length(), 0));
+  ASSERT_TRUE(bl4.contents_equal(expected));
+}
+
+TEST_F(StriperTestPP, ReadaheadRoundTripPP) {
+  ASSERT_EQ(0, cluster.conf_set("rados_striper_readahead_max_bytes", "1048576"));
+  ASSERT_EQ(0, cluster.conf_set("rados_striper_readahead_trigger_requests", "2"));
+  RadosStriper rstriper;
+  ASSERT_EQ(0, RadosStriper::striper_create(ioctx, &rstriper));
+  ASSERT_EQ(0, cluster.conf_set("rados_striper_readahead_max_bytes", "0"));
+  ASSERT_EQ(0, cluster.conf_set("rados_striper_readahead_trigger_requests", "10"));
+  ASSERT_EQ(0, rstriper.set_object_layout_stripe_unit(65536));
+  ASSERT_EQ(0, rstriper.set_object_layout_stripe_count(2));
+  ASSERT_EQ(0, rstriper.set_object_layout_object_size(131072));
+  bufferlist bl;
+  for (int i = 0; i < 1024; i++) {
+    char buf[1024];
+    memset(buf, i & 0xff, sizeof(buf));
+    bl.append(buf, sizeof(buf));
+  }
+  ASSERT_EQ(0, rstriper.write("ReadaheadRoundTripPP", bl, bl.length(), 0));
+  // sequential reads, partly served from prefetched data
+  for (uint64_t off = 0; off < bl.length(); off += 16384) {
+    bufferlist expected;
+    expected.substr_of(bl, off, 16384);
+    bufferlist bl2;
+    ASSERT_EQ(16384, rstriper.read("ReadaheadRoundTripPP", &bl2, 16384, off));
+    ASSERT_TRUE(bl2.contents_equal(expected));
+  }
+  // a write drops what was prefetched
+  bufferlist bl3;
+  bl3.append_zero(16384);
+  ASSERT_EQ(0, rstriper.write("ReadaheadRoundTripPP", bl3, bl3.length(), 0));
+  for (uint64_t off = 0; off < 65536; off += 16384) {
+    bufferlist bl4;
+    ASSERT_EQ(16384, rstriper.read("ReadaheadRoundTripPP", &bl4, 16384, off));
+    if (off == 0) {
+      ASSERT_TRUE(bl4.contents_equal(bl3));
+    } else {
+      bufferlist expected;
+      expected.substr_of(bl, off, 16384);
+      ASSERT_TRUE(bl4.contents_equal(expected));
+    }
+  }
+}
+
 TEST_F(StriperTest, TruncTest) {
   char buf[128];
   char buf2[sizeof(buf)];
@@ -939,6 +939,71 @@ TEST_F(TestLibRBD, TestIOPP)
   ioctx.close();
 }
 
+TEST_F(TestLibRBD, QueuedAioPP)
+{
+  ASSERT_EQ(0, _rados.conf_set("rbd_op_threads", "2"));
+  BOOST_SCOPE_EXIT( (&_rados) ) {
+    _rados.conf_set("rbd_op_threads", "0");
+  } BOOST_SCOPE_EXIT_END;
+
+  librados::IoCtx ioctx;
+  ASSERT_EQ(0, _rados.ioctx_create(m_pool_name.c_str(), ioctx));
+
+  {
+    librbd::RBD rbd;
+    librbd::Image image;
+    int order = 0;
+    std::string name = get_temp_image_name();
+    uint64_t size = 2 << 20;
+
+    ASSERT_EQ(0, create_image_pp(rbd, ioctx, name.c_str(), size, &order));
+    ASSERT_EQ(0, rbd.open(ioctx, image, name.c_str(), NULL));
+
+    char test_data[TEST_IO_SIZE + 1];
+    int i;
+    for (i = 0; i < TEST_IO_SIZE; ++i) {
+      test_data[i] = (char) (rand() % (126 - 33) + 33);
+    }
+    test_data[TEST_IO_SIZE] = '\0';
+
+    // queue the writes and a flush behind them without waiting
+    std::vector<librbd::RBD::AioCompletion*> comps;
+    for (i = 0; i < 10; ++i) {
+      ceph::bufferlist bl;
+      bl.append(test_data, TEST_IO_SIZE);
+      librbd::RBD::AioCompletion *comp =
+	new librbd::RBD::AioCompletion(NULL, NULL);
+      ASSERT_EQ(0, image.aio_write(TEST_IO_SIZE * i, TEST_IO_SIZE, bl, comp));
+      comps.push_back(comp);
+    }
+    librbd::RBD::AioCompletion *flush_comp =
+      new librbd::RBD::AioCompletion(NULL, NULL);
+    ASSERT_EQ(0, image.aio_flush(flush_comp));
+    flush_comp->wait_for_complete();
+    ASSERT_EQ(0, flush_comp->get_return_value());
+    flush_comp->release();
+    for (i = 0; i < 10; ++i) {
+      ASSERT_TRUE(comps[i]->is_complete());
+      ASSERT_EQ(0, comps[i]->get_return_value());
+      comps[i]->release();
+    }
+
+    for (i = 0; i < 10; ++i)
+      aio_read_test_data(image, test_data, TEST_IO_SIZE * i, TEST_IO_SIZE);
+
+    // errors come back through the completion
+    ceph::bufferlist bl;
+    librbd::RBD::AioCompletion *comp =
+      new librbd::RBD::AioCompletion(NULL, NULL);
+    ASSERT_EQ(0, image.aio_read(size, TEST_IO_SIZE, bl, comp));
+    comp->wait_for_complete();
+    ASSERT_EQ(-EINVAL, comp->get_return_value());
+    comp->release();
+  }
+
+  ioctx.close();
+}
+
 
 TEST_F(TestLibRBD, TestIOToSnapshot)
 {
@@ -2018,6 +2083,298 @@ TEST_F(TestLibRBD, LargeCacheRead)
   rados_ioctx_destroy(ioctx);
 }
 
+TEST_F(TestLibRBD, ShardedCache)
+{
+  if (!g_conf->rbd_cache) {
+    std::cout << "SKIPPING due to disabled cache" << std::endl;
+    return;
+  }
+
+  rados_ioctx_t ioctx;
+  rados_ioctx_create(_cluster, m_pool_name.c_str(), &ioctx);
+
+  int orig_cache_shards = g_conf->rbd_cache_shards;
+  g_conf->set_val("rbd_cache_shards", "4");
+  BOOST_SCOPE_EXIT( (orig_cache_shards) ) {
+    g_conf->set_val("rbd_cache_shards", stringify(orig_cache_shards).c_str());
+  } BOOST_SCOPE_EXIT_END;
+  ASSERT_EQ(4, g_conf->rbd_cache_shards);
+
+  rbd_image_t image;
+  int order = 20;
+  std::string name = get_temp_image_name();
+  const int objects = 16;
+  uint64_t object_size = 1 << order;
+  uint64_t size = objects * object_size;
+
+  ASSERT_EQ(0, create_image(ioctx, name.c_str(), size, &order));
+  ASSERT_EQ(0, rbd_open(ioctx, name.c_str(), &image, NULL));
+
+  // each object lands in some shard; the data has to come back the same
+  // from the cache, after a flush of every shard, and from the osds
+  for (int i = 0; i < objects; ++i) {
+    std::string buffer(object_size, 'a' + i);
+    ASSERT_EQ(static_cast<ssize_t>(object_size),
+	      rbd_write(image, i * object_size, object_size, buffer.c_str()));
+  }
+  std::string buffer(size, '\0');
+  ASSERT_EQ(static_cast<ssize_t>(size), rbd_read(image, 0, size, &buffer[0]));
+  for (int i = 0; i < objects; ++i)
+    ASSERT_EQ(std::string(object_size, 'a' + i),
+	      buffer.substr(i * object_size, object_size));
+
+  ASSERT_EQ(0, rbd_flush(image));
+  ASSERT_EQ(0, rbd_invalidate_cache(image));
+
+  // a discard spanning objects in different shards
+  ASSERT_EQ(static_cast<ssize_t>(2 * object_size),
+	    rbd_discard(image, 3 * object_size, 2 * object_size));
+  buffer.assign(size, 'x');
+  ASSERT_EQ(static_cast<ssize_t>(size), rbd_read(image, 0, size, &buffer[0]));
+  for (int i = 0; i < objects; ++i) {
+    char c = (i == 3 || i == 4) ? '\0' : 'a' + i;
+    ASSERT_EQ(std::string(object_size, c),
+	      buffer.substr(i * object_size, object_size));
+  }
+
+  ASSERT_EQ(0, rbd_close(image));
+
+  rados_ioctx_destroy(ioctx);
+}
+
+TEST_F(TestLibRBD, CopyOnReadPP)
+{
+  ASSERT_EQ(0, _rados.conf_set("rbd_clone_copy_on_read", "true"));
+  BOOST_SCOPE_EXIT( (&_rados) ) {
+    _rados.conf_set("rbd_clone_copy_on_read", "false");
+  } BOOST_SCOPE_EXIT_END;
+
+  librados::IoCtx ioctx;
+  ASSERT_EQ(0, _rados.ioctx_create(m_pool_name.c_str(), ioctx));
+
+  {
+    librbd::RBD rbd;
+    int order = 0;
+    std::string parent_name = get_temp_image_name();
+    std::string child_name = get_temp_image_name();
+    uint64_t size = 4 << 20;
+
+    ASSERT_EQ(0, rbd.create2(ioctx, parent_name.c_str(), size,
+			     RBD_FEATURE_LAYERING, &order));
+    {
+      librbd::Image parent;
+      ASSERT_EQ(0, rbd.open(ioctx, parent, parent_name.c_str(), NULL));
+      bufferlist bl;
+      bl.append("testdata");
+      ASSERT_EQ((ssize_t)bl.length(), parent.write(0, bl.length(), bl));
+      ASSERT_EQ(0, parent.snap_create("snap"));
+      ASSERT_EQ(0, parent.snap_protect("snap"));
+    }
+    ASSERT_EQ(0, rbd.clone(ioctx, parent_name.c_str(), "snap", ioctx,
+			   child_name.c_str(), RBD_FEATURE_LAYERING, &order));
+
+    std::string oid;
+    {
+      librbd::Image child;
+      ASSERT_EQ(0, rbd.open(ioctx, child, child_name.c_str(), NULL));
+      librbd::image_info_t info;
+      ASSERT_EQ(0, child.stat(info, sizeof(info)));
+      oid = std::string(info.block_name_prefix) + ".0000000000000000";
+      ASSERT_EQ(-ENOENT, ioctx.stat(oid, NULL, NULL));
+
+      bufferlist read_bl;
+      ASSERT_EQ(8, child.read(0, 8, read_bl));
+      ASSERT_EQ("testdata", std::string(read_bl.c_str(), read_bl.length()));
+    }
+
+    // closing the child waits for the copyup
+    uint64_t obj_size;
+    ASSERT_EQ(0, ioctx.stat(oid, &obj_size, NULL));
+    ASSERT_LE(8u, obj_size);
+  }
+
+  ioctx.close();
+}
+
+TEST_F(TestLibRBD, PersistentCachePP)
+{
+  char dir[] = "/tmp/test_librbd_wlog.XXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  ASSERT_EQ(0, _rados.conf_set("rbd_persistent_cache_path", dir));
+  ASSERT_EQ(0, _rados.conf_set("rbd_persistent_cache_size", "4194304"));
+  ASSERT_EQ(0, _rados.conf_set("rbd_persistent_cache", "true"));
+  BOOST_SCOPE_EXIT( (&_rados) ) {
+    _rados.conf_set("rbd_persistent_cache", "false");
+  } BOOST_SCOPE_EXIT_END;
+
+  librados::IoCtx ioctx;
+  ASSERT_EQ(0, _rados.ioctx_create(m_pool_name.c_str(), ioctx));
+
+  {
+    librbd::RBD rbd;
+    int order = 0;
+    std::string name = get_temp_image_name();
+    uint64_t size = 2 << 20;
+    ASSERT_EQ(0, create_image_pp(rbd, ioctx, name.c_str(), size, &order));
+
+    {
+      librbd::Image image;
+      ASSERT_EQ(0, rbd.open(ioctx, image, name.c_str(), NULL));
+
+      // more than the log holds, so appends have to wait for destage
+      bufferlist bl;
+      bl.append(std::string(1 << 20, '1'));
+      for (uint64_t off = 0; off < size; off += bl.length())
+	ASSERT_EQ((ssize_t)bl.length(), image.write(off, bl.length(), bl));
+      ASSERT_EQ(4096, image.discard(4096, 4096));
+
+      // reads see writes still in the log
+      bufferlist read_bl;
+      ASSERT_EQ(8192, image.read(0, 8192, read_bl));
+      ASSERT_EQ(std::string(4096, '1') + std::string(4096, '\0'),
+		std::string(read_bl.c_str(), read_bl.length()));
+      ASSERT_EQ(0, image.flush());
+    }
+
+    // and so does another client once we are closed
+    _rados.conf_set("rbd_persistent_cache", "false");
+    {
+      librbd::Image image;
+      ASSERT_EQ(0, rbd.open(ioctx, image, name.c_str(), NULL));
+      bufferlist read_bl;
+      ASSERT_EQ(8192, image.read(size - 8192, 8192, read_bl));
+      ASSERT_EQ(std::string(8192, '1'),
+		std::string(read_bl.c_str(), read_bl.length()));
+    }
+  }
+
+  ioctx.close();
+}
+
+TEST_F(TestLibRBD, PersistentCacheSnapshotPP)
+{
+  char dir[] = "/tmp/test_librbd_wlog.XXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  ASSERT_EQ(0, _rados.conf_set("rbd_persistent_cache_path", dir));
+  ASSERT_EQ(0, _rados.conf_set("rbd_persistent_cache_size", "4194304"));
+  ASSERT_EQ(0, _rados.conf_set("rbd_persistent_cache", "true"));
+  BOOST_SCOPE_EXIT( (&_rados) ) {
+    _rados.conf_set("rbd_persistent_cache", "false");
+  } BOOST_SCOPE_EXIT_END;
+
+  librados::IoCtx ioctx;
+  ASSERT_EQ(0, _rados.ioctx_create(m_pool_name.c_str(), ioctx));
+
+  {
+    librbd::RBD rbd;
+    int order = 0;
+    std::string name = get_temp_image_name();
+    uint64_t size = 2 << 20;
+    ASSERT_EQ(0, create_image_pp(rbd, ioctx, name.c_str(), size, &order));
+
+    librbd::Image image;
+    ASSERT_EQ(0, rbd.open(ioctx, image, name.c_str(), NULL));
+
+    // the first write is acked from the log before the snapshot exists
+    bufferlist bl;
+    bl.append(std::string(4096, '1'));
+    ASSERT_EQ(4096, image.write(0, bl.length(), bl));
+    ASSERT_EQ(0, image.snap_create("snap"));
+    bl.clear();
+    bl.append(std::string(4096, '2'));
+    ASSERT_EQ(4096, image.write(0, bl.length(), bl));
+
+    bufferlist read_bl;
+    ASSERT_EQ(4096, image.read(0, 4096, read_bl));
+    ASSERT_EQ(std::string(4096, '2'),
+	      std::string(read_bl.c_str(), read_bl.length()));
+
+    // snap_set destages the log
+    ASSERT_EQ(0, image.snap_set("snap"));
+    read_bl.clear();
+    ASSERT_EQ(4096, image.read(0, 4096, read_bl));
+    ASSERT_EQ(std::string(4096, '1'),
+	      std::string(read_bl.c_str(), read_bl.length()));
+  }
+
+  ioctx.close();
+}
+
+TEST_F(TestLibRBD, PersistentCacheReplayPP)
+{
+  char dir[] = "/tmp/test_librbd_wlog.XXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  ASSERT_EQ(0, _rados.conf_set("rbd_persistent_cache_path", dir));
+  ASSERT_EQ(0, _rados.conf_set("rbd_persistent_cache_size", "4194304"));
+  ASSERT_EQ(0, _rados.conf_set("rbd_persistent_cache", "true"));
+  ASSERT_EQ(0, _rados.conf_set("rbd_persistent_cache_debug_no_destage", "true"));
+  BOOST_SCOPE_EXIT( (&_rados) ) {
+    _rados.conf_set("rbd_persistent_cache", "false");
+    _rados.conf_set("rbd_persistent_cache_debug_no_destage", "false");
+  } BOOST_SCOPE_EXIT_END;
+
+  librados::IoCtx ioctx;
+  ASSERT_EQ(0, _rados.ioctx_create(m_pool_name.c_str(), ioctx));
+
+  {
+    librbd::RBD rbd;
+    int order = 0;
+    std::string name = get_temp_image_name();
+    uint64_t size = 2 << 20;
+    ASSERT_EQ(0, create_image_pp(rbd, ioctx, name.c_str(), size, &order));
+
+    // close with everything still in the log, as a crashed client would
+    {
+      librbd::Image image;
+      ASSERT_EQ(0, rbd.open(ioctx, image, name.c_str(), NULL));
+      bufferlist bl;
+      bl.append(std::string(4096, '1'));
+      ASSERT_EQ(4096, image.write(0, bl.length(), bl));
+      ASSERT_EQ(0, image.snap_create("snap"));
+      bl.clear();
+      bl.append(std::string(4096, '2'));
+      ASSERT_EQ(4096, image.write(4096, bl.length(), bl));
+      ASSERT_EQ(0, image.flush());
+    }
+
+    _rados.conf_set("rbd_persistent_cache", "false");
+    {
+      librbd::Image image;
+      ASSERT_EQ(0, rbd.open(ioctx, image, name.c_str(), NULL));
+      bufferlist read_bl;
+      ASSERT_EQ(8192, image.read(0, 8192, read_bl));
+      ASSERT_EQ(std::string(8192, '\0'),
+		std::string(read_bl.c_str(), read_bl.length()));
+    }
+
+    // the next open replays the log, each write under its own snapc
+    _rados.conf_set("rbd_persistent_cache_debug_no_destage", "false");
+    _rados.conf_set("rbd_persistent_cache", "true");
+    {
+      librbd::Image image;
+      ASSERT_EQ(0, rbd.open(ioctx, image, name.c_str(), NULL));
+    }
+
+    _rados.conf_set("rbd_persistent_cache", "false");
+    {
+      librbd::Image image;
+      ASSERT_EQ(0, rbd.open(ioctx, image, name.c_str(), NULL));
+      bufferlist read_bl;
+      ASSERT_EQ(8192, image.read(0, 8192, read_bl));
+      ASSERT_EQ(std::string(4096, '1') + std::string(4096, '2'),
+		std::string(read_bl.c_str(), read_bl.length()));
+
+      ASSERT_EQ(0, image.snap_set("snap"));
+      read_bl.clear();
+      ASSERT_EQ(8192, image.read(0, 8192, read_bl));
+      ASSERT_EQ(std::string(4096, '1') + std::string(4096, '\0'),
+		std::string(read_bl.c_str(), read_bl.length()));
+    }
+  }
+
+  ioctx.close();
+}
+
 int main(int argc, char **argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,201 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <unistd.h>
+
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "messages/MPing.h"
+#include "msg/Dispatcher.h"
+#include "msg/async/AsyncMessenger.h"
+#include "msg/async/ShmChannel.h"
+#include "test/unit.h"
+
+class CountingDispatcher : public Dispatcher {
+ public:
+  Mutex lock;
+  Cond cond;
+  int got;
+
+  CountingDispatcher()
+    : Dispatcher(g_ceph_context), lock("CountingDispatcher::lock"), got(0) {}
+
+  bool ms_dispatch(Message *m) {
+    Mutex::Locker l(lock);
+    ++got;
+    cond.Signal();
+    m->put();
+    return true;
+  }
+  bool ms_handle_reset(Connection *con) { return true; }
+  void ms_handle_remote_reset(Connection *con) {}
+  bool ms_verify_authorizer(Connection *con, int peer_type, int protocol,
+			    bufferlist& authorizer, bufferlist& authorizer_reply,
+			    bool& isvalid, CryptoKey& session_key) {
+    isvalid = true;
+    return true;
+  }
+
+  /// @returns true if n messages arrived within 30 seconds
+  bool wait_for(int n) {
+    Mutex::Locker l(lock);
+    utime_t end = ceph_clock_now(g_ceph_context) + utime_t(30, 0);
+    while (got < n) {
+      if (ceph_clock_now(g_ceph_context) > end)
+	return false;
+      cond.WaitInterval(g_ceph_context, lock, utime_t(1, 0));
+    }
+    return true;
+  }
+};
+
+class AsyncMessengerTest : public ::testing::Test {
+ public:
+  CountingDispatcher server_dispatcher, client_dispatcher;
+  AsyncMessenger *server;
+  vector<AsyncMessenger*> clients;
+
+  AsyncMessengerTest() : server(NULL) {}
+
+  AsyncMessenger *create(entity_name_t name, const char *lname) {
+    return new AsyncMessenger(g_ceph_context, name, lname, getpid());
+  }
+
+  void start_server() {
+    server = create(entity_name_t::OSD(0), "server");
+    server->set_default_policy(Messenger::Policy::stateless_server(0, 0));
+    entity_addr_t addr;
+    addr.parse("127.0.0.1:0");
+    ASSERT_EQ(0, server->bind(addr));
+    server->add_dispatcher_head(&server_dispatcher);
+    ASSERT_EQ(0, server->start());
+  }
+
+  void start_clients(int n) {
+    for (int i = 0; i < n; ++i) {
+      AsyncMessenger *c = create(entity_name_t::CLIENT(i), "client");
+      c->set_default_policy(Messenger::Policy::lossy_client(0, 0));
+      c->add_dispatcher_head(&client_dispatcher);
+      ASSERT_EQ(0, c->start());
+      clients.push_back(c);
+    }
+  }
+
+  virtual void TearDown() {
+    for (vector<AsyncMessenger*>::iterator p = clients.begin();
+	 p != clients.end();
+	 ++p) {
+      (*p)->shutdown();
+      (*p)->wait();
+      delete *p;
+    }
+    clients.clear();
+    if (server) {
+      server->shutdown();
+      server->wait();
+      delete server;
+      server = NULL;
+    }
+    g_ceph_context->_conf->set_val("ms_async_shm", "false");
+    g_ceph_context->_conf->apply_changes(NULL);
+  }
+
+  void ping_all(int per_client) {
+    vector<ConnectionRef> cons;
+    for (unsigned i = 0; i < clients.size(); ++i) {
+      ConnectionRef con = clients[i]->get_connection(server->get_myinst());
+      // one connection per peer, found again through its shard
+      ASSERT_EQ(con, clients[i]->get_connection(server->get_myinst()));
+      cons.push_back(con);
+    }
+    for (int n = 0; n < per_client; ++n)
+      for (unsigned i = 0; i < cons.size(); ++i)
+	cons[i]->send_message(new MPing);
+    ASSERT_TRUE(server_dispatcher.wait_for(per_client * clients.size()));
+  }
+};
+
+TEST_F(AsyncMessengerTest, ManyConnections)
+{
+  // more clients than workers, so connections land on every shard
+  ASSERT_NO_FATAL_FAILURE(start_server());
+  ASSERT_NO_FATAL_FAILURE(start_clients(8));
+  ASSERT_NO_FATAL_FAILURE(ping_all(100));
+}
+
+TEST_F(AsyncMessengerTest, ShmManyConnections)
+{
+  g_ceph_context->_conf->set_val("ms_async_shm", "true");
+  g_ceph_context->_conf->set_val("ms_async_shm_dir", "/tmp");
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  ASSERT_NO_FATAL_FAILURE(start_server());
+  string path = server->get_shm_path(server->get_myaddr());
+  EXPECT_EQ(0, ::access(path.c_str(), F_OK));
+  ASSERT_NO_FATAL_FAILURE(start_clients(8));
+  // every client hands the server a channel, all through the worker pool
+  ASSERT_NO_FATAL_FAILURE(ping_all(100));
+}
+
+TEST_F(AsyncMessengerTest, SendMessageByAddr)
+{
+  ASSERT_NO_FATAL_FAILURE(start_server());
+  ASSERT_NO_FATAL_FAILURE(start_clients(4));
+
+  // no connection yet: submit_message creates it on the right worker
+  for (int n = 0; n < 50; ++n)
+    for (unsigned i = 0; i < clients.size(); ++i)
+      clients[i]->send_message(new MPing, server->get_myinst());
+  ASSERT_TRUE(server_dispatcher.wait_for(50 * clients.size()));
+}
+
+TEST_F(AsyncMessengerTest, Loopback)
+{
+  ASSERT_NO_FATAL_FAILURE(start_server());
+  ASSERT_EQ(server->get_loopback_connection(),
+	    server->get_connection(server->get_myinst()));
+  server->send_message(new MPing, server->get_myinst());
+  ASSERT_TRUE(server_dispatcher.wait_for(1));
+}
+
+TEST(ShmRing, CorruptPeer)
+{
+  const uint64_t size = 4096;
+  vector<char> mem(ShmRing::get_footprint(size));
+  shm_ring_header_t *h = (shm_ring_header_t*)&mem[0];
+  memset(h, 0, sizeof(*h));
+  ShmRing ring;
+  ring.init(&mem[0], size);
+
+  char buf[2 * size];
+  memset(buf, 0xcc, sizeof(buf));
+  ASSERT_EQ((int64_t)size, ring.write(buf, sizeof(buf)));
+  ASSERT_EQ(0, ring.write(buf, 1));
+  ASSERT_EQ(100, ring.read(buf, 100));
+
+  // a tail past the head would make the free space look huge
+  h->tail = h->head + 1;
+  ASSERT_TRUE(ring.is_corrupt());
+  ASSERT_EQ(0u, ring.get_space());
+  ASSERT_EQ(-EIO, ring.write(buf, sizeof(buf)));
+  ASSERT_FALSE(ring.wait_writable());
+
+  // as would a head more than a ring ahead of the tail for reads
+  h->tail = 0;
+  h->head = size + 1;
+  ASSERT_EQ(-EIO, ring.read(buf, sizeof(buf)));
+  ASSERT_FALSE(ring.wait_readable());
+}
+
+// Local Variables:
+// compile-command: "cd ../.. ; make unittest_async_messenger && ./unittest_async_messenger"
+// End:
@@ -0,0 +1,96 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "msg/async/ShmChannel.h"
+#include "test/unit.h"
+
+#ifdef __linux__
+
+static bool readable(int fd)
+{
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  return ::poll(&pfd, 1, 0) == 1;
+}
+
+class ShmChannelTest : public ::testing::Test {
+ public:
+  ShmChannel client, server;
+  ShmChannelTest() : client(g_ceph_context), server(g_ceph_context) {}
+
+  virtual void SetUp() {
+    int sv[2];
+    ASSERT_EQ(0, ::socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    ASSERT_EQ(0, client.create(4096));
+    // queue the ack up front so we can do both ends from one thread
+    char ack = 0;
+    ASSERT_EQ(1, ::write(sv[1], &ack, 1));
+    ASSERT_EQ(0, client.connect(sv[0], 42));
+    uint64_t cookie = 0;
+    ASSERT_EQ(0, server.accept(sv[1], &cookie));
+    ASSERT_EQ(42u, cookie);
+    ::close(sv[0]);
+    ::close(sv[1]);
+  }
+};
+
+TEST_F(ShmChannelTest, BothDirections)
+{
+  char buf[16];
+  ASSERT_EQ(5, client.write("hello", 5));
+  ASSERT_EQ(5, server.read(buf, sizeof(buf)));
+  ASSERT_EQ(0, memcmp(buf, "hello", 5));
+  ASSERT_EQ(5, server.write("world", 5));
+  ASSERT_EQ(5, client.read(buf, sizeof(buf)));
+  ASSERT_EQ(0, memcmp(buf, "world", 5));
+  ASSERT_EQ(0, client.read(buf, sizeof(buf)));
+}
+
+TEST_F(ShmChannelTest, WrapAround)
+{
+  char in[3000], out[3000];
+  for (int round = 0; round < 5; ++round) {
+    memset(in, 'a' + round, sizeof(in));
+    ASSERT_EQ((int)sizeof(in), client.write(in, sizeof(in)));
+    ASSERT_EQ((int)sizeof(out), server.read(out, sizeof(out)));
+    ASSERT_EQ(0, memcmp(in, out, sizeof(in)));
+  }
+}
+
+TEST_F(ShmChannelTest, Wakeups)
+{
+  char buf[8192];
+  memset(buf, 'x', sizeof(buf));
+
+  // an empty read arms a wakeup the writer delivers
+  ASSERT_EQ(0, server.read(buf, 1));
+  ASSERT_FALSE(readable(server.get_event_fd()));
+  ASSERT_EQ(1, client.write(buf, 1));
+  ASSERT_TRUE(readable(server.get_event_fd()));
+  server.clear_event();
+  ASSERT_FALSE(readable(server.get_event_fd()));
+  ASSERT_EQ(1, server.read(buf, 1));
+
+  // so does a short write, once the reader makes room
+  ASSERT_EQ(4096, client.write(buf, sizeof(buf)));
+  ASSERT_FALSE(readable(client.get_event_fd()));
+  ASSERT_EQ(100, server.read(buf, 100));
+  ASSERT_TRUE(readable(client.get_event_fd()));
+}
+
+#endif
@@ -258,6 +258,75 @@ TEST_P(StoreTest, SimpleCloneTest) {
   }
 }
 
+TEST_P(StoreTest, SparseCloneRangeTest) {
+  int r;
+  coll_t cid = coll_t("coll");
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  ghobject_t hoid2(hobject_t(sobject_t("Object 2", CEPH_NOSNAP)));
+  bufferlist bl;
+  bl.append(string(65536, 'a'));
+  {
+    // data, a hole, data, then a trailing hole
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 0, bl.length(), bl);
+    t.write(cid, hoid, 1048576, bl.length(), bl);
+    t.truncate(cid, hoid, 2097152);
+    cerr << "Creating sparse object " << hoid << std::endl;
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  {
+    bufferlist fm;
+    r = store->fiemap(cid, hoid, 0, 2097152, fm);
+    ASSERT_EQ(r, 0);
+    map<uint64_t, uint64_t> m;
+    bufferlist::iterator p = fm.begin();
+    ::decode(m, p);
+    interval_set<uint64_t> extents;
+    for (map<uint64_t, uint64_t>::iterator i = m.begin(); i != m.end(); ++i) {
+      ASSERT_LE(i->first + i->second, 2097152u);
+      extents.insert(i->first, i->second);
+    }
+    ASSERT_TRUE(extents.contains(0, bl.length()));
+    ASSERT_TRUE(extents.contains(1048576, bl.length()));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.touch(cid, hoid2);
+    t.clone_range(cid, hoid, hoid2, 0, 2097152, 0);
+    cerr << "Clone range sparse object" << std::endl;
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  {
+    struct stat st;
+    r = store->stat(cid, hoid2, &st);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(2097152, st.st_size);
+    bufferlist a, b;
+    r = store->read(cid, hoid, 0, 2097152, a);
+    ASSERT_EQ(r, 2097152);
+    r = store->read(cid, hoid2, 0, 2097152, b);
+    ASSERT_EQ(r, 2097152);
+    ASSERT_TRUE(a.contents_equal(b));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove(cid, hoid2);
+    t.remove_collection(cid);
+    cerr << "Cleaning" << std::endl;
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTest, SimpleObjectLongnameTest) {
   int r;
   coll_t cid = coll_t("coll");
@@ -1775,6 +1844,66 @@ TEST(DummyTest, ValueParameterizedTestsAreNotSupportedOnThisPlatform) {}
 #endif
 
 
+static void fsync_commit_round(ObjectStore *store, const coll_t &cid,
+			       int first, int count, bufferlist &bl)
+{
+  ObjectStore::Transaction t;
+  for (int i = first; i < first + count; ++i) {
+    ostringstream name;
+    name << "obj" << i;
+    t.write(cid, ghobject_t(hobject_t(sobject_t(name.str(), CEPH_NOSNAP))),
+	    0, bl.length(), bl);
+  }
+  ASSERT_EQ(0, store->apply_transaction(t));
+  store->sync_and_flush();
+}
+
+TEST(FileStoreTest, FsyncCommit) {
+  g_ceph_context->_conf->set_val("filestore_fsync_commit", "true");
+  g_ceph_context->_conf->set_val("filestore_fsync_commit_max_files", "4");
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  ASSERT_TRUE(::mkdir("store_test_temp_dir", 0777) == 0 || errno == EEXIST);
+  boost::scoped_ptr<ObjectStore> store(
+    ObjectStore::create(g_ceph_context, "filestore",
+			"store_test_temp_dir", "store_test_temp_journal"));
+  ASSERT_EQ(0, store->mkfs());
+  ASSERT_EQ(0, store->mount());
+
+  coll_t cid("fsync_commit");
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    ASSERT_EQ(0, store->apply_transaction(t));
+  }
+  bufferlist bl;
+  bl.append("abcdefgh");
+  // fits the dirty set
+  fsync_commit_round(store.get(), cid, 0, 3, bl);
+  // overflows it; this commit falls back to syncfs
+  fsync_commit_round(store.get(), cid, 3, 10, bl);
+  // and the next commit goes back to fdatasync
+  fsync_commit_round(store.get(), cid, 13, 2, bl);
+
+  ASSERT_EQ(0, store->umount());
+  ASSERT_EQ(0, store->mount());
+  for (int i = 0; i < 15; ++i) {
+    ostringstream name;
+    name << "obj" << i;
+    bufferlist in;
+    ASSERT_EQ((int)bl.length(),
+	      store->read(cid, ghobject_t(hobject_t(sobject_t(name.str(),
+							      CEPH_NOSNAP))),
+			  0, bl.length(), in));
+    ASSERT_TRUE(in.contents_equal(bl));
+  }
+  store->umount();
+
+  g_ceph_context->_conf->set_val("filestore_fsync_commit", "false");
+  g_ceph_context->_conf->set_val("filestore_fsync_commit_max_files", "1024");
+  g_ceph_context->_conf->apply_changes(NULL);
+}
+
 //
 // support tests for qa/workunits/filestore/filestore.sh
 //
@@ -0,0 +1,164 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <sstream>
+#include "os/ObjectStore.h"
+#include "common/Formatter.h"
+#include "include/ceph_features.h"
+#include <gtest/gtest.h>
+
+static ghobject_t make_oid(const char *name)
+{
+  return ghobject_t(hobject_t(sobject_t(object_t(name), CEPH_NOSNAP)));
+}
+
+static string dump(ObjectStore::Transaction &t)
+{
+  JSONFormatter f(false);
+  f.open_object_section("transaction");
+  t.dump(&f);
+  f.close_section();
+  ostringstream ss;
+  f.flush(ss);
+  return ss.str();
+}
+
+static void build(ObjectStore::Transaction &t)
+{
+  coll_t c("c"), d("d");
+  ghobject_t a = make_oid("a"), b = make_oid("b");
+  bufferlist bl;
+  bl.append("some data");
+  map<string, bufferlist> kv;
+  kv["k"] = bl;
+  set<string> keys;
+  keys.insert("k");
+
+  t.create_collection(c);
+  t.touch(c, a);
+  t.write(c, a, 4096, bl.length(), bl);
+  t.setattr(c, a, "attr", bl);
+  t.clone_range(c, a, b, 0, 10, 20);
+  t.omap_setkeys(c, b, kv);
+  t.omap_rmkeys(c, b, keys);
+  t.collection_move_rename(c, b, d, a);
+  t.split_collection(c, 3, 5, d);
+  t.set_alloc_hint(d, a, 1 << 22, 1 << 12);
+  t.remove(d, a);
+}
+
+TEST(Transaction, EncodeDecode)
+{
+  ObjectStore::Transaction t;
+  build(t);
+  string expected = dump(t);
+
+  bufferlist bl;
+  t.encode(bl, CEPH_FEATURES_ALL);
+  bufferlist::iterator p = bl.begin();
+  ObjectStore::Transaction d(p);
+  ASSERT_EQ(t.get_num_ops(), d.get_num_ops());
+  ASSERT_EQ(expected, dump(d));
+}
+
+TEST(Transaction, LegacyEncodeDecode)
+{
+  ObjectStore::Transaction t;
+  build(t);
+  string expected = dump(t);
+
+  bufferlist bl;
+  t.encode(bl, 0);
+  bufferlist::iterator p = bl.begin();
+  ObjectStore::Transaction d(p);
+  ASSERT_EQ(t.get_num_ops(), d.get_num_ops());
+  ASSERT_EQ(expected, dump(d));
+}
+
+TEST(Transaction, Append)
+{
+  ObjectStore::Transaction whole, a, b;
+  coll_t c("c");
+  ghobject_t x = make_oid("x"), y = make_oid("y");
+
+  // b references y before x, so its indices must be remapped
+  whole.touch(c, x);
+  whole.touch(c, y);
+  whole.touch(c, y);
+  whole.remove(c, x);
+  a.touch(c, x);
+  b.touch(c, y);
+  b.touch(c, y);
+  b.remove(c, x);
+
+  a.append(b);
+  ASSERT_EQ(whole.get_num_ops(), a.get_num_ops());
+  ASSERT_EQ(dump(whole), dump(a));
+}
+
+TEST(Transaction, CopyDoesNotShareOpSpace)
+{
+  ObjectStore::Transaction t;
+  coll_t c("c");
+  t.touch(c, make_oid("x"));
+
+  ObjectStore::Transaction u(t);
+  t.remove(c, make_oid("x"));
+  u.touch(c, make_oid("y"));
+
+  ObjectStore::Transaction::iterator i = t.begin();
+  ASSERT_EQ((__u32)ObjectStore::Transaction::OP_TOUCH, (__u32)i.decode_op()->op);
+  ASSERT_EQ((__u32)ObjectStore::Transaction::OP_REMOVE, (__u32)i.decode_op()->op);
+  ObjectStore::Transaction::iterator j = u.begin();
+  ASSERT_EQ((__u32)ObjectStore::Transaction::OP_TOUCH, (__u32)j.decode_op()->op);
+  ObjectStore::Transaction::Op *op = j.decode_op();
+  ASSERT_EQ((__u32)ObjectStore::Transaction::OP_TOUCH, (__u32)op->op);
+  ASSERT_EQ(make_oid("y"), j.get_oid(op->oid));
+}
+
+TEST(Transaction, MalformedIds)
+{
+  ObjectStore::Transaction t;
+  coll_t c("c");
+  t.touch(c, make_oid("x"));
+  bufferlist bl;
+  t.encode(bl, CEPH_FEATURES_ALL);
+
+  // find the op table: header, ops, pad, three u32s, data_bl, op_bl
+  bufferlist::iterator p = bl.begin();
+  __u8 struct_v, struct_compat;
+  __u32 struct_len, u32;
+  uint64_t u64;
+  bufferlist data;
+  ::decode(struct_v, p);
+  ::decode(struct_compat, p);
+  ::decode(struct_len, p);
+  ::decode(u64, p);
+  ::decode(u64, p);
+  ::decode(u32, p);
+  ::decode(u32, p);
+  ::decode(u32, p);
+  ::decode(data, p);
+  unsigned op_off = p.get_off() + sizeof(__u32);
+
+  // oid is the third __le32 of the only op
+  bufferlist bad;
+  bad.append(bl.c_str(), bl.length());
+  __le32 oid = 1000;
+  memcpy(bad.c_str() + op_off + 2 * sizeof(__le32), &oid, sizeof(oid));
+  bufferlist::iterator q = bad.begin();
+  ASSERT_THROW(ObjectStore::Transaction d(q), buffer::malformed_input);
+}
+
+// Local Variables:
+// compile-command: "cd ../.. ; make unittest_transaction && ./unittest_transaction"
+// End:
@@ -11,6 +11,7 @@
 #include "common/ceph_argparse.h"
 #include "common/common_init.h"
 #include "common/config.h"
+#include "common/Cond.h"
 #include "common/Mutex.h"
 #include "common/snap_types.h"
 #include "global/global_init.h"
@@ -170,6 +171,87 @@ int stress_test(uint64_t num_ops, uint64_t num_objs,
   return EXIT_SUCCESS;
 }
 
+/// @returns true if the read was served from the cache
+bool read_object(ObjectCacher &obc, Mutex &lock,
+		 ObjectCacher::ObjectSet *object_set,
+		 const std::string &oid, uint64_t len)
+{
+  op_data op(oid, 0, len, true);
+  ObjectCacher::OSDRead *rd = obc.prepare_read(CEPH_NOSNAP, &op.result, 0);
+  rd->extents.push_back(op.extent);
+  C_SaferCond cond;
+  lock.Lock();
+  int r = obc.readx(rd, object_set, &cond);
+  lock.Unlock();
+  assert(r >= 0);
+  if ((uint64_t)r == len)
+    return true;
+  assert(r == 0);
+  r = cond.wait();
+  assert((uint64_t)r == len);
+  return false;
+}
+
+/*
+ * A scan through more data than the cache holds must leave alone a
+ * working set that has been read again since it was first trimmed,
+ * because a ghost hit puts it on bh_lru_rest.
+ */
+int scan_test(uint64_t obj_size, uint64_t cache_objs, uint64_t working_objs)
+{
+  Mutex lock("object_cacher_stress::object_cacher");
+  FakeWriteback writeback(g_ceph_context, &lock, 0);
+
+  ObjectCacher obc(g_ceph_context, "test", writeback, lock, NULL, NULL,
+		   cache_objs * obj_size,
+		   10 * cache_objs,
+		   0, 0, 0, true);
+  obc.start();
+  ObjectCacher::ObjectSet object_set(NULL, 0, 0);
+
+  std::cout << "Scan test: " << working_objs << " of " << cache_objs
+	    << " objects of " << obj_size << " bytes in the working set"
+	    << std::endl;
+
+  vector<std::string> working;
+  for (uint64_t i = 0; i < working_objs; ++i)
+    working.push_back("working" + stringify(i));
+
+  int ret = EXIT_SUCCESS;
+  for (int pass = 0; pass < 3; ++pass) {
+    uint64_t hits = 0;
+    for (uint64_t i = 0; i < working.size(); ++i)
+      if (read_object(obc, lock, &object_set, working[i], obj_size))
+	++hits;
+    std::cout << "pass " << pass << ": " << hits << " of " << working.size()
+	      << " working set reads hit" << std::endl;
+    if (pass == 1 && hits != 0) {
+      // read once, it was still on probation and the scan took it
+      std::cout << "working set survived a scan while on probation!"
+		<< std::endl;
+      ret = EXIT_FAILURE;
+    }
+    if (pass == 2 && hits != working.size()) {
+      // the misses of pass 1 were ghost hits, so it is protected now
+      std::cout << "scan evicted the promoted working set!" << std::endl;
+      ret = EXIT_FAILURE;
+    }
+
+    for (uint64_t i = 0; i < 2 * cache_objs; ++i)
+      read_object(obc, lock, &object_set,
+		  "scan" + stringify(pass) + "." + stringify(i), obj_size);
+  }
+
+  lock.Lock();
+  obc.release_set(&object_set);
+  lock.Unlock();
+  obc.stop();
+
+  if (ret == EXIT_SUCCESS)
+    std::cout << "Test completed successfully." << std::endl;
+  return ret;
+}
+
 int main(int argc, const char **argv)
 {
   std::vector<const char*> args;
@@ -184,6 +266,7 @@ int main(int argc, const char **argv)
   long long num_objs = 10;
   float percent_reads = 0.90;
   int seed = time(0) % 100000;
+  bool scan = false;
   std::ostringstream err;
   std::vector<const char*>::iterator i;
   for (i = args.begin(); i != args.end();) {
@@ -222,6 +305,8 @@ int main(int argc, const char **argv)
 	cerr << argv[0] << ": " << err.str() << std::endl;
 	return EXIT_FAILURE;
       }
+    } else if (ceph_argparse_flag(args, i, "--scan-test", (char*)NULL)) {
+      scan = true;
     } else {
       cerr << "unknown option " << *i << std::endl;
       return EXIT_FAILURE;
@@ -229,5 +314,7 @@ int main(int argc, const char **argv)
   }
 
   srandom(seed);
+  if (scan)
+    return scan_test(64 << 10, 16, 4);
   return stress_test(num_ops, num_objs, obj_bytes, delay_ns, max_len, percent_reads);
 }
@@ -0,0 +1,96 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "osdc/Objecter.h"
+#include "test/unit.h"
+
+class OSDWindowTest : public ::testing::Test {
+ public:
+  Objecter::OSDSession *s;
+  utime_t now;
+
+  OSDWindowTest() : now(1000, 0) {}
+
+  virtual void SetUp() {
+    s = new Objecter::OSDSession(g_ceph_context, 0);
+    s->window = 16;
+    s->avg_latency = .01;
+  }
+  virtual void TearDown() {
+    s->put();
+  }
+
+  bool reply(double latency) {
+    return s->update_window(latency, now, 2, 32, 2.0);
+  }
+};
+
+TEST_F(OSDWindowTest, Grow)
+{
+  // +1/window per reply, so about +1 per window's worth of replies
+  ASSERT_FALSE(reply(.01));
+  ASSERT_DOUBLE_EQ(16 + 1.0 / 16, s->window);
+  for (int i = 0; i < 15; ++i)
+    ASSERT_FALSE(reply(.01));
+  ASSERT_GT(s->window, 16.9);
+  ASSERT_LT(s->window, 17);
+
+  // just under the latency factor still counts as normal
+  double w = s->window;
+  ASSERT_FALSE(reply(.0199));
+  ASSERT_DOUBLE_EQ(w + 1.0 / w, s->window);
+}
+
+TEST_F(OSDWindowTest, GrowClampsAtMax)
+{
+  s->window = 31.99;
+  ASSERT_FALSE(reply(.01));
+  ASSERT_EQ(32, s->window);
+  for (int i = 0; i < 100; ++i)
+    ASSERT_FALSE(reply(.01));
+  ASSERT_EQ(32, s->window);
+}
+
+TEST_F(OSDWindowTest, HalveOncePerRoundTrip)
+{
+  ASSERT_TRUE(reply(.05));
+  ASSERT_EQ(8, s->window);
+
+  // more slow replies within one average latency don't count, nor grow it
+  now += .005;
+  ASSERT_FALSE(reply(.05));
+  ASSERT_FALSE(reply(.05));
+  ASSERT_EQ(8, s->window);
+
+  // but a fast one in between still grows it
+  ASSERT_FALSE(reply(.01));
+  ASSERT_DOUBLE_EQ(8 + 1.0 / 8, s->window);
+
+  // a round trip later the next slow reply halves it again
+  now += .01;
+  ASSERT_TRUE(reply(.05));
+  ASSERT_DOUBLE_EQ((8 + 1.0 / 8) / 2, s->window);
+}
+
+TEST_F(OSDWindowTest, HalveClampsAtMin)
+{
+  s->window = 3;
+  ASSERT_TRUE(reply(.05));
+  ASSERT_EQ(2, s->window);
+  now += 1;
+  ASSERT_TRUE(reply(.05));
+  ASSERT_EQ(2, s->window);
+}
+
+// Local Variables:
+// compile-command: "cd ../.. ; make unittest_osd_window && ./unittest_osd_window"
+// End:
@@ -0,0 +1,61 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Print a binary log file (log_binary = true) as the text log it stands
+ * for.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <iostream>
+#include <string>
+
+#include "include/buffer.h"
+#include "log/BinaryFormat.h"
+
+using namespace std;
+
+static void usage()
+{
+  cerr << "usage: ceph-log-decode <binary log file> [...]" << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  if (argc < 2) {
+    usage();
+    return 1;
+  }
+  if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
+    usage();
+    return 0;
+  }
+
+  int ret = 0;
+  for (int i = 1; i < argc; ++i) {
+    bufferlist bl;
+    string err;
+    int r = bl.read_file(argv[i], &err);
+    if (r < 0) {
+      cerr << argv[i] << ": " << err << std::endl;
+      ret = 1;
+      continue;
+    }
+    r = ceph::log::decode_binary_log(bl, cout);
+    if (r < 0) {
+      cerr << argv[i] << ": not a binary log, or truncated" << std::endl;
+      ret = 1;
+    }
+  }
+  return ret;
+}